@@ -0,0 +1,167 @@
+/**
+ * @file batched.h
+ * @author Ethan Stockbridge (ethanstockbridge@gmail.com)
+ * @author Devan Kidd (jjkidd1245@gmail.com)
+ * @brief Batched multiplication of many small matrices with sizes fixed at
+ * compile time. The matrices are dense (no padding) and packed back to back in
+ * one buffer, so there is no per-matrix allocation and the fixed loop bounds let
+ * the compiler unroll every loop.
+ * @date 2022-01-25
+ */
+#ifndef BATCHED_H
+#define BATCHED_H
+
+#include <cstddef>
+#include <immintrin.h> // For SIMD functions
+
+#include "dispatch.h"
+
+/**
+ * @brief Largest size of a batched matrix. Past this the blocked GEMM engine is
+ * faster, and the fully unrolled loops only bloat the code.
+ */
+#define BATCHED_MAX_SIZE 64
+
+/**
+ * @brief Multiply one small matrix, C = A*B, in regular C++
+ *
+ * @tparam M Rows of A and C
+ * @tparam N Columns of B and C
+ * @tparam K Columns of A, rows of B
+ * @tparam T Type of data stored in the matrices
+ * @param A Input matrix A (M x K, dense row major)
+ * @param B Input matrix B (K x N, dense row major)
+ * @param C Output matrix C (M x N, dense row major)
+ */
+template <unsigned int M, unsigned int N, unsigned int K, typename T>
+inline void small_gemm(const T* A, const T* B, T* C)
+{
+    for(unsigned int i=0; i<M; i++)
+    {
+        T acc[N] = {};
+        #pragma GCC unroll 64
+        for(unsigned int k=0; k<K; k++)
+        {
+            const T aik = A[i*K + k];
+            #pragma GCC unroll 64
+            for(unsigned int j=0; j<N; j++)
+            {
+                acc[j] += aik*B[k*N + j];
+            }
+        }
+        for(unsigned int j=0; j<N; j++)
+        {
+            C[i*N + j] = acc[j];
+        }
+    }
+}
+
+/**
+ * @brief Multiply a batch of small matrices, C[b] = A[b]*B[b], in regular C++.
+ * Matrix b of each operand starts stride*b elements into its buffer, so a
+ * stride of 0 shares one matrix (ex: one weight matrix B) across the batch.
+ *
+ * @tparam M Rows of A and C
+ * @tparam N Columns of B and C
+ * @tparam K Columns of A, rows of B
+ * @tparam T Type of data stored in the matrices
+ * @param count Number of multiplications
+ * @param A Input matrices A
+ * @param strideA Distance (in elements) between two A matrices
+ * @param B Input matrices B
+ * @param strideB Distance (in elements) between two B matrices
+ * @param C Output matrices C
+ * @param strideC Distance (in elements) between two C matrices
+ */
+template <unsigned int M, unsigned int N, unsigned int K, typename T>
+void batched_gemm(unsigned int count, const T* A, size_t strideA, const T* B, size_t strideB, T* C, size_t strideC)
+{
+    static_assert(M <= BATCHED_MAX_SIZE && N <= BATCHED_MAX_SIZE && K <= BATCHED_MAX_SIZE,
+                  "batched matrices must be at most BATCHED_MAX_SIZE on each side");
+    for(unsigned int b=0; b<count; b++)
+    {
+        small_gemm<M, N, K>(A + b*strideA, B + b*strideB, C + b*strideC);
+    }
+}
+
+/**
+ * @brief AVX2 + FMA batch of small float multiplications. Each row of C is kept
+ * in N/8 (or one N = 4) registers while the K rows of B are streamed through it.
+ * Only call this if cpu_features().avx2 and fma are set.
+ */
+template <unsigned int M, unsigned int N, unsigned int K>
+__attribute__((target("avx2,fma")))
+void batched_sgemm_avx2(unsigned int count, const float* A, size_t strideA, const float* B, size_t strideB,
+                        float* C, size_t strideC)
+{
+    static_assert(N % 8 == 0 || N == 4, "the AVX2 batch needs N to be a multiple of 8, or 4");
+    for(unsigned int b=0; b<count; b++)
+    {
+        const float* a = A + b*strideA;
+        const float* bm = B + b*strideB;
+        float* c = C + b*strideC;
+        for(unsigned int i=0; i<M; i++)
+        {
+            if constexpr (N % 8 == 0)
+            {
+                __m256 acc[N/8];
+                #pragma GCC unroll 8
+                for(unsigned int j=0; j<N/8; j++)
+                {
+                    acc[j] = _mm256_setzero_ps();
+                }
+                #pragma GCC unroll 64
+                for(unsigned int k=0; k<K; k++)
+                {
+                    const __m256 aik = _mm256_broadcast_ss(a + i*K + k);
+                    #pragma GCC unroll 8
+                    for(unsigned int j=0; j<N/8; j++)
+                    {
+                        acc[j] = _mm256_fmadd_ps(aik, _mm256_loadu_ps(bm + k*N + 8*j), acc[j]);
+                    }
+                }
+                #pragma GCC unroll 8
+                for(unsigned int j=0; j<N/8; j++)
+                {
+                    _mm256_storeu_ps(c + i*N + 8*j, acc[j]);
+                }
+            }
+            else
+            {
+                __m128 acc = _mm_setzero_ps();
+                #pragma GCC unroll 64
+                for(unsigned int k=0; k<K; k++)
+                {
+                    acc = _mm_fmadd_ps(_mm_broadcast_ss(a + i*K + k), _mm_loadu_ps(bm + k*N), acc);
+                }
+                _mm_storeu_ps(c + i*N, acc);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Multiply a batch of small float matrices, C[b] = A[b]*B[b], with the
+ * AVX2 batch if the CPU and N allow it, otherwise in regular C++. See
+ * batched_gemm() for the layout.
+ *
+ * @tparam M Rows of A and C
+ * @tparam N Columns of B and C
+ * @tparam K Columns of A, rows of B
+ */
+template <unsigned int M, unsigned int N, unsigned int K>
+void batched_sgemm(unsigned int count, const float* A, size_t strideA, const float* B, size_t strideB,
+                   float* C, size_t strideC)
+{
+    if constexpr (N % 8 == 0 || N == 4)
+    {
+        if(kernels().variant >= CpuVariant::AVX2)
+        {
+            batched_sgemm_avx2<M, N, K>(count, A, strideA, B, strideB, C, strideC);
+            return;
+        }
+    }
+    batched_gemm<M, N, K, float>(count, A, strideA, B, strideB, C, strideC);
+}
+
+#endif
@@ -0,0 +1,418 @@
+/**
+ * @file benchmark.cpp
+ * @author Ethan Stockbridge (ethanstockbridge@gmail.com)
+ * @author Devan Kidd (jjkidd1245@gmail.com)
+ * @brief Benchmark suite for the GEMM kernels: size sweeps, timing statistics,
+ * correctness checks and CSV / JSON output
+ * @date 2022-01-25
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <cmath>
+#include <cstring>
+
+#include "benchmark.h"
+#include "matrix.h"
+#include "dispatch.h"
+#include "strassen.h"
+
+std::vector<unsigned int> default_bench_sizes()
+{
+    return {64, 100, 127, 128, 255, 256, 500, 512, 1000, 1024};
+}
+
+/**
+ * @brief Fill the used part of a matrix with random integers in [lo, hi]. The
+ * ranges keep every integer kernel exact (see qgemm.h), so any mismatch is a bug.
+ */
+template <typename T>
+static void randomize(Matrix<T>& A, int lo, int hi)
+{
+    for(unsigned int i=0; i<A.getRows(); i++)
+    {
+        for(unsigned int j=0; j<A.getCols(); j++)
+        {
+            A[i][j] = T(lo + rand()%(hi - lo + 1));
+        }
+    }
+}
+
+/**
+ * @brief Fill the used part of a float matrix with random values in [-1, 1]
+ */
+static void randomize(Matrix<float>& A)
+{
+    for(unsigned int i=0; i<A.getRows(); i++)
+    {
+        for(unsigned int j=0; j<A.getCols(); j++)
+        {
+            A[i][j] = 2.0f*rand()/RAND_MAX - 1.0f;
+        }
+    }
+}
+
+/**
+ * @brief Largest difference between C and ref, relative to the largest value of ref
+ */
+template <typename T>
+static double relative_error(Matrix<T>& C, Matrix<T>& ref)
+{
+    double worst = 0, largest = 0;
+    for(unsigned int i=0; i<ref.getRows(); i++)
+    {
+        for(unsigned int j=0; j<ref.getCols(); j++)
+        {
+            worst = std::max(worst, std::abs(double(C[i][j]) - double(ref[i][j])));
+            largest = std::max(largest, std::abs(double(ref[i][j])));
+        }
+    }
+    return worst/(largest > 0 ? largest : 1.0);
+}
+
+/**
+ * @brief Run a kernel warmup + repeats times and return the timed runs, sorted,
+ * in microseconds
+ */
+static std::vector<double> time_runs(unsigned int warmup, unsigned int repeats, const std::function<void()>& run)
+{
+    for(unsigned int r=0; r<warmup; r++)
+    {
+        run();
+    }
+    std::vector<double> times;
+    for(unsigned int r=0; r<repeats; r++)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        run();
+        auto stop = std::chrono::high_resolution_clock::now();
+        times.push_back(std::chrono::duration<double, std::micro>(stop - start).count());
+    }
+    std::sort(times.begin(), times.end());
+    return times;
+}
+
+/**
+ * @brief Time one kernel and check its result. The first kernel of each type is
+ * the reference: its result is copied into ref instead of being checked.
+ *
+ * @param options Settings of the run
+ * @param type Name of the element types
+ * @param kernel Name of the kernel
+ * @param n Size of the multiplication
+ * @param bytes Compulsory traffic of one multiplication
+ * @param C Output of the kernel
+ * @param ref Reference result
+ * @param isReference If true, this kernel produces the reference result
+ * @param tolerance Largest relative error allowed
+ * @param run Runs the kernel once
+ * @return BenchResult
+ */
+template <typename TC>
+static BenchResult measure(const BenchOptions& options, const char* type, const std::string& kernel,
+                           unsigned int n, double bytes, Matrix<TC>& C, Matrix<TC>& ref,
+                           bool isReference, double tolerance, const std::function<void()>& run)
+{
+    std::vector<double> times = time_runs(options.warmup, options.repeats, run);
+    const size_t count = times.size();
+
+    BenchResult result;
+    result.type = type;
+    result.kernel = kernel;
+    result.size = n;
+    result.medianUs = (count % 2 == 1) ? times[count/2] : 0.5*(times[count/2 - 1] + times[count/2]);
+    result.p95Us = times[(size_t)std::ceil(0.95*count) - 1];
+    result.minUs = times[0];
+    result.gflops = 2.0*n*n*n/(result.medianUs*1e3);
+    result.bandwidthGBs = bytes/(result.medianUs*1e3);
+    result.intensity = 2.0*n*n*n/bytes;
+
+    if(isReference)
+    {
+        std::memcpy(ref.getData(), C.getData(), (size_t)C.getPaddedRows()*C.getStride()*sizeof(TC));
+        result.error = 0;
+    }
+    else
+    {
+        result.error = relative_error(C, ref);
+    }
+    result.pass = result.error <= tolerance;
+    return result;
+}
+
+/**
+ * @brief Benchmark every float kernel at one size
+ */
+static void bench_float(const BenchOptions& options, unsigned int n, bool transB, std::vector<BenchResult>& results)
+{
+    Matrix<float> A(n, n, false), B(n, n, false), C(n, n, false), ref(n, n, false);
+    randomize(A);
+    randomize(B);
+    const double bytes = 3.0*n*n*sizeof(float);
+    const CpuVariant all[] = {CpuVariant::Scalar, CpuVariant::SSE, CpuVariant::AVX2, CpuVariant::AVX512};
+
+    bool first = true;
+    for(CpuVariant v : all)
+    {
+        if(!variant_supported(v))
+        {
+            continue;
+        }
+        const sgemm_fn sgemm = kernels_for(v).sgemm;
+        results.push_back(measure(options, "float", std::string("sgemm_") + variant_name(v), n, bytes, C, ref,
+                                  first, BENCH_TOLERANCE, [&]()
+        {
+            sgemm(transB, n, n, n, 1.0f, A.getData(), A.getStride(), B.getData(), B.getStride(),
+                  0.0f, C.getData(), C.getStride());
+        }));
+        first = false;
+    }
+
+    if(options.strassenCutoff > 0)
+    {
+        StrassenWorkspace workspace;
+        results.push_back(measure(options, "float", "strassen_" + std::to_string(options.strassenCutoff), n, bytes,
+                                  C, ref, false, BENCH_TOLERANCE, [&]()
+        {
+            strassen_sgemm(transB, n, n, n, A.getData(), A.getStride(), B.getData(), B.getStride(),
+                           C.getData(), C.getStride(), options.strassenCutoff, workspace);
+        }));
+    }
+}
+
+/**
+ * @brief Benchmark every integer kernel at one size. Variants bound to the same
+ * kernel as a slower variant (see dispatch.cpp) are only run once.
+ */
+static void bench_integer(const BenchOptions& options, unsigned int n, bool transB, std::vector<BenchResult>& results)
+{
+    const CpuVariant all[] = {CpuVariant::Scalar, CpuVariant::SSE, CpuVariant::AVX2, CpuVariant::AVX512};
+
+    Matrix<short int> A16(n, n, false), B16(n, n, false);
+    randomize(A16, -256, 255);
+    randomize(B16, -256, 255);
+    Matrix<unsigned char> A8(n, n, false);
+    Matrix<signed char> B8(n, n, false);
+    randomize(A8, 0, 127);
+    randomize(B8, -128, 127);
+    Matrix<int> C(n, n, false), ref16(n, n, false), ref8(n, n, false);
+
+    const double bytes16 = 2.0*n*n*sizeof(int16_t) + (double)n*n*sizeof(int32_t);
+    const double bytes8 = 2.0*n*n*sizeof(int8_t) + (double)n*n*sizeof(int32_t);
+
+    std::vector<qgemm_s16_fn> seen16;
+    for(CpuVariant v : all)
+    {
+        if(!variant_supported(v))
+        {
+            continue;
+        }
+        const qgemm_s16_fn qgemm = kernels_for(v).qgemm_s16;
+        if(std::find(seen16.begin(), seen16.end(), qgemm) != seen16.end())
+        {
+            continue;
+        }
+        results.push_back(measure(options, "int16", std::string("qgemm_s16_") + variant_name(v), n, bytes16,
+                                  C, ref16, seen16.empty(), 0.0, [&]()
+        {
+            qgemm(transB, n, n, n, A16.getData(), A16.getStride(),
+                  B16.getData(), B16.getStride(), C.getData(), C.getStride());
+        }));
+        seen16.push_back(qgemm);
+    }
+
+    std::vector<qgemm_u8s8_fn> seen8;
+    for(CpuVariant v : all)
+    {
+        if(!variant_supported(v))
+        {
+            continue;
+        }
+        const qgemm_u8s8_fn qgemm = kernels_for(v).qgemm_u8s8;
+        if(std::find(seen8.begin(), seen8.end(), qgemm) != seen8.end())
+        {
+            continue;
+        }
+        results.push_back(measure(options, "uint8xint8", std::string("qgemm_u8s8_") + variant_name(v), n, bytes8,
+                                  C, ref8, seen8.empty(), 0.0, [&]()
+        {
+            qgemm(transB, n, n, n, A8.getData(), A8.getStride(),
+                  B8.getData(), B8.getStride(), C.getData(), C.getStride());
+        }));
+        seen8.push_back(qgemm);
+    }
+}
+
+static void write_table(std::ostream& out, const std::vector<BenchResult>& results)
+{
+    out<<std::left<<std::setw(12)<<"type"<<std::setw(22)<<"kernel"<<std::right<<std::setw(6)<<"size"
+       <<std::setw(14)<<"median (us)"<<std::setw(14)<<"p95 (us)"<<std::setw(10)<<"GFLOP/s"
+       <<std::setw(10)<<"GB/s"<<std::setw(10)<<"FLOP/B"<<std::setw(12)<<"error"<<"  status"<<std::endl;
+    for(const BenchResult& r : results)
+    {
+        out<<std::left<<std::setw(12)<<r.type<<std::setw(22)<<r.kernel<<std::right<<std::setw(6)<<r.size
+           <<std::fixed<<std::setprecision(1)<<std::setw(14)<<r.medianUs<<std::setw(14)<<r.p95Us
+           <<std::setprecision(2)<<std::setw(10)<<r.gflops<<std::setw(10)<<r.bandwidthGBs<<std::setw(10)<<r.intensity
+           <<std::scientific<<std::setprecision(2)<<std::setw(12)<<r.error<<std::defaultfloat
+           <<"  "<<(r.pass ? "ok" : "FAIL")<<std::endl;
+    }
+}
+
+static void write_csv(std::ostream& out, const std::vector<BenchResult>& results)
+{
+    out<<"type,kernel,size,median_us,p95_us,min_us,gflops,bandwidth_gbs,intensity,error,status"<<std::endl;
+    for(const BenchResult& r : results)
+    {
+        out<<r.type<<","<<r.kernel<<","<<r.size<<","<<r.medianUs<<","<<r.p95Us<<","<<r.minUs<<","
+           <<r.gflops<<","<<r.bandwidthGBs<<","<<r.intensity<<","<<r.error<<","<<(r.pass ? "ok" : "fail")<<std::endl;
+    }
+}
+
+static void write_json(std::ostream& out, const BenchOptions& options, const std::vector<BenchResult>& results)
+{
+    out<<"{"<<std::endl;
+    out<<"  \"warmup\": "<<options.warmup<<","<<std::endl;
+    out<<"  \"repeats\": "<<options.repeats<<","<<std::endl;
+    #ifdef CACHE_OPTIMIZATION
+    out<<"  \"cache_optimization\": true,"<<std::endl;
+    #else
+    out<<"  \"cache_optimization\": false,"<<std::endl;
+    #endif
+    out<<"  \"results\": ["<<std::endl;
+    for(size_t i=0; i<results.size(); i++)
+    {
+        const BenchResult& r = results[i];
+        out<<"    {\"type\": \""<<r.type<<"\", \"kernel\": \""<<r.kernel<<"\", \"size\": "<<r.size
+           <<", \"median_us\": "<<r.medianUs<<", \"p95_us\": "<<r.p95Us<<", \"min_us\": "<<r.minUs
+           <<", \"gflops\": "<<r.gflops<<", \"bandwidth_gbs\": "<<r.bandwidthGBs<<", \"intensity\": "<<r.intensity
+           <<", \"error\": "<<r.error<<", \"pass\": "<<(r.pass ? "true" : "false")<<"}"
+           <<(i + 1 < results.size() ? "," : "")<<std::endl;
+    }
+    out<<"  ]"<<std::endl;
+    out<<"}"<<std::endl;
+}
+
+/**
+ * @brief Compare median times against a CSV written by an earlier run
+ *
+ * @return int Number of regressions found
+ */
+static int compare_baseline(const std::string& path, const std::vector<BenchResult>& results)
+{
+    std::ifstream in(path);
+    if(!in)
+    {
+        std::cerr<<"Error: cannot open baseline "<<path<<std::endl;
+        return 1;
+    }
+    //type,kernel,size -> median_us
+    std::map<std::string, double> baseline;
+    std::string line;
+    while(std::getline(in, line))
+    {
+        std::vector<std::string> fields;
+        std::stringstream row(line);
+        std::string field;
+        while(std::getline(row, field, ','))
+        {
+            fields.push_back(field);
+        }
+        if(fields.size() < 4 || fields[0] == "type")
+        {
+            continue;
+        }
+        baseline[fields[0] + "," + fields[1] + "," + fields[2]] = std::atof(fields[3].c_str());
+    }
+
+    int regressions = 0;
+    for(const BenchResult& r : results)
+    {
+        auto it = baseline.find(r.type + "," + r.kernel + "," + std::to_string(r.size));
+        if(it == baseline.end() || it->second <= 0)
+        {
+            continue;
+        }
+        if(r.medianUs > it->second*(1.0 + BENCH_REGRESSION))
+        {
+            std::cerr<<"Regression: "<<r.type<<" "<<r.kernel<<" size "<<r.size<<": "<<r.medianUs<<"us vs "
+                     <<it->second<<"us in baseline (+"<<100.0*(r.medianUs/it->second - 1.0)<<"%)"<<std::endl;
+            regressions++;
+        }
+    }
+    return regressions;
+}
+
+int run_benchmark(const BenchOptions& options)
+{
+    if(options.repeats == 0)
+    {
+        std::cerr<<"Error: the benchmark needs at least one timed run"<<std::endl;
+        return 1;
+    }
+    if(options.format != "table" && options.format != "csv" && options.format != "json")
+    {
+        std::cerr<<"Error: unknown output format "<<options.format<<" (expected table, csv or json)"<<std::endl;
+        return 1;
+    }
+
+    #ifdef CACHE_OPTIMIZATION
+    const bool transB = true;
+    #else
+    const bool transB = false;
+    #endif
+
+    std::vector<BenchResult> results;
+    const std::vector<unsigned int> sizes = options.sizes.empty() ? default_bench_sizes() : options.sizes;
+    for(unsigned int n : sizes)
+    {
+        std::cerr<<"Benchmarking size "<<n<<"..."<<std::endl;
+        bench_float(options, n, transB, results);
+        bench_integer(options, n, transB, results);
+    }
+
+    std::ofstream file;
+    if(!options.output.empty())
+    {
+        file.open(options.output);
+        if(!file)
+        {
+            std::cerr<<"Error: cannot open "<<options.output<<" for writing"<<std::endl;
+            return 1;
+        }
+    }
+    std::ostream& out = options.output.empty() ? std::cout : file;
+    if(options.format == "csv")
+    {
+        write_csv(out, results);
+    }
+    else if(options.format == "json")
+    {
+        write_json(out, options, results);
+    }
+    else
+    {
+        write_table(out, results);
+    }
+
+    int status = 0;
+    for(const BenchResult& r : results)
+    {
+        if(!r.pass)
+        {
+            std::cerr<<"Error: "<<r.type<<" "<<r.kernel<<" size "<<r.size<<" differs from the reference by "
+                     <<r.error<<" (tolerance "<<(r.type == "float" ? BENCH_TOLERANCE : 0.0)<<")"<<std::endl;
+            status = 1;
+        }
+    }
+    if(!options.baseline.empty() && compare_baseline(options.baseline, results) > 0)
+    {
+        status = 1;
+    }
+    return status;
+}
@@ -0,0 +1,116 @@
+/**
+ * @file benchmark.h
+ * @author Ethan Stockbridge (ethanstockbridge@gmail.com)
+ * @author Devan Kidd (jjkidd1245@gmail.com)
+ * @brief Benchmark suite for the GEMM kernels: size sweeps, timing statistics,
+ * correctness checks and CSV / JSON output
+ * @date 2022-01-25
+ */
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <string>
+#include <vector>
+
+/**
+ * @brief Largest error allowed for a float kernel, relative to the largest value
+ * of the reference result. Integer kernels must match exactly.
+ */
+#ifndef BENCH_TOLERANCE
+#define BENCH_TOLERANCE 1e-4
+#endif
+
+/**
+ * @brief Slowdown of the median time against a baseline run that is reported as
+ * a regression (0.10 = 10% slower)
+ */
+#ifndef BENCH_REGRESSION
+#define BENCH_REGRESSION 0.10
+#endif
+
+/**
+ * @brief Settings of a benchmark run
+ */
+struct BenchOptions
+{
+    /**
+     * @brief Sizes of the N x N multiplications to run
+     */
+    std::vector<unsigned int> sizes;
+    /**
+     * @brief Untimed runs before the timed ones (fills caches, pack buffers and pages)
+     */
+    unsigned int warmup;
+    /**
+     * @brief Timed runs of every kernel and size
+     */
+    unsigned int repeats;
+    /**
+     * @brief Output format: "table", "csv" or "json"
+     */
+    std::string format;
+    /**
+     * @brief File to write the results to, standard output if empty
+     */
+    std::string output;
+    /**
+     * @brief CSV file from an earlier run to check for regressions, none if empty
+     */
+    std::string baseline;
+    /**
+     * @brief If not 0, also run Strassen-Winograd with this cutoff
+     */
+    unsigned int strassenCutoff;
+};
+
+/**
+ * @brief Measurements of one kernel at one size
+ */
+struct BenchResult
+{
+    std::string type;
+    std::string kernel;
+    unsigned int size;
+    /**
+     * @brief Time statistics over the timed runs, in microseconds
+     */
+    double medianUs, p95Us, minUs;
+    /**
+     * @brief 2*N^3 operations per median time
+     */
+    double gflops;
+    /**
+     * @brief Compulsory traffic (reading A and B, writing C once) per median time
+     */
+    double bandwidthGBs;
+    /**
+     * @brief Operations per byte of compulsory traffic (x axis of a roofline plot)
+     */
+    double intensity;
+    /**
+     * @brief Largest difference from the reference kernel, relative to the
+     * largest value of the reference result
+     */
+    double error;
+    bool pass;
+};
+
+/**
+ * @brief Sizes swept when none are given, including sizes that are not a
+ * multiple of ROW_WIDTH or of any micro-kernel tile
+ *
+ * @return std::vector<unsigned int>
+ */
+std::vector<unsigned int> default_bench_sizes();
+
+/**
+ * @brief Run every supported kernel variant of every type at every size, check
+ * each against the scalar variant, write the results and compare them against a
+ * baseline if one is given
+ *
+ * @param options Settings of the run
+ * @return int 0 if every kernel passed and nothing regressed, 1 otherwise
+ */
+int run_benchmark(const BenchOptions& options);
+
+#endif
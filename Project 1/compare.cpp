@@ -0,0 +1,89 @@
+/**
+ * @file compare.cpp
+ * @author Ethan Stockbridge (ethanstockbridge@gmail.com)
+ * @author Devan Kidd (jjkidd1245@gmail.com)
+ * @brief AVX2 comparison of float rows, 8 elements at a time
+ * @date 2022-01-25
+ */
+
+#include <immintrin.h> // For SIMD functions
+
+#include "compare.h"
+#include "dispatch.h"
+
+/**
+ * @brief Compare a float row 8 elements at a time: ULP distances on the bit
+ * patterns as 32 bit integers, absolute differences in double precision
+ */
+__attribute__((target("avx2,popcnt")))
+static CompareRow compare_row_avx2(const float* a, const float* b, unsigned int n, double tolerance, uint32_t maxUlp)
+{
+    const __m256d absMask = _mm256_castsi256_pd(_mm256_set1_epi64x(0x7fffffffffffffffll));
+    const __m256d tol = _mm256_set1_pd(tolerance);
+    const __m256i ulpTol = _mm256_set1_epi32((int)maxUlp);
+    const __m256i magnitude = _mm256_set1_epi32(0x7fffffff);
+    const __m256i ones = _mm256_set1_epi32(-1);
+    //one pair of maxima per half, so the two halves do not wait on each other
+    __m256d maxAbs[2] = {_mm256_setzero_pd(), _mm256_setzero_pd()};
+    __m256d maxMag[2] = {_mm256_setzero_pd(), _mm256_setzero_pd()};
+    __m256i maxU = _mm256_setzero_si256();
+    size_t mismatches = 0;
+    unsigned int j = 0;
+    for(; j + 8 <= n; j += 8)
+    {
+        const __m256 va = _mm256_loadu_ps(a + j);
+        const __m256 vb = _mm256_loadu_ps(b + j);
+
+        //sign and magnitude to ordered integers, see ulp_distance()
+        __m256i ia = _mm256_castps_si256(va), ib = _mm256_castps_si256(vb);
+        ia = _mm256_xor_si256(ia, _mm256_and_si256(_mm256_srai_epi32(ia, 31), magnitude));
+        ib = _mm256_xor_si256(ib, _mm256_and_si256(_mm256_srai_epi32(ib, 31), magnitude));
+        //max - min always fits in 32 unsigned bits, NaNs are as far as it goes
+        const __m256i ordered = _mm256_castps_si256(_mm256_cmp_ps(va, vb, _CMP_ORD_Q));
+        const __m256i ulp = _mm256_or_si256(_mm256_sub_epi32(_mm256_max_epi32(ia, ib), _mm256_min_epi32(ia, ib)),
+                                            _mm256_andnot_si256(ordered, ones));
+        maxU = _mm256_max_epu32(maxU, ulp);
+        const __m256i ulpOk = _mm256_and_si256(ordered, _mm256_cmpeq_epi32(_mm256_max_epu32(ulp, ulpTol), ulpTol));
+        unsigned int ok = (unsigned int)_mm256_movemask_ps(_mm256_castsi256_ps(ulpOk));
+
+        //4 elements per double register. max_pd returns its second operand when
+        //the first is NaN, so NaN differences are left out like in compare_row()
+        for(int h=0; h<2; h++)
+        {
+            const __m256d da = _mm256_cvtps_pd(h ? _mm256_extractf128_ps(va, 1) : _mm256_castps256_ps128(va));
+            const __m256d db = _mm256_cvtps_pd(h ? _mm256_extractf128_ps(vb, 1) : _mm256_castps256_ps128(vb));
+            const __m256d diff = _mm256_and_pd(_mm256_sub_pd(da, db), absMask);
+            maxAbs[h] = _mm256_max_pd(diff, maxAbs[h]);
+            maxMag[h] = _mm256_max_pd(_mm256_and_pd(da, absMask), maxMag[h]);
+            ok |= (unsigned int)_mm256_movemask_pd(_mm256_cmp_pd(diff, tol, _CMP_LE_OQ)) << (4*h);
+        }
+        mismatches += 8 - _mm_popcnt_u32(ok);
+    }
+
+    alignas(32) double absLanes[4], magLanes[4];
+    alignas(32) uint32_t ulpLanes[8];
+    _mm256_store_pd(absLanes, _mm256_max_pd(maxAbs[0], maxAbs[1]));
+    _mm256_store_pd(magLanes, _mm256_max_pd(maxMag[0], maxMag[1]));
+    _mm256_store_si256(reinterpret_cast<__m256i*>(ulpLanes), maxU);
+    CompareRow r = compare_row<float>(a + j, b + j, n - j, tolerance, maxUlp);
+    for(int l=0; l<4; l++)
+    {
+        r.maxAbsError = std::max(r.maxAbsError, absLanes[l]);
+        r.maxMagnitude = std::max(r.maxMagnitude, magLanes[l]);
+    }
+    for(int l=0; l<8; l++)
+    {
+        r.maxUlp = std::max<uint64_t>(r.maxUlp, ulpLanes[l]);
+    }
+    r.mismatches += mismatches;
+    return r;
+}
+
+CompareRow compare_row(const float* a, const float* b, unsigned int n, double tolerance, uint32_t maxUlp)
+{
+    if(cpu_features().avx2)
+    {
+        return compare_row_avx2(a, b, n, tolerance, maxUlp);
+    }
+    return compare_row<float>(a, b, n, tolerance, maxUlp);
+}
@@ -0,0 +1,217 @@
+/**
+ * @file compare.h
+ * @author Ethan Stockbridge (ethanstockbridge@gmail.com)
+ * @author Devan Kidd (jjkidd1245@gmail.com)
+ * @brief Element by element comparison of two matrices with an absolute and a
+ * ULP tolerance, vectorized and split over threads for large matrices
+ * @date 2022-01-25
+ */
+#ifndef COMPARE_H
+#define COMPARE_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#include "matrix.h"
+
+/**
+ * @brief Rows of the matrices compared by one task
+ */
+#ifndef COMPARE_TASK_ROWS
+#define COMPARE_TASK_ROWS 64
+#endif
+
+/**
+ * @brief Result of comparing a matrix B against a reference A
+ */
+struct CompareStats
+{
+    double maxAbsError;     // largest |a - b|, not counting NaNs
+    double maxMagnitude;    // largest |a|
+    double relativeError;   // maxAbsError / maxMagnitude (0 if A is all zeros)
+    uint64_t maxUlp;        // largest distance in units in the last place
+    size_t mismatches;      // elements outside both tolerances (or NaN)
+    unsigned int worstRow;  // position of the largest |a - b|
+    unsigned int worstCol;
+};
+
+/**
+ * @brief Distance between two floats in units in the last place: the number of
+ * floats between them, counting +0 and -0 as neighbours. 2^32 - 1 if either is NaN.
+ *
+ * @param a First value
+ * @param b Second value
+ * @return uint32_t
+ */
+inline uint32_t ulp_distance(float a, float b)
+{
+    if(std::isnan(a) || std::isnan(b))
+    {
+        return UINT32_MAX;
+    }
+    int32_t ia, ib;
+    std::memcpy(&ia, &a, sizeof(ia));
+    std::memcpy(&ib, &b, sizeof(ib));
+    //sign and magnitude to an ordered integer: negative floats count down from -1
+    ia ^= (ia >> 31) & 0x7fffffff;
+    ib ^= (ib >> 31) & 0x7fffffff;
+    return (ia > ib) ? (uint32_t)ia - (uint32_t)ib : (uint32_t)ib - (uint32_t)ia;
+}
+
+/**
+ * @brief Statistics of one row, combined into CompareStats by compare()
+ */
+struct CompareRow
+{
+    double maxAbsError;
+    double maxMagnitude;
+    uint64_t maxUlp;
+    size_t mismatches;
+};
+
+/**
+ * @brief Compare n elements of a row. An element matches if |a - b| <= tolerance
+ * or its distance in ULPs (as floats, or the difference itself for integer
+ * types) is at most maxUlp. Differences are taken in double precision. Generic
+ * version for any element type, see the float overload for the AVX2 version.
+ *
+ * @param a Row of the reference
+ * @param b Row to check
+ * @param n Number of elements
+ * @param tolerance Absolute tolerance
+ * @param maxUlp ULP tolerance
+ * @return CompareRow
+ */
+template <typename T>
+CompareRow compare_row(const T* a, const T* b, unsigned int n, double tolerance, uint32_t maxUlp)
+{
+    CompareRow r = {0, 0, 0, 0};
+    for(unsigned int j=0; j<n; j++)
+    {
+        const double da = double(a[j]), db = double(b[j]);
+        const double diff = std::abs(da - db);
+        uint64_t ulp;
+        if constexpr (std::is_integral<T>::value)
+        {
+            ulp = (uint64_t)diff;
+        }
+        else
+        {
+            ulp = ulp_distance(float(a[j]), float(b[j]));
+        }
+        const bool ordered = !std::isnan(da) && !std::isnan(db);
+        if(!(diff <= tolerance) && !(ordered && ulp <= maxUlp))
+        {
+            r.mismatches++;
+        }
+        if(diff > r.maxAbsError)
+        {
+            r.maxAbsError = diff;
+        }
+        r.maxMagnitude = std::max(r.maxMagnitude, std::abs(da));
+        r.maxUlp = std::max(r.maxUlp, ulp);
+    }
+    return r;
+}
+
+CompareRow compare_row(const float* a, const float* b, unsigned int n, double tolerance, uint32_t maxUlp);
+
+/**
+ * @brief Compare two rows x cols blocks, COMPARE_TASK_ROWS rows per task. Large
+ * blocks (at least FILL_PARALLEL_MIN bytes) are compared on the shared pool of
+ * all CPUs, see parallel_fill().
+ *
+ * @param a Reference
+ * @param lda Leading dimension of a
+ * @param b Block to check
+ * @param ldb Leading dimension of b
+ * @param rows Rows of the blocks
+ * @param cols Columns of the blocks
+ * @param tolerance Absolute tolerance
+ * @param maxUlp ULP tolerance
+ * @return CompareStats
+ */
+template <typename T>
+CompareStats compare(const T* a, unsigned int lda, const T* b, unsigned int ldb,
+                     unsigned int rows, unsigned int cols, double tolerance, uint32_t maxUlp)
+{
+    const unsigned int tasks = (rows + COMPARE_TASK_ROWS - 1) / COMPARE_TASK_ROWS;
+    //each task keeps its own totals and its worst row, merged in order below
+    std::vector<CompareStats> partial(tasks);
+    parallel_fill(tasks, 2*(size_t)rows*cols*sizeof(T), [&](unsigned int task)
+    {
+        CompareStats s = {0, 0, 0, 0, 0, 0, 0};
+        const unsigned int end = std::min(rows, (task + 1)*COMPARE_TASK_ROWS);
+        for(unsigned int i=task*COMPARE_TASK_ROWS; i<end; i++)
+        {
+            const CompareRow r = compare_row(a + (size_t)i*lda, b + (size_t)i*ldb, cols, tolerance, maxUlp);
+            if(r.maxAbsError > s.maxAbsError || i == task*COMPARE_TASK_ROWS)
+            {
+                s.maxAbsError = r.maxAbsError;
+                s.worstRow = i;
+            }
+            s.maxMagnitude = std::max(s.maxMagnitude, r.maxMagnitude);
+            s.maxUlp = std::max(s.maxUlp, r.maxUlp);
+            s.mismatches += r.mismatches;
+        }
+        partial[task] = s;
+    });
+
+    CompareStats stats = {0, 0, 0, 0, 0, 0, 0};
+    for(const CompareStats& s : partial)
+    {
+        if(s.maxAbsError > stats.maxAbsError)
+        {
+            stats.maxAbsError = s.maxAbsError;
+            stats.worstRow = s.worstRow;
+        }
+        stats.maxMagnitude = std::max(stats.maxMagnitude, s.maxMagnitude);
+        stats.maxUlp = std::max(stats.maxUlp, s.maxUlp);
+        stats.mismatches += s.mismatches;
+    }
+    //find the column in the worst row
+    const T* ra = a + (size_t)stats.worstRow*lda;
+    const T* rb = b + (size_t)stats.worstRow*ldb;
+    double worst = 0;
+    for(unsigned int j=0; j<cols && rows > 0; j++)
+    {
+        const double diff = std::abs(double(ra[j]) - double(rb[j]));
+        if(diff > worst)
+        {
+            worst = diff;
+            stats.worstCol = j;
+        }
+    }
+    stats.relativeError = (stats.maxMagnitude > 0) ? stats.maxAbsError/stats.maxMagnitude : 0.0;
+    return stats;
+}
+
+/**
+ * @brief Compare matrix B against the reference A. With the default tolerances
+ * only identical values match.
+ *
+ * @tparam T type of the matrices
+ * @param A Reference
+ * @param B Matrix to check, the same size as A
+ * @param tolerance Absolute tolerance
+ * @param maxUlp ULP tolerance
+ * @return CompareStats All mismatches if the sizes differ
+ */
+template <typename T>
+CompareStats compare(const Matrix<T>& A, const Matrix<T>& B, double tolerance = 0, uint32_t maxUlp = 0)
+{
+    if(A.getRows() != B.getRows() || A.getCols() != B.getCols())
+    {
+        std::cerr<<"Error: Cannot compare a "<<A.getRows()<<"x"<<A.getCols()<<" matrix with a "
+                 <<B.getRows()<<"x"<<B.getCols()<<" matrix"<<std::endl;
+        CompareStats stats = {0, 0, 0, 0, 0, 0, 0};
+        stats.mismatches = (size_t)A.getRows()*A.getCols();
+        return stats;
+    }
+    return compare(A.getData(), A.getStride(), B.getData(), B.getStride(),
+                   A.getRows(), A.getCols(), tolerance, maxUlp);
+}
+
+#endif
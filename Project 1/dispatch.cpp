@@ -0,0 +1,195 @@
+/**
+ * @file dispatch.cpp
+ * @author Ethan Stockbridge (ethanstockbridge@gmail.com)
+ * @author Devan Kidd (jjkidd1245@gmail.com)
+ * @brief Runtime CPU feature detection and selection of the GEMM kernel variants
+ * @date 2022-01-25
+ */
+
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <cpuid.h>
+
+#include "dispatch.h"
+
+/**
+ * @brief Read an extended control register (the OS enabled register state)
+ */
+static uint64_t read_xcr0()
+{
+    uint32_t eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return ((uint64_t)edx << 32) | eax;
+}
+
+static CpuFeatures detect()
+{
+    CpuFeatures f;
+    std::memset(&f, 0, sizeof(f));
+
+    unsigned int eax, ebx, ecx, edx;
+    if(!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+    {
+        return f;
+    }
+    f.sse2 = (edx & bit_SSE2) != 0;
+    f.sse41 = (ecx & bit_SSE4_1) != 0;
+
+    // AVX registers are only usable if the OS saves them on a context switch
+    const bool osxsave = (ecx & bit_OSXSAVE) != 0;
+    const uint64_t xcr0 = osxsave ? read_xcr0() : 0;
+    const bool ymmState = (xcr0 & 0x6) == 0x6;        // XMM | YMM
+    const bool zmmState = (xcr0 & 0xE6) == 0xE6;      // XMM | YMM | opmask | ZMM
+
+    f.avx = ymmState && (ecx & bit_AVX) != 0;
+    f.fma = f.avx && (ecx & bit_FMA) != 0;
+    f.f16c = f.avx && (ecx & bit_F16C) != 0;
+
+    if(__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+    {
+        f.avx2 = f.avx && (ebx & bit_AVX2) != 0;
+        f.avx512f = zmmState && (ebx & bit_AVX512F) != 0;
+        f.avx512bw = f.avx512f && (ebx & bit_AVX512BW) != 0;
+    }
+    return f;
+}
+
+const CpuFeatures& cpu_features()
+{
+    static const CpuFeatures features = detect();
+    return features;
+}
+
+bool variant_supported(CpuVariant variant)
+{
+    const CpuFeatures& f = cpu_features();
+    switch(variant)
+    {
+    case CpuVariant::Scalar:
+        return true;
+    case CpuVariant::SSE:
+        return f.sse2;
+    case CpuVariant::AVX2:
+        return f.avx2 && f.fma && f.f16c;
+    case CpuVariant::AVX512:
+        return f.avx512f && f.avx512bw && f.avx2 && f.fma && f.f16c;
+    }
+    return false;
+}
+
+const char* variant_name(CpuVariant variant)
+{
+    switch(variant)
+    {
+    case CpuVariant::Scalar:
+        return "scalar";
+    case CpuVariant::SSE:
+        return "sse";
+    case CpuVariant::AVX2:
+        return "avx2";
+    case CpuVariant::AVX512:
+        return "avx512";
+    }
+    return "unknown";
+}
+
+KernelTable kernels_for(CpuVariant variant)
+{
+    KernelTable table;
+    table.variant = variant;
+    switch(variant)
+    {
+    case CpuVariant::Scalar:
+        table.sgemm = sgemm_scalar;
+        table.hgemm = hgemm_scalar;
+        table.bgemm = bgemm_scalar;
+        table.sgemv = sgemv_scalar;
+        table.hgemv = hgemv_scalar;
+        table.bgemv = bgemv_scalar;
+        table.qgemm_s16 = qgemm_s16_scalar;
+        table.qgemm_u8s8 = qgemm_u8s8_scalar;
+        table.requantize_s32_s16 = requantize_s32_s16_scalar;
+        break;
+    case CpuVariant::SSE:
+        table.sgemm = sgemm_sse;
+        table.hgemm = hgemm_sse;
+        table.bgemm = bgemm_sse;
+        table.sgemv = sgemv_scalar;
+        table.hgemv = hgemv_scalar;
+        table.bgemv = bgemv_scalar;
+        table.qgemm_s16 = qgemm_s16_sse;
+        table.qgemm_u8s8 = qgemm_u8s8_scalar;
+        table.requantize_s32_s16 = requantize_s32_s16_scalar;
+        break;
+    case CpuVariant::AVX2:
+        table.sgemm = sgemm_avx2;
+        table.hgemm = hgemm_avx2;
+        table.bgemm = bgemm_avx2;
+        table.sgemv = sgemv_avx2;
+        table.hgemv = hgemv_avx2;
+        table.bgemv = bgemv_avx2;
+        table.qgemm_s16 = qgemm_s16_avx2;
+        table.qgemm_u8s8 = qgemm_u8s8_avx2;
+        table.requantize_s32_s16 = requantize_s32_s16_avx2;
+        break;
+    case CpuVariant::AVX512:
+        table.sgemm = sgemm_avx512;
+        table.hgemm = hgemm_avx512;
+        table.bgemm = bgemm_avx512;
+        table.sgemv = sgemv_avx2;
+        table.hgemv = hgemv_avx2;
+        table.bgemv = bgemv_avx2;
+        table.qgemm_s16 = qgemm_s16_avx512;
+        table.qgemm_u8s8 = qgemm_u8s8_avx512;
+        table.requantize_s32_s16 = requantize_s32_s16_avx2;
+        break;
+    }
+    return table;
+}
+
+/**
+ * @brief Pick the variant to use: MATRIX_KERNEL if set and supported, otherwise
+ * the fastest variant the CPU supports
+ */
+static CpuVariant select_variant()
+{
+    const CpuVariant all[] = {CpuVariant::AVX512, CpuVariant::AVX2, CpuVariant::SSE, CpuVariant::Scalar};
+
+    const char* forced = std::getenv("MATRIX_KERNEL");
+    if(forced != nullptr && forced[0] != '\0')
+    {
+        for(CpuVariant v : all)
+        {
+            if(std::strcmp(forced, variant_name(v)) == 0)
+            {
+                if(variant_supported(v))
+                {
+                    return v;
+                }
+                std::cerr<<"Warning: MATRIX_KERNEL="<<forced<<" is not supported by this CPU, ignoring it"<<std::endl;
+                forced = nullptr;
+                break;
+            }
+        }
+        if(forced != nullptr)
+        {
+            std::cerr<<"Warning: unknown MATRIX_KERNEL="<<forced<<" (expected scalar, sse, avx2 or avx512), ignoring it"<<std::endl;
+        }
+    }
+
+    for(CpuVariant v : all)
+    {
+        if(variant_supported(v))
+        {
+            return v;
+        }
+    }
+    return CpuVariant::Scalar;
+}
+
+const KernelTable& kernels()
+{
+    static const KernelTable table = kernels_for(select_variant());
+    return table;
+}
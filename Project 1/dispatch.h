@@ -0,0 +1,199 @@
+/**
+ * @file dispatch.h
+ * @author Ethan Stockbridge (ethanstockbridge@gmail.com)
+ * @author Devan Kidd (jjkidd1245@gmail.com)
+ * @brief Runtime CPU feature detection and selection of the GEMM kernel variants
+ * @date 2022-01-25
+ */
+#ifndef DISPATCH_H
+#define DISPATCH_H
+
+#include <cstdint>
+
+struct half;
+struct bfloat16;
+
+/**
+ * @brief Instruction set a kernel variant is compiled for, from slowest to fastest
+ */
+enum class CpuVariant
+{
+    Scalar,
+    SSE,
+    AVX2,
+    AVX512
+};
+
+/**
+ * @brief Instruction set extensions supported by both the CPU and the OS
+ */
+struct CpuFeatures
+{
+    bool sse2;
+    bool sse41;
+    bool avx;
+    bool avx2;
+    bool fma;
+    bool f16c;
+    bool avx512f;
+    bool avx512bw;
+};
+
+// Signatures of the dispatched kernels, see gemm.h, gemv.h and qgemm.h for the parameters
+typedef void (*sgemm_fn)(bool transB, unsigned int M, unsigned int N, unsigned int K,
+                         float alpha, const float* A, unsigned int lda,
+                         const float* B, unsigned int ldb,
+                         float beta, float* C, unsigned int ldc);
+typedef void (*hgemm_fn)(bool transB, unsigned int M, unsigned int N, unsigned int K,
+                         float alpha, const half* A, unsigned int lda,
+                         const half* B, unsigned int ldb,
+                         float beta, float* C, unsigned int ldc);
+typedef void (*bgemm_fn)(bool transB, unsigned int M, unsigned int N, unsigned int K,
+                         float alpha, const bfloat16* A, unsigned int lda,
+                         const bfloat16* B, unsigned int ldb,
+                         float beta, float* C, unsigned int ldc);
+typedef void (*qgemm_s16_fn)(bool transB, unsigned int M, unsigned int N, unsigned int K,
+                             const int16_t* A, unsigned int lda,
+                             const int16_t* B, unsigned int ldb,
+                             int32_t* C, unsigned int ldc);
+typedef void (*qgemm_u8s8_fn)(bool transB, unsigned int M, unsigned int N, unsigned int K,
+                              const uint8_t* A, unsigned int lda,
+                              const int8_t* B, unsigned int ldb,
+                              int32_t* C, unsigned int ldc);
+typedef void (*sgemv_fn)(bool transA, unsigned int M, unsigned int N,
+                         float alpha, const float* A, unsigned int lda,
+                         const float* x, float beta, float* y);
+typedef void (*hgemv_fn)(bool transA, unsigned int M, unsigned int N,
+                         float alpha, const half* A, unsigned int lda,
+                         const float* x, float beta, float* y);
+typedef void (*bgemv_fn)(bool transA, unsigned int M, unsigned int N,
+                         float alpha, const bfloat16* A, unsigned int lda,
+                         const float* x, float beta, float* y);
+typedef void (*requantize_fn)(unsigned int M, unsigned int N,
+                              const int32_t* src, unsigned int lds,
+                              int16_t* dst, unsigned int ldd, float scale);
+
+/**
+ * @brief Kernels bound for the variant in use. A variant that has no kernel of
+ * its own for an operation is bound to the next slower one that does.
+ */
+struct KernelTable
+{
+    CpuVariant variant;
+    sgemm_fn sgemm;
+    hgemm_fn hgemm;
+    bgemm_fn bgemm;
+    sgemv_fn sgemv;
+    hgemv_fn hgemv;
+    bgemv_fn bgemv;
+    qgemm_s16_fn qgemm_s16;
+    qgemm_u8s8_fn qgemm_u8s8;
+    requantize_fn requantize_s32_s16;
+};
+
+/**
+ * @brief Detect the CPU's features with cpuid, and xgetbv for the OS saving the
+ * AVX / AVX-512 register state. Detected once, on first call.
+ *
+ * @return const CpuFeatures&
+ */
+const CpuFeatures& cpu_features();
+
+/**
+ * @brief Check whether a variant can run on this CPU
+ *
+ * @param variant Variant to check
+ * @return true The CPU supports every extension the variant uses
+ */
+bool variant_supported(CpuVariant variant);
+
+/**
+ * @brief Get the name of a variant ("scalar", "sse", "avx2", "avx512")
+ *
+ * @param variant Variant to name
+ * @return const char*
+ */
+const char* variant_name(CpuVariant variant);
+
+/**
+ * @brief Get the kernels for the best variant this CPU supports. The
+ * MATRIX_KERNEL environment variable (scalar / sse / avx2 / avx512) forces a
+ * variant for A/B testing, if the CPU supports it. Bound once, on first call.
+ *
+ * @return const KernelTable&
+ */
+const KernelTable& kernels();
+
+/**
+ * @brief Build the kernel table of a specific variant, ignoring MATRIX_KERNEL.
+ * The caller must check variant_supported() first.
+ *
+ * @param variant Variant to bind
+ * @return KernelTable
+ */
+KernelTable kernels_for(CpuVariant variant);
+
+// Kernel variants, implemented in gemm.cpp, gemv.cpp and qgemm.cpp
+void sgemm_scalar(bool, unsigned int, unsigned int, unsigned int, float, const float*, unsigned int,
+                  const float*, unsigned int, float, float*, unsigned int);
+void sgemm_sse(bool, unsigned int, unsigned int, unsigned int, float, const float*, unsigned int,
+               const float*, unsigned int, float, float*, unsigned int);
+void sgemm_avx2(bool, unsigned int, unsigned int, unsigned int, float, const float*, unsigned int,
+                const float*, unsigned int, float, float*, unsigned int);
+void sgemm_avx512(bool, unsigned int, unsigned int, unsigned int, float, const float*, unsigned int,
+                  const float*, unsigned int, float, float*, unsigned int);
+
+void hgemm_scalar(bool, unsigned int, unsigned int, unsigned int, float, const half*, unsigned int,
+                  const half*, unsigned int, float, float*, unsigned int);
+void hgemm_sse(bool, unsigned int, unsigned int, unsigned int, float, const half*, unsigned int,
+               const half*, unsigned int, float, float*, unsigned int);
+void hgemm_avx2(bool, unsigned int, unsigned int, unsigned int, float, const half*, unsigned int,
+                const half*, unsigned int, float, float*, unsigned int);
+void hgemm_avx512(bool, unsigned int, unsigned int, unsigned int, float, const half*, unsigned int,
+                  const half*, unsigned int, float, float*, unsigned int);
+
+void bgemm_scalar(bool, unsigned int, unsigned int, unsigned int, float, const bfloat16*, unsigned int,
+                  const bfloat16*, unsigned int, float, float*, unsigned int);
+void bgemm_sse(bool, unsigned int, unsigned int, unsigned int, float, const bfloat16*, unsigned int,
+               const bfloat16*, unsigned int, float, float*, unsigned int);
+void bgemm_avx2(bool, unsigned int, unsigned int, unsigned int, float, const bfloat16*, unsigned int,
+                const bfloat16*, unsigned int, float, float*, unsigned int);
+void bgemm_avx512(bool, unsigned int, unsigned int, unsigned int, float, const bfloat16*, unsigned int,
+                  const bfloat16*, unsigned int, float, float*, unsigned int);
+
+void sgemv_scalar(bool, unsigned int, unsigned int, float, const float*, unsigned int,
+                  const float*, float, float*);
+void sgemv_avx2(bool, unsigned int, unsigned int, float, const float*, unsigned int,
+                const float*, float, float*);
+
+void hgemv_scalar(bool, unsigned int, unsigned int, float, const half*, unsigned int,
+                  const float*, float, float*);
+void hgemv_avx2(bool, unsigned int, unsigned int, float, const half*, unsigned int,
+                const float*, float, float*);
+void bgemv_scalar(bool, unsigned int, unsigned int, float, const bfloat16*, unsigned int,
+                  const float*, float, float*);
+void bgemv_avx2(bool, unsigned int, unsigned int, float, const bfloat16*, unsigned int,
+                const float*, float, float*);
+
+void qgemm_s16_scalar(bool, unsigned int, unsigned int, unsigned int, const int16_t*, unsigned int,
+                      const int16_t*, unsigned int, int32_t*, unsigned int);
+void qgemm_s16_sse(bool, unsigned int, unsigned int, unsigned int, const int16_t*, unsigned int,
+                   const int16_t*, unsigned int, int32_t*, unsigned int);
+void qgemm_s16_avx2(bool, unsigned int, unsigned int, unsigned int, const int16_t*, unsigned int,
+                    const int16_t*, unsigned int, int32_t*, unsigned int);
+void qgemm_s16_avx512(bool, unsigned int, unsigned int, unsigned int, const int16_t*, unsigned int,
+                      const int16_t*, unsigned int, int32_t*, unsigned int);
+
+void qgemm_u8s8_scalar(bool, unsigned int, unsigned int, unsigned int, const uint8_t*, unsigned int,
+                       const int8_t*, unsigned int, int32_t*, unsigned int);
+void qgemm_u8s8_avx2(bool, unsigned int, unsigned int, unsigned int, const uint8_t*, unsigned int,
+                     const int8_t*, unsigned int, int32_t*, unsigned int);
+void qgemm_u8s8_avx512(bool, unsigned int, unsigned int, unsigned int, const uint8_t*, unsigned int,
+                       const int8_t*, unsigned int, int32_t*, unsigned int);
+
+void requantize_s32_s16_scalar(unsigned int, unsigned int, const int32_t*, unsigned int,
+                               int16_t*, unsigned int, float);
+void requantize_s32_s16_avx2(unsigned int, unsigned int, const int32_t*, unsigned int,
+                             int16_t*, unsigned int, float);
+
+#endif
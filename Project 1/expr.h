@@ -0,0 +1,423 @@
+/**
+ * @file expr.h
+ * @author Ethan Stockbridge (ethanstockbridge@gmail.com)
+ * @author Devan Kidd (jjkidd1245@gmail.com)
+ * @brief Lazy matrix expressions. Operators on matrices build a small tree of
+ * expression nodes instead of computing anything, and assigning the tree to a
+ * Matrix evaluates it in a single pass with no intermediate matrices:
+ *
+ *     C = relu(A + B);            // one SIMD pass over A, B and C
+ *     C = alpha*A*B + beta*D;     // one sgemm() call (C = D, then beta*C += alpha*A*B)
+ *
+ * Elementwise nodes support +, -, unary -, scaling by a scalar, hadamard() and
+ * relu(). The product A*B can only be scaled and added to a (scaled) matrix,
+ * which is exactly what sgemm() computes.
+ * @date 2022-01-25
+ */
+#ifndef EXPR_H
+#define EXPR_H
+
+#include <immintrin.h> // For SIMD functions
+#include <algorithm>
+#include <type_traits>
+#include <cstring>
+
+#include "matrix.h"
+#include "dispatch.h"
+#include "gemm.h"
+
+// Operations of the elementwise nodes. Each has a scalar version for any type
+// and an AVX version for 8 floats.
+
+struct AddOp
+{
+    template <typename T> static T apply(T a, T b) { return a + b; }
+    __attribute__((target("avx2,fma")))
+    static __m256 apply(__m256 a, __m256 b) { return _mm256_add_ps(a, b); }
+};
+
+struct SubOp
+{
+    template <typename T> static T apply(T a, T b) { return a - b; }
+    __attribute__((target("avx2,fma")))
+    static __m256 apply(__m256 a, __m256 b) { return _mm256_sub_ps(a, b); }
+};
+
+struct MulOp
+{
+    template <typename T> static T apply(T a, T b) { return a*b; }
+    __attribute__((target("avx2,fma")))
+    static __m256 apply(__m256 a, __m256 b) { return _mm256_mul_ps(a, b); }
+};
+
+struct NegOp
+{
+    template <typename T> static T apply(T a) { return -a; }
+    __attribute__((target("avx2,fma")))
+    static __m256 apply(__m256 a) { return _mm256_sub_ps(_mm256_setzero_ps(), a); }
+};
+
+struct ReluOp
+{
+    template <typename T> static T apply(T a) { return a > 0 ? a : T(0); }
+    __attribute__((target("avx2,fma")))
+    static __m256 apply(__m256 a) { return _mm256_max_ps(a, _mm256_setzero_ps()); }
+};
+
+/**
+ * @brief Leaf of an expression: a reference to a matrix
+ *
+ * @tparam T Type of data stored in the matrix
+ */
+template <typename T>
+struct MatrixLeaf : public MatExpr<MatrixLeaf<T>>
+{
+    typedef T value_type;
+    const Matrix<T>& m;
+
+    explicit MatrixLeaf(const Matrix<T>& m) : m(m) {}
+    unsigned int rows() const { return this->m.getRows(); }
+    unsigned int cols() const { return this->m.getCols(); }
+    T eval(unsigned int i, unsigned int j) const { return this->m[i][j]; }
+    /**
+     * @brief Load elements j..j+7 of row i. Rows are MATRIX_ALIGNMENT aligned and
+     * j is a multiple of 8, so the load is aligned.
+     */
+    __attribute__((target("avx2,fma")))
+    __m256 packet(unsigned int i, unsigned int j) const { return _mm256_load_ps(this->m[i] + j); }
+};
+
+/**
+ * @brief How an operand is stored inside a node: matrices by reference (as a
+ * MatrixLeaf), other nodes by value, since they are temporaries
+ */
+template <typename E>
+struct ExprNode
+{
+    typedef E type;
+    static const E& make(const E& e) { return e; }
+};
+
+template <typename T>
+struct ExprNode<Matrix<T>>
+{
+    typedef MatrixLeaf<T> type;
+    static MatrixLeaf<T> make(const Matrix<T>& m) { return MatrixLeaf<T>(m); }
+};
+
+/**
+ * @brief Elementwise operation of two expressions of the same size
+ */
+template <typename Op, typename L, typename R>
+struct BinaryExpr : public MatExpr<BinaryExpr<Op, L, R>>
+{
+    typedef typename L::value_type value_type;
+    L lhs;
+    R rhs;
+
+    BinaryExpr(const L& lhs, const R& rhs) : lhs(lhs), rhs(rhs)
+    {
+        if(lhs.rows() != rhs.rows() || lhs.cols() != rhs.cols())
+        {
+            std::cerr<<"Error: elementwise operation on a "<<lhs.rows()<<"x"<<lhs.cols()
+                     <<" and a "<<rhs.rows()<<"x"<<rhs.cols()<<" matrix"<<std::endl;
+        }
+    }
+    // on a size mismatch only the overlapping block is evaluated
+    unsigned int rows() const { return std::min(this->lhs.rows(), this->rhs.rows()); }
+    unsigned int cols() const { return std::min(this->lhs.cols(), this->rhs.cols()); }
+    value_type eval(unsigned int i, unsigned int j) const
+    {
+        return Op::apply(this->lhs.eval(i, j), this->rhs.eval(i, j));
+    }
+    __attribute__((target("avx2,fma")))
+    __m256 packet(unsigned int i, unsigned int j) const
+    {
+        return Op::apply(this->lhs.packet(i, j), this->rhs.packet(i, j));
+    }
+    template <typename T> void assignTo(Matrix<T>& C) const;
+};
+
+/**
+ * @brief Elementwise operation of one expression
+ */
+template <typename Op, typename E>
+struct UnaryExpr : public MatExpr<UnaryExpr<Op, E>>
+{
+    typedef typename E::value_type value_type;
+    E arg;
+
+    explicit UnaryExpr(const E& arg) : arg(arg) {}
+    unsigned int rows() const { return this->arg.rows(); }
+    unsigned int cols() const { return this->arg.cols(); }
+    value_type eval(unsigned int i, unsigned int j) const { return Op::apply(this->arg.eval(i, j)); }
+    __attribute__((target("avx2,fma")))
+    __m256 packet(unsigned int i, unsigned int j) const { return Op::apply(this->arg.packet(i, j)); }
+    template <typename T> void assignTo(Matrix<T>& C) const;
+};
+
+/**
+ * @brief Expression multiplied by a scalar
+ */
+template <typename E>
+struct ScaleExpr : public MatExpr<ScaleExpr<E>>
+{
+    typedef typename E::value_type value_type;
+    value_type alpha;
+    E arg;
+
+    ScaleExpr(value_type alpha, const E& arg) : alpha(alpha), arg(arg) {}
+    unsigned int rows() const { return this->arg.rows(); }
+    unsigned int cols() const { return this->arg.cols(); }
+    value_type eval(unsigned int i, unsigned int j) const { return this->alpha*this->arg.eval(i, j); }
+    __attribute__((target("avx2,fma")))
+    __m256 packet(unsigned int i, unsigned int j) const
+    {
+        return _mm256_mul_ps(_mm256_set1_ps(this->alpha), this->arg.packet(i, j));
+    }
+    template <typename T> void assignTo(Matrix<T>& C) const;
+};
+
+/**
+ * @brief Evaluate an elementwise float expression with AVX, 8 columns at a time
+ * (the last columns of a row one at a time, so the padding stays zero). Only
+ * call this if cpu_features().avx2 and fma are set.
+ *
+ * @param e Expression to evaluate
+ * @param C Output matrix, the same size as e
+ */
+template <typename E>
+__attribute__((target("avx2,fma")))
+void assign_elementwise_avx2(const E& e, Matrix<float>& C)
+{
+    const unsigned int rows = e.rows(), cols = e.cols();
+    const unsigned int vecCols = cols & ~7u;
+    for(unsigned int i=0; i<rows; i++)
+    {
+        float* c = C[i];
+        for(unsigned int j=0; j<vecCols; j+=8)
+        {
+            _mm256_store_ps(c + j, e.packet(i, j));
+        }
+        for(unsigned int j=vecCols; j<cols; j++)
+        {
+            c[j] = e.eval(i, j);
+        }
+    }
+}
+
+/**
+ * @brief Evaluate an elementwise expression into a matrix of the same size, in
+ * one pass. Every element is read before it is written, so the operands may
+ * alias C.
+ *
+ * @param e Expression to evaluate
+ * @param C Output matrix
+ */
+template <typename E, typename T>
+void assign_elementwise(const E& e, Matrix<T>& C)
+{
+    if constexpr (std::is_same<T, float>::value)
+    {
+        if(kernels().variant >= CpuVariant::AVX2)
+        {
+            assign_elementwise_avx2(e, C);
+            return;
+        }
+    }
+    const unsigned int rows = e.rows(), cols = e.cols();
+    for(unsigned int i=0; i<rows; i++)
+    {
+        T* c = C[i];
+        for(unsigned int j=0; j<cols; j++)
+        {
+            c[j] = e.eval(i, j);
+        }
+    }
+}
+
+template <typename Op, typename L, typename R>
+template <typename T>
+void BinaryExpr<Op, L, R>::assignTo(Matrix<T>& C) const { assign_elementwise(*this, C); }
+
+template <typename Op, typename E>
+template <typename T>
+void UnaryExpr<Op, E>::assignTo(Matrix<T>& C) const { assign_elementwise(*this, C); }
+
+template <typename E>
+template <typename T>
+void ScaleExpr<E>::assignTo(Matrix<T>& C) const { assign_elementwise(*this, C); }
+
+/**
+ * @brief Scaled float matrix product, alpha*A*B, plus an optional scaled matrix,
+ * beta*D. Assigned to C with one sgemm() call.
+ */
+struct GemmExpr : public MatExpr<GemmExpr>
+{
+    typedef float value_type;
+    const Matrix<float>& A;
+    const Matrix<float>& B;
+    float alpha;
+    /**
+     * @brief Matrix added to the product, none if nullptr
+     */
+    const Matrix<float>* D;
+    float beta;
+
+    GemmExpr(float alpha, const Matrix<float>& A, const Matrix<float>& B)
+        : A(A), B(B), alpha(alpha), D(nullptr), beta(0)
+    {
+        if(A.getCols() != B.getRows())
+        {
+            std::cerr<<"Error: cannot multiply a "<<A.getRows()<<"x"<<A.getCols()
+                     <<" and a "<<B.getRows()<<"x"<<B.getCols()<<" matrix"<<std::endl;
+        }
+    }
+    unsigned int rows() const { return this->A.getRows(); }
+    unsigned int cols() const { return this->B.getCols(); }
+
+    /**
+     * @brief Add beta*D to the product
+     *
+     * @param beta Scale applied to D
+     * @param D Matrix to add, rows() x cols()
+     * @return GemmExpr
+     */
+    GemmExpr plus(float beta, const Matrix<float>& D) const
+    {
+        GemmExpr e = *this;
+        if(this->D != nullptr)
+        {
+            std::cerr<<"Error: only one matrix can be added to a product"<<std::endl;
+            return e;
+        }
+        if(D.getRows() != this->rows() || D.getCols() != this->cols())
+        {
+            std::cerr<<"Error: cannot add a "<<D.getRows()<<"x"<<D.getCols()<<" matrix to a "
+                     <<this->rows()<<"x"<<this->cols()<<" product"<<std::endl;
+            return e;
+        }
+        e.D = &D;
+        e.beta = beta;
+        return e;
+    }
+
+    /**
+     * @brief Compute C = alpha*A*B + beta*D. D is copied into C (unless it is C)
+     * and sgemm() scales it in place, so no temporary is needed unless C is A or B.
+     *
+     * @param C Output matrix, rows() x cols()
+     */
+    void assignTo(Matrix<float>& C) const
+    {
+        if(this->A.getCols() != this->B.getRows())
+        {
+            return;
+        }
+        if(&C == &this->A || &C == &this->B)
+        {
+            //sgemm() reads A and B while writing C, so compute into a new matrix
+            Matrix<float> tmp(this->rows(), this->cols(), false);
+            this->assignTo(tmp);
+            C = std::move(tmp);
+            return;
+        }
+        float beta = 0;
+        if(this->D != nullptr && this->beta != 0)
+        {
+            if(this->D != &C)
+            {
+                for(unsigned int i=0; i<this->rows(); i++)
+                {
+                    std::memcpy(C[i], (*this->D)[i], (size_t)this->cols()*sizeof(float));
+                }
+            }
+            beta = this->beta;
+        }
+        sgemm(false, this->rows(), this->cols(), this->A.getCols(),
+              this->alpha, this->A.getData(), this->A.getStride(),
+              this->B.getData(), this->B.getStride(),
+              beta, C.getData(), C.getStride());
+    }
+};
+
+// Elementwise operators
+
+template <typename L, typename R>
+BinaryExpr<AddOp, typename ExprNode<L>::type, typename ExprNode<R>::type>
+operator+(const MatExpr<L>& l, const MatExpr<R>& r)
+{
+    return {ExprNode<L>::make(l.self()), ExprNode<R>::make(r.self())};
+}
+
+template <typename L, typename R>
+BinaryExpr<SubOp, typename ExprNode<L>::type, typename ExprNode<R>::type>
+operator-(const MatExpr<L>& l, const MatExpr<R>& r)
+{
+    return {ExprNode<L>::make(l.self()), ExprNode<R>::make(r.self())};
+}
+
+template <typename E>
+UnaryExpr<NegOp, typename ExprNode<E>::type> operator-(const MatExpr<E>& e)
+{
+    return UnaryExpr<NegOp, typename ExprNode<E>::type>(ExprNode<E>::make(e.self()));
+}
+
+template <typename E>
+ScaleExpr<typename ExprNode<E>::type> operator*(typename ExprNode<E>::type::value_type alpha, const MatExpr<E>& e)
+{
+    return {alpha, ExprNode<E>::make(e.self())};
+}
+
+template <typename E>
+ScaleExpr<typename ExprNode<E>::type> operator*(const MatExpr<E>& e, typename ExprNode<E>::type::value_type alpha)
+{
+    return {alpha, ExprNode<E>::make(e.self())};
+}
+
+/**
+ * @brief Elementwise (Hadamard) product. A*B is the matrix product.
+ */
+template <typename L, typename R>
+BinaryExpr<MulOp, typename ExprNode<L>::type, typename ExprNode<R>::type>
+hadamard(const MatExpr<L>& l, const MatExpr<R>& r)
+{
+    return {ExprNode<L>::make(l.self()), ExprNode<R>::make(r.self())};
+}
+
+/**
+ * @brief Elementwise max(x, 0)
+ */
+template <typename E>
+UnaryExpr<ReluOp, typename ExprNode<E>::type> relu(const MatExpr<E>& e)
+{
+    return UnaryExpr<ReluOp, typename ExprNode<E>::type>(ExprNode<E>::make(e.self()));
+}
+
+// Matrix product operators (float only, they map to sgemm())
+
+inline GemmExpr operator*(const Matrix<float>& A, const Matrix<float>& B) { return GemmExpr(1, A, B); }
+inline GemmExpr operator*(const ScaleExpr<MatrixLeaf<float>>& A, const Matrix<float>& B)
+{
+    return GemmExpr(A.alpha, A.arg.m, B);
+}
+inline GemmExpr operator*(const Matrix<float>& A, const ScaleExpr<MatrixLeaf<float>>& B)
+{
+    return GemmExpr(B.alpha, A, B.arg.m);
+}
+inline GemmExpr operator*(float alpha, const GemmExpr& e)
+{
+    GemmExpr r = e;
+    r.alpha *= alpha;
+    return r;
+}
+inline GemmExpr operator*(const GemmExpr& e, float alpha) { return alpha*e; }
+
+inline GemmExpr operator+(const GemmExpr& e, const Matrix<float>& D) { return e.plus(1, D); }
+inline GemmExpr operator+(const Matrix<float>& D, const GemmExpr& e) { return e.plus(1, D); }
+inline GemmExpr operator+(const GemmExpr& e, const ScaleExpr<MatrixLeaf<float>>& D) { return e.plus(D.alpha, D.arg.m); }
+inline GemmExpr operator+(const ScaleExpr<MatrixLeaf<float>>& D, const GemmExpr& e) { return e.plus(D.alpha, D.arg.m); }
+inline GemmExpr operator-(const GemmExpr& e, const Matrix<float>& D) { return e.plus(-1, D); }
+inline GemmExpr operator-(const GemmExpr& e, const ScaleExpr<MatrixLeaf<float>>& D) { return e.plus(-D.alpha, D.arg.m); }
+
+#endif
@@ -0,0 +1,248 @@
+/**
+ * @file fill.cpp
+ * @author Ethan Stockbridge (ethanstockbridge@gmail.com)
+ * @author Devan Kidd (jjkidd1245@gmail.com)
+ * @brief Philox4x32-10 random fill 8 counters (32 values) at a time with AVX2,
+ * non-temporal zero fill, and the thread pool large matrices are filled on
+ * @date 2022-01-25
+ */
+
+#include <immintrin.h> // For SIMD functions
+#include <pthread.h>
+#include <atomic>
+#include <cassert>
+#include <cstring>
+
+#include "fill.h"
+#include "dispatch.h"
+#include "thread_pool.h"
+
+static std::atomic<uint64_t> baseSeed(0);
+static std::atomic<uint32_t> fillCount(0);
+
+void set_fill_seed(uint64_t seed)
+{
+    baseSeed = seed;
+    fillCount = 0;
+}
+
+uint64_t next_fill_seed()
+{
+    //the n'th seed is Philox block n of the base seed
+    uint32_t ctr[4] = {fillCount++, 0, 0, 0};
+    philox4x32(ctr, baseSeed);
+    return (uint64_t)ctr[1] << 32 | ctr[0];
+}
+
+/**
+ * @brief High and low 32 bits of the 8 products a*m
+ */
+__attribute__((target("avx2")))
+static inline void mulhilo8(__m256i a, __m256i m, __m256i& hi, __m256i& lo)
+{
+    lo = _mm256_mullo_epi32(a, m);
+    //_mm256_mul_epu32 multiplies the even lanes into 64 bit products
+    const __m256i even = _mm256_mul_epu32(a, m);
+    const __m256i odd = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), m);
+    hi = _mm256_blend_epi32(_mm256_srli_epi64(even, 32), odd, 0xAA);
+}
+
+/**
+ * @brief Philox4x32-10 on 8 counters at once, word w of counter l in lane l of x[w]
+ */
+__attribute__((target("avx2")))
+static inline void philox4x32_8(__m256i x[4], uint64_t key)
+{
+    const __m256i m0 = _mm256_set1_epi32((int)0xD2511F53u);
+    const __m256i m1 = _mm256_set1_epi32((int)0xCD9E8D57u);
+    const __m256i w0 = _mm256_set1_epi32((int)0x9E3779B9u);
+    const __m256i w1 = _mm256_set1_epi32((int)0xBB67AE85u);
+    __m256i k0 = _mm256_set1_epi32((int)(uint32_t)key);
+    __m256i k1 = _mm256_set1_epi32((int)(uint32_t)(key >> 32));
+    for(int round=0; round<10; round++)
+    {
+        __m256i hi0, lo0, hi1, lo1;
+        mulhilo8(x[0], m0, hi0, lo0);
+        mulhilo8(x[2], m1, hi1, lo1);
+        x[0] = _mm256_xor_si256(_mm256_xor_si256(hi1, x[1]), k0);
+        x[1] = lo1;
+        x[2] = _mm256_xor_si256(_mm256_xor_si256(hi0, x[3]), k1);
+        x[3] = lo0;
+        k0 = _mm256_add_epi32(k0, w0);
+        k1 = _mm256_add_epi32(k1, w1);
+    }
+}
+
+/**
+ * @brief Store 8 values in [0, 2^31) converted to the element type
+ */
+__attribute__((target("avx2")))
+static inline void store8(float* dst, __m256i v, bool stream)
+{
+    const __m256 f = _mm256_cvtepi32_ps(v);
+    if(stream)
+    {
+        _mm256_stream_ps(dst, f);
+    }
+    else
+    {
+        _mm256_storeu_ps(dst, f);
+    }
+}
+
+__attribute__((target("avx2")))
+static inline void store8(int* dst, __m256i v, bool stream)
+{
+    if(stream)
+    {
+        _mm256_stream_si256(reinterpret_cast<__m256i*>(dst), v);
+    }
+    else
+    {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), v);
+    }
+}
+
+__attribute__((target("avx2")))
+static inline void store8(short int* dst, __m256i v, bool stream)
+{
+    //keep the low 16 bits like a cast, then pack the 8 lanes into 8 shorts
+    v = _mm256_and_si256(v, _mm256_set1_epi32(0xffff));
+    const __m128i packed = _mm256_castsi256_si128(_mm256_permute4x64_epi64(_mm256_packus_epi32(v, v), 0x08));
+    if(stream)
+    {
+        _mm_stream_si128(reinterpret_cast<__m128i*>(dst), packed);
+    }
+    else
+    {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), packed);
+    }
+}
+
+/**
+ * @brief Fill a row 32 values (8 Philox counters) at a time, see random_value()
+ * for the layout of the stream
+ */
+template <typename T>
+__attribute__((target("avx2")))
+static void random_fill_avx2(T* dst, unsigned int n, uint64_t seed, unsigned int row, bool stream)
+{
+    stream = stream && (reinterpret_cast<uintptr_t>(dst) % 32 == 0);
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i rowv = _mm256_set1_epi32((int)row);
+    unsigned int j = 0;
+    for(; j<n; j+=32)
+    {
+        __m256i x[4] = {_mm256_add_epi32(_mm256_set1_epi32((int)(j/32*8)), lanes), rowv,
+                        _mm256_setzero_si256(), _mm256_setzero_si256()};
+        philox4x32_8(x, seed);
+        if(j + 32 <= n)
+        {
+            for(int w=0; w<4; w++)
+            {
+                store8(dst + j + 8*w, _mm256_srli_epi32(x[w], 1), stream);
+            }
+        }
+        else
+        { //last partial block
+            alignas(32) T tail[32];
+            for(int w=0; w<4; w++)
+            {
+                store8(tail + 8*w, _mm256_srli_epi32(x[w], 1), false);
+            }
+            std::memcpy(dst + j, tail, (n - j)*sizeof(T));
+        }
+    }
+    if(stream)
+    {
+        _mm_sfence();
+    }
+}
+
+void random_fill(float* dst, unsigned int n, uint64_t seed, unsigned int row, bool stream)
+{
+    if(cpu_features().avx2)
+    {
+        random_fill_avx2(dst, n, seed, row, stream);
+        return;
+    }
+    random_fill<float>(dst, n, seed, row, stream);
+}
+
+void random_fill(int* dst, unsigned int n, uint64_t seed, unsigned int row, bool stream)
+{
+    if(cpu_features().avx2)
+    {
+        random_fill_avx2(dst, n, seed, row, stream);
+        return;
+    }
+    random_fill<int>(dst, n, seed, row, stream);
+}
+
+void random_fill(short int* dst, unsigned int n, uint64_t seed, unsigned int row, bool stream)
+{
+    if(cpu_features().avx2)
+    {
+        random_fill_avx2(dst, n, seed, row, stream);
+        return;
+    }
+    random_fill<short int>(dst, n, seed, row, stream);
+}
+
+void zero_fill(void* dst, size_t bytes, bool stream)
+{
+    char* p = static_cast<char*>(dst);
+    if(!stream || bytes < 128)
+    {
+        std::memset(p, 0, bytes);
+        return;
+    }
+    //regular stores up to a 16 byte boundary, then whole cache lines with SSE2
+    //non-temporal stores, then the rest
+    const size_t head = (16 - reinterpret_cast<uintptr_t>(p) % 16) % 16;
+    std::memset(p, 0, head);
+    p += head;
+    bytes -= head;
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for(; i + 64 <= bytes; i += 64)
+    {
+        _mm_stream_si128(reinterpret_cast<__m128i*>(p + i), zero);
+        _mm_stream_si128(reinterpret_cast<__m128i*>(p + i + 16), zero);
+        _mm_stream_si128(reinterpret_cast<__m128i*>(p + i + 32), zero);
+        _mm_stream_si128(reinterpret_cast<__m128i*>(p + i + 48), zero);
+    }
+    std::memset(p + i, 0, bytes - i);
+    _mm_sfence();
+}
+
+/**
+ * @brief Held while the fill pool runs a batch. A fill started while it is held
+ * (by another thread, or from inside a fill task) runs on its own thread.
+ */
+static pthread_mutex_t fillPoolLock = PTHREAD_MUTEX_INITIALIZER;
+
+void parallel_fill(unsigned int tasks, size_t bytes, const std::function<void(unsigned int)>& fn,
+                   ThreadPool* pool)
+{
+    if(pool != nullptr)
+    {
+        //task i on worker i, the placement depends on which thread writes first
+        assert(tasks == pool->size());
+        pool->runOnEach([&fn](unsigned int task, unsigned int) { fn(task); });
+        return;
+    }
+    static const unsigned int cpus = ThreadPool::availableCPUs();
+    if(tasks > 1 && cpus > 1 && bytes >= FILL_PARALLEL_MIN && pthread_mutex_trylock(&fillPoolLock) == 0)
+    {
+        //created on the first large fill, and kept for the rest of the program
+        static ThreadPool pool(cpus, false);
+        pool.run(tasks, [&fn](unsigned int task, unsigned int) { fn(task); });
+        pthread_mutex_unlock(&fillPoolLock);
+        return;
+    }
+    for(unsigned int i=0; i<tasks; i++)
+    {
+        fn(i);
+    }
+}
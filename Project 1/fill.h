@@ -0,0 +1,143 @@
+/**
+ * @file fill.h
+ * @author Ethan Stockbridge (ethanstockbridge@gmail.com)
+ * @author Devan Kidd (jjkidd1245@gmail.com)
+ * @brief Matrix initialization: a counter-based (Philox4x32-10) random fill and
+ * a streaming zero fill, vectorized and split over threads for large matrices
+ * @date 2022-01-25
+ */
+#ifndef FILL_H
+#define FILL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+class ThreadPool;
+
+/**
+ * @brief Matrices of at least this many bytes are filled by a pool of threads
+ * with non-temporal stores. Smaller ones are filled on the calling thread with
+ * regular stores, so they are still in cache when they are used.
+ */
+#ifndef FILL_PARALLEL_MIN
+#define FILL_PARALLEL_MIN (4u << 20)
+#endif
+
+/**
+ * @brief Bytes of a matrix filled by one task of the fill pool
+ */
+#ifndef FILL_TASK_BYTES
+#define FILL_TASK_BYTES (1u << 20)
+#endif
+
+/**
+ * @brief One Philox4x32-10 block: 4 random 32 bit words for a 128 bit counter
+ * and a 64 bit key. Every output depends only on the counter and the key, so
+ * any part of a random stream can be generated on its own, in any order.
+ *
+ * @param ctr Counter, replaced by the 4 output words
+ * @param key Key (the seed)
+ */
+inline void philox4x32(uint32_t ctr[4], uint64_t key)
+{
+    uint32_t k0 = (uint32_t)key, k1 = (uint32_t)(key >> 32);
+    for(int round=0; round<10; round++)
+    {
+        const uint64_t p0 = (uint64_t)0xD2511F53u*ctr[0];
+        const uint64_t p1 = (uint64_t)0xCD9E8D57u*ctr[2];
+        const uint32_t c1 = ctr[1], c3 = ctr[3];
+        ctr[0] = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+        ctr[1] = (uint32_t)p1;
+        ctr[2] = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+        ctr[3] = (uint32_t)p0;
+        k0 += 0x9E3779B9u;
+        k1 += 0xBB67AE85u;
+    }
+}
+
+/**
+ * @brief Random value of element (row, col) of the stream of a seed, in
+ * [0, 2^31 - 1] like rand(). Columns come in blocks of 32: counter
+ * (col/32*8 + col%8, row) gives the values of columns col%8, col%8 + 8, +16 and
+ * +24 of the block, so 8 counters fill 32 columns with 4 whole AVX2 registers.
+ *
+ * @param seed Seed of the stream
+ * @param row Row of the element
+ * @param col Column of the element
+ * @return uint32_t
+ */
+inline uint32_t random_value(uint64_t seed, unsigned int row, unsigned int col)
+{
+    uint32_t ctr[4] = {(col / 32)*8 + col % 8, row, 0, 0};
+    philox4x32(ctr, seed);
+    return ctr[(col % 32) / 8] >> 1;
+}
+
+/**
+ * @brief Set the seed every random matrix is derived from. The n'th random
+ * matrix created after this call gets the same values for the same seed, no
+ * matter how many threads fill it.
+ *
+ * @param seed Base seed
+ */
+void set_fill_seed(uint64_t seed);
+
+/**
+ * @brief Get the seed of the next random matrix, derived from the base seed and
+ * the number of matrices filled since it was set
+ *
+ * @return uint64_t
+ */
+uint64_t next_fill_seed();
+
+/**
+ * @brief Fill part of a row with random values, random_value(seed, row, j)
+ * converted to the element type for j in [0, n). Generic version for any
+ * element type, see the float, int and short int overloads for the AVX2 versions.
+ *
+ * @param dst First element of the row
+ * @param n Number of elements to fill
+ * @param seed Seed of the stream
+ * @param row Row of the stream to fill with
+ * @param stream If true, write with non-temporal stores (dst should be 64 byte aligned)
+ */
+template <typename T>
+void random_fill(T* dst, unsigned int n, uint64_t seed, unsigned int row, bool stream = false)
+{
+    (void)stream;
+    for(unsigned int j=0; j<n; j++)
+    {
+        dst[j] = (T)random_value(seed, row, j);
+    }
+}
+
+void random_fill(float* dst, unsigned int n, uint64_t seed, unsigned int row, bool stream = false);
+void random_fill(int* dst, unsigned int n, uint64_t seed, unsigned int row, bool stream = false);
+void random_fill(short int* dst, unsigned int n, uint64_t seed, unsigned int row, bool stream = false);
+
+/**
+ * @brief Set a buffer to zero
+ *
+ * @param dst Buffer to clear
+ * @param bytes Size of the buffer
+ * @param stream If true, write with non-temporal stores that bypass the cache
+ * and skip reading the old contents
+ */
+void zero_fill(void* dst, size_t bytes, bool stream);
+
+/**
+ * @brief Run fn(i) for every i in [0, tasks). Runs on the given pool, one task
+ * per worker with task i on worker i (tasks must then be the pool's size, which is
+ * asserted), or on a shared pool of all CPUs if bytes is at least FILL_PARALLEL_MIN
+ * and that pool is free, otherwise on the calling thread.
+ *
+ * @param tasks Number of tasks
+ * @param bytes Total bytes the tasks write
+ * @param fn Function to run for each task
+ * @param pool Pool to run the tasks on (ex: for first touch placement), or nullptr
+ */
+void parallel_fill(unsigned int tasks, size_t bytes, const std::function<void(unsigned int)>& fn,
+                   ThreadPool* pool = nullptr);
+
+#endif
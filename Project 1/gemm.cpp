@@ -0,0 +1,615 @@
+/**
+ * @file gemm.cpp
+ * @author Ethan Stockbridge (ethanstockbridge@gmail.com)
+ * @author Devan Kidd (jjkidd1245@gmail.com)
+ * @brief Cache blocked, register tiled single precision matrix multiplication.
+ * A and B are copied ("packed") into contiguous panels sized for the L2 / L1
+ * caches, then a micro-kernel computes C one register tile at a time. There is
+ * one micro-kernel per instruction set, chosen at runtime by dispatch.cpp.
+ * @date 2022-01-25
+ */
+
+#include <iostream>
+#include <algorithm>
+#include <immintrin.h> // For SIMD functions
+#include <type_traits>
+
+#include "gemm.h"
+#include "dispatch.h"
+
+/**
+ * @brief Packing buffers, allocated once per thread and reused by every call
+ */
+struct PackBuffers
+{
+    float* a = nullptr;
+    float* b = nullptr;
+
+    PackBuffers()
+    {
+        this->a = static_cast<float*>(std::aligned_alloc(MATRIX_ALIGNMENT, sizeof(float)*GEMM_MC*GEMM_KC));
+        this->b = static_cast<float*>(std::aligned_alloc(MATRIX_ALIGNMENT, sizeof(float)*GEMM_KC*GEMM_NC));
+        if(this->a == nullptr || this->b == nullptr)
+        {
+            throw std::bad_alloc();
+        }
+    }
+    ~PackBuffers()
+    {
+        std::free(this->a);
+        std::free(this->b);
+    }
+};
+
+/**
+ * @brief Pack an mc x kc block of A into MR row panels. Within a panel the
+ * MR values of each k are contiguous, and rows past mc are zero. 16 bit types
+ * are widened to float one row at a time, then interleaved into the panel.
+ */
+template <unsigned int MR, typename TIn>
+static void pack_A(const TIn* A, unsigned int lda, unsigned int mc, unsigned int kc, float* buff)
+{
+    for(unsigned int i=0; i<mc; i+=MR)
+    {
+        const unsigned int rows = std::min<unsigned int>(MR, mc-i);
+        const TIn* a = A + (size_t)i*lda;
+        if constexpr (std::is_same<TIn, float>::value)
+        {
+            for(unsigned int k=0; k<kc; k++)
+            {
+                for(unsigned int r=0; r<MR; r++)
+                {
+                    buff[r] = (r < rows) ? a[(size_t)r*lda + k] : 0.0f;
+                }
+                buff += MR;
+            }
+        }
+        else
+        {
+            alignas(MATRIX_ALIGNMENT) float row[GEMM_KC];
+            for(unsigned int r=0; r<MR; r++)
+            {
+                if(r < rows)
+                {
+                    to_float(a + (size_t)r*lda, row, kc);
+                }
+                for(unsigned int k=0; k<kc; k++)
+                {
+                    buff[(size_t)k*MR + r] = (r < rows) ? row[k] : 0.0f;
+                }
+            }
+            buff += (size_t)MR*kc;
+        }
+    }
+}
+
+/**
+ * @brief Pack a kc x nc block of B into NR column panels. Within a panel the
+ * NR values of each k are contiguous, and columns past nc are zero. 16 bit
+ * types are widened to float as they are packed.
+ */
+template <unsigned int NR, typename TIn>
+static void pack_B(bool transB, const TIn* B, unsigned int ldb, unsigned int kc, unsigned int nc, float* buff)
+{
+    for(unsigned int j=0; j<nc; j+=NR)
+    {
+        const unsigned int cols = std::min<unsigned int>(NR, nc-j);
+        if constexpr (!std::is_same<TIn, float>::value)
+        {
+            if(transB)
+            { // column j+c of B is a contiguous row of the stored matrix
+                alignas(MATRIX_ALIGNMENT) float row[GEMM_KC];
+                for(unsigned int c=0; c<NR; c++)
+                {
+                    if(c < cols)
+                    {
+                        to_float(B + (size_t)(j+c)*ldb, row, kc);
+                    }
+                    for(unsigned int k=0; k<kc; k++)
+                    {
+                        buff[(size_t)k*NR + c] = (c < cols) ? row[k] : 0.0f;
+                    }
+                }
+            }
+            else
+            {
+                for(unsigned int k=0; k<kc; k++)
+                {
+                    to_float(B + (size_t)k*ldb + j, buff + (size_t)k*NR, cols);
+                    for(unsigned int c=cols; c<NR; c++)
+                    {
+                        buff[(size_t)k*NR + c] = 0.0f;
+                    }
+                }
+            }
+            buff += (size_t)NR*kc;
+        }
+        else
+        {
+            for(unsigned int k=0; k<kc; k++)
+            {
+                if(transB)
+                { // B(k, j+c) is stored at B[(j+c)*ldb + k]
+                    for(unsigned int c=0; c<NR; c++)
+                    {
+                        buff[c] = (c < cols) ? B[(size_t)(j+c)*ldb + k] : 0.0f;
+                    }
+                }
+                else
+                { // B(k, j+c) is stored at B[k*ldb + j+c]
+                    const TIn* b = B + (size_t)k*ldb + j;
+                    for(unsigned int c=0; c<NR; c++)
+                    {
+                        buff[c] = (c < cols) ? b[c] : 0.0f;
+                    }
+                }
+                buff += NR;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Micro-kernel signature: C[0:MR][0:NR] += alpha * (packed A panel) x (packed B panel)
+ *
+ * @param kc Depth of the panels
+ * @param a Packed A panel (kc x MR)
+ * @param b Packed B panel (kc x NR), MATRIX_ALIGNMENT aligned
+ * @param C Top left of the output tile
+ * @param ldc Leading dimension of C
+ * @param alpha Scale applied to the product
+ */
+typedef void (*MicroKernel)(unsigned int kc, const float* a, const float* b, float* C, unsigned int ldc, float alpha);
+
+/**
+ * @brief Portable 4x8 micro-kernel in plain C++, for CPUs without any of the
+ * vector extensions below
+ */
+static void kernel_scalar_4x8(unsigned int kc, const float* a, const float* b, float* C, unsigned int ldc, float alpha)
+{
+    float acc[4][8] = {{0}};
+    for(unsigned int k=0; k<kc; k++)
+    {
+        for(unsigned int r=0; r<4; r++)
+        {
+            for(unsigned int c=0; c<8; c++)
+            {
+                acc[r][c] += a[r]*b[c];
+            }
+        }
+        a += 4;
+        b += 8;
+    }
+    for(unsigned int r=0; r<4; r++)
+    {
+        for(unsigned int c=0; c<8; c++)
+        {
+            C[(size_t)r*ldc + c] += alpha*acc[r][c];
+        }
+    }
+}
+
+/**
+ * @brief SSE 4x8 micro-kernel. The 4x8 tile of C is held in 8 SSE registers.
+ */
+static void kernel_sse_4x8(unsigned int kc, const float* a, const float* b, float* C, unsigned int ldc, float alpha)
+{
+    __m128 c00 = _mm_setzero_ps(), c01 = _mm_setzero_ps();
+    __m128 c10 = _mm_setzero_ps(), c11 = _mm_setzero_ps();
+    __m128 c20 = _mm_setzero_ps(), c21 = _mm_setzero_ps();
+    __m128 c30 = _mm_setzero_ps(), c31 = _mm_setzero_ps();
+    __m128 b0, b1, ai;
+
+    for(unsigned int k=0; k<kc; k++)
+    {
+        b0 = _mm_load_ps(b);
+        b1 = _mm_load_ps(b+4);
+
+        ai = _mm_set1_ps(a[0]);
+        c00 = _mm_add_ps(c00, _mm_mul_ps(ai, b0));
+        c01 = _mm_add_ps(c01, _mm_mul_ps(ai, b1));
+        ai = _mm_set1_ps(a[1]);
+        c10 = _mm_add_ps(c10, _mm_mul_ps(ai, b0));
+        c11 = _mm_add_ps(c11, _mm_mul_ps(ai, b1));
+        ai = _mm_set1_ps(a[2]);
+        c20 = _mm_add_ps(c20, _mm_mul_ps(ai, b0));
+        c21 = _mm_add_ps(c21, _mm_mul_ps(ai, b1));
+        ai = _mm_set1_ps(a[3]);
+        c30 = _mm_add_ps(c30, _mm_mul_ps(ai, b0));
+        c31 = _mm_add_ps(c31, _mm_mul_ps(ai, b1));
+
+        a += 4;
+        b += 8;
+    }
+
+    const __m128 scale = _mm_set1_ps(alpha);
+    float* c;
+    c = C + 0*(size_t)ldc;
+    _mm_storeu_ps(c,   _mm_add_ps(_mm_loadu_ps(c),   _mm_mul_ps(scale, c00)));
+    _mm_storeu_ps(c+4, _mm_add_ps(_mm_loadu_ps(c+4), _mm_mul_ps(scale, c01)));
+    c = C + 1*(size_t)ldc;
+    _mm_storeu_ps(c,   _mm_add_ps(_mm_loadu_ps(c),   _mm_mul_ps(scale, c10)));
+    _mm_storeu_ps(c+4, _mm_add_ps(_mm_loadu_ps(c+4), _mm_mul_ps(scale, c11)));
+    c = C + 2*(size_t)ldc;
+    _mm_storeu_ps(c,   _mm_add_ps(_mm_loadu_ps(c),   _mm_mul_ps(scale, c20)));
+    _mm_storeu_ps(c+4, _mm_add_ps(_mm_loadu_ps(c+4), _mm_mul_ps(scale, c21)));
+    c = C + 3*(size_t)ldc;
+    _mm_storeu_ps(c,   _mm_add_ps(_mm_loadu_ps(c),   _mm_mul_ps(scale, c30)));
+    _mm_storeu_ps(c+4, _mm_add_ps(_mm_loadu_ps(c+4), _mm_mul_ps(scale, c31)));
+}
+
+/**
+ * @brief AVX2 6x16 micro-kernel. The whole C tile lives in 12 accumulator
+ * registers for the length of the k loop, so each iteration is 2 loads of B,
+ * 6 broadcasts of A and 12 FMAs.
+ */
+__attribute__((target("avx2,fma")))
+static void kernel_avx2_6x16(unsigned int kc, const float* a, const float* b, float* C, unsigned int ldc, float alpha)
+{
+    __m256 c00 = _mm256_setzero_ps(), c01 = _mm256_setzero_ps();
+    __m256 c10 = _mm256_setzero_ps(), c11 = _mm256_setzero_ps();
+    __m256 c20 = _mm256_setzero_ps(), c21 = _mm256_setzero_ps();
+    __m256 c30 = _mm256_setzero_ps(), c31 = _mm256_setzero_ps();
+    __m256 c40 = _mm256_setzero_ps(), c41 = _mm256_setzero_ps();
+    __m256 c50 = _mm256_setzero_ps(), c51 = _mm256_setzero_ps();
+    __m256 b0, b1, ai;
+
+    for(unsigned int k=0; k<kc; k++)
+    {
+        b0 = _mm256_load_ps(b);
+        b1 = _mm256_load_ps(b+8);
+
+        ai = _mm256_broadcast_ss(a+0);
+        c00 = _mm256_fmadd_ps(ai, b0, c00);
+        c01 = _mm256_fmadd_ps(ai, b1, c01);
+        ai = _mm256_broadcast_ss(a+1);
+        c10 = _mm256_fmadd_ps(ai, b0, c10);
+        c11 = _mm256_fmadd_ps(ai, b1, c11);
+        ai = _mm256_broadcast_ss(a+2);
+        c20 = _mm256_fmadd_ps(ai, b0, c20);
+        c21 = _mm256_fmadd_ps(ai, b1, c21);
+        ai = _mm256_broadcast_ss(a+3);
+        c30 = _mm256_fmadd_ps(ai, b0, c30);
+        c31 = _mm256_fmadd_ps(ai, b1, c31);
+        ai = _mm256_broadcast_ss(a+4);
+        c40 = _mm256_fmadd_ps(ai, b0, c40);
+        c41 = _mm256_fmadd_ps(ai, b1, c41);
+        ai = _mm256_broadcast_ss(a+5);
+        c50 = _mm256_fmadd_ps(ai, b0, c50);
+        c51 = _mm256_fmadd_ps(ai, b1, c51);
+
+        a += 6;
+        b += 16;
+    }
+
+    const __m256 scale = _mm256_set1_ps(alpha);
+    float* c;
+    c = C + 0*(size_t)ldc;
+    _mm256_storeu_ps(c,   _mm256_fmadd_ps(scale, c00, _mm256_loadu_ps(c)));
+    _mm256_storeu_ps(c+8, _mm256_fmadd_ps(scale, c01, _mm256_loadu_ps(c+8)));
+    c = C + 1*(size_t)ldc;
+    _mm256_storeu_ps(c,   _mm256_fmadd_ps(scale, c10, _mm256_loadu_ps(c)));
+    _mm256_storeu_ps(c+8, _mm256_fmadd_ps(scale, c11, _mm256_loadu_ps(c+8)));
+    c = C + 2*(size_t)ldc;
+    _mm256_storeu_ps(c,   _mm256_fmadd_ps(scale, c20, _mm256_loadu_ps(c)));
+    _mm256_storeu_ps(c+8, _mm256_fmadd_ps(scale, c21, _mm256_loadu_ps(c+8)));
+    c = C + 3*(size_t)ldc;
+    _mm256_storeu_ps(c,   _mm256_fmadd_ps(scale, c30, _mm256_loadu_ps(c)));
+    _mm256_storeu_ps(c+8, _mm256_fmadd_ps(scale, c31, _mm256_loadu_ps(c+8)));
+    c = C + 4*(size_t)ldc;
+    _mm256_storeu_ps(c,   _mm256_fmadd_ps(scale, c40, _mm256_loadu_ps(c)));
+    _mm256_storeu_ps(c+8, _mm256_fmadd_ps(scale, c41, _mm256_loadu_ps(c+8)));
+    c = C + 5*(size_t)ldc;
+    _mm256_storeu_ps(c,   _mm256_fmadd_ps(scale, c50, _mm256_loadu_ps(c)));
+    _mm256_storeu_ps(c+8, _mm256_fmadd_ps(scale, c51, _mm256_loadu_ps(c+8)));
+}
+
+/**
+ * @brief AVX-512 12x32 micro-kernel. The C tile is held in 24 of the 32 zmm
+ * registers, each iteration is 2 loads of B, 12 broadcasts of A and 24 FMAs.
+ */
+__attribute__((target("avx512f")))
+static void kernel_avx512_12x32(unsigned int kc, const float* a, const float* b, float* C, unsigned int ldc, float alpha)
+{
+    __m512 acc[12][2];
+    #pragma GCC unroll 12
+    for(unsigned int r=0; r<12; r++)
+    {
+        acc[r][0] = _mm512_setzero_ps();
+        acc[r][1] = _mm512_setzero_ps();
+    }
+
+    for(unsigned int k=0; k<kc; k++)
+    {
+        const __m512 b0 = _mm512_load_ps(b);
+        const __m512 b1 = _mm512_load_ps(b+16);
+        #pragma GCC unroll 12
+        for(unsigned int r=0; r<12; r++)
+        {
+            const __m512 ai = _mm512_set1_ps(a[r]);
+            acc[r][0] = _mm512_fmadd_ps(ai, b0, acc[r][0]);
+            acc[r][1] = _mm512_fmadd_ps(ai, b1, acc[r][1]);
+        }
+        a += 12;
+        b += 32;
+    }
+
+    const __m512 scale = _mm512_set1_ps(alpha);
+    #pragma GCC unroll 12
+    for(unsigned int r=0; r<12; r++)
+    {
+        float* c = C + (size_t)r*ldc;
+        _mm512_storeu_ps(c,    _mm512_fmadd_ps(scale, acc[r][0], _mm512_loadu_ps(c)));
+        _mm512_storeu_ps(c+16, _mm512_fmadd_ps(scale, acc[r][1], _mm512_loadu_ps(c+16)));
+    }
+}
+
+/**
+ * @brief Blocked GEMM driver shared by every variant. Only the register tile
+ * size and the micro-kernel differ between instruction sets. A and B of a 16 bit
+ * type are widened to float while they are packed, so the float micro-kernels
+ * accumulate in fp32 and only half of the bytes are read from memory.
+ *
+ * @tparam TIn Type A and B are stored as (float, half or bfloat16)
+ * @tparam MR Rows of the micro-kernel's tile (GEMM_MC must be a multiple of it)
+ * @tparam NR Columns of the micro-kernel's tile (GEMM_NC must be a multiple of it)
+ * @tparam Kernel Micro-kernel
+ */
+template <typename TIn, unsigned int MR, unsigned int NR, MicroKernel Kernel>
+static void gemm_driver(bool transB, unsigned int M, unsigned int N, unsigned int K,
+                        float alpha, const TIn* A, unsigned int lda,
+                        const TIn* B, unsigned int ldb,
+                        float beta, float* C, unsigned int ldc)
+{
+    static_assert(GEMM_MC % MR == 0, "GEMM_MC must be a multiple of the micro-kernel rows");
+    static_assert(GEMM_NC % NR == 0, "GEMM_NC must be a multiple of the micro-kernel columns");
+
+    // apply beta up front so every block below only has to accumulate
+    if(beta != 1.0f)
+    {
+        for(unsigned int i=0; i<M; i++)
+        {
+            float* c = C + (size_t)i*ldc;
+            for(unsigned int j=0; j<N; j++)
+            {
+                c[j] = (beta == 0.0f) ? 0.0f : beta*c[j];
+            }
+        }
+    }
+    if(alpha == 0.0f || K == 0)
+    {
+        return;
+    }
+
+    static thread_local PackBuffers pack;
+
+    for(unsigned int jc=0; jc<N; jc+=GEMM_NC)
+    { // L3: one NC wide block of B
+        const unsigned int nc = std::min<unsigned int>(GEMM_NC, N-jc);
+        for(unsigned int pc=0; pc<K; pc+=GEMM_KC)
+        { // one KC deep slice of the product
+            const unsigned int kc = std::min<unsigned int>(GEMM_KC, K-pc);
+            const TIn* Bblock = transB ? B + (size_t)jc*ldb + pc : B + (size_t)pc*ldb + jc;
+            pack_B<NR, TIn>(transB, Bblock, ldb, kc, nc, pack.b);
+
+            for(unsigned int ic=0; ic<M; ic+=GEMM_MC)
+            { // L2: one MC tall block of A
+                const unsigned int mc = std::min<unsigned int>(GEMM_MC, M-ic);
+                pack_A<MR, TIn>(A + (size_t)ic*lda + pc, lda, mc, kc, pack.a);
+
+                for(unsigned int jr=0; jr<nc; jr+=NR)
+                { // L1: one NR wide panel of B
+                    const unsigned int nr = std::min<unsigned int>(NR, nc-jr);
+                    for(unsigned int ir=0; ir<mc; ir+=MR)
+                    { // registers: one MR x NR tile of C
+                        const unsigned int mr = std::min<unsigned int>(MR, mc-ir);
+                        const float* a = pack.a + (size_t)ir*kc;
+                        const float* b = pack.b + (size_t)jr*kc;
+                        float* c = C + (size_t)(ic+ir)*ldc + jc + jr;
+                        if(mr == MR && nr == NR)
+                        {
+                            Kernel(kc, a, b, c, ldc, alpha);
+                        }
+                        else
+                        { //partial tile, compute into scratch and add the valid part
+                            alignas(MATRIX_ALIGNMENT) float tile[MR*NR] = {0};
+                            Kernel(kc, a, b, tile, NR, alpha);
+                            for(unsigned int i=0; i<mr; i++)
+                            {
+                                for(unsigned int j=0; j<nr; j++)
+                                {
+                                    c[(size_t)i*ldc + j] += tile[i*NR + j];
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+void sgemm_scalar(bool transB, unsigned int M, unsigned int N, unsigned int K,
+                  float alpha, const float* A, unsigned int lda,
+                  const float* B, unsigned int ldb,
+                  float beta, float* C, unsigned int ldc)
+{
+    gemm_driver<float, 4, 8, kernel_scalar_4x8>(transB, M, N, K, alpha, A, lda, B, ldb, beta, C, ldc);
+}
+
+void sgemm_sse(bool transB, unsigned int M, unsigned int N, unsigned int K,
+               float alpha, const float* A, unsigned int lda,
+               const float* B, unsigned int ldb,
+               float beta, float* C, unsigned int ldc)
+{
+    gemm_driver<float, 4, 8, kernel_sse_4x8>(transB, M, N, K, alpha, A, lda, B, ldb, beta, C, ldc);
+}
+
+void sgemm_avx2(bool transB, unsigned int M, unsigned int N, unsigned int K,
+                float alpha, const float* A, unsigned int lda,
+                const float* B, unsigned int ldb,
+                float beta, float* C, unsigned int ldc)
+{
+    gemm_driver<float, 6, 16, kernel_avx2_6x16>(transB, M, N, K, alpha, A, lda, B, ldb, beta, C, ldc);
+}
+
+void sgemm_avx512(bool transB, unsigned int M, unsigned int N, unsigned int K,
+                  float alpha, const float* A, unsigned int lda,
+                  const float* B, unsigned int ldb,
+                  float beta, float* C, unsigned int ldc)
+{
+    gemm_driver<float, 12, 32, kernel_avx512_12x32>(transB, M, N, K, alpha, A, lda, B, ldb, beta, C, ldc);
+}
+
+void hgemm_scalar(bool transB, unsigned int M, unsigned int N, unsigned int K,
+                  float alpha, const half* A, unsigned int lda,
+                  const half* B, unsigned int ldb,
+                  float beta, float* C, unsigned int ldc)
+{
+    gemm_driver<half, 4, 8, kernel_scalar_4x8>(transB, M, N, K, alpha, A, lda, B, ldb, beta, C, ldc);
+}
+
+void hgemm_sse(bool transB, unsigned int M, unsigned int N, unsigned int K,
+               float alpha, const half* A, unsigned int lda,
+               const half* B, unsigned int ldb,
+               float beta, float* C, unsigned int ldc)
+{
+    gemm_driver<half, 4, 8, kernel_sse_4x8>(transB, M, N, K, alpha, A, lda, B, ldb, beta, C, ldc);
+}
+
+void hgemm_avx2(bool transB, unsigned int M, unsigned int N, unsigned int K,
+                float alpha, const half* A, unsigned int lda,
+                const half* B, unsigned int ldb,
+                float beta, float* C, unsigned int ldc)
+{
+    gemm_driver<half, 6, 16, kernel_avx2_6x16>(transB, M, N, K, alpha, A, lda, B, ldb, beta, C, ldc);
+}
+
+void hgemm_avx512(bool transB, unsigned int M, unsigned int N, unsigned int K,
+                  float alpha, const half* A, unsigned int lda,
+                  const half* B, unsigned int ldb,
+                  float beta, float* C, unsigned int ldc)
+{
+    gemm_driver<half, 12, 32, kernel_avx512_12x32>(transB, M, N, K, alpha, A, lda, B, ldb, beta, C, ldc);
+}
+
+void bgemm_scalar(bool transB, unsigned int M, unsigned int N, unsigned int K,
+                  float alpha, const bfloat16* A, unsigned int lda,
+                  const bfloat16* B, unsigned int ldb,
+                  float beta, float* C, unsigned int ldc)
+{
+    gemm_driver<bfloat16, 4, 8, kernel_scalar_4x8>(transB, M, N, K, alpha, A, lda, B, ldb, beta, C, ldc);
+}
+
+void bgemm_sse(bool transB, unsigned int M, unsigned int N, unsigned int K,
+               float alpha, const bfloat16* A, unsigned int lda,
+               const bfloat16* B, unsigned int ldb,
+               float beta, float* C, unsigned int ldc)
+{
+    gemm_driver<bfloat16, 4, 8, kernel_sse_4x8>(transB, M, N, K, alpha, A, lda, B, ldb, beta, C, ldc);
+}
+
+void bgemm_avx2(bool transB, unsigned int M, unsigned int N, unsigned int K,
+                float alpha, const bfloat16* A, unsigned int lda,
+                const bfloat16* B, unsigned int ldb,
+                float beta, float* C, unsigned int ldc)
+{
+    gemm_driver<bfloat16, 6, 16, kernel_avx2_6x16>(transB, M, N, K, alpha, A, lda, B, ldb, beta, C, ldc);
+}
+
+void bgemm_avx512(bool transB, unsigned int M, unsigned int N, unsigned int K,
+                  float alpha, const bfloat16* A, unsigned int lda,
+                  const bfloat16* B, unsigned int ldb,
+                  float beta, float* C, unsigned int ldc)
+{
+    gemm_driver<bfloat16, 12, 32, kernel_avx512_12x32>(transB, M, N, K, alpha, A, lda, B, ldb, beta, C, ldc);
+}
+
+void sgemm(bool transB, unsigned int M, unsigned int N, unsigned int K,
+           float alpha, const float* A, unsigned int lda,
+           const float* B, unsigned int ldb,
+           float beta, float* C, unsigned int ldc)
+{
+    kernels().sgemm(transB, M, N, K, alpha, A, lda, B, ldb, beta, C, ldc);
+}
+
+void GEMM_matrix_multiplication(Matrix<float>& A, Matrix<float>& B, Matrix<float>& C)
+{
+    #ifdef CACHE_OPTIMIZATION
+    const bool transB = true;
+    const unsigned int N = B.getRows(); //B is stored inverted
+    const unsigned int K = B.getCols();
+    #else
+    const bool transB = false;
+    const unsigned int N = B.getCols();
+    const unsigned int K = B.getRows();
+    #endif
+    if( (A.getCols() != K) ||
+        (C.getCols() != N) ||
+        (C.getRows() != A.getRows()) )
+    {
+        std::cerr<<"Error: Matrix dimensions do not match"<<std::endl;
+        return;
+    }
+
+    sgemm(transB, A.getRows(), N, K,
+          1.0f, A.getData(), A.getStride(),
+          B.getData(), B.getStride(),
+          0.0f, C.getData(), C.getStride());
+}
+
+void hgemm(bool transB, unsigned int M, unsigned int N, unsigned int K,
+           float alpha, const half* A, unsigned int lda,
+           const half* B, unsigned int ldb,
+           float beta, float* C, unsigned int ldc)
+{
+    kernels().hgemm(transB, M, N, K, alpha, A, lda, B, ldb, beta, C, ldc);
+}
+
+void bgemm(bool transB, unsigned int M, unsigned int N, unsigned int K,
+           float alpha, const bfloat16* A, unsigned int lda,
+           const bfloat16* B, unsigned int ldb,
+           float beta, float* C, unsigned int ldc)
+{
+    kernels().bgemm(transB, M, N, K, alpha, A, lda, B, ldb, beta, C, ldc);
+}
+
+/**
+ * @brief Check the sizes and run a 16 bit GEMM on matrices, like the float
+ * GEMM_matrix_multiplication()
+ */
+template <typename T, typename Gemm>
+static void reduced_matrix_multiplication(Matrix<T>& A, Matrix<T>& B, Matrix<float>& C, Gemm gemm)
+{
+    #ifdef CACHE_OPTIMIZATION
+    const bool transB = true;
+    const unsigned int N = B.getRows(); //B is stored inverted
+    const unsigned int K = B.getCols();
+    #else
+    const bool transB = false;
+    const unsigned int N = B.getCols();
+    const unsigned int K = B.getRows();
+    #endif
+    if( (A.getCols() != K) ||
+        (C.getCols() != N) ||
+        (C.getRows() != A.getRows()) )
+    {
+        std::cerr<<"Error: Matrix dimensions do not match"<<std::endl;
+        return;
+    }
+
+    gemm(transB, A.getRows(), N, K,
+         1.0f, A.getData(), A.getStride(),
+         B.getData(), B.getStride(),
+         0.0f, C.getData(), C.getStride());
+}
+
+void GEMM_matrix_multiplication(Matrix<half>& A, Matrix<half>& B, Matrix<float>& C)
+{
+    reduced_matrix_multiplication(A, B, C, hgemm);
+}
+
+void GEMM_matrix_multiplication(Matrix<bfloat16>& A, Matrix<bfloat16>& B, Matrix<float>& C)
+{
+    reduced_matrix_multiplication(A, B, C, bgemm);
+}
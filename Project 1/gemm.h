@@ -0,0 +1,98 @@
+/**
+ * @file gemm.h
+ * @author Ethan Stockbridge (ethanstockbridge@gmail.com)
+ * @author Devan Kidd (jjkidd1245@gmail.com)
+ * @brief Cache blocked, register tiled single precision matrix multiplication
+ * @date 2022-01-25
+ */
+#ifndef GEMM_H
+#define GEMM_H
+
+#include "matrix.h"
+#include "half.h"
+
+/**
+ * @brief Depth of the packed panels. One KC x 16 panel of B (16KB) stays in L1
+ * while the micro-kernel walks down the packed block of A.
+ */
+#ifndef GEMM_KC
+#define GEMM_KC 256
+#endif
+
+/**
+ * @brief Rows of A packed at a time (multiple of every micro-kernel's rows: 4, 6
+ * and 12). One MC x KC block of A (144KB) is kept in L2 and reused for every
+ * panel of B.
+ */
+#ifndef GEMM_MC
+#define GEMM_MC 144
+#endif
+
+/**
+ * @brief Columns of B packed at a time (multiple of every micro-kernel's columns:
+ * 8, 16 and 32). One KC x NC block of B (4MB) is kept in L3 and reused for
+ * every block of A.
+ */
+#ifndef GEMM_NC
+#define GEMM_NC 4096
+#endif
+
+/**
+ * @brief General single precision matrix multiplication, C = alpha*A*B + beta*C.
+ * All matrices are row major with the given leading dimensions. Runs the
+ * fastest variant the CPU supports (see dispatch.h).
+ *
+ * @param transB If true, B is stored transposed (N x K, element B(k,j) at B[j*ldb+k])
+ * @param M Rows of A and C
+ * @param N Columns of B and C
+ * @param K Columns of A, rows of B
+ * @param alpha Scale applied to A*B
+ * @param A Input matrix A (M x K)
+ * @param lda Leading dimension of A
+ * @param B Input matrix B (K x N, or N x K if transB)
+ * @param ldb Leading dimension of B
+ * @param beta Scale applied to the existing contents of C (0 ignores C)
+ * @param C Output matrix C (M x N)
+ * @param ldc Leading dimension of C
+ */
+void sgemm(bool transB, unsigned int M, unsigned int N, unsigned int K,
+           float alpha, const float* A, unsigned int lda,
+           const float* B, unsigned int ldb,
+           float beta, float* C, unsigned int ldc);
+
+/**
+ * @brief Matrix multiplication using the cache blocked GEMM engine
+ *
+ * @param A First input matrix
+ * @param B Second input matrix (stored inverted if CACHE_OPTIMIZATION is defined)
+ * @param C Output matrix (A x B = C)
+ */
+void GEMM_matrix_multiplication(Matrix<float>& A, Matrix<float>& B, Matrix<float>& C);
+
+/**
+ * @brief Matrix multiplication of 16 bit matrices, C = alpha*A*B + beta*C, with
+ * fp32 accumulation and a float result. Same layout as sgemm(). A and B are
+ * widened to float while they are packed (F16C for half, a 16 bit shift for
+ * bfloat16), so they take half the memory and memory traffic of float inputs.
+ */
+void hgemm(bool transB, unsigned int M, unsigned int N, unsigned int K,
+           float alpha, const half* A, unsigned int lda,
+           const half* B, unsigned int ldb,
+           float beta, float* C, unsigned int ldc);
+void bgemm(bool transB, unsigned int M, unsigned int N, unsigned int K,
+           float alpha, const bfloat16* A, unsigned int lda,
+           const bfloat16* B, unsigned int ldb,
+           float beta, float* C, unsigned int ldc);
+
+/**
+ * @brief Matrix multiplication of 16 bit matrices into a float matrix using the
+ * cache blocked GEMM engine
+ *
+ * @param A First input matrix
+ * @param B Second input matrix (stored inverted if CACHE_OPTIMIZATION is defined)
+ * @param C Output matrix (A x B = C)
+ */
+void GEMM_matrix_multiplication(Matrix<half>& A, Matrix<half>& B, Matrix<float>& C);
+void GEMM_matrix_multiplication(Matrix<bfloat16>& A, Matrix<bfloat16>& B, Matrix<float>& C);
+
+#endif
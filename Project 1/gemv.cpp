@@ -0,0 +1,265 @@
+/**
+ * @file gemv.cpp
+ * @author Ethan Stockbridge (ethanstockbridge@gmail.com)
+ * @author Devan Kidd (jjkidd1245@gmail.com)
+ * @brief Single precision matrix-vector multiplication. GEMV reads every element
+ * of A once, so it is limited by memory bandwidth: the kernels stream 4 rows of A
+ * at a time to keep several loads in flight and to reuse each load of x or y.
+ * @date 2022-01-25
+ */
+
+#include <immintrin.h> // For SIMD functions
+
+#include "gemv.h"
+#include "dispatch.h"
+#include "simd_util.h"
+
+/**
+ * @brief y = beta*y, treating beta == 0 as overwrite (y may hold garbage)
+ */
+static void scale_y(unsigned int n, float beta, float* y)
+{
+    for(unsigned int i=0; i<n; i++)
+    {
+        y[i] = (beta == 0.0f) ? 0.0f : beta*y[i];
+    }
+}
+
+/**
+ * @brief GEMV in regular C++ for A stored as TIn (float, half or bfloat16)
+ */
+template <typename TIn>
+static void gemv_scalar(bool transA, unsigned int M, unsigned int N,
+                        float alpha, const TIn* A, unsigned int lda,
+                        const float* x, float beta, float* y)
+{
+    if(!transA)
+    {
+        for(unsigned int i=0; i<M; i++)
+        {
+            const TIn* a = A + (size_t)i*lda;
+            float sum = 0;
+            for(unsigned int j=0; j<N; j++)
+            {
+                sum += a[j]*x[j];
+            }
+            y[i] = alpha*sum + ((beta == 0.0f) ? 0.0f : beta*y[i]);
+        }
+        return;
+    }
+
+    scale_y(N, beta, y);
+    for(unsigned int i=0; i<M; i++)
+    {
+        const TIn* a = A + (size_t)i*lda;
+        const float xi = alpha*x[i];
+        for(unsigned int j=0; j<N; j++)
+        {
+            y[j] += xi*a[j];
+        }
+    }
+}
+
+/**
+ * @brief Load 8 elements of A as floats. 16 bit types are widened as they are
+ * loaded, so A is read from memory at half the bytes of a float matrix.
+ */
+__attribute__((target("avx2,fma,f16c")))
+static inline __m256 load8(const float* p)
+{
+    return _mm256_loadu_ps(p);
+}
+
+__attribute__((target("avx2,fma,f16c")))
+static inline __m256 load8(const half* p)
+{
+    return _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+}
+
+__attribute__((target("avx2,fma,f16c")))
+static inline __m256 load8(const bfloat16* p)
+{
+    const __m256i wide = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+    return _mm256_castsi256_ps(_mm256_slli_epi32(wide, 16));
+}
+
+/**
+ * @brief AVX2 + FMA GEMV for A stored as TIn (float, half or bfloat16)
+ */
+template <typename TIn>
+__attribute__((target("avx2,fma,f16c")))
+static void gemv_avx2(bool transA, unsigned int M, unsigned int N,
+                      float alpha, const TIn* A, unsigned int lda,
+                      const float* x, float beta, float* y)
+{
+    const unsigned int N8 = N & ~7u;
+    const unsigned int M4 = M & ~3u;
+
+    if(!transA)
+    {
+        //4 dot products at a time share every load of x
+        for(unsigned int i=0; i<M4; i+=4)
+        {
+            const TIn* a0 = A + (size_t)i*lda;
+            const TIn* a1 = a0 + lda;
+            const TIn* a2 = a1 + lda;
+            const TIn* a3 = a2 + lda;
+            __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+            __m256 s2 = _mm256_setzero_ps(), s3 = _mm256_setzero_ps();
+            for(unsigned int j=0; j<N8; j+=8)
+            {
+                const __m256 xv = _mm256_loadu_ps(x + j);
+                s0 = _mm256_fmadd_ps(load8(a0 + j), xv, s0);
+                s1 = _mm256_fmadd_ps(load8(a1 + j), xv, s1);
+                s2 = _mm256_fmadd_ps(load8(a2 + j), xv, s2);
+                s3 = _mm256_fmadd_ps(load8(a3 + j), xv, s3);
+            }
+            float sum[4] = {hsum(s0), hsum(s1), hsum(s2), hsum(s3)};
+            for(unsigned int j=N8; j<N; j++)
+            {
+                sum[0] += a0[j]*x[j];
+                sum[1] += a1[j]*x[j];
+                sum[2] += a2[j]*x[j];
+                sum[3] += a3[j]*x[j];
+            }
+            for(unsigned int r=0; r<4; r++)
+            {
+                y[i+r] = alpha*sum[r] + ((beta == 0.0f) ? 0.0f : beta*y[i+r]);
+            }
+        }
+        for(unsigned int i=M4; i<M; i++)
+        {
+            const TIn* a = A + (size_t)i*lda;
+            __m256 s = _mm256_setzero_ps();
+            for(unsigned int j=0; j<N8; j+=8)
+            {
+                s = _mm256_fmadd_ps(load8(a + j), _mm256_loadu_ps(x + j), s);
+            }
+            float sum = hsum(s);
+            for(unsigned int j=N8; j<N; j++)
+            {
+                sum += a[j]*x[j];
+            }
+            y[i] = alpha*sum + ((beta == 0.0f) ? 0.0f : beta*y[i]);
+        }
+        return;
+    }
+
+    //y += alpha*x[i]*A[i] for every row, 4 rows per pass over y
+    scale_y(N, beta, y);
+    for(unsigned int i=0; i<M4; i+=4)
+    {
+        const TIn* a0 = A + (size_t)i*lda;
+        const TIn* a1 = a0 + lda;
+        const TIn* a2 = a1 + lda;
+        const TIn* a3 = a2 + lda;
+        const float x0 = alpha*x[i], x1 = alpha*x[i+1], x2 = alpha*x[i+2], x3 = alpha*x[i+3];
+        const __m256 v0 = _mm256_set1_ps(x0), v1 = _mm256_set1_ps(x1);
+        const __m256 v2 = _mm256_set1_ps(x2), v3 = _mm256_set1_ps(x3);
+        for(unsigned int j=0; j<N8; j+=8)
+        {
+            __m256 yv = _mm256_loadu_ps(y + j);
+            yv = _mm256_fmadd_ps(v0, load8(a0 + j), yv);
+            yv = _mm256_fmadd_ps(v1, load8(a1 + j), yv);
+            yv = _mm256_fmadd_ps(v2, load8(a2 + j), yv);
+            yv = _mm256_fmadd_ps(v3, load8(a3 + j), yv);
+            _mm256_storeu_ps(y + j, yv);
+        }
+        for(unsigned int j=N8; j<N; j++)
+        {
+            y[j] += x0*a0[j] + x1*a1[j] + x2*a2[j] + x3*a3[j];
+        }
+    }
+    for(unsigned int i=M4; i<M; i++)
+    {
+        const TIn* a = A + (size_t)i*lda;
+        const float xi = alpha*x[i];
+        const __m256 v = _mm256_set1_ps(xi);
+        for(unsigned int j=0; j<N8; j+=8)
+        {
+            _mm256_storeu_ps(y + j, _mm256_fmadd_ps(v, load8(a + j), _mm256_loadu_ps(y + j)));
+        }
+        for(unsigned int j=N8; j<N; j++)
+        {
+            y[j] += xi*a[j];
+        }
+    }
+}
+
+void sgemv_scalar(bool transA, unsigned int M, unsigned int N,
+                  float alpha, const float* A, unsigned int lda,
+                  const float* x, float beta, float* y)
+{
+    gemv_scalar(transA, M, N, alpha, A, lda, x, beta, y);
+}
+
+void sgemv_avx2(bool transA, unsigned int M, unsigned int N,
+                float alpha, const float* A, unsigned int lda,
+                const float* x, float beta, float* y)
+{
+    gemv_avx2(transA, M, N, alpha, A, lda, x, beta, y);
+}
+
+void hgemv_scalar(bool transA, unsigned int M, unsigned int N,
+                  float alpha, const half* A, unsigned int lda,
+                  const float* x, float beta, float* y)
+{
+    gemv_scalar(transA, M, N, alpha, A, lda, x, beta, y);
+}
+
+void hgemv_avx2(bool transA, unsigned int M, unsigned int N,
+                float alpha, const half* A, unsigned int lda,
+                const float* x, float beta, float* y)
+{
+    gemv_avx2(transA, M, N, alpha, A, lda, x, beta, y);
+}
+
+void bgemv_scalar(bool transA, unsigned int M, unsigned int N,
+                  float alpha, const bfloat16* A, unsigned int lda,
+                  const float* x, float beta, float* y)
+{
+    gemv_scalar(transA, M, N, alpha, A, lda, x, beta, y);
+}
+
+void bgemv_avx2(bool transA, unsigned int M, unsigned int N,
+                float alpha, const bfloat16* A, unsigned int lda,
+                const float* x, float beta, float* y)
+{
+    gemv_avx2(transA, M, N, alpha, A, lda, x, beta, y);
+}
+
+void sgemv(bool transA, unsigned int M, unsigned int N,
+           float alpha, const float* A, unsigned int lda,
+           const float* x, float beta, float* y)
+{
+    kernels().sgemv(transA, M, N, alpha, A, lda, x, beta, y);
+}
+
+void GEMV_matrix_vector_multiplication(Matrix<float>& A, const float* x, float* y)
+{
+    sgemv(false, A.getRows(), A.getCols(), 1.0f, A.getData(), A.getStride(), x, 0.0f, y);
+}
+
+void hgemv(bool transA, unsigned int M, unsigned int N,
+           float alpha, const half* A, unsigned int lda,
+           const float* x, float beta, float* y)
+{
+    kernels().hgemv(transA, M, N, alpha, A, lda, x, beta, y);
+}
+
+void bgemv(bool transA, unsigned int M, unsigned int N,
+           float alpha, const bfloat16* A, unsigned int lda,
+           const float* x, float beta, float* y)
+{
+    kernels().bgemv(transA, M, N, alpha, A, lda, x, beta, y);
+}
+
+void GEMV_matrix_vector_multiplication(Matrix<half>& A, const float* x, float* y)
+{
+    hgemv(false, A.getRows(), A.getCols(), 1.0f, A.getData(), A.getStride(), x, 0.0f, y);
+}
+
+void GEMV_matrix_vector_multiplication(Matrix<bfloat16>& A, const float* x, float* y)
+{
+    bgemv(false, A.getRows(), A.getCols(), 1.0f, A.getData(), A.getStride(), x, 0.0f, y);
+}
@@ -0,0 +1,66 @@
+/**
+ * @file gemv.h
+ * @author Ethan Stockbridge (ethanstockbridge@gmail.com)
+ * @author Devan Kidd (jjkidd1245@gmail.com)
+ * @brief Single precision matrix-vector multiplication
+ * @date 2022-01-25
+ */
+#ifndef GEMV_H
+#define GEMV_H
+
+#include "matrix.h"
+#include "half.h"
+
+/**
+ * @brief General single precision matrix-vector multiplication,
+ * y = alpha*A*x + beta*y (or alpha*A^T*x + beta*y if transA). A is row major
+ * with leading dimension lda. Runs the fastest variant the CPU supports (see
+ * dispatch.h).
+ *
+ * @param transA If true, multiply by the transpose of A
+ * @param M Rows of A
+ * @param N Columns of A
+ * @param alpha Scale applied to A*x
+ * @param A Input matrix A (M x N)
+ * @param lda Leading dimension of A
+ * @param x Input vector (N values, or M if transA)
+ * @param beta Scale applied to the existing contents of y (0 ignores y)
+ * @param y Output vector (M values, or N if transA)
+ */
+void sgemv(bool transA, unsigned int M, unsigned int N,
+           float alpha, const float* A, unsigned int lda,
+           const float* x, float beta, float* y);
+
+/**
+ * @brief Matrix-vector multiplication using the SIMD GEMV kernels
+ *
+ * @param A Input matrix
+ * @param x Input vector, A.getCols() values
+ * @param y Output vector (A x x = y), A.getRows() values
+ */
+void GEMV_matrix_vector_multiplication(Matrix<float>& A, const float* x, float* y);
+
+/**
+ * @brief Matrix-vector multiplication with A stored as half or bfloat16,
+ * y = alpha*A*x + beta*y (or A transposed). x and y stay float and the sums are
+ * kept in fp32. GEMV is limited by reading A, so half as many bytes of A make it
+ * up to twice as fast.
+ */
+void hgemv(bool transA, unsigned int M, unsigned int N,
+           float alpha, const half* A, unsigned int lda,
+           const float* x, float beta, float* y);
+void bgemv(bool transA, unsigned int M, unsigned int N,
+           float alpha, const bfloat16* A, unsigned int lda,
+           const float* x, float beta, float* y);
+
+/**
+ * @brief Matrix-vector multiplication of a 16 bit matrix using the SIMD GEMV kernels
+ *
+ * @param A Input matrix
+ * @param x Input vector, A.getCols() values
+ * @param y Output vector (A x x = y), A.getRows() values
+ */
+void GEMV_matrix_vector_multiplication(Matrix<half>& A, const float* x, float* y);
+void GEMV_matrix_vector_multiplication(Matrix<bfloat16>& A, const float* x, float* y);
+
+#endif
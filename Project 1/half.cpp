@@ -0,0 +1,143 @@
+/**
+ * @file half.cpp
+ * @author Ethan Stockbridge (ethanstockbridge@gmail.com)
+ * @author Devan Kidd (jjkidd1245@gmail.com)
+ * @brief Bulk conversions between float and the 16 bit floating point types,
+ * 8 values at a time with F16C (half) or AVX2 (bfloat16)
+ * @date 2022-01-25
+ */
+
+#include <immintrin.h> // For SIMD functions
+
+#include "half.h"
+#include "dispatch.h"
+
+__attribute__((target("avx,f16c")))
+static void half_to_float_f16c(const half* src, float* dst, size_t n)
+{
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8)
+    {
+        _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i))));
+    }
+    for(; i<n; i++)
+    {
+        dst[i] = src[i];
+    }
+}
+
+__attribute__((target("avx,f16c")))
+static void float_to_half_f16c(const float* src, half* dst, size_t n)
+{
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8)
+    {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+                         _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+    }
+    for(; i<n; i++)
+    {
+        dst[i] = half(src[i]);
+    }
+}
+
+/**
+ * @brief bfloat16 to float is a zero extension and a 16 bit shift
+ */
+__attribute__((target("avx2")))
+static void bfloat16_to_float_avx2(const bfloat16* src, float* dst, size_t n)
+{
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8)
+    {
+        const __m256i wide = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)));
+        _mm256_storeu_ps(dst + i, _mm256_castsi256_ps(_mm256_slli_epi32(wide, 16)));
+    }
+    for(; i<n; i++)
+    {
+        dst[i] = src[i];
+    }
+}
+
+/**
+ * @brief Same rounding as float_to_bfloat16_bits(): add 0x7fff plus the lowest
+ * kept bit, keep the upper 16 bits, and set the quiet bit of NaNs
+ */
+__attribute__((target("avx2")))
+static void float_to_bfloat16_avx2(const float* src, bfloat16* dst, size_t n)
+{
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i round = _mm256_set1_epi32(0x7fff);
+    const __m256i absMask = _mm256_set1_epi32(0x7fffffff);
+    const __m256i infinity = _mm256_set1_epi32(0x7f800000);
+    const __m256i quiet = _mm256_set1_epi32(0x00400000);
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8)
+    {
+        const __m256i u = _mm256_castps_si256(_mm256_loadu_ps(src + i));
+        const __m256i odd = _mm256_and_si256(_mm256_srli_epi32(u, 16), one);
+        __m256i r = _mm256_srli_epi32(_mm256_add_epi32(_mm256_add_epi32(u, round), odd), 16);
+        const __m256i nan = _mm256_cmpgt_epi32(_mm256_and_si256(u, absMask), infinity);
+        const __m256i nanBits = _mm256_srli_epi32(_mm256_or_si256(u, quiet), 16);
+        r = _mm256_blendv_epi8(r, nanBits, nan);
+        //pack the 8 32 bit lanes (all < 0x10000) into 8 16 bit values
+        const __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(r, r), 0x08);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm256_castsi256_si128(packed));
+    }
+    for(; i<n; i++)
+    {
+        dst[i] = bfloat16(src[i]);
+    }
+}
+
+void to_float(const half* src, float* dst, size_t n)
+{
+    if(cpu_features().f16c)
+    {
+        half_to_float_f16c(src, dst, n);
+        return;
+    }
+    for(size_t i=0; i<n; i++)
+    {
+        dst[i] = src[i];
+    }
+}
+
+void to_float(const bfloat16* src, float* dst, size_t n)
+{
+    if(cpu_features().avx2)
+    {
+        bfloat16_to_float_avx2(src, dst, n);
+        return;
+    }
+    for(size_t i=0; i<n; i++)
+    {
+        dst[i] = src[i];
+    }
+}
+
+void from_float(const float* src, half* dst, size_t n)
+{
+    if(cpu_features().f16c)
+    {
+        float_to_half_f16c(src, dst, n);
+        return;
+    }
+    for(size_t i=0; i<n; i++)
+    {
+        dst[i] = half(src[i]);
+    }
+}
+
+void from_float(const float* src, bfloat16* dst, size_t n)
+{
+    if(cpu_features().avx2)
+    {
+        float_to_bfloat16_avx2(src, dst, n);
+        return;
+    }
+    for(size_t i=0; i<n; i++)
+    {
+        dst[i] = bfloat16(src[i]);
+    }
+}
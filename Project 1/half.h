@@ -0,0 +1,207 @@
+/**
+ * @file half.h
+ * @author Ethan Stockbridge (ethanstockbridge@gmail.com)
+ * @author Devan Kidd (jjkidd1245@gmail.com)
+ * @brief 16 bit floating point storage types: IEEE half precision and bfloat16.
+ * They halve the memory (and memory bandwidth) of a float matrix, and are
+ * widened to float for arithmetic.
+ * @date 2022-01-25
+ */
+#ifndef HALF_H
+#define HALF_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+#include "matrix.h"
+
+/**
+ * @brief Reinterpret the bits of a float
+ */
+inline uint32_t float_bits(float f)
+{
+    uint32_t u;
+    std::memcpy(&u, &f, sizeof(u));
+    return u;
+}
+
+/**
+ * @brief Build a float from its bits
+ */
+inline float bits_float(uint32_t u)
+{
+    float f;
+    std::memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+/**
+ * @brief Round a float to the nearest half (ties to even). Values past the half
+ * range (65504) become infinity, small values become subnormal or 0.
+ *
+ * @param f Value to convert
+ * @return uint16_t Bits of the half
+ */
+inline uint16_t float_to_half_bits(float f)
+{
+    uint32_t u = float_bits(f);
+    const uint32_t sign = u & 0x80000000u;
+    u ^= sign;
+    uint16_t h;
+    if(u >= (uint32_t)(127 + 16) << 23)
+    { //overflow, infinity or NaN
+        h = (u > 0x7f800000u) ? 0x7e00 : 0x7c00;
+    }
+    else if(u < (uint32_t)113 << 23)
+    { //subnormal half: let the float adder round the mantissa into place
+        const uint32_t magic = (uint32_t)((127 - 15) + (23 - 10) + 1) << 23;
+        h = (uint16_t)(float_bits(bits_float(u) + bits_float(magic)) - magic);
+    }
+    else
+    { //normal half: rebias the exponent, round to nearest even
+        const uint32_t odd = (u >> 13) & 1;
+        u += ((uint32_t)(15 - 127) << 23) + 0xfff + odd;
+        h = (uint16_t)(u >> 13);
+    }
+    return h | (uint16_t)(sign >> 16);
+}
+
+/**
+ * @brief Widen a half to a float (exact)
+ *
+ * @param h Bits of the half
+ * @return float
+ */
+inline float half_bits_to_float(uint16_t h)
+{
+    const uint32_t expMask = 0x7c00u << 13;
+    uint32_t u = (uint32_t)(h & 0x7fff) << 13;
+    const uint32_t exp = u & expMask;
+    u += (uint32_t)(127 - 15) << 23;
+    if(exp == expMask)
+    { //infinity or NaN, NaNs come out quiet like F16C
+        u += (uint32_t)(128 - 16) << 23;
+        if(u & 0x007fffffu)
+        {
+            u |= 0x00400000u;
+        }
+    }
+    else if(exp == 0)
+    { //zero or subnormal, renormalize
+        u += 1u << 23;
+        u = float_bits(bits_float(u) - bits_float((uint32_t)113 << 23));
+    }
+    return bits_float(u | ((uint32_t)(h & 0x8000) << 16));
+}
+
+/**
+ * @brief Round a float to the nearest bfloat16 (ties to even), keeping NaNs NaN
+ *
+ * @param f Value to convert
+ * @return uint16_t Bits of the bfloat16
+ */
+inline uint16_t float_to_bfloat16_bits(float f)
+{
+    const uint32_t u = float_bits(f);
+    if((u & 0x7fffffffu) > 0x7f800000u)
+    {
+        return (uint16_t)((u >> 16) | 0x40);
+    }
+    return (uint16_t)((u + 0x7fffu + ((u >> 16) & 1)) >> 16);
+}
+
+/**
+ * @brief IEEE 754 half precision: 1 sign, 5 exponent and 10 mantissa bits.
+ * About 3 decimal digits, largest value 65504.
+ */
+struct half
+{
+    uint16_t bits;
+
+    half() = default;
+    half(float f) : bits(float_to_half_bits(f)) {}
+    operator float() const { return half_bits_to_float(this->bits); }
+    half& operator+=(float f) { return *this = half(float(*this) + f); }
+};
+
+/**
+ * @brief bfloat16: the upper half of a float (1 sign, 8 exponent and 7 mantissa
+ * bits). Same range as float, about 2 decimal digits, and converts to float
+ * with a shift.
+ */
+struct bfloat16
+{
+    uint16_t bits;
+
+    bfloat16() = default;
+    bfloat16(float f) : bits(float_to_bfloat16_bits(f)) {}
+    operator float() const { return bits_float((uint32_t)this->bits << 16); }
+    bfloat16& operator+=(float f) { return *this = bfloat16(float(*this) + f); }
+};
+
+static_assert(sizeof(half) == 2 && sizeof(bfloat16) == 2, "16 bit types must be 2 bytes");
+
+/**
+ * @brief Widen n values to float. Uses F16C (half) or AVX2 (bfloat16) if the
+ * CPU supports it.
+ *
+ * @param src Values to convert
+ * @param dst Output floats
+ * @param n Number of values
+ */
+void to_float(const half* src, float* dst, size_t n);
+void to_float(const bfloat16* src, float* dst, size_t n);
+
+/**
+ * @brief Round n floats to the 16 bit type (ties to even). Uses F16C (half) or
+ * AVX2 (bfloat16) if the CPU supports it.
+ *
+ * @param src Floats to convert
+ * @param dst Output values
+ * @param n Number of values
+ */
+void from_float(const float* src, half* dst, size_t n);
+void from_float(const float* src, bfloat16* dst, size_t n);
+
+/**
+ * @brief Widen a 16 bit matrix into a float matrix of the same size
+ *
+ * @param src Matrix to convert
+ * @param dst Output matrix, src.getRows() x src.getCols()
+ */
+template <typename T>
+void to_float(const Matrix<T>& src, Matrix<float>& dst)
+{
+    if(src.getRows() != dst.getRows() || src.getCols() != dst.getCols())
+    {
+        std::cerr<<"Error: Cannot convert matrix because matrix dimensions do not match"<<std::endl;
+        return;
+    }
+    for(unsigned int i=0; i<src.getRows(); i++)
+    {
+        to_float(src[i], dst[i], src.getCols());
+    }
+}
+
+/**
+ * @brief Round a float matrix into a 16 bit matrix of the same size
+ *
+ * @param src Matrix to convert
+ * @param dst Output matrix, src.getRows() x src.getCols()
+ */
+template <typename T>
+void from_float(const Matrix<float>& src, Matrix<T>& dst)
+{
+    if(src.getRows() != dst.getRows() || src.getCols() != dst.getCols())
+    {
+        std::cerr<<"Error: Cannot convert matrix because matrix dimensions do not match"<<std::endl;
+        return;
+    }
+    for(unsigned int i=0; i<src.getRows(); i++)
+    {
+        from_float(src[i], dst[i], src.getCols());
+    }
+}
+
+#endif
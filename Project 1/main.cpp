@@ -9,10 +9,55 @@
 
 #include <iostream>
 #include <time.h>
+#include <unistd.h> // For getopt
 #include <chrono> // For timing
 #include <immintrin.h> // For SIMD functions
+#include <type_traits>
+#include <algorithm>
+#include <vector>
+#include <cmath>
+#include <string>
 
 #include "matrix.h"
+#include "gemm.h"
+#include "strassen.h"
+#include "gemv.h"
+#include "expr.h"
+#include "sparse.h"
+#include "batched.h"
+#include "matrix_file.h"
+#include "qgemm.h"
+#include "dispatch.h"
+#include "thread_pool.h"
+#include "benchmark.h"
+#include "perf_counters.h"
+#include "compare.h"
+
+/**
+ * @brief Size of the tiles of C handed out to worker threads by the parallel
+ * matrix multiplication. Rows are a multiple of GEMM_MC and columns a multiple of
+ * GEMM_NR so float tiles map onto whole blocks of the GEMM engine.
+ */
+#ifndef PARALLEL_TILE_ROWS
+#define PARALLEL_TILE_ROWS 144
+#endif
+#ifndef PARALLEL_TILE_COLS
+#define PARALLEL_TILE_COLS 256
+#endif
+
+/**
+ * @brief Number of 16x16 matrices multiplied by the batched multiplication test
+ */
+#ifndef BATCH_COUNT
+#define BATCH_COUNT 4096
+#endif
+
+/**
+ * @brief Percentage of the elements of A kept by the sparse multiplication test
+ */
+#ifndef SPARSE_PERCENT
+#define SPARSE_PERCENT 5
+#endif
 
 /**
  * @brief Matrix multiplication using regular C++ basic matrix multiplication
@@ -37,8 +82,8 @@ void matrix_multiplication(Matrix<T>& A, Matrix<T>& B, Matrix<T>& C)
         for (j = 0; j < B.getCols(); j++)
         {
             #ifdef CACHE_OPTIMIZATION
-            T* a = A[i];
-            T* b = B[j];
+            const T* a = A[i];
+            const T* b = B[j];
             for (k = 0; k < A.getCols(); k++)
             {
                 C[i][j] += a[k]*b[k];
@@ -56,12 +101,14 @@ void matrix_multiplication(Matrix<T>& A, Matrix<T>& B, Matrix<T>& C)
 
 
 /**
- * @brief Matrix multiplication using AVX instructions for floats
+ * @brief Matrix multiplication using AVX instructions for floats. Only call this
+ * if cpu_features().avx is set.
  * 
  * @param A First input matrix
  * @param B Second input matrix
  * @param C Output matrix (A x B = C)
  */
+__attribute__((target("avx")))
 void SIMD_matrix_multiplication(Matrix<float>& A, Matrix<float>& B, Matrix<float>& C)
 {
     if( (A.getCols() != B.getRows()) || 
@@ -73,14 +120,10 @@ void SIMD_matrix_multiplication(Matrix<float>& A, Matrix<float>& B, Matrix<float
     }
     
     unsigned int i,j,k;
-    float ans[8];
+    alignas(32) float ans[8];
     // __m256 num1, num2;
     __m256 num3, sum;
 
-    float** matrixA = A.getMatrix();
-    float** matrixB = B.getMatrix();
-    float** matrixC = C.getMatrix();
-
     const unsigned int size1 = A.getRows(); //= C.getRows()
     const unsigned int size2 = B.getCols(); //= C.getCols()
     const unsigned int size3 = A.getCols(); //= B.getRows()
@@ -88,20 +131,27 @@ void SIMD_matrix_multiplication(Matrix<float>& A, Matrix<float>& B, Matrix<float
     const float* arow;
     const float* bcol;
 
+    #ifndef CACHE_OPTIMIZATION
+    // aligned, zero padded buffer for gathering one column of B. Padded to the
+    // row stride of A so the k loop below never reads past the gathered values
+    Matrix<float> tmp(1, A.getStride(), false);
+    #endif
+
+    // every row is MATRIX_ALIGNMENT aligned and k steps by 8 floats, so all of the
+    // loads below can use the aligned variant
     for (i = 0; i < size1; i++)
     {
-        arow = matrixA[i];
+        arow = A[i];
         for (j = 0; j < size2; j++)
         {
             #ifdef CACHE_OPTIMIZATION
-            bcol = matrixB[j];
+            bcol = B[j];
             #else
-            float tmp[B.getCols()];
-            for(int i=0;i<B.getRows();i++)
+            for(unsigned int r=0;r<B.getRows();r++)
             {
-                tmp[i] = B[i][j];
+                tmp[0][r] = B[r][j];
             }
-            bcol = tmp;
+            bcol = tmp[0];
             #endif
 
             sum= _mm256_setzero_ps();  //sets sum to zero
@@ -113,80 +163,160 @@ void SIMD_matrix_multiplication(Matrix<float>& A, Matrix<float>& B, Matrix<float
                 // num2 = _mm256_loadu_ps(bcol+k);             // load: num2 = [b[7], b[6], b[5], b[4], b[3], b[2], b[1], b[0]]
                 // num3 = _mm256_dp_ps(num1, num2, 0xFF);      // dot prod hi,low: [a[7]b[7]+..., ..., a[3]b[3]+..., ...]
                 // Combining the above saves time vs storing into num 1,2:
-                num3 = _mm256_dp_ps(_mm256_loadu_ps(arow+k), _mm256_loadu_ps(bcol+k), 0xFF);
+                num3 = _mm256_dp_ps(_mm256_load_ps(arow+k), _mm256_load_ps(bcol+k), 0xFF);
                 sum = _mm256_add_ps(sum, num3);             // performs vertical addition with previous values
             }
-            _mm256_storeu_ps(ans, sum); //stores sum to local float
-            matrixC[i][j] = (ans[0] + ans[4]); //set matrix to lower half + upper half answer
+            _mm256_store_ps(ans, sum); //stores sum to local float
+            C[i][j] = (ans[0] + ans[4]); //set matrix to lower half + upper half answer
         }
     }
 }
 
 
 /**
- * @brief Matrix multiplication using AVX / AVX2 instructions for integers
+ * @brief Matrix multiplication using AVX / AVX2 instructions for integers. Products
+ * are accumulated in 32 bits by the quantized GEMM engine, then requantized back
+ * to short int with saturation (results that do not fit are clamped instead of
+ * wrapping around).
  * 
  * @param A First input matrix
  * @param B Second input matrix
  * @param C Output matrix (A x B = C)
+ * @param scale Requantization scale applied to the 32 bit results (default 1)
  */
-void SIMD_matrix_multiplication(Matrix<short int>& A, Matrix<short int>& B, Matrix<short int>& C)
+void SIMD_matrix_multiplication(Matrix<short int>& A, Matrix<short int>& B, Matrix<short int>& C, float scale = 1.0f)
 {
-    unsigned int i,j,k;
-    if( (A.getCols() != B.getRows()) || 
-        (C.getCols() != B.getCols()) ||
-        (C.getRows() != A.getRows()) )
+    Matrix<int> wide(C.getRows(), C.getCols(), false);
+    SIMD_matrix_multiplication(A, B, wide);
+    requantize_s32_s16(C.getRows(), C.getCols(), wide.getData(), wide.getStride(),
+                       C.getData(), C.getStride(), scale);
+}
+
+
+/**
+ * @brief Compute rows [r0, r1) and columns [c0, c1) of C = A x B using regular C++
+ * 
+ * @param A First input matrix
+ * @param B Second input matrix (stored inverted if CACHE_OPTIMIZATION is defined)
+ * @param C Output matrix
+ */
+template <typename T>
+void multiply_tile(Matrix<T>& A, Matrix<T>& B, Matrix<T>& C,
+                   unsigned int r0, unsigned int r1, unsigned int c0, unsigned int c1)
+{
+    const unsigned int size3 = A.getCols();
+    for (unsigned int i = r0; i < r1; i++)
     {
-        std::cerr<<"Error, Matrix dimensions do not match"<<std::endl;
-        return;
+        const T* a = A[i];
+        T* c = C[i];
+        #ifdef CACHE_OPTIMIZATION
+        for (unsigned int j = c0; j < c1; j++)
+        {
+            const T* b = B[j];
+            T sum = 0;
+            for (unsigned int k = 0; k < size3; k++)
+            {
+                sum += a[k]*b[k];
+            }
+            c[j] = sum;
+        }
+        #else
+        for (unsigned int j = c0; j < c1; j++)
+        {
+            c[j] = 0;
+        }
+        //i-k-j order walks rows of B instead of columns
+        for (unsigned int k = 0; k < size3; k++)
+        {
+            const T aik = a[k];
+            const T* b = B[k];
+            for (unsigned int j = c0; j < c1; j++)
+            {
+                c[j] += aik*b[j];
+            }
+        }
+        #endif
     }
+}
 
-    short int** matrixA = A.getMatrix();
-    short int** matrixB = B.getMatrix();
-    short int** matrixC = C.getMatrix();
 
-    const unsigned int size1 = A.getRows(); //= C.getRows()
-    const unsigned int size2 = B.getCols(); //= C.getCols()
-    const unsigned int size3 = A.getCols(); //= B.getRows()
+/**
+ * @brief Compute rows [r0, r1) and columns [c0, c1) of C = A x B for floats using
+ * the blocked GEMM engine
+ * 
+ * @param A First input matrix
+ * @param B Second input matrix (stored inverted if CACHE_OPTIMIZATION is defined)
+ * @param C Output matrix
+ */
+void multiply_tile(Matrix<float>& A, Matrix<float>& B, Matrix<float>& C,
+                   unsigned int r0, unsigned int r1, unsigned int c0, unsigned int c1)
+{
+    #ifdef CACHE_OPTIMIZATION
+    const bool transB = true;
+    const float* b = B[c0];
+    #else
+    const bool transB = false;
+    const float* b = B[0] + c0;
+    #endif
+    sgemm(transB, r1-r0, c1-c0, A.getCols(),
+          1.0f, A[r0], A.getStride(),
+          b, B.getStride(),
+          0.0f, C[r0] + c0, C.getStride());
+}
 
-    const short int* arow;
-    const short int* bcol;
 
-    // __m256i num1, num2, num3
-    __m256i sum;
-    short int extract[16];
+/**
+ * @brief Multithreaded matrix multiplication. C is split into
+ * PARALLEL_TILE_ROWS x PARALLEL_TILE_COLS tiles which are scheduled on the worker
+ * pool, idle workers stealing tiles from busy ones. If C was placed with
+ * NumaPolicy::FirstTouch, worker i instead computes band i of the rows (the band
+ * it wrote first), one PARALLEL_TILE_COLS wide tile at a time and without
+ * stealing, so each worker writes C and reads A from its own node.
+ * 
+ * @param A First input matrix
+ * @param B Second input matrix
+ * @param C Output matrix (A x B = C)
+ * @param pool Worker threads to run the tiles on
+ */
+template <typename T>
+void parallel_matrix_multiplication(Matrix<T>& A, Matrix<T>& B, Matrix<T>& C, ThreadPool& pool)
+{
+    if( (A.getCols() != B.getRows()) || 
+        (C.getCols() != B.getCols()) ||
+        (C.getRows() != A.getRows()) )
+    {
+        std::cerr<<"Error: Cannot perform matrix multiplication because matrix dimensions do not match"<<std::endl;
+        return;
+    }
+    const unsigned int rows = C.getRows();
+    const unsigned int cols = C.getCols();
+    const unsigned int tileRows = (rows + PARALLEL_TILE_ROWS - 1)/PARALLEL_TILE_ROWS;
+    const unsigned int tileCols = (cols + PARALLEL_TILE_COLS - 1)/PARALLEL_TILE_COLS;
 
-    for (i = 0; i < size1; i++)
+    if(C.getPolicy() == NumaPolicy::FirstTouch)
     {
-        arow = matrixA[i];
-        for (j = 0; j < size2; j++)
+        const unsigned int bands = pool.size();
+        pool.runOnEach([&](unsigned int band, unsigned int)
         {
-            #ifdef CACHE_OPTIMIZATION
-            bcol = matrixB[j];
-            #else
-            short int tmp[B.getCols()];
-            for(int i=0;i<B.getRows();i++)
-            {
-                tmp[i] = B[i][j];
-            }
-            bcol = tmp;
-            #endif
-
-            sum= _mm256_setzero_si256();  //sets sum to zero
-
-            //multiply accumulate flattened column with flattened row
-            for(k=0; k < size3; k+=16)
+            const unsigned int r0 = std::min(rows, numa_band_start(C.getPaddedRows(), band, bands));
+            const unsigned int r1 = std::min(rows, numa_band_start(C.getPaddedRows(), band + 1, bands));
+            for(unsigned int c0=0; r0<r1 && c0<cols; c0+=PARALLEL_TILE_COLS)
             {
-                sum = _mm256_add_epi16(sum, 
-                        _mm256_mullo_epi16(_mm256_loadu_si256((__m256i*)&arow[k]), 
-                                           _mm256_loadu_si256((__m256i*)&bcol[k])));
+                multiply_tile(A, B, C, r0, r1, c0, std::min(cols, c0 + PARALLEL_TILE_COLS));
             }
-            sum = _mm256_hadd_epi16(sum,sum); //consolidate sum
-            sum = _mm256_hadd_epi16(sum,sum); //consolidate sum
-            _mm256_storeu_si256((__m256i*)extract, sum); //store and add last numbers together
-            matrixC[i][j] = extract[0]+extract[1]+extract[8]+extract[9]; //save extracted sum to matrix
-        }
+        });
+        return;
     }
+
+    //tiles are numbered row by row, so each worker starts on a band of C
+    pool.run(tileRows*tileCols, [&](unsigned int tile, unsigned int)
+    {
+        const unsigned int r0 = (tile/tileCols)*PARALLEL_TILE_ROWS;
+        const unsigned int c0 = (tile%tileCols)*PARALLEL_TILE_COLS;
+        const unsigned int r1 = std::min(rows, r0 + PARALLEL_TILE_ROWS);
+        const unsigned int c1 = std::min(cols, c0 + PARALLEL_TILE_COLS);
+        multiply_tile(A, B, C, r0, r1, c0, c1);
+    });
 }
 
 
@@ -204,17 +334,134 @@ void SIMD_matrix_multiplication(Matrix<short int>& A, Matrix<short int>& B, Matr
 template <typename T>
 bool same(Matrix<T>& A, Matrix<T>& B)
 {
-    for(unsigned int i=0; i<A.getRows(); i++)
+    return compare(A, B).mismatches == 0;
+}
+
+
+/**
+ * @brief Start the hardware counters, if they are in use (-p)
+ *
+ * @param perf Counters, or nullptr
+ */
+void counters_start(PerfCounters* perf)
+{
+    if(perf != nullptr)
     {
-        for(unsigned int j=0; j<A.getCols(); j++)
-        {
-            if(T(A[i][j]) != T(B[i][j]))
-            {
-                return false;
-            }
-        }
+        perf->start();
+    }
+}
+
+/**
+ * @brief Stop the hardware counters, if they are in use
+ *
+ * @param perf Counters, or nullptr
+ * @return PerfSample Counts since counters_start(), not available if perf is nullptr
+ */
+PerfSample counters_stop(PerfCounters* perf)
+{
+    if(perf != nullptr)
+    {
+        return perf->stop();
+    }
+    return PerfSample{-1, -1, -1, -1, -1, -1, -1};
+}
+
+/**
+ * @brief Print the counts of a kernel under its timing, if the counters are in use
+ *
+ * @param perf Counters, or nullptr
+ * @param sample Counts of the kernel
+ * @param flops Floating point operations of the algorithm (0 for integer kernels)
+ */
+void counters_print(PerfCounters* perf, const PerfSample& sample, double flops)
+{
+    if(perf != nullptr)
+    {
+        print_perf_sample(std::cout, sample, flops);
+    }
+}
+
+/**
+ * @brief Print how many pages of a matrix are on each NUMA node
+ *
+ * @tparam T type of matrix
+ * @param name Name of the matrix to print
+ * @param A Matrix to check
+ */
+template <typename T>
+void print_placement(const char* name, const Matrix<T>& A)
+{
+    std::vector<size_t> pages;
+    if(!numa_pages_per_node(A.getData(), (size_t)A.getPaddedRows()*A.getStride()*sizeof(T), pages))
+    {
+        std::cout<<name<<" placement: unknown (move_pages failed)"<<std::endl;
+        return;
+    }
+    std::cout<<name<<" pages per node ("<<numa_policy_name(A.getPolicy())<<"):";
+    for(int node : numa_nodes())
+    {
+        std::cout<<" node "<<node<<": "<<pages[node];
+    }
+    std::cout<<std::endl;
+}
+
+
+/**
+ * @brief Time the GEMM and GEMV of A and B stored as a 16 bit type and compare
+ * them with the float results. rand() values are past the range of half, so A
+ * and B are scaled into [0, 1] before they are converted.
+ *
+ * @tparam T 16 bit type (half or bfloat16)
+ * @param name Name of the type to print
+ * @param A First input matrix
+ * @param B Second input matrix (stored inverted if CACHE_OPTIMIZATION is defined)
+ * @param C Float GEMM result, A x B
+ * @param x Vector the float GEMV multiplied A with
+ * @param size Size of the NxN matrices
+ * @param perf Hardware counters to read around the GEMM, or nullptr
+ */
+template <typename T>
+void test_reduced_precision(const char* name, Matrix<float>& A, Matrix<float>& B, Matrix<float>& C,
+                            const std::vector<float>& x, unsigned int size, PerfCounters* perf)
+{
+    const float scale = 1.0f/RAND_MAX;
+    Matrix<float> As = scale*A, Bs = scale*B;
+    Matrix<T> Ar(size, size, false), Br(size, size, false);
+    from_float(As, Ar);
+    from_float(Bs, Br);
+
+    Matrix<float> Cr(size, size, false);
+    counters_start(perf);
+    auto start = std::chrono::high_resolution_clock::now();
+    GEMM_matrix_multiplication(Ar, Br, Cr);
+    auto stop = std::chrono::high_resolution_clock::now();
+    PerfSample sample = counters_stop(perf);
+    std::vector<float> y(size), yr(size);
+    auto start2 = std::chrono::high_resolution_clock::now();
+    GEMV_matrix_vector_multiplication(As, x.data(), y.data());
+    auto stop2 = std::chrono::high_resolution_clock::now();
+    GEMV_matrix_vector_multiplication(Ar, x.data(), yr.data());
+    auto stop3 = std::chrono::high_resolution_clock::now();
+
+    //errors relative to the largest value of the float results
+    Matrix<float> Cs = (scale*scale)*C;
+    double errGemm = compare(Cs, Cr).relativeError;
+    double errGemv = 0, largest = 1e-30;
+    for(unsigned int i=0; i<size; i++)
+    {
+        errGemv = std::max(errGemv, std::abs(double(y[i]) - double(yr[i])));
+        largest = std::max(largest, std::abs(double(y[i])));
     }
-    return true;
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(stop - start);
+    auto duration2 = std::chrono::duration_cast<std::chrono::nanoseconds>(stop2 - start2);
+    auto duration3 = std::chrono::duration_cast<std::chrono::nanoseconds>(stop3 - stop2);
+    double gflops = (duration.count() > 0) ? 2.0*size*size*size/(duration.count()*1e3) : 0.0;
+    std::cout<<name<<" matrix multiplication: "<<duration.count()<<"us ("<<gflops<<" GFLOP/s), max error "
+             <<errGemm<<" relative; matrix-vector: "<<duration3.count()/1000.0<<"us vs float "
+             <<duration2.count()/1000.0<<"us, max error "<<errGemv/largest<<" relative; "
+             <<(size_t)Ar.getPaddedRows()*Ar.getStride()*sizeof(T)<<" bytes vs float "
+             <<(size_t)As.getPaddedRows()*As.getStride()*sizeof(float)<<" bytes"<<std::endl;
+    counters_print(perf, sample, 2.0*size*size*size);
 }
 
 
@@ -224,17 +471,30 @@ bool same(Matrix<T>& A, Matrix<T>& B)
  * 
  * @tparam MATRIX_TYPE Type of matrix to be tested (short int / float)
  * @param size Size of the NxN matrix to be tested
+ * @param maxThreads Largest thread count to run the parallel multiplication with
+ * @param pinThreads If true, pin each worker thread to its own CPU
+ * @param strassenCutoff If not 0, also run Strassen-Winograd (floats only) with this cutoff
+ * @param oocDir If not empty, also run the out-of-core multiplication (floats only)
+ * with its matrix files in this directory
+ * @param numaPolicy NUMA placement of A and C for the parallel multiplication.
+ * B, which every worker reads, is interleaved unless the policy is local.
+ * @param numaReport If true, print the pages per node of A, B and C
+ * @param perf Hardware counters to read around each kernel, or nullptr
  */
 template <typename MATRIX_TYPE>
-void test(unsigned int size)
+void test(unsigned int size, unsigned int maxThreads, bool pinThreads, unsigned int strassenCutoff,
+          const std::string& oocDir, NumaPolicy numaPolicy, bool numaReport, PerfCounters* perf)
 {   
-    Matrix<MATRIX_TYPE> A(size, size, true);
+    //operations of an N x N multiplication, left out of FLOPs/byte for integers
+    const double flops = std::is_same<MATRIX_TYPE, float>::value ? 2.0*size*size*size : 0.0;
+
+    Matrix<MATRIX_TYPE> A(size, size, true, (numaPolicy == NumaPolicy::Interleave) ? NumaPolicy::Interleave : NumaPolicy::Local);
     #ifdef VERBOSE
     std::cout<<"Matrix A:"<<std::endl;
     A.print();
     #endif
 
-    Matrix<MATRIX_TYPE> B(size, size, true);
+    Matrix<MATRIX_TYPE> B(size, size, true, (numaPolicy == NumaPolicy::Local) ? NumaPolicy::Local : NumaPolicy::Interleave);
     #ifdef VERBOSE
     std::cout<<"Matrix B:"<<std::endl;
     B.print();
@@ -246,30 +506,380 @@ void test(unsigned int size)
     #endif
 
     Matrix<MATRIX_TYPE> C(size, size, false);
+    counters_start(perf);
     auto start1 = std::chrono::high_resolution_clock::now();
     matrix_multiplication(A, B, C);
     auto stop1 = std::chrono::high_resolution_clock::now();
+    PerfSample sample1 = counters_stop(perf);
 
     #ifdef VERBOSE
     std::cout<<"Standard A x B ="<<std::endl;
     C.print();
     #endif
 
-    Matrix<MATRIX_TYPE> C2(size, size, false);
-    auto start2 = std::chrono::high_resolution_clock::now();
-    SIMD_matrix_multiplication(A, B, C2);
-    auto stop2 = std::chrono::high_resolution_clock::now();
+    auto duration1 = std::chrono::duration_cast<std::chrono::microseconds>(stop1 - start1);
+    std::cout<<"Regular c++ matrix multiplication: "<<duration1.count()<<"us"<<std::endl;
+    counters_print(perf, sample1, flops);
 
-    #ifdef VERBOSE
-    std::cout<<"SIMD A x B ="<<std::endl;
-    C2.print();
-    #endif
+    //the float SIMD kernel is written directly with AVX instructions
+    if(!std::is_same<MATRIX_TYPE, float>::value || cpu_features().avx)
+    {
+        Matrix<MATRIX_TYPE> C2(size, size, false);
+        counters_start(perf);
+        auto start2 = std::chrono::high_resolution_clock::now();
+        SIMD_matrix_multiplication(A, B, C2);
+        auto stop2 = std::chrono::high_resolution_clock::now();
+        PerfSample sample2 = counters_stop(perf);
 
-    auto duration1 = std::chrono::duration_cast<std::chrono::microseconds>(stop1 - start1);
-    auto duration2 = std::chrono::duration_cast<std::chrono::microseconds>(stop2 - start2);
+        #ifdef VERBOSE
+        std::cout<<"SIMD A x B ="<<std::endl;
+        C2.print();
+        #endif
 
-    std::cout<<"Regular c++ matrix multiplication: "<<duration1.count()<<"us"<<std::endl;
-    std::cout<<"SIMD matrix multiplication: "<<duration2.count()<<"us\n"<<std::endl;
+        auto duration2 = std::chrono::duration_cast<std::chrono::microseconds>(stop2 - start2);
+        std::cout<<"SIMD matrix multiplication: "<<duration2.count()<<"us"<<std::endl;
+        counters_print(perf, sample2, flops);
+    }
+    else
+    {
+        std::cout<<"SIMD matrix multiplication: skipped (CPU does not support AVX)"<<std::endl;
+    }
+
+    //the blocked GEMM engine is only implemented for floats
+    if constexpr (std::is_same<MATRIX_TYPE, float>::value)
+    {
+        Matrix<MATRIX_TYPE> C3(size, size, false);
+        counters_start(perf);
+        auto start3 = std::chrono::high_resolution_clock::now();
+        GEMM_matrix_multiplication(A, B, C3);
+        auto stop3 = std::chrono::high_resolution_clock::now();
+        PerfSample sample3 = counters_stop(perf);
+
+        #ifdef VERBOSE
+        std::cout<<"Blocked GEMM A x B ="<<std::endl;
+        C3.print();
+        #endif
+
+        auto duration3 = std::chrono::duration_cast<std::chrono::microseconds>(stop3 - start3);
+        // 2*N^3 floating point operations (one multiply and one add per term)
+        double gflops = (duration3.count() > 0) ? 2.0*size*size*size/(duration3.count()*1e3) : 0.0;
+        std::cout<<"Blocked GEMM matrix multiplication: "<<duration3.count()<<"us ("<<gflops<<" GFLOP/s)"<<std::endl;
+        counters_print(perf, sample3, flops);
+
+        if(strassenCutoff > 0)
+        {
+            Matrix<MATRIX_TYPE> C5(size, size, false);
+            counters_start(perf);
+            auto start5 = std::chrono::high_resolution_clock::now();
+            Strassen_matrix_multiplication(A, B, C5, strassenCutoff);
+            auto stop5 = std::chrono::high_resolution_clock::now();
+            PerfSample sample5 = counters_stop(perf);
+
+            #ifdef VERBOSE
+            std::cout<<"Strassen-Winograd A x B ="<<std::endl;
+            C5.print();
+            #endif
+
+            auto duration5 = std::chrono::duration_cast<std::chrono::microseconds>(stop5 - start5);
+            // reported against the 2*N^3 operations of the cubic algorithm
+            double gflops5 = (duration5.count() > 0) ? 2.0*size*size*size/(duration5.count()*1e3) : 0.0;
+            std::cout<<"Strassen-Winograd matrix multiplication (cutoff "<<strassenCutoff<<"): "
+                     <<duration5.count()<<"us ("<<gflops5<<" effective GFLOP/s)"<<std::endl;
+            counters_print(perf, sample5, flops);
+
+            //errors relative to the largest value of the regular c++ result, with
+            //the blocked GEMM engine's error as the baseline for float rounding
+            CompareStats errGemm = compare(C, C3);
+            CompareStats errStrassen = compare(C, C5);
+            std::cout<<"Accuracy vs regular c++: blocked GEMM max error "<<errGemm.maxAbsError<<" ("<<errGemm.relativeError
+                     <<" relative, "<<errGemm.maxUlp<<" ULP), Strassen-Winograd max error "<<errStrassen.maxAbsError<<" ("
+                     <<errStrassen.relativeError<<" relative, "<<errStrassen.maxUlp<<" ULP)"<<std::endl;
+        }
+
+        //y = A x, every element of A is read once
+        std::vector<float> x(size), y(size);
+        for(unsigned int j=0; j<size; j++)
+        {
+            x[j] = (float)rand();
+        }
+        counters_start(perf);
+        auto start6 = std::chrono::high_resolution_clock::now();
+        GEMV_matrix_vector_multiplication(A, x.data(), y.data());
+        auto stop6 = std::chrono::high_resolution_clock::now();
+        PerfSample sample6 = counters_stop(perf);
+        auto duration6 = std::chrono::duration_cast<std::chrono::nanoseconds>(stop6 - start6);
+        double gflops6 = (duration6.count() > 0) ? 2.0*size*size/duration6.count() : 0.0;
+        //error relative to the largest value of a scalar double result
+        double errGemv = 0, largestGemv = 1e-30;
+        for(unsigned int i=0; i<size; i++)
+        {
+            double ref = 0;
+            for(unsigned int j=0; j<size; j++)
+            {
+                ref += double(A[i][j])*double(x[j]);
+            }
+            errGemv = std::max(errGemv, std::abs(double(y[i]) - ref));
+            largestGemv = std::max(largestGemv, std::abs(ref));
+        }
+        std::cout<<"SIMD matrix-vector multiplication: "<<duration6.count()/1000.0<<"us ("<<gflops6<<" GFLOP/s), max error "
+                 <<errGemv/largestGemv<<" relative"<<std::endl;
+        counters_print(perf, sample6, 2.0*size*size);
+
+        //A and B stored as half and bfloat16: half the bytes, fp32 accumulation
+        test_reduced_precision<half>("Half", A, B, C3, x, size, perf);
+        test_reduced_precision<bfloat16>("Bfloat16", A, B, C3, x, size, perf);
+
+        //lazy expressions: one fused pass over A, B and E, then one sgemm() call
+        //(B is multiplied as stored, so it is B transposed with CACHE_OPTIMIZATION)
+        auto start10 = std::chrono::high_resolution_clock::now();
+        Matrix<MATRIX_TYPE> E = relu(A + B);
+        auto stop10 = std::chrono::high_resolution_clock::now();
+        E = 0.5f*A*B + 2.0f*E;
+        auto stop11 = std::chrono::high_resolution_clock::now();
+        auto duration10 = std::chrono::duration_cast<std::chrono::microseconds>(stop10 - start10);
+        auto duration11 = std::chrono::duration_cast<std::chrono::microseconds>(stop11 - stop10);
+        double gflops11 = (duration11.count() > 0) ? 2.0*size*size*size/(duration11.count()*1e3) : 0.0;
+        std::cout<<"Fused expression relu(A + B): "<<duration10.count()<<"us, alpha*A*B + beta*E: "
+                 <<duration11.count()<<"us ("<<gflops11<<" GFLOP/s)"<<std::endl;
+
+        //A with SPARSE_PERCENT% of its elements kept, multiplied dense, as CSR and as
+        //BSR (the sparse kernels take B as stored, not inverted)
+        Matrix<MATRIX_TYPE> S(size, size, false);
+        for(unsigned int i=0; i<size; i++)
+        {
+            for(unsigned int j=0; j<size; j++)
+            {
+                if(rand()%100 < SPARSE_PERCENT)
+                {
+                    S[i][j] = A[i][j];
+                }
+            }
+        }
+        #ifdef CACHE_OPTIMIZATION
+        Matrix<MATRIX_TYPE> Bn(B);
+        Bn.invert();
+        #else
+        const Matrix<MATRIX_TYPE>& Bn = B;
+        #endif
+        CsrMatrix<float> csr(S);
+        BsrMatrix<float> bsr(S);
+        Matrix<MATRIX_TYPE> CS(size, size, false), CS2(size, size, false);
+        ThreadPool sparsePool(maxThreads, pinThreads);
+        auto start12 = std::chrono::high_resolution_clock::now();
+        GEMM_matrix_multiplication(S, B, CS);
+        auto stop12 = std::chrono::high_resolution_clock::now();
+        spmm(csr, Bn, CS2);
+        auto stop13 = std::chrono::high_resolution_clock::now();
+        spmm(csr, Bn, CS2, &sparsePool);
+        auto stop14 = std::chrono::high_resolution_clock::now();
+        spmm(bsr, Bn, CS2);
+        auto stop15 = std::chrono::high_resolution_clock::now();
+        std::cout<<"Sparse ("<<SPARSE_PERCENT<<"% non-zero) multiplication: dense GEMM "
+                 <<std::chrono::duration_cast<std::chrono::microseconds>(stop12 - start12).count()<<"us, CSR "
+                 <<std::chrono::duration_cast<std::chrono::microseconds>(stop13 - stop12).count()<<"us, CSR ("<<maxThreads<<" threads) "
+                 <<std::chrono::duration_cast<std::chrono::microseconds>(stop14 - stop13).count()<<"us, BSR "
+                 <<std::chrono::duration_cast<std::chrono::microseconds>(stop15 - stop14).count()<<"us, max difference "
+                 <<compare(CS, CS2).relativeError<<" relative"<<std::endl;
+        std::cout<<"Sparse storage: dense "<<(size_t)S.getPaddedRows()*S.getStride()*sizeof(float)
+                 <<" bytes, CSR "<<csr.bytes()<<" bytes, BSR "<<bsr.bytes()<<" bytes ("<<bsr.blocks()<<" blocks)"<<std::endl;
+        auto start16 = std::chrono::high_resolution_clock::now();
+        spmv(csr, x.data(), y.data());
+        auto stop16 = std::chrono::high_resolution_clock::now();
+        auto duration16 = std::chrono::duration_cast<std::chrono::nanoseconds>(stop16 - start16);
+        std::cout<<"Sparse matrix-vector multiplication (CSR): "<<duration16.count()/1000.0<<"us"<<std::endl;
+
+        //many 16x16 multiplications, packed in one buffer vs one Matrix<float> each
+        std::vector<float> As(BATCH_COUNT*256), Bs(BATCH_COUNT*256), Cs(BATCH_COUNT*256);
+        for(size_t j=0; j<As.size(); j++)
+        {
+            As[j] = (float)rand();
+            Bs[j] = (float)rand();
+        }
+        //the same matrices as Matrix<float>, allocated and copied before timing
+        std::vector<Matrix<float>> As1, Bs1, Cs1;
+        As1.reserve(BATCH_COUNT);
+        Bs1.reserve(BATCH_COUNT);
+        Cs1.reserve(BATCH_COUNT);
+        for(unsigned int b=0; b<BATCH_COUNT; b++)
+        {
+            As1.emplace_back(16, 16, false);
+            Bs1.emplace_back(16, 16, false);
+            Cs1.emplace_back(16, 16, false);
+            for(unsigned int i=0; i<16; i++)
+            {
+                std::copy(&As[b*256 + i*16], &As[b*256 + i*16] + 16, As1[b][i]);
+                std::copy(&Bs[b*256 + i*16], &Bs[b*256 + i*16] + 16, Bs1[b][i]);
+            }
+            #ifdef CACHE_OPTIMIZATION
+            Bs1[b].invert();
+            #endif
+        }
+        auto start7 = std::chrono::high_resolution_clock::now();
+        batched_sgemm<16, 16, 16>(BATCH_COUNT, As.data(), 256, Bs.data(), 256, Cs.data(), 256);
+        auto stop7 = std::chrono::high_resolution_clock::now();
+        for(unsigned int b=0; b<BATCH_COUNT; b++)
+        {
+            GEMM_matrix_multiplication(As1[b], Bs1[b], Cs1[b]);
+        }
+        auto stop8 = std::chrono::high_resolution_clock::now();
+        //error relative to the largest value of the per-matrix GEMM results
+        double errBatched = 0;
+        for(unsigned int b=0; b<BATCH_COUNT; b++)
+        {
+            errBatched = std::max(errBatched, compare(Cs1[b][0], Cs1[b].getStride(), &Cs[b*256], 16, 16, 16, 0, 0).relativeError);
+        }
+        auto duration7 = std::chrono::duration_cast<std::chrono::microseconds>(stop7 - start7);
+        auto duration8 = std::chrono::duration_cast<std::chrono::microseconds>(stop8 - stop7);
+        double gflops7 = (duration7.count() > 0) ? 2.0*16*16*16*BATCH_COUNT/(duration7.count()*1e3) : 0.0;
+        std::cout<<"Batched 16x16 multiplication ("<<BATCH_COUNT<<" matrices): "<<duration7.count()<<"us ("<<gflops7
+                 <<" GFLOP/s), one Matrix<float> at a time: "<<duration8.count()<<"us, max error "<<errBatched<<" relative"<<std::endl;
+
+        if(!oocDir.empty())
+        {
+            //A and B go to disk, C is multiplied from the files into a file
+            #ifdef CACHE_OPTIMIZATION
+            const bool transB = true;
+            #else
+            const bool transB = false;
+            #endif
+            const std::string pathA = oocDir + "/A.mat", pathB = oocDir + "/B.mat", pathC = oocDir + "/C.mat";
+            if(save_matrix(pathA, A) && save_matrix(pathB, B))
+            {
+                auto start9 = std::chrono::high_resolution_clock::now();
+                bool done = out_of_core_multiplication(transB, pathA, pathB, pathC);
+                auto stop9 = std::chrono::high_resolution_clock::now();
+                MatrixFile fileC;
+                Matrix<MATRIX_TYPE> C9(size, size, false);
+                if(done && fileC.open(pathC, false) && load_matrix(fileC, C9))
+                {
+                    auto duration9 = std::chrono::duration_cast<std::chrono::microseconds>(stop9 - start9);
+                    double gflops9 = (duration9.count() > 0) ? 2.0*size*size*size/(duration9.count()*1e3) : 0.0;
+                    std::cout<<"Out-of-core matrix multiplication: "<<duration9.count()<<"us ("<<gflops9
+                             <<" GFLOP/s), max difference from blocked GEMM "<<compare(C3, C9).maxAbsError<<std::endl;
+                }
+            }
+        }
+    }
+
+    //the quantized engine keeps 32 bit results for integer inputs
+    if constexpr (std::is_same<MATRIX_TYPE, short int>::value)
+    {
+        Matrix<int> C3(size, size, false);
+        counters_start(perf);
+        auto start3 = std::chrono::high_resolution_clock::now();
+        SIMD_matrix_multiplication(A, B, C3);
+        auto stop3 = std::chrono::high_resolution_clock::now();
+        PerfSample sample3 = counters_stop(perf);
+
+        #ifdef VERBOSE
+        std::cout<<"SIMD A x B (32 bit results) ="<<std::endl;
+        C3.print();
+        #endif
+
+        //8 bit activations x 8 bit weights of the same size. A stays below 128 so
+        //no pair of products saturates (see qgemm.h) and the result is exact
+        Matrix<unsigned char> A8(size, size, false);
+        Matrix<signed char> B8(size, size, false);
+        for(unsigned int i=0; i<size; i++)
+        {
+            for(unsigned int j=0; j<size; j++)
+            {
+                A8[i][j] = (unsigned char)(rand()%128);
+                B8[i][j] = (signed char)(rand()%256 - 128);
+            }
+        }
+        //scalar 32 bit reference, before B is transposed
+        Matrix<int> C8ref(size, size, false);
+        for(unsigned int i=0; i<size; i++)
+        {
+            for(unsigned int k=0; k<size; k++)
+            {
+                const int aik = A8[i][k];
+                for(unsigned int j=0; j<size; j++)
+                {
+                    C8ref[i][j] += aik*B8[k][j];
+                }
+            }
+        }
+        #ifdef CACHE_OPTIMIZATION
+        B8.invert();
+        #endif
+        Matrix<int> C8(size, size, false);
+        counters_start(perf);
+        auto start8 = std::chrono::high_resolution_clock::now();
+        SIMD_matrix_multiplication(A8, B8, C8);
+        auto stop8 = std::chrono::high_resolution_clock::now();
+        PerfSample sample8 = counters_stop(perf);
+
+        auto duration3 = std::chrono::duration_cast<std::chrono::microseconds>(stop3 - start3);
+        auto duration8 = std::chrono::duration_cast<std::chrono::microseconds>(stop8 - start8);
+        double gops3 = (duration3.count() > 0) ? 2.0*size*size*size/(duration3.count()*1e3) : 0.0;
+        double gops8 = (duration8.count() > 0) ? 2.0*size*size*size/(duration8.count()*1e3) : 0.0;
+        std::cout<<"SIMD int16 x int16 -> int32 multiplication: "<<duration3.count()<<"us ("<<gops3<<" GOP/s)"<<std::endl;
+        counters_print(perf, sample3, 0);
+        std::cout<<"SIMD uint8 x int8 -> int32 multiplication: "<<duration8.count()<<"us ("<<gops8<<" GOP/s), "
+                 <<compare(C8ref, C8).mismatches<<" values differ from regular c++"<<std::endl;
+        counters_print(perf, sample8, 0);
+    }
+
+    //scale the parallel multiplication over 1, 2, 4, ... threads, then maxThreads
+    std::vector<unsigned int> threadCounts;
+    for(unsigned int threads = 1; threads < maxThreads; threads *= 2)
+    {
+        threadCounts.push_back(threads);
+    }
+    threadCounts.push_back(maxThreads);
+
+    Matrix<MATRIX_TYPE> C4(size, size, false, numaPolicy);
+    Matrix<MATRIX_TYPE> A4(0, 0, false);
+    for(unsigned int threads : threadCounts)
+    {
+        //the workers are only counted if they are created and joined while the
+        //counters run (so with first-touch, placing A and C is counted as well)
+        counters_start(perf);
+        std::chrono::microseconds duration4;
+        {
+            ThreadPool pool(threads, pinThreads);
+            if(numaPolicy == NumaPolicy::FirstTouch)
+            { //the rows of A and C are written first by the worker that uses them
+                A4 = Matrix<MATRIX_TYPE>(size, size, false, numaPolicy, &pool);
+                A4 = A;
+                C4 = Matrix<MATRIX_TYPE>(size, size, false, numaPolicy, &pool);
+            }
+            Matrix<MATRIX_TYPE>& Ause = (numaPolicy == NumaPolicy::FirstTouch) ? A4 : A;
+            auto start4 = std::chrono::high_resolution_clock::now();
+            parallel_matrix_multiplication(Ause, B, C4, pool);
+            auto stop4 = std::chrono::high_resolution_clock::now();
+            duration4 = std::chrono::duration_cast<std::chrono::microseconds>(stop4 - start4);
+        }
+        PerfSample sample4 = counters_stop(perf);
+
+        double gflops = (duration4.count() > 0) ? 2.0*size*size*size/(duration4.count()*1e3) : 0.0;
+        //floats are summed in another order than the regular c++ result, integers match exactly
+        const CompareStats err4 = compare(C, C4);
+        std::cout<<"Parallel matrix multiplication ("<<threads<<" threads): "<<duration4.count()<<"us ("<<gflops<<" GFLOP/s), ";
+        if constexpr (std::is_floating_point<MATRIX_TYPE>::value)
+        {
+            std::cout<<"max error "<<err4.relativeError<<" relative to regular c++"<<std::endl;
+        }
+        else
+        {
+            std::cout<<err4.mismatches<<" values differ from regular c++"<<std::endl;
+        }
+        counters_print(perf, sample4, flops);
+    }
+    if(numaReport)
+    {
+        print_placement("A", (numaPolicy == NumaPolicy::FirstTouch) ? A4 : A);
+        print_placement("B", B);
+        print_placement("C", C4);
+    }
+
+    #ifdef VERBOSE
+    std::cout<<"Parallel A x B ="<<std::endl;
+    C4.print();
+    #endif
+    std::cout<<std::endl;
 }
 
 
@@ -277,19 +887,109 @@ void test(unsigned int size)
  * @brief Main function to perform different type matrix testing
  * 
  * @param argc Number of input arguments
- * @param argv Arguments passed in (argv[1] = matrix size)
+ * @param argv Arguments passed in: [-t threads] [-a] [-s cutoff] [-x directory] [-g seed] [-n local|interleave|first-touch] [-p] [matrix size], or
+ * -b [-w warmup] [-r repeats] [-f table|csv|json] [-o file] [-c baseline.csv] [-s cutoff] [sizes...]
  * @return int 
  */
 int main(int argc, char* argv[])
 {
-    // Set the seed time for random
-    srand (time(NULL));
+    // Seed of the random matrices (and of rand()), the time unless -g is given
+    unsigned long seed = time(NULL);
+
+    // Parallel multiplication options
+    unsigned int maxThreads = ThreadPool::availableCPUs();
+    bool pinThreads = false;
+    unsigned int strassenCutoff = 0;
+    std::string oocDir;
+    NumaPolicy numaPolicy = NumaPolicy::Local;
+    bool numaReport = false;
+    // Read hardware performance counters around each kernel
+    bool perfReport = false;
+    // Benchmark suite options
+    bool benchmark = false;
+    BenchOptions bench;
+    bench.warmup = 1;
+    bench.repeats = 5;
+    bench.format = "table";
+    int opt;
+    while((opt = getopt(argc, argv, "t:as:x:g:n:pbw:r:f:o:c:")) != -1)
+    {
+        switch(opt)
+        {
+        case 't':
+            maxThreads = std::stoi(optarg);
+            break;
+        case 'a':
+            pinThreads = true;
+            break;
+        case 's':
+            strassenCutoff = std::stoi(optarg);
+            break;
+        case 'x':
+            oocDir = optarg;
+            break;
+        case 'g':
+            seed = std::stoul(optarg);
+            break;
+        case 'n':
+            if(!parse_numa_policy(optarg, numaPolicy))
+            {
+                std::cerr<<"Error: unknown NUMA policy "<<optarg<<" (local, interleave or first-touch)"<<std::endl;
+                return 1;
+            }
+            numaReport = true;
+            break;
+        case 'p':
+            perfReport = true;
+            break;
+        case 'b':
+            benchmark = true;
+            break;
+        case 'w':
+            bench.warmup = std::stoi(optarg);
+            break;
+        case 'r':
+            bench.repeats = std::stoi(optarg);
+            break;
+        case 'f':
+            bench.format = optarg;
+            break;
+        case 'o':
+            bench.output = optarg;
+            break;
+        case 'c':
+            bench.baseline = optarg;
+            break;
+        default:
+            std::cout<<"Usage: "<<argv[0]<<" [-t <max threads>] [-a] [-s <strassen cutoff>] [-x <directory>] [-g <seed>] [-n <numa policy>] [-p] [size]"<<std::endl;
+            std::cout<<"       "<<argv[0]<<" -b [-w <warmup runs>] [-r <timed runs>] [-f table|csv|json] [-o <file>] "
+                     <<"[-c <baseline csv>] [-s <strassen cutoff>] [sizes...]"<<std::endl;
+            return 1;
+        }
+    }
+    if(maxThreads == 0)
+    {
+        maxThreads = 1;
+    }
+    srand(seed);
+    set_fill_seed(seed);
+
+    // Benchmark suite: every remaining argument is a size to sweep
+    if(benchmark)
+    {
+        for(int i = optind; i < argc; i++)
+        {
+            bench.sizes.push_back(std::stoi(argv[i]));
+        }
+        bench.strassenCutoff = strassenCutoff;
+        return run_benchmark(bench);
+    }
 
     // Size for N x N matrix multiplication:
     unsigned int size;
-    if(argc>1)
+    if(optind<argc)
     {
-        size = std::stoi(argv[1]);
+        size = std::stoi(argv[optind]);
     }
     else
     {
@@ -297,6 +997,15 @@ int main(int argc, char* argv[])
     }
 
     std::cout<<"Using matrix size of: "<<size<<std::endl;
+    std::cout<<"Using random seed "<<seed<<std::endl;
+    std::cout<<"Using up to "<<maxThreads<<" threads"<<(pinThreads ? " (pinned to CPUs)" : "")<<std::endl;
+    if(strassenCutoff > 0)
+    {
+        std::cout<<"Using Strassen-Winograd with a cutoff of "<<strassenCutoff<<std::endl;
+    }
+    // bind the kernels before printing, so a MATRIX_KERNEL warning gets its own line
+    const KernelTable& table = kernels();
+    std::cout<<"Using "<<variant_name(table.variant)<<" GEMM kernels"<<std::endl;
 
     #ifdef CACHE_OPTIMIZATION
     std::cout<<"Cache optimization enabled"<<std::endl;
@@ -311,10 +1020,47 @@ int main(int argc, char* argv[])
     #endif
     std::cout<<std::endl;
 
+    if(numaReport)
+    {
+        //read bandwidth of every node from all of the worker threads
+        std::cout<<"Using the "<<numa_policy_name(numaPolicy)<<" NUMA policy, "<<numa_nodes().size()<<" node(s)"<<std::endl;
+        ThreadPool pool(maxThreads, pinThreads);
+        for(int node : numa_nodes())
+        {
+            double bandwidth = numa_node_bandwidth(node, pool);
+            if(bandwidth > 0)
+            {
+                std::cout<<"Node "<<node<<" read bandwidth ("<<maxThreads<<" threads): "<<bandwidth<<" GB/s"<<std::endl;
+            }
+            else
+            {
+                std::cout<<"Node "<<node<<" read bandwidth: unknown (mbind failed)"<<std::endl;
+            }
+        }
+        std::cout<<std::endl;
+    }
+
+    PerfCounters* perf = nullptr;
+    if(perfReport)
+    {
+        perf = new PerfCounters();
+        if(perf->available())
+        {
+            std::cout<<"Reading hardware performance counters around each kernel"<<std::endl<<std::endl;
+        }
+        else
+        {
+            std::cout<<"Hardware performance counters unavailable, "<<perf->error()<<std::endl<<std::endl;
+            delete perf;
+            perf = nullptr;
+        }
+    }
+
     std::cout<<"Testing float matrix-matrix multiplication:"<<std::endl;
-    test<float>(size);
+    test<float>(size, maxThreads, pinThreads, strassenCutoff, oocDir, numaPolicy, numaReport, perf);
     std::cout<<"Testing short int matrix-matrix multiplication:"<<std::endl;
-    test<short int>(size);
+    test<short int>(size, maxThreads, pinThreads, strassenCutoff, oocDir, numaPolicy, numaReport, perf);
+    delete perf;
 
     return 0;
 }
\ No newline at end of file
@@ -2,12 +2,25 @@
  * @file matrix.h
  * @author Ethan Stockbridge (ethanstockbridge@gmail.com)
  * @author Devan Kidd (jjkidd1245@gmail.com)
- * @brief Matrix class definitions 
+ * @brief Matrix class definitions
  * @date 2022-01-25
  */
 #ifndef MATRIX_H
 #define MATRIX_H
 
+#include <iostream>
+#include <cstdlib>
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <cstring>
+#include <algorithm>
+
+#include "transpose.h"
+#include "fill.h"
+#include "numa.h"
+#include "thread_pool.h"
+
 /**
  * @brief set row width to be a multiple of 16 since we are using AVX instructions,
  * these load data in chunks of 8/16
@@ -15,28 +28,127 @@
 #define ROW_WIDTH 16
 
 /**
- * @brief Matrix class 
- * 
+ * @brief Alignment (in bytes) of the matrix buffer and of every row inside of it.
+ * 64 bytes is one cache line, and is enough for aligned AVX / AVX-512 loads.
+ */
+#define MATRIX_ALIGNMENT 64
+
+/**
+ * @brief Non-owning view of a rectangular block of a matrix. Rows are stride
+ * elements apart in memory, so a view can describe a whole matrix or any
+ * sub-block of one without copying.
+ *
+ * @tparam T Type of data stored in the matrix (ex: float, int)
+ */
+template <typename T>
+struct MatrixView
+{
+    /**
+     * @brief Pointer to the first element of the view
+     */
+    T* data;
+    /**
+     * @brief The row and column values of the view
+     */
+    unsigned int rows, cols;
+    /**
+     * @brief Distance (in elements) between the start of two consecutive rows
+     */
+    unsigned int stride;
+
+    /**
+     * @brief Overloading subscript operator
+     *
+     * @param i Number indicating row desired
+     * @return T* Row "i" of the view
+     */
+    T* operator [](unsigned int i) const { return this->data + (size_t)i*this->stride; }
+
+    /**
+     * @brief Get a view of a sub-block of this view
+     *
+     * @param r First row of the sub-block
+     * @param c First column of the sub-block
+     * @param nrows Number of rows in the sub-block
+     * @param ncols Number of columns in the sub-block
+     * @return MatrixView<T>
+     */
+    MatrixView<T> block(unsigned int r, unsigned int c, unsigned int nrows, unsigned int ncols) const
+    {
+        return MatrixView<T>{(*this)[r] + c, nrows, ncols, this->stride};
+    }
+};
+
+/**
+ * @brief Base of every matrix expression (see expr.h), including Matrix itself.
+ * Operators take their operands as MatExpr<E> and build a lazy expression that
+ * is only evaluated when it is assigned to a Matrix.
+ *
+ * @tparam E The derived expression type
+ */
+template <typename E>
+struct MatExpr
+{
+    /**
+     * @brief Get the derived expression
+     *
+     * @return const E&
+     */
+    const E& self() const { return static_cast<const E&>(*this); }
+};
+
+/**
+ * @brief Matrix class
+ *
  * @tparam T Type of data stored in the matrix (ex: float, int)
  */
 template <typename T>
-class Matrix
+class Matrix : public MatExpr<Matrix<T>>
 {
 private:
 
     /**
-     * @brief The curent matrix
+     * @brief The curent matrix, stored as one contiguous MATRIX_ALIGNMENT aligned
+     * buffer of realRow rows, each realCol elements long
      */
-    T** M;
+    T* M;
     /**
      * @brief The row and column values of the stored matrix
      */
-    unsigned int row, col; 
+    unsigned int row, col;
     /**
      * @brief The real size of the col (increase width to a multiple of ROW_WIDTH
-     * to allow for intrinsics to not access uninitialized memory)
+     * to allow for intrinsics to not access uninitialized memory). realCol is also
+     * the stride between rows, and is chosen so every row starts on a
+     * MATRIX_ALIGNMENT boundary. Rows are padded to the same multiple, so the
+     * storage of a square matrix is square and can be transposed in place.
      */
     unsigned int realRow, realCol;
+    /**
+     * @brief Where the pages of the buffer are placed on NUMA machines
+     */
+    NumaPolicy policy;
+
+    /**
+     * @brief Round n up to the padded width used for the rows of this matrix type
+     *
+     * @param n Number of elements to pad
+     * @param width Multiple to pad to
+     * @return unsigned int
+     */
+    static unsigned int padTo(unsigned int n, unsigned int width)
+    {
+        return ((n + width - 1) / width) * width;
+    }
+
+    /**
+     * @brief Allocate an aligned buffer for a padded matrix
+     *
+     * @param prows Number of (padded) rows to allocate
+     * @param stride Number of (padded) columns in each row
+     * @return T*
+     */
+    static T* allocate(unsigned int prows, unsigned int stride);
 
 public:
     /**
@@ -45,52 +157,147 @@ public:
      * @param mcol The number of columns to make this matrix
      * @param randomize If true, randomize the numbers inside of the matrix.
      * Otherwise, initialize them all to 0.
+     * @param policy NUMA placement of the buffer (see numa.h)
+     * @param pool For NumaPolicy::FirstTouch, the workers that will use the rows:
+     * band i of the rows (see numa_band_start()) is written first by worker i
+     */
+    Matrix(unsigned int mrow, unsigned int mcol, bool randomize,
+           NumaPolicy policy = NumaPolicy::Local, ThreadPool* pool = nullptr);
+    /**
+     * @brief Copy a matrix, padding included. An interleaved matrix stays
+     * interleaved, other copies are placed local to the copying thread.
+     *
+     * @param other Matrix to copy
+     */
+    Matrix(const Matrix<T>& other);
+    /**
+     * @brief Take the buffer of a matrix, leaving it empty (0x0)
+     *
+     * @param other Matrix to move from
      */
-    Matrix(unsigned int mrow, unsigned int mcol, bool randomize);
+    Matrix(Matrix<T>&& other) noexcept;
+    /**
+     * @brief Construct a matrix holding the result of an expression (see expr.h)
+     *
+     * @param e Expression to evaluate
+     */
+    template <typename E>
+    Matrix(const MatExpr<E>& e);
     /**
      * @brief Destroy the Matrix object
      */
     ~Matrix();
 
+    /**
+     * @brief Copy a matrix, reusing this buffer if the padded sizes match
+     *
+     * @param other Matrix to copy
+     * @return Matrix<T>&
+     */
+    Matrix<T>& operator=(const Matrix<T>& other);
+    /**
+     * @brief Swap buffers with a matrix, its old buffer is freed with it
+     *
+     * @param other Matrix to move from
+     * @return Matrix<T>&
+     */
+    Matrix<T>& operator=(Matrix<T>&& other) noexcept;
+    /**
+     * @brief Evaluate an expression into this matrix in one pass (see expr.h).
+     * The buffer is reused if the size is unchanged, so operands may alias it.
+     *
+     * @param e Expression to evaluate
+     * @return Matrix<T>&
+     */
+    template <typename E>
+    Matrix<T>& operator=(const MatExpr<E>& e);
+
     // Accessors
     /**
      * @brief Get the matrix's number of rows
-     * 
-     * @return unsigned int 
+     *
+     * @return unsigned int
      */
     unsigned int getRows() const { return this->row; }
     /**
      * @brief Get the matrix's number of columns
-     * 
-     * @return unsigned int 
+     *
+     * @return unsigned int
      */
     unsigned int getCols() const { return this->col; }
+    /**
+     * @brief Get the number of allocated (padded) rows
+     *
+     * @return unsigned int
+     */
+    unsigned int getPaddedRows() const { return this->realRow; }
+    /**
+     * @brief Get the leading dimension, the distance in elements between two rows
+     *
+     * @return unsigned int
+     */
+    unsigned int getStride() const { return this->realCol; }
+    /**
+     * @brief Get the NUMA placement policy of the buffer
+     *
+     * @return NumaPolicy
+     */
+    NumaPolicy getPolicy() const { return this->policy; }
+
+    /**
+     * @brief Number of columns every row is padded to a multiple of. This is a
+     * multiple of ROW_WIDTH that also keeps each row MATRIX_ALIGNMENT aligned.
+     *
+     * @return unsigned int
+     */
+    static unsigned int paddingWidth()
+    {
+        unsigned int width = ROW_WIDTH;
+        while((width*sizeof(T)) % MATRIX_ALIGNMENT != 0)
+        {
+            width += ROW_WIDTH;
+        }
+        return width;
+    }
 
 
     // Modifiers
     /**
      * @brief Fill the values inside of the matrix
-     * 
-     * @param randomize If true, randomize the contents. If false, set to 0.
+     *
+     * @param randomize If true, randomize the contents with the stream of
+     * next_fill_seed() (see fill.h), values in [0, 2^31 - 1] like rand(). If
+     * false, set to 0.
+     * @param pool If not nullptr, band i of the rows (see numa_band_start()) is
+     * filled by worker i of the pool (ThreadPool::runOnEach()), for first touch placement
      */
-    void fill(bool randomize);
+    void fill(bool randomize, ThreadPool* pool = nullptr);
     /**
      * @brief Set a value of the matrix
-     * 
+     *
      * @param row The row desired to be set
      * @param col The column desired to be set
      * @param val The value to set this cell to
      */
     void set(const int row, const int col, const T val) const
     {
-        this->M[row][col] = val;
+        (*this)[row][col] = val;
     }
     /**
-     * @brief Calculate the inverted matrix and set it to our matrix
+     * @brief Calculate the inverted matrix and set it to our matrix. Square
+     * matrices (whose padded storage is square too) are transposed in place,
+     * other shapes into a new buffer.
      */
     void invert();
     /**
-     * @brief Print the matrix 
+     * @brief Write the inverted matrix into a preallocated matrix, leaving this
+     * one untouched
+     *
+     * @param dst Output matrix, must be getCols() x getRows()
+     */
+    void transposeTo(Matrix<T>& dst) const;
+    /**
+     * @brief Print the matrix
      */
     void print();
     /**
@@ -98,40 +305,98 @@ public:
      */
     void free();
     /**
-     * @brief Get the matrix
-     * 
-     * @return T** This object's matrix
+     * @brief Get the matrix's contiguous buffer
+     *
+     * @return T* Pointer to the first element of row 0
      */
-    T** getMatrix() const { return this->M; }
+    T* getData() const { return this->M; }
+    /**
+     * @brief Get a row of the matrix
+     *
+     * @param i Number indicating row desired
+     * @return T* Row "i" of the matrix, MATRIX_ALIGNMENT aligned
+     */
+    T* getRow(unsigned int i) const { return this->M + (size_t)i*this->realCol; }
+    /**
+     * @brief Get a view of the whole matrix
+     *
+     * @return MatrixView<T>
+     */
+    MatrixView<T> view() const { return MatrixView<T>{this->M, this->row, this->col, this->realCol}; }
+    /**
+     * @brief Get a view of a sub-block of the matrix
+     *
+     * @param r First row of the sub-block
+     * @param c First column of the sub-block
+     * @param nrows Number of rows in the sub-block
+     * @param ncols Number of columns in the sub-block
+     * @return MatrixView<T>
+     */
+    MatrixView<T> view(unsigned int r, unsigned int c, unsigned int nrows, unsigned int ncols) const
+    {
+        return this->view().block(r, c, nrows, ncols);
+    }
 
     // Opertors
     /**
      * @brief Overloading subscript operator
-     * 
-     * @param i Number indicating row desired 
-     * @return T*& Row "i" of the matrix
+     *
+     * @param i Number indicating row desired
+     * @return T* Row "i" of the matrix
      */
-    T* & operator [](int i) const { return this->M[i]; }
+    T* operator [](unsigned int i) const { return this->getRow(i); }
 };
- 
-// Matrix function implimentation 
+
+// Matrix function implimentation
 
 template <typename T>
-Matrix<T>::Matrix(unsigned int mrow, unsigned int mcol, bool randomize)
+Matrix<T>::Matrix(unsigned int mrow, unsigned int mcol, bool randomize, NumaPolicy policy, ThreadPool* pool)
 {
     this->row = mrow;
     this->col = mcol;
     // "real" represents the data stored, which is adjusted for intrinsic instructions
     // which require contiguous values of multiples, ROW_WIDTH.
-    this->realRow = this->row + ROW_WIDTH - this->row%ROW_WIDTH;
-    this->realCol = this->col + ROW_WIDTH - this->col%ROW_WIDTH;
-    // Initilize the matrix with specified size
-    this->M = new T*[this->realRow];
-    for(unsigned int i=0; i<this->realRow; i++)
-    {
-        this->M[i] = new T[this->realCol];
-    }
-    this->fill(randomize);
+    this->realRow = padTo(this->row, paddingWidth());
+    this->realCol = padTo(this->col, paddingWidth());
+    // Initilize the matrix with specified size as one block
+    this->M = allocate(this->realRow, this->realCol);
+    // pages are placed when they are first written, so set the policy before the fill
+    this->policy = policy;
+    numa_place(this->M, (size_t)this->realRow*this->realCol*sizeof(T), policy);
+    this->fill(randomize, policy == NumaPolicy::FirstTouch ? pool : nullptr);
+}
+
+template <typename T>
+Matrix<T>::Matrix(const Matrix<T>& other)
+{
+    this->row = other.row;
+    this->col = other.col;
+    this->realRow = other.realRow;
+    this->realCol = other.realCol;
+    this->M = allocate(this->realRow, this->realCol);
+    this->policy = (other.policy == NumaPolicy::Interleave) ? NumaPolicy::Interleave : NumaPolicy::Local;
+    numa_place(this->M, (size_t)this->realRow*this->realCol*sizeof(T), this->policy);
+    std::memcpy(this->M, other.M, (size_t)this->realRow*this->realCol*sizeof(T));
+}
+
+template <typename T>
+Matrix<T>::Matrix(Matrix<T>&& other) noexcept
+{
+    this->row = other.row;
+    this->col = other.col;
+    this->realRow = other.realRow;
+    this->realCol = other.realCol;
+    this->M = other.M;
+    this->policy = other.policy;
+    other.M = nullptr;
+    other.row = other.col = other.realRow = other.realCol = 0;
+}
+
+template <typename T>
+template <typename E>
+Matrix<T>::Matrix(const MatExpr<E>& e) : Matrix(e.self().rows(), e.self().cols(), false)
+{
+    e.self().assignTo(*this);
 }
 
 template <typename T>
@@ -140,6 +405,67 @@ Matrix<T>::~Matrix()
     this->free();
 }
 
+template <typename T>
+Matrix<T>& Matrix<T>::operator=(const Matrix<T>& other)
+{
+    if(this == &other)
+    {
+        return *this;
+    }
+    if(this->realRow != other.realRow || this->realCol != other.realCol)
+    {
+        T* buffer = allocate(other.realRow, other.realCol);
+        numa_place(buffer, (size_t)other.realRow*other.realCol*sizeof(T), this->policy);
+        this->free();
+        this->M = buffer;
+        this->realRow = other.realRow;
+        this->realCol = other.realCol;
+    }
+    this->row = other.row;
+    this->col = other.col;
+    std::memcpy(this->M, other.M, (size_t)this->realRow*this->realCol*sizeof(T));
+    return *this;
+}
+
+template <typename T>
+Matrix<T>& Matrix<T>::operator=(Matrix<T>&& other) noexcept
+{
+    std::swap(this->M, other.M);
+    std::swap(this->row, other.row);
+    std::swap(this->col, other.col);
+    std::swap(this->realRow, other.realRow);
+    std::swap(this->realCol, other.realCol);
+    std::swap(this->policy, other.policy);
+    return *this;
+}
+
+template <typename T>
+template <typename E>
+Matrix<T>& Matrix<T>::operator=(const MatExpr<E>& e)
+{
+    if(e.self().rows() != this->row || e.self().cols() != this->col)
+    {
+        //evaluate into a new matrix first, the expression may still read this one
+        *this = Matrix<T>(e);
+        return *this;
+    }
+    e.self().assignTo(*this);
+    return *this;
+}
+
+template <typename T>
+T* Matrix<T>::allocate(unsigned int prows, unsigned int stride)
+{
+    // stride*sizeof(T) is a multiple of MATRIX_ALIGNMENT, as aligned_alloc requires
+    size_t bytes = (size_t)prows*stride*sizeof(T);
+    void* buffer = std::aligned_alloc(MATRIX_ALIGNMENT, bytes > 0 ? bytes : MATRIX_ALIGNMENT);
+    if(buffer == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return static_cast<T*>(buffer);
+}
+
 template <typename T>
 void Matrix<T>::print()
 {
@@ -147,7 +473,7 @@ void Matrix<T>::print()
     {
         for(unsigned int j=0; j<this->col; j++)
         {
-            std::cout<<this->M[i][j]<<"\t";
+            std::cout<<(*this)[i][j]<<"\t";
         }
         std::cout<<std::endl;
     }
@@ -157,53 +483,87 @@ void Matrix<T>::print()
 template <typename T>
 void Matrix<T>::free()
 {
-    for(unsigned int i=0;i<this->realRow;i++)
-    {
-        delete[] this->M[i];
-    }
-    delete[] this->M;
+    std::free(this->M);
+    this->M = nullptr;
 }
 
 template <typename T>
 void Matrix<T>::invert()
 {
-    //create a new matrix to store inverted B in
-    T** tmp = new T*[this->realCol];
-    for (unsigned int i=0;i<this->realCol;i++)
+    const unsigned int invRow = padTo(this->col, paddingWidth());
+    const unsigned int invCol = padTo(this->row, paddingWidth());
+    if(this->realRow == this->realCol && invRow == this->realRow && invCol == this->realCol)
     {
-        tmp[i] = new T[realRow];
+        //the padded storage is square and keeps its shape, so swap in place
+        //(padding zeros are swapped with padding zeros)
+        transpose_inplace(this->M, this->realCol, this->realRow);
+        std::swap(this->row, this->col);
+        return;
     }
-    //invert values of matrix
-    for (unsigned int i=0;i<this->realRow;i++)
+    //create a new buffer to store inverted matrix in
+    T* tmp = allocate(invRow, invCol);
+    //invert the padded rows of the matrix (padding zeros stay zeros), then zero
+    //the columns the new stride adds
+    transpose(this->M, this->realCol, tmp, invCol, this->realRow, invRow);
+    if(invCol > this->realRow)
     {
-        for(unsigned int j=0;j<this->realCol;j++)
+        for(unsigned int i=0; i<invRow; i++)
         {
-            tmp[j][i] = M[i][j];
+            std::memset(tmp + (size_t)i*invCol + this->realRow, 0, (invCol - this->realRow)*sizeof(T));
         }
     }
     //delete old matrix
     this->free();
     //set new to inverted
-    M = tmp;
+    this->M = tmp;
+    std::swap(this->row, this->col);
+    this->realRow = invRow;
+    this->realCol = invCol;
+}
+
+template <typename T>
+void Matrix<T>::transposeTo(Matrix<T>& dst) const
+{
+    if(dst.row != this->col || dst.col != this->row)
+    {
+        std::cout<<"Error: cannot invert a "<<this->row<<"x"<<this->col<<" matrix into a "
+                 <<dst.row<<"x"<<dst.col<<" matrix"<<std::endl;
+        return;
+    }
+    //dst padding is already zero, only the stored values need to move
+    transpose(this->M, this->realCol, dst.M, dst.realCol, this->row, this->col);
 }
 
 template <typename T>
-void Matrix<T>::fill(bool randomize)
+void Matrix<T>::fill(bool randomize, ThreadPool* pool)
 {
-    for(unsigned int i=0; i < this->realRow; i++)
+    //every value only depends on the seed and its position, so the rows can be
+    //filled in any order by any number of threads
+    const uint64_t seed = randomize ? next_fill_seed() : 0;
+    const size_t rowBytes = (size_t)this->realCol*sizeof(T);
+    const size_t bytes = rowBytes*this->realRow;
+    const bool stream = bytes >= FILL_PARALLEL_MIN;
+    const unsigned int rowsPerTask = (unsigned int)std::max<size_t>(1, FILL_TASK_BYTES / std::max<size_t>(rowBytes, 1));
+    const unsigned int tasks = pool ? pool->size() : (this->realRow + rowsPerTask - 1) / rowsPerTask;
+    parallel_fill(tasks, bytes, [&](unsigned int task)
     {
-        for(unsigned int j=0; j< this->realCol; j++)
+        const unsigned int begin = pool ? numa_band_start(this->realRow, task, tasks) : task*rowsPerTask;
+        const unsigned int end = pool ? numa_band_start(this->realRow, task + 1, tasks)
+                                      : std::min(this->realRow, (task + 1)*rowsPerTask);
+        for(unsigned int i=begin; i<end; i++)
         {
-            if(randomize && (j < this->col && i < this->row))
-            { //fill desired space with random numbers
-                this->M[i][j] = (T)(rand());
+            T* r = (*this)[i];
+            if(randomize && i < this->row)
+            { //fill desired space with random numbers, the padding with zeros
+                random_fill(r, this->col, seed, i, stream);
+                std::memset(r + this->col, 0, (this->realCol - this->col)*sizeof(T));
             }
             else
             { //fill other space with zeros
-                this->M[i][j] = 0;
+                zero_fill(r, rowBytes, stream);
             }
         }
-    }
+    }, pool);
 }
 
-#endif
\ No newline at end of file
+#endif
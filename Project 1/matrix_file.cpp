@@ -0,0 +1,284 @@
+/**
+ * @file matrix_file.cpp
+ * @author Ethan Stockbridge (ethanstockbridge@gmail.com)
+ * @author Devan Kidd (jjkidd1245@gmail.com)
+ * @brief Binary on-disk matrix format, memory mapped loading and an out-of-core
+ * multiplication for matrices larger than memory
+ * @date 2022-01-25
+ */
+
+#include <iostream>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "matrix_file.h"
+#include "gemm.h"
+
+static const char MATRIX_FILE_MAGIC[8] = {'S', 'I', 'M', 'D', 'M', 'A', 'T', '\0'};
+
+MatrixFile::MatrixFile()
+{
+    this->fd = -1;
+    this->map = nullptr;
+    this->mapLength = 0;
+    std::memset(&this->head, 0, sizeof(this->head));
+}
+
+MatrixFile::~MatrixFile()
+{
+    this->close();
+}
+
+void MatrixFile::close()
+{
+    if(this->map != nullptr)
+    {
+        munmap(this->map, this->mapLength);
+        this->map = nullptr;
+        this->mapLength = 0;
+    }
+    if(this->fd >= 0)
+    {
+        ::close(this->fd);
+        this->fd = -1;
+    }
+}
+
+bool MatrixFile::open(const std::string& path, bool writable)
+{
+    this->close();
+    this->fd = ::open(path.c_str(), writable ? O_RDWR : O_RDONLY);
+    if(this->fd < 0)
+    {
+        std::cerr<<"Error: cannot open matrix file "<<path<<std::endl;
+        return false;
+    }
+    struct stat st;
+    if(fstat(this->fd, &st) != 0 || (size_t)st.st_size < sizeof(MatrixFileHeader) ||
+       pread(this->fd, &this->head, sizeof(this->head), 0) != (ssize_t)sizeof(this->head))
+    {
+        std::cerr<<"Error: cannot read the header of matrix file "<<path<<std::endl;
+        this->close();
+        return false;
+    }
+
+    const MatrixFileHeader& h = this->head;
+    const size_t needed = h.dataOffset + (size_t)h.rows*h.stride*h.elementSize;
+    if(std::memcmp(h.magic, MATRIX_FILE_MAGIC, sizeof(h.magic)) != 0 || h.version != MATRIX_FILE_VERSION ||
+       h.elementSize == 0 || h.stride < h.cols || h.dataOffset < sizeof(MatrixFileHeader) ||
+       (size_t)st.st_size < needed)
+    {
+        std::cerr<<"Error: "<<path<<" is not a valid matrix file"<<std::endl;
+        this->close();
+        return false;
+    }
+
+    this->mapLength = needed;
+    this->map = mmap(nullptr, this->mapLength, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, this->fd, 0);
+    if(this->map == MAP_FAILED)
+    {
+        this->map = nullptr;
+        std::cerr<<"Error: cannot map matrix file "<<path<<std::endl;
+        this->close();
+        return false;
+    }
+    return true;
+}
+
+bool MatrixFile::create(const std::string& path, MatrixFileType type, unsigned int elementSize,
+                        unsigned int rows, unsigned int cols, unsigned int stride)
+{
+    this->close();
+    MatrixFileHeader& h = this->head;
+    std::memset(&h, 0, sizeof(h));
+    std::memcpy(h.magic, MATRIX_FILE_MAGIC, sizeof(h.magic));
+    h.version = MATRIX_FILE_VERSION;
+    h.type = (uint32_t)type;
+    h.elementSize = elementSize;
+    h.rows = rows;
+    h.cols = cols;
+    h.stride = stride;
+    //largest power of two (up to a page) that divides every row start
+    h.alignment = 1;
+    while(h.alignment < MATRIX_FILE_DATA_OFFSET && ((size_t)stride*elementSize) % (h.alignment*2) == 0)
+    {
+        h.alignment *= 2;
+    }
+    h.dataOffset = MATRIX_FILE_DATA_OFFSET;
+
+    this->fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(this->fd < 0)
+    {
+        std::cerr<<"Error: cannot create matrix file "<<path<<std::endl;
+        return false;
+    }
+    //the file starts out sparse, so untouched parts read as zeros without using disk
+    this->mapLength = h.dataOffset + (size_t)rows*stride*elementSize;
+    if(ftruncate(this->fd, this->mapLength) != 0 ||
+       pwrite(this->fd, &h, sizeof(h), 0) != (ssize_t)sizeof(h))
+    {
+        std::cerr<<"Error: cannot write matrix file "<<path<<std::endl;
+        this->close();
+        return false;
+    }
+    this->map = mmap(nullptr, this->mapLength, PROT_READ | PROT_WRITE, MAP_SHARED, this->fd, 0);
+    if(this->map == MAP_FAILED)
+    {
+        this->map = nullptr;
+        std::cerr<<"Error: cannot map matrix file "<<path<<std::endl;
+        this->close();
+        return false;
+    }
+    return true;
+}
+
+void MatrixFile::advise(unsigned int r0, unsigned int nrows, unsigned int c0, unsigned int ncols, int advice) const
+{
+    if(this->map == nullptr || nrows == 0 || ncols == 0)
+    {
+        return;
+    }
+    const size_t page = sysconf(_SC_PAGESIZE);
+    const size_t rowBytes = (size_t)this->head.stride*this->head.elementSize;
+    char* base = static_cast<char*>(this->data());
+
+    //madvise works on whole pages: widen each range out to page boundaries for
+    //read ahead, and shrink it in to them when dropping, so pages shared with a
+    //neighbouring tile are never dropped
+    auto apply = [&](size_t begin, size_t end)
+    {
+        size_t first = (size_t)(base + begin) & ~(page - 1);
+        size_t last = (size_t)(base + end);
+        if(advice == MADV_DONTNEED)
+        {
+            first = ((size_t)(base + begin) + page - 1) & ~(page - 1);
+            last &= ~(page - 1);
+        }
+        if(last > first)
+        {
+            madvise((void*)first, last - first, advice);
+        }
+    };
+
+    if((size_t)ncols*this->head.elementSize*2 >= rowBytes)
+    {
+        //the block covers most of each row: one range over all of its rows
+        apply((size_t)r0*rowBytes + (size_t)c0*this->head.elementSize,
+              (size_t)(r0 + nrows - 1)*rowBytes + (size_t)(c0 + ncols)*this->head.elementSize);
+    }
+    else
+    {
+        for(unsigned int i=r0; i<r0+nrows; i++)
+        {
+            apply((size_t)i*rowBytes + (size_t)c0*this->head.elementSize,
+                  (size_t)i*rowBytes + (size_t)(c0 + ncols)*this->head.elementSize);
+        }
+    }
+}
+
+bool out_of_core_multiplication(bool transB, const std::string& pathA, const std::string& pathB,
+                                const std::string& pathC, unsigned int tile)
+{
+    MatrixFile A, B;
+    if(!A.open(pathA, false) || !B.open(pathB, false))
+    {
+        return false;
+    }
+    const MatrixFileHeader& ha = A.header();
+    const MatrixFileHeader& hb = B.header();
+    if(ha.type != (uint32_t)MatrixFileType::Float32 || hb.type != (uint32_t)MatrixFileType::Float32)
+    {
+        std::cerr<<"Error: the out-of-core multiplication only supports float matrix files"<<std::endl;
+        return false;
+    }
+    const unsigned int M = ha.rows;
+    const unsigned int K = ha.cols;
+    const unsigned int N = transB ? hb.rows : hb.cols;
+    if((transB ? hb.cols : hb.rows) != K)
+    {
+        std::cerr<<"Error: Cannot perform matrix multiplication because matrix dimensions do not match"<<std::endl;
+        return false;
+    }
+    if(tile == 0)
+    {
+        tile = OOC_TILE;
+    }
+
+    MatrixFile C;
+    if(!C.create(pathC, MatrixFileType::Float32, sizeof(float), M, N,
+                 ((N + Matrix<float>::paddingWidth() - 1)/Matrix<float>::paddingWidth())*Matrix<float>::paddingWidth()))
+    {
+        return false;
+    }
+
+    const float* a = static_cast<const float*>(A.data());
+    const float* b = static_cast<const float*>(B.data());
+    float* c = static_cast<float*>(C.data());
+    const unsigned int lda = ha.stride, ldb = hb.stride, ldc = C.header().stride;
+
+    //tile (k, j) of B, in the rows / columns it covers in B's file
+    auto adviseB = [&](unsigned int k0, unsigned int kn, unsigned int j0, unsigned int jn, int advice)
+    {
+        if(transB)
+        {
+            B.advise(j0, jn, k0, kn, advice);
+        }
+        else
+        {
+            B.advise(k0, kn, j0, jn, advice);
+        }
+    };
+
+    //every (i, j, k) step in the order they run, so the next one can be read ahead
+    const unsigned int tilesM = (M + tile - 1)/tile;
+    const unsigned int tilesN = (N + tile - 1)/tile;
+    const unsigned int tilesK = (K + tile - 1)/tile;
+    const size_t steps = (size_t)tilesM*tilesN*tilesK;
+    auto bounds = [&](size_t step, unsigned int& i0, unsigned int& j0, unsigned int& k0)
+    {
+        k0 = (unsigned int)(step % tilesK)*tile;
+        j0 = (unsigned int)((step/tilesK) % tilesN)*tile;
+        i0 = (unsigned int)(step/((size_t)tilesK*tilesN))*tile;
+    };
+
+    if(steps > 0)
+    {
+        unsigned int i0, j0, k0;
+        bounds(0, i0, j0, k0);
+        A.advise(i0, std::min(tile, M - i0), k0, std::min(tile, K - k0), MADV_WILLNEED);
+        adviseB(k0, std::min(tile, K - k0), j0, std::min(tile, N - j0), MADV_WILLNEED);
+    }
+    for(size_t step = 0; step < steps; step++)
+    {
+        unsigned int i0, j0, k0;
+        bounds(step, i0, j0, k0);
+        const unsigned int mi = std::min(tile, M - i0);
+        const unsigned int nj = std::min(tile, N - j0);
+        const unsigned int kk = std::min(tile, K - k0);
+
+        //start reading the next tiles from disk while this one is multiplied
+        if(step + 1 < steps)
+        {
+            unsigned int i1, j1, k1;
+            bounds(step + 1, i1, j1, k1);
+            A.advise(i1, std::min(tile, M - i1), k1, std::min(tile, K - k1), MADV_WILLNEED);
+            adviseB(k1, std::min(tile, K - k1), j1, std::min(tile, N - j1), MADV_WILLNEED);
+        }
+
+        const float* bt = transB ? b + (size_t)j0*ldb + k0 : b + (size_t)k0*ldb + j0;
+        sgemm(transB, mi, nj, kk, 1.0f, a + (size_t)i0*lda + k0, lda, bt, ldb,
+              (k0 == 0) ? 0.0f : 1.0f, c + (size_t)i0*ldc + j0, ldc);
+
+        A.advise(i0, mi, k0, kk, MADV_DONTNEED);
+        adviseB(k0, kk, j0, nj, MADV_DONTNEED);
+        if(k0 + kk == K)
+        {
+            //tile of C complete: let the kernel write it back and drop it
+            C.advise(i0, mi, j0, nj, MADV_DONTNEED);
+        }
+    }
+    return true;
+}
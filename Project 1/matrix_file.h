@@ -0,0 +1,230 @@
+/**
+ * @file matrix_file.h
+ * @author Ethan Stockbridge (ethanstockbridge@gmail.com)
+ * @author Devan Kidd (jjkidd1245@gmail.com)
+ * @brief Binary on-disk matrix format, memory mapped loading and an out-of-core
+ * multiplication for matrices larger than memory
+ * @date 2022-01-25
+ */
+#ifndef MATRIX_FILE_H
+#define MATRIX_FILE_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "matrix.h"
+
+/**
+ * @brief Byte offset of row 0 in a matrix file. One page, so the data (and every
+ * row, see the header's alignment) is aligned in the mapping.
+ */
+#define MATRIX_FILE_DATA_OFFSET 4096
+
+/**
+ * @brief Version of the file format written by this code
+ */
+#define MATRIX_FILE_VERSION 1
+
+/**
+ * @brief Side of the square tiles the out-of-core multiplication streams from
+ * disk (16MB of floats). One tile each of A, B and C is being used while the
+ * next tiles of A and B are read ahead.
+ */
+#ifndef OOC_TILE
+#define OOC_TILE 2048
+#endif
+
+/**
+ * @brief Element types that can be stored in a matrix file
+ */
+enum class MatrixFileType : uint32_t
+{
+    Float32 = 1,
+    Int16 = 2,
+    Int32 = 3,
+    UInt8 = 4,
+    Int8 = 5
+};
+
+/**
+ * @brief Map a C++ element type to its MatrixFileType
+ */
+template <typename T> struct MatrixFileTypeOf;
+template <> struct MatrixFileTypeOf<float> { static const MatrixFileType value = MatrixFileType::Float32; };
+template <> struct MatrixFileTypeOf<short int> { static const MatrixFileType value = MatrixFileType::Int16; };
+template <> struct MatrixFileTypeOf<int> { static const MatrixFileType value = MatrixFileType::Int32; };
+template <> struct MatrixFileTypeOf<unsigned char> { static const MatrixFileType value = MatrixFileType::UInt8; };
+template <> struct MatrixFileTypeOf<signed char> { static const MatrixFileType value = MatrixFileType::Int8; };
+
+/**
+ * @brief Header at the start of a matrix file (64 bytes, little endian). Row i
+ * starts at dataOffset + i*stride*elementSize.
+ */
+struct MatrixFileHeader
+{
+    char magic[8];          // "SIMDMAT" followed by a 0
+    uint32_t version;       // MATRIX_FILE_VERSION
+    uint32_t type;          // MatrixFileType
+    uint32_t elementSize;   // bytes per element
+    uint32_t rows, cols;
+    uint32_t stride;        // elements between the start of two rows
+    uint32_t alignment;     // bytes every row start is aligned to
+    uint32_t reserved0;
+    uint64_t dataOffset;    // bytes from the start of the file to row 0
+    uint8_t reserved[16];
+};
+static_assert(sizeof(MatrixFileHeader) == 64, "the matrix file header must be 64 bytes");
+
+/**
+ * @brief A memory mapped matrix file. The data is read straight from the page
+ * cache, only the pages that are touched are loaded, and pages can be read
+ * ahead or dropped tile by tile with advise().
+ */
+class MatrixFile
+{
+private:
+    int fd;
+    void* map;
+    size_t mapLength;
+    MatrixFileHeader head;
+
+public:
+    /**
+     * @brief Construct a closed file
+     */
+    MatrixFile();
+    /**
+     * @brief Unmap and close the file
+     */
+    ~MatrixFile();
+    MatrixFile(const MatrixFile&) = delete;
+    MatrixFile& operator=(const MatrixFile&) = delete;
+
+    /**
+     * @brief Map an existing matrix file and check its header
+     *
+     * @param path File to open
+     * @param writable If true, map it so changes are written back to the file
+     * @return true The file was opened
+     */
+    bool open(const std::string& path, bool writable);
+    /**
+     * @brief Create (or replace) a matrix file of zeros and map it for writing
+     *
+     * @param path File to create
+     * @param type Element type
+     * @param elementSize Bytes per element
+     * @param rows Number of rows
+     * @param cols Number of columns
+     * @param stride Elements between the start of two rows (at least cols)
+     * @return true The file was created
+     */
+    bool create(const std::string& path, MatrixFileType type, unsigned int elementSize,
+                unsigned int rows, unsigned int cols, unsigned int stride);
+    /**
+     * @brief Unmap and close the file, if open
+     */
+    void close();
+
+    /**
+     * @brief Check whether a file is mapped
+     *
+     * @return true
+     */
+    bool isOpen() const { return this->map != nullptr; }
+    /**
+     * @brief Get the header of the mapped file
+     *
+     * @return const MatrixFileHeader&
+     */
+    const MatrixFileHeader& header() const { return this->head; }
+    /**
+     * @brief Get the first element of row 0
+     *
+     * @return void*
+     */
+    void* data() const { return static_cast<char*>(this->map) + this->head.dataOffset; }
+
+    /**
+     * @brief Pass madvise() advice for the pages holding a block of the matrix:
+     * MADV_WILLNEED to start reading it ahead, MADV_DONTNEED to drop it from this
+     * process once it has been used (file pages stay in the page cache)
+     *
+     * @param r0 First row of the block
+     * @param nrows Number of rows in the block
+     * @param c0 First column of the block
+     * @param ncols Number of columns in the block
+     * @param advice MADV_WILLNEED or MADV_DONTNEED
+     */
+    void advise(unsigned int r0, unsigned int nrows, unsigned int c0, unsigned int ncols, int advice) const;
+};
+
+/**
+ * @brief Write a matrix to a file (padding columns included, padding rows not)
+ *
+ * @param path File to write
+ * @param A Matrix to store
+ * @return true The file was written
+ */
+template <typename T>
+bool save_matrix(const std::string& path, Matrix<T>& A)
+{
+    MatrixFile file;
+    if(!file.create(path, MatrixFileTypeOf<T>::value, sizeof(T), A.getRows(), A.getCols(), A.getStride()))
+    {
+        return false;
+    }
+    std::memcpy(file.data(), A.getData(), (size_t)A.getRows()*A.getStride()*sizeof(T));
+    return true;
+}
+
+/**
+ * @brief Copy the contents of a mapped matrix file into a matrix of the same size
+ * and type. Construct the matrix with file.header().rows and cols.
+ *
+ * @param file Open matrix file
+ * @param A Matrix to fill
+ * @return true The file was loaded
+ */
+template <typename T>
+bool load_matrix(const MatrixFile& file, Matrix<T>& A)
+{
+    const MatrixFileHeader& h = file.header();
+    if(h.type != (uint32_t)MatrixFileTypeOf<T>::value || h.elementSize != sizeof(T))
+    {
+        std::cerr<<"Error: matrix file holds a different element type"<<std::endl;
+        return false;
+    }
+    if(h.rows != A.getRows() || h.cols != A.getCols())
+    {
+        std::cerr<<"Error: cannot load a "<<h.rows<<"x"<<h.cols<<" matrix file into a "
+                 <<A.getRows()<<"x"<<A.getCols()<<" matrix"<<std::endl;
+        return false;
+    }
+    const T* src = static_cast<const T*>(file.data());
+    for(unsigned int i=0; i<h.rows; i++)
+    {
+        std::memcpy(A[i], src + (size_t)i*h.stride, (size_t)h.cols*sizeof(T));
+    }
+    return true;
+}
+
+/**
+ * @brief Out-of-core matrix multiplication of float matrix files, C = A*B. C is
+ * computed one OOC_TILE x OOC_TILE tile at a time from tiles of A and B mapped
+ * from disk. The next tiles are read ahead (MADV_WILLNEED) while the current ones
+ * are multiplied, and tiles are dropped (MADV_DONTNEED) once used, so the memory
+ * in use stays a few tiles no matter how large the matrices are.
+ *
+ * @param transB If true, B is stored transposed (N x K)
+ * @param pathA File holding A (M x K)
+ * @param pathB File holding B (K x N, or N x K if transB)
+ * @param pathC File to write C (M x N) to, created or replaced
+ * @param tile Side of the tiles
+ * @return true The product was written
+ */
+bool out_of_core_multiplication(bool transB, const std::string& pathA, const std::string& pathB,
+                                const std::string& pathC, unsigned int tile = OOC_TILE);
+
+#endif
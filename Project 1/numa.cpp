@@ -0,0 +1,255 @@
+/**
+ * @file numa.cpp
+ * @author Ethan Stockbridge (ethanstockbridge@gmail.com)
+ * @author Devan Kidd (jjkidd1245@gmail.com)
+ * @brief NUMA placement with the mbind, move_pages and getcpu system calls
+ * @date 2022-01-25
+ */
+
+#include <immintrin.h> // For SIMD functions
+#include <linux/mempolicy.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include "numa.h"
+#include "thread_pool.h"
+
+/**
+ * @brief Largest node id a node mask can hold
+ */
+#define NUMA_MAX_NODES 1024
+
+/**
+ * @brief Pages queried per move_pages call
+ */
+#define NUMA_QUERY_PAGES 4096
+
+const char* numa_policy_name(NumaPolicy policy)
+{
+    switch(policy)
+    {
+    case NumaPolicy::Local:
+        return "local";
+    case NumaPolicy::Interleave:
+        return "interleave";
+    case NumaPolicy::FirstTouch:
+        return "first-touch";
+    }
+    return "unknown";
+}
+
+bool parse_numa_policy(const std::string& name, NumaPolicy& policy)
+{
+    for(NumaPolicy p : {NumaPolicy::Local, NumaPolicy::Interleave, NumaPolicy::FirstTouch})
+    {
+        if(name == numa_policy_name(p))
+        {
+            policy = p;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Parse a kernel list such as "0-1,4" into ids
+ */
+static std::vector<int> parse_list(const std::string& text)
+{
+    std::vector<int> ids;
+    size_t pos = 0;
+    while(pos < text.size())
+    {
+        size_t end = text.find(',', pos);
+        if(end == std::string::npos)
+        {
+            end = text.size();
+        }
+        const std::string range = text.substr(pos, end - pos);
+        const size_t dash = range.find('-');
+        try
+        {
+            const int first = std::stoi(range.substr(0, dash));
+            const int last = (dash == std::string::npos) ? first : std::stoi(range.substr(dash + 1));
+            for(int id=first; id<=last; id++)
+            {
+                ids.push_back(id);
+            }
+        }
+        catch(const std::exception&)
+        { //not a number, skip it
+        }
+        pos = end + 1;
+    }
+    return ids;
+}
+
+const std::vector<int>& numa_nodes()
+{
+    static const std::vector<int> nodes = []()
+    {
+        std::ifstream file("/sys/devices/system/node/has_memory");
+        std::string text;
+        std::vector<int> ids;
+        if(file >> text)
+        {
+            ids = parse_list(text);
+        }
+        if(ids.empty())
+        {
+            ids.push_back(0);
+        }
+        return ids;
+    }();
+    return nodes;
+}
+
+/**
+ * @brief Node mask with the given nodes set
+ */
+struct NodeMask
+{
+    unsigned long bits[NUMA_MAX_NODES / (8*sizeof(unsigned long))];
+
+    NodeMask() { std::memset(this->bits, 0, sizeof(this->bits)); }
+    void set(int node)
+    {
+        if(node >= 0 && node < NUMA_MAX_NODES)
+        {
+            this->bits[node / (8*sizeof(unsigned long))] |= 1ul << (node % (8*sizeof(unsigned long)));
+        }
+    }
+};
+
+/**
+ * @brief mbind the whole pages inside [data, data + bytes)
+ */
+static bool bind_pages(void* data, size_t bytes, int mode, const NodeMask& mask)
+{
+    const uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    const uintptr_t first = ((uintptr_t)data + page - 1) & ~(page - 1);
+    const uintptr_t last = ((uintptr_t)data + bytes) & ~(page - 1);
+    if(last <= first)
+    { //no whole page, the buffer shares its pages with other allocations
+        return true;
+    }
+    // the kernel reads maxnode - 1 bits of the mask. Pages the allocator hands
+    // back already written are moved, new pages are placed when first written.
+    return syscall(SYS_mbind, first, last - first, mode, mask.bits, (unsigned long)NUMA_MAX_NODES + 1,
+                   MPOL_MF_MOVE) == 0;
+}
+
+bool numa_place(void* data, size_t bytes, NumaPolicy policy)
+{
+    NodeMask mask;
+    switch(policy)
+    {
+    case NumaPolicy::Local:
+    {
+        if(numa_nodes().size() < 2)
+        {
+            return true;
+        }
+        unsigned int cpu = 0, node = 0;
+        if(syscall(SYS_getcpu, &cpu, &node, nullptr) != 0)
+        {
+            return false;
+        }
+        mask.set((int)node);
+        //preferred rather than bound, so a full node spills over instead of failing
+        return bind_pages(data, bytes, MPOL_PREFERRED, mask);
+    }
+    case NumaPolicy::Interleave:
+        for(int node : numa_nodes())
+        {
+            mask.set(node);
+        }
+        return bind_pages(data, bytes, MPOL_INTERLEAVE, mask);
+    case NumaPolicy::FirstTouch:
+        return true;
+    }
+    return false;
+}
+
+bool numa_pages_per_node(const void* data, size_t bytes, std::vector<size_t>& pages)
+{
+    pages.assign(numa_nodes().back() + 1, 0);
+    const uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    const uintptr_t first = (uintptr_t)data & ~(page - 1);
+    const uintptr_t end = (uintptr_t)data + bytes;
+    std::vector<void*> addrs;
+    std::vector<int> status;
+    addrs.reserve(NUMA_QUERY_PAGES);
+    status.resize(NUMA_QUERY_PAGES);
+    for(uintptr_t p=first; p<end; )
+    {
+        addrs.clear();
+        for(; p<end && addrs.size()<NUMA_QUERY_PAGES; p+=page)
+        {
+            addrs.push_back(reinterpret_cast<void*>(p));
+        }
+        //with no target nodes, move_pages only reports where each page is
+        if(syscall(SYS_move_pages, 0, addrs.size(), addrs.data(), nullptr, status.data(), 0) != 0)
+        {
+            return false;
+        }
+        for(size_t i=0; i<addrs.size(); i++)
+        {
+            if(status[i] >= 0 && (size_t)status[i] < pages.size())
+            { //negative status: page not present (never written)
+                pages[status[i]]++;
+            }
+        }
+    }
+    return true;
+}
+
+double numa_node_bandwidth(int node, ThreadPool& pool)
+{
+    const size_t bytes = NUMA_BANDWIDTH_BYTES;
+    void* buffer = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(buffer == MAP_FAILED)
+    {
+        return 0;
+    }
+    NodeMask mask;
+    mask.set(node);
+    if(!bind_pages(buffer, bytes, MPOL_BIND, mask))
+    {
+        munmap(buffer, bytes);
+        return 0;
+    }
+    std::memset(buffer, 1, bytes);
+
+    //every worker sums its own slice, 4 independent 16 byte accumulators each
+    const unsigned int workers = pool.size();
+    const size_t chunks = bytes / 64;
+    std::vector<long long> sums(workers*8);
+    auto start = std::chrono::high_resolution_clock::now();
+    pool.run(workers, [&](unsigned int task, unsigned int)
+    {
+        const __m128i* p = static_cast<const __m128i*>(buffer);
+        __m128i s0 = _mm_setzero_si128(), s1 = s0, s2 = s0, s3 = s0;
+        const size_t c1 = chunks*(task + 1)/workers;
+        for(size_t c=chunks*task/workers; c<c1; c++)
+        {
+            s0 = _mm_add_epi64(s0, _mm_load_si128(p + 4*c));
+            s1 = _mm_add_epi64(s1, _mm_load_si128(p + 4*c + 1));
+            s2 = _mm_add_epi64(s2, _mm_load_si128(p + 4*c + 2));
+            s3 = _mm_add_epi64(s3, _mm_load_si128(p + 4*c + 3));
+        }
+        //one 64 byte line per task, so the results do not share cache lines
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&sums[task*8]),
+                         _mm_add_epi64(_mm_add_epi64(s0, s1), _mm_add_epi64(s2, s3)));
+    });
+    auto stop = std::chrono::high_resolution_clock::now();
+    munmap(buffer, bytes);
+    const double seconds = std::chrono::duration<double>(stop - start).count();
+    return (seconds > 0) ? bytes/seconds/1e9 : 0.0;
+}
@@ -0,0 +1,121 @@
+/**
+ * @file numa.h
+ * @author Ethan Stockbridge (ethanstockbridge@gmail.com)
+ * @author Devan Kidd (jjkidd1245@gmail.com)
+ * @brief NUMA page placement of matrices (local, interleaved or first touch by
+ * the threads that use them), placement queries and per-node bandwidth. Uses the
+ * mbind and move_pages system calls directly, so libnuma is not needed.
+ * @date 2022-01-25
+ */
+#ifndef NUMA_H
+#define NUMA_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class ThreadPool;
+
+/**
+ * @brief Bytes read from each node by numa_node_bandwidth()
+ */
+#ifndef NUMA_BANDWIDTH_BYTES
+#define NUMA_BANDWIDTH_BYTES (256u << 20)
+#endif
+
+/**
+ * @brief Where the pages of a matrix are placed on a machine with more than one
+ * memory node
+ */
+enum class NumaPolicy
+{
+    /**
+     * @brief On the node of the thread that creates the matrix
+     */
+    Local,
+    /**
+     * @brief Spread page by page over all nodes, so every thread sees the same
+     * mix of local and remote memory (best for data every thread reads, ex: B)
+     */
+    Interleave,
+    /**
+     * @brief Each band of rows is written first by the pool worker that will use
+     * it, so the kernel places its pages on that worker's node (see Matrix and
+     * parallel_matrix_multiplication)
+     */
+    FirstTouch
+};
+
+/**
+ * @brief Get the name of a policy ("local", "interleave", "first-touch")
+ *
+ * @param policy Policy to name
+ * @return const char*
+ */
+const char* numa_policy_name(NumaPolicy policy);
+
+/**
+ * @brief Parse a policy name
+ *
+ * @param name "local", "interleave" or "first-touch"
+ * @param policy Output policy
+ * @return true The name is valid
+ */
+bool parse_numa_policy(const std::string& name, NumaPolicy& policy);
+
+/**
+ * @brief Ids of the online memory nodes (just node 0 without NUMA support)
+ *
+ * @return const std::vector<int>&
+ */
+const std::vector<int>& numa_nodes();
+
+/**
+ * @brief Apply a policy to the whole pages of a buffer that has not been
+ * written yet. FirstTouch needs no system call, and Local is skipped on machines
+ * with one node.
+ *
+ * @param data Start of the buffer
+ * @param bytes Size of the buffer
+ * @param policy Policy to apply
+ * @return true The policy was applied (or needed nothing)
+ */
+bool numa_place(void* data, size_t bytes, NumaPolicy policy);
+
+/**
+ * @brief Count the pages of a buffer on every node (with move_pages). Pages
+ * that were never written are not counted.
+ *
+ * @param data Start of the buffer
+ * @param bytes Size of the buffer
+ * @param pages Output, pages[node] is the number of pages on that node
+ * @return true The placement could be read
+ */
+bool numa_pages_per_node(const void* data, size_t bytes, std::vector<size_t>& pages);
+
+/**
+ * @brief Bandwidth of reading NUMA_BANDWIDTH_BYTES bound to one node, split over
+ * all of the workers of a pool
+ *
+ * @param node Node to read from
+ * @param pool Threads that read
+ * @return double GB/s, 0 if the memory could not be bound to the node
+ */
+double numa_node_bandwidth(int node, ThreadPool& pool);
+
+/**
+ * @brief First row of a band when rows are split into bands for first touch
+ * placement. The fill and the parallel multiplication both use it with
+ * ThreadPool::runOnEach(), so band i is written first and then used by pool worker i.
+ *
+ * @param rows Number of rows
+ * @param band Band number, 0 to bands (bands gives rows)
+ * @param bands Number of bands
+ * @return unsigned int
+ */
+inline unsigned int numa_band_start(unsigned int rows, unsigned int band, unsigned int bands)
+{
+    return (unsigned int)(((unsigned long)rows*band)/bands);
+}
+
+#endif
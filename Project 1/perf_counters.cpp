@@ -0,0 +1,227 @@
+/**
+ * @file perf_counters.cpp
+ * @author Ethan Stockbridge (ethanstockbridge@gmail.com)
+ * @author Devan Kidd (jjkidd1245@gmail.com)
+ * @brief Hardware performance counters with the perf_event_open system call
+ * @date 2022-01-25
+ */
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cpuid.h>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+
+#include "perf_counters.h"
+
+/**
+ * @brief Intel FP_ARITH_INST_RETIRED event. FMA instructions count twice.
+ */
+#define PERF_INTEL_FP_ARITH 0xC7
+
+/**
+ * @brief Check for an Intel CPU with architectural performance monitoring
+ * version 4 or later (Skylake and newer), which has FP_ARITH_INST_RETIRED
+ */
+static bool intel_fp_arith()
+{
+    unsigned int eax, ebx, ecx, edx;
+    if(!__get_cpuid(0, &eax, &ebx, &ecx, &edx) || eax < 0xA)
+    {
+        return false;
+    }
+    //vendor string "GenuineIntel" in ebx, edx, ecx
+    if(ebx != 0x756e6547 || edx != 0x49656e69 || ecx != 0x6c65746e)
+    {
+        return false;
+    }
+    __get_cpuid(0xA, &eax, &ebx, &ecx, &edx);
+    return (eax & 0xff) >= 4;
+}
+
+/**
+ * @brief Cache event config: cache, operation and result
+ */
+static unsigned long long cache_event(unsigned long long cache, unsigned long long result)
+{
+    return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (result << 16);
+}
+
+PerfCounters::PerfCounters()
+{
+    //without the cycle counter nothing else will work either
+    if(!this->open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, &PerfSample::cycles, 1))
+    {
+        const int err = errno;
+        this->reason = std::string("perf_event_open failed: ") + std::strerror(err);
+        if(err == EACCES || err == EPERM)
+        {
+            int paranoid = 0;
+            std::ifstream file("/proc/sys/kernel/perf_event_paranoid");
+            if(file >> paranoid)
+            {
+                this->reason += " (perf_event_paranoid is " + std::to_string(paranoid) + ", needs 2 or less)";
+            }
+        }
+        else if(err == ENOENT || err == EOPNOTSUPP)
+        {
+            this->reason += " (no hardware counters, ex: a virtual machine without a PMU)";
+        }
+        return;
+    }
+    this->open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, &PerfSample::instructions, 1);
+    this->open(PERF_TYPE_HW_CACHE, cache_event(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_RESULT_ACCESS),
+               &PerfSample::l1Loads, 1);
+    this->open(PERF_TYPE_HW_CACHE, cache_event(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_RESULT_MISS),
+               &PerfSample::l1Misses, 1);
+    this->open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES, &PerfSample::llcReferences, 1);
+    this->open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, &PerfSample::llcMisses, 1);
+
+    //there is no generic floating point event, the Intel one counts instructions
+    //by width: scalar, 128, 256 and 512 bit single precision
+    if(intel_fp_arith())
+    {
+        const struct { unsigned int umask; double flops; } widths[] = {{0x02, 1}, {0x08, 4}, {0x20, 8}, {0x80, 16}};
+        for(const auto& w : widths)
+        {
+            this->open(PERF_TYPE_RAW, PERF_INTEL_FP_ARITH | (w.umask << 8), &PerfSample::fpOps, w.flops);
+        }
+    }
+}
+
+PerfCounters::~PerfCounters()
+{
+    for(const Counter& c : this->counters)
+    {
+        close(c.fd);
+    }
+}
+
+bool PerfCounters::open(unsigned int type, unsigned long long config, double PerfSample::* field, double weight)
+{
+    struct perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.inherit = 1;           // threads created while counting
+    attr.exclude_kernel = 1;    // user space only, allowed at perf_event_paranoid 2
+    attr.exclude_hv = 1;
+    //every event on its own, so the kernel can multiplex more events than the
+    //CPU has counters, and the times tell how much to scale each count up
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    const int fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+    if(fd < 0)
+    {
+        return false;
+    }
+    this->counters.push_back(Counter{fd, field, weight, {0, 0, 0}});
+    return true;
+}
+
+/**
+ * @brief Read a counter: count, time enabled and time running
+ */
+static bool read_counter(int fd, uint64_t values[3])
+{
+    return read(fd, values, 3*sizeof(uint64_t)) == (ssize_t)(3*sizeof(uint64_t));
+}
+
+void PerfCounters::start()
+{
+    //counts of threads that exited are added to the counter and a reset does
+    //not clear them, so a sample is the difference between two reads
+    for(Counter& c : this->counters)
+    {
+        ioctl(c.fd, PERF_EVENT_IOC_ENABLE, 0);
+        if(!read_counter(c.fd, c.begin))
+        {
+            c.begin[0] = c.begin[1] = c.begin[2] = 0;
+        }
+    }
+}
+
+PerfSample PerfCounters::stop()
+{
+    for(const Counter& c : this->counters)
+    {
+        ioctl(c.fd, PERF_EVENT_IOC_DISABLE, 0);
+    }
+    PerfSample sample;
+    for(double PerfSample::* field : {&PerfSample::cycles, &PerfSample::instructions, &PerfSample::l1Loads,
+                                      &PerfSample::l1Misses, &PerfSample::llcReferences, &PerfSample::llcMisses,
+                                      &PerfSample::fpOps})
+    {
+        sample.*field = -1;
+    }
+    for(const Counter& c : this->counters)
+    {
+        uint64_t end[3];
+        if(!read_counter(c.fd, end) || end[2] == c.begin[2])
+        { //never got a hardware counter, leave it as not available
+            continue;
+        }
+        const double enabled = (double)(end[1] - c.begin[1]), running = (double)(end[2] - c.begin[2]);
+        const double count = (double)(end[0] - c.begin[0])*(enabled/running)*c.weight;
+        sample.*(c.field) = (sample.*(c.field) < 0) ? count : sample.*(c.field) + count;
+    }
+    return sample;
+}
+
+/**
+ * @brief Print a ratio as a percentage, or n/a if either count is missing
+ */
+static void print_percent(std::ostream& out, double part, double whole)
+{
+    if(part < 0 || whole <= 0)
+    {
+        out<<"n/a";
+    }
+    else
+    {
+        out<<std::fixed<<std::setprecision(1)<<100.0*part/whole<<"%"<<std::defaultfloat;
+    }
+}
+
+void print_perf_sample(std::ostream& out, const PerfSample& sample, double flops)
+{
+    out<<"    IPC ";
+    if(sample.cycles > 0 && sample.instructions >= 0)
+    {
+        out<<std::fixed<<std::setprecision(2)<<sample.instructions/sample.cycles<<std::defaultfloat;
+    }
+    else
+    {
+        out<<"n/a";
+    }
+    out<<", L1D miss rate ";
+    print_percent(out, sample.l1Misses, sample.l1Loads);
+    out<<", LLC miss rate ";
+    print_percent(out, sample.llcMisses, sample.llcReferences);
+
+    //measured operations if the CPU counts them, otherwise the algorithm's
+    const bool measured = sample.fpOps >= 0;
+    const double ops = measured ? sample.fpOps : flops;
+    const double bytes = (sample.llcMisses >= 0) ? 64*sample.llcMisses : -1;
+    if(ops > 0)
+    {
+        out<<", "<<std::setprecision(3)<<ops<<(measured ? " FP ops" : " FLOPs (not counted)");
+        out<<", FLOPs/byte ";
+        if(bytes > 0)
+        {
+            out<<std::setprecision(3)<<ops/bytes;
+        }
+        else
+        {
+            out<<"n/a";
+        }
+    }
+    out<<std::setprecision(6)<<std::endl;
+}
@@ -0,0 +1,115 @@
+/**
+ * @file perf_counters.h
+ * @author Ethan Stockbridge (ethanstockbridge@gmail.com)
+ * @author Devan Kidd (jjkidd1245@gmail.com)
+ * @brief Hardware performance counters (cycles, instructions, cache misses and
+ * floating point operations) read with the perf_event_open system call, to tell
+ * whether a kernel is limited by compute or by memory
+ * @date 2022-01-25
+ */
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Counts of one measurement, scaled up when the kernel had to share the
+ * hardware counters between events. A count is negative if it is not available
+ * on this CPU or was never scheduled.
+ */
+struct PerfSample
+{
+    double cycles;
+    double instructions;
+    double l1Loads;          // L1 data cache reads
+    double l1Misses;         // L1 data cache read misses
+    double llcReferences;    // last level cache references
+    double llcMisses;        // last level cache misses, lines read from memory
+    double fpOps;            // single precision floating point operations retired
+};
+
+/**
+ * @brief Set of counters for the calling thread and the threads it creates while
+ * counting. Threads that already exist are not counted, and a thread's counts
+ * are only added when it exits, so a thread pool has to be created and destroyed
+ * between start() and stop() to be included.
+ *
+ * Counters the CPU or the kernel does not support are left out. If none can be
+ * opened (ex: perf_event_paranoid is above 2, or a virtual machine without a
+ * PMU), available() is false and every sample reads as not available.
+ */
+class PerfCounters
+{
+public:
+    /**
+     * @brief Open the counters, stopped
+     */
+    PerfCounters();
+    /**
+     * @brief Close the counters
+     */
+    ~PerfCounters();
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    /**
+     * @brief Check whether at least the cycle counter could be opened
+     *
+     * @return true Samples have cycles, and the other counts the CPU supports
+     */
+    bool available() const { return !this->counters.empty(); }
+
+    /**
+     * @brief Get the reason the counters are not available
+     *
+     * @return const std::string&
+     */
+    const std::string& error() const { return this->reason; }
+
+    /**
+     * @brief Start all counters
+     */
+    void start();
+
+    /**
+     * @brief Stop all counters and read them
+     *
+     * @return PerfSample Counts since start()
+     */
+    PerfSample stop();
+
+private:
+    /**
+     * @brief One open counter, added (times weight) to a field of the sample
+     */
+    struct Counter
+    {
+        int fd;
+        double PerfSample::* field;
+        double weight;
+        uint64_t begin[3];    // count, time enabled and time running at start()
+    };
+
+    std::vector<Counter> counters;
+    std::string reason;
+
+    bool open(unsigned int type, unsigned long long config, double PerfSample::* field, double weight);
+};
+
+/**
+ * @brief Print IPC, L1 and last level cache miss rates and FLOPs per byte read
+ * from memory (last level cache misses x 64 bytes) on one line. Counts that are
+ * not available print as n/a.
+ *
+ * @param out Stream to print to
+ * @param sample Counts of the measurement
+ * @param flops Floating point operations of the algorithm, used for FLOPs/byte
+ * if the CPU cannot count them (0 to leave it out)
+ */
+void print_perf_sample(std::ostream& out, const PerfSample& sample, double flops);
+
+#endif
@@ -0,0 +1,581 @@
+/**
+ * @file qgemm.cpp
+ * @author Ethan Stockbridge (ethanstockbridge@gmail.com)
+ * @author Devan Kidd (jjkidd1245@gmail.com)
+ * @brief Quantized integer matrix multiplication with 32 bit accumulators.
+ * Consecutive values of k are interleaved while packing (pairs for int16,
+ * quads for int8) so one multiply-add instruction produces 8 partial sums for 8
+ * different columns of C, and no horizontal reduction is ever needed. There is
+ * one micro-kernel per instruction set, chosen at runtime by dispatch.cpp.
+ * @date 2022-01-25
+ */
+
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+#include <immintrin.h> // For SIMD functions
+
+#include "gemm.h"
+#include "qgemm.h"
+#include "dispatch.h"
+
+/**
+ * @brief Rows of C computed by one call of every micro-kernel. The number of
+ * columns (NR) depends on the register width of the variant.
+ */
+#define QGEMM_MR 6
+
+/**
+ * @brief Packing buffers, allocated once per thread and reused by every call
+ */
+struct QPackBuffers
+{
+    int32_t* a = nullptr;
+    int8_t* b = nullptr;
+
+    QPackBuffers()
+    {
+        // sized for the larger of the int16 and int8 panels
+        this->a = static_cast<int32_t*>(std::aligned_alloc(MATRIX_ALIGNMENT, sizeof(int32_t)*GEMM_MC*GEMM_KC));
+        this->b = static_cast<int8_t*>(std::aligned_alloc(MATRIX_ALIGNMENT, sizeof(int16_t)*(GEMM_KC+4)*GEMM_NC));
+        if(this->a == nullptr || this->b == nullptr)
+        {
+            throw std::bad_alloc();
+        }
+    }
+    ~QPackBuffers()
+    {
+        std::free(this->a);
+        std::free(this->b);
+    }
+};
+
+/**
+ * @brief Pack an mc x kc block of A into QGEMM_MR row panels. Each group of G
+ * consecutive k values of one row is packed into a single 32 bit word so the
+ * micro-kernel can broadcast it. Rows past mc and k past kc are zero.
+ */
+template <typename TA, unsigned int G>
+static void pack_A(const TA* A, unsigned int lda, unsigned int mc, unsigned int kc, int32_t* buff)
+{
+    typedef typename std::make_unsigned<TA>::type UA;
+    for(unsigned int i=0; i<mc; i+=QGEMM_MR)
+    {
+        const unsigned int rows = std::min<unsigned int>(QGEMM_MR, mc-i);
+        for(unsigned int k=0; k<kc; k+=G)
+        {
+            for(unsigned int r=0; r<QGEMM_MR; r++)
+            {
+                uint32_t word = 0;
+                if(r < rows)
+                {
+                    const TA* a = A + (size_t)(i+r)*lda + k;
+                    for(unsigned int g=0; g<G && k+g<kc; g++)
+                    {
+                        word |= (uint32_t)(UA)a[g] << (8*sizeof(TA)*g);
+                    }
+                }
+                buff[r] = (int32_t)word;
+            }
+            buff += QGEMM_MR;
+        }
+    }
+}
+
+/**
+ * @brief Pack a kc x nc block of B into NR column panels. For each group of
+ * G k values, the G values of a column are adjacent, then the next column follows.
+ * Columns past nc and k past kc are zero.
+ */
+template <typename TB, unsigned int G, unsigned int NR>
+static void pack_B(bool transB, const TB* B, unsigned int ldb, unsigned int kc, unsigned int nc, TB* buff)
+{
+    for(unsigned int j=0; j<nc; j+=NR)
+    {
+        const unsigned int cols = std::min<unsigned int>(NR, nc-j);
+        for(unsigned int k=0; k<kc; k+=G)
+        {
+            for(unsigned int c=0; c<NR; c++)
+            {
+                for(unsigned int g=0; g<G; g++)
+                {
+                    TB val = 0;
+                    if(c < cols && k+g < kc)
+                    {
+                        val = transB ? B[(size_t)(j+c)*ldb + k+g] : B[(size_t)(k+g)*ldb + j+c];
+                    }
+                    buff[c*G + g] = val;
+                }
+            }
+            buff += NR*G;
+        }
+    }
+}
+
+/**
+ * @brief Portable micro-kernel in plain C++: unpacks each group of G values of A
+ * and multiplies it against the matching G values of NR columns of B. Unlike
+ * _mm256_maddubs_epi16, the int8 products are never saturated.
+ *
+ * @param groups Number of k groups
+ * @param a Packed A panel
+ * @param b Packed B panel
+ * @param C Top left of the output tile
+ * @param ldc Leading dimension of C
+ */
+template <typename TA, typename TB, unsigned int G, unsigned int NR>
+static void kernel_scalar(unsigned int groups, const int32_t* a, const TB* b, int32_t* C, unsigned int ldc)
+{
+    int32_t acc[QGEMM_MR][NR] = {{0}};
+    for(unsigned int p=0; p<groups; p++)
+    {
+        for(unsigned int r=0; r<QGEMM_MR; r++)
+        {
+            const uint32_t word = (uint32_t)a[r];
+            for(unsigned int g=0; g<G; g++)
+            {
+                const TA ag = (TA)(word >> (8*sizeof(TA)*g));
+                for(unsigned int c=0; c<NR; c++)
+                {
+                    acc[r][c] += (int32_t)ag*(int32_t)b[c*G + g];
+                }
+            }
+        }
+        a += QGEMM_MR;
+        b += NR*G;
+    }
+    for(unsigned int r=0; r<QGEMM_MR; r++)
+    {
+        for(unsigned int c=0; c<NR; c++)
+        {
+            C[(size_t)r*ldc + c] += acc[r][c];
+        }
+    }
+}
+
+/**
+ * @brief SSE2 int16 6x8 micro-kernel, same scheme as the AVX2 one below on 128 bit registers
+ */
+static void kernel_s16_sse_6x8(unsigned int groups, const int32_t* a, const int16_t* b, int32_t* C, unsigned int ldc)
+{
+    __m128i acc[QGEMM_MR][2];
+    for(unsigned int r=0; r<QGEMM_MR; r++)
+    {
+        acc[r][0] = _mm_setzero_si128();
+        acc[r][1] = _mm_setzero_si128();
+    }
+    for(unsigned int p=0; p<groups; p++)
+    {
+        const __m128i b0 = _mm_load_si128((const __m128i*)b);
+        const __m128i b1 = _mm_load_si128((const __m128i*)(b+8));
+        for(unsigned int r=0; r<QGEMM_MR; r++)
+        {
+            const __m128i ar = _mm_set1_epi32(a[r]);
+            acc[r][0] = _mm_add_epi32(acc[r][0], _mm_madd_epi16(ar, b0));
+            acc[r][1] = _mm_add_epi32(acc[r][1], _mm_madd_epi16(ar, b1));
+        }
+        a += QGEMM_MR;
+        b += 2*8;
+    }
+    for(unsigned int r=0; r<QGEMM_MR; r++)
+    {
+        __m128i* c = (__m128i*)(C + (size_t)r*ldc);
+        _mm_storeu_si128(c,   _mm_add_epi32(_mm_loadu_si128(c),   acc[r][0]));
+        _mm_storeu_si128(c+1, _mm_add_epi32(_mm_loadu_si128(c+1), acc[r][1]));
+    }
+}
+
+/**
+ * @brief Add a 6x16 tile of AVX2 accumulators into C
+ */
+__attribute__((target("avx2")))
+static inline void store_tile_avx2(const __m256i acc[QGEMM_MR][2], int32_t* C, unsigned int ldc)
+{
+    for(unsigned int r=0; r<QGEMM_MR; r++)
+    {
+        __m256i* c = (__m256i*)(C + (size_t)r*ldc);
+        _mm256_storeu_si256(c,   _mm256_add_epi32(_mm256_loadu_si256(c),   acc[r][0]));
+        _mm256_storeu_si256(c+1, _mm256_add_epi32(_mm256_loadu_si256(c+1), acc[r][1]));
+    }
+}
+
+/**
+ * @brief AVX2 int16 6x16 micro-kernel. Every step consumes one pair of k values:
+ * _mm256_madd_epi16 multiplies the broadcast (a[k], a[k+1]) pair of a row against
+ * the (b[k][j], b[k+1][j]) pairs of 8 columns and adds each pair into an int32.
+ */
+__attribute__((target("avx2")))
+static void kernel_s16_avx2_6x16(unsigned int groups, const int32_t* a, const int16_t* b, int32_t* C, unsigned int ldc)
+{
+    __m256i acc[QGEMM_MR][2];
+    for(unsigned int r=0; r<QGEMM_MR; r++)
+    {
+        acc[r][0] = _mm256_setzero_si256();
+        acc[r][1] = _mm256_setzero_si256();
+    }
+    for(unsigned int p=0; p<groups; p++)
+    {
+        const __m256i b0 = _mm256_load_si256((const __m256i*)b);
+        const __m256i b1 = _mm256_load_si256((const __m256i*)(b+16));
+        for(unsigned int r=0; r<QGEMM_MR; r++)
+        {
+            const __m256i ar = _mm256_set1_epi32(a[r]);
+            acc[r][0] = _mm256_add_epi32(acc[r][0], _mm256_madd_epi16(ar, b0));
+            acc[r][1] = _mm256_add_epi32(acc[r][1], _mm256_madd_epi16(ar, b1));
+        }
+        a += QGEMM_MR;
+        b += 2*16;
+    }
+    store_tile_avx2(acc, C, ldc);
+}
+
+/**
+ * @brief AVX2 uint8 x int8 6x16 micro-kernel. Every step consumes four k values:
+ * _mm256_maddubs_epi16 multiplies bytes and adds adjacent pairs into int16, then
+ * _mm256_madd_epi16 against ones adds the two pairs of each column into an int32.
+ */
+__attribute__((target("avx2")))
+static void kernel_u8s8_avx2_6x16(unsigned int groups, const int32_t* a, const int8_t* b, int32_t* C, unsigned int ldc)
+{
+    const __m256i ones = _mm256_set1_epi16(1);
+    __m256i acc[QGEMM_MR][2];
+    for(unsigned int r=0; r<QGEMM_MR; r++)
+    {
+        acc[r][0] = _mm256_setzero_si256();
+        acc[r][1] = _mm256_setzero_si256();
+    }
+    for(unsigned int p=0; p<groups; p++)
+    {
+        const __m256i b0 = _mm256_load_si256((const __m256i*)b);
+        const __m256i b1 = _mm256_load_si256((const __m256i*)(b+32));
+        for(unsigned int r=0; r<QGEMM_MR; r++)
+        {
+            const __m256i ar = _mm256_set1_epi32(a[r]);
+            acc[r][0] = _mm256_add_epi32(acc[r][0], _mm256_madd_epi16(_mm256_maddubs_epi16(ar, b0), ones));
+            acc[r][1] = _mm256_add_epi32(acc[r][1], _mm256_madd_epi16(_mm256_maddubs_epi16(ar, b1), ones));
+        }
+        a += QGEMM_MR;
+        b += 4*16;
+    }
+    store_tile_avx2(acc, C, ldc);
+}
+
+/**
+ * @brief Add a 6x32 tile of AVX-512 accumulators into C
+ */
+__attribute__((target("avx512f")))
+static inline void store_tile_avx512(const __m512i acc[QGEMM_MR][2], int32_t* C, unsigned int ldc)
+{
+    for(unsigned int r=0; r<QGEMM_MR; r++)
+    {
+        int32_t* c = C + (size_t)r*ldc;
+        _mm512_storeu_si512(c,    _mm512_add_epi32(_mm512_loadu_si512(c),    acc[r][0]));
+        _mm512_storeu_si512(c+16, _mm512_add_epi32(_mm512_loadu_si512(c+16), acc[r][1]));
+    }
+}
+
+/**
+ * @brief AVX-512 int16 6x32 micro-kernel, the AVX2 scheme on 512 bit registers
+ */
+__attribute__((target("avx512f,avx512bw")))
+static void kernel_s16_avx512_6x32(unsigned int groups, const int32_t* a, const int16_t* b, int32_t* C, unsigned int ldc)
+{
+    __m512i acc[QGEMM_MR][2];
+    for(unsigned int r=0; r<QGEMM_MR; r++)
+    {
+        acc[r][0] = _mm512_setzero_si512();
+        acc[r][1] = _mm512_setzero_si512();
+    }
+    for(unsigned int p=0; p<groups; p++)
+    {
+        const __m512i b0 = _mm512_load_si512(b);
+        const __m512i b1 = _mm512_load_si512(b+32);
+        for(unsigned int r=0; r<QGEMM_MR; r++)
+        {
+            const __m512i ar = _mm512_set1_epi32(a[r]);
+            acc[r][0] = _mm512_add_epi32(acc[r][0], _mm512_madd_epi16(ar, b0));
+            acc[r][1] = _mm512_add_epi32(acc[r][1], _mm512_madd_epi16(ar, b1));
+        }
+        a += QGEMM_MR;
+        b += 2*32;
+    }
+    store_tile_avx512(acc, C, ldc);
+}
+
+/**
+ * @brief AVX-512 uint8 x int8 6x32 micro-kernel, the AVX2 scheme on 512 bit registers
+ */
+__attribute__((target("avx512f,avx512bw")))
+static void kernel_u8s8_avx512_6x32(unsigned int groups, const int32_t* a, const int8_t* b, int32_t* C, unsigned int ldc)
+{
+    const __m512i ones = _mm512_set1_epi16(1);
+    __m512i acc[QGEMM_MR][2];
+    for(unsigned int r=0; r<QGEMM_MR; r++)
+    {
+        acc[r][0] = _mm512_setzero_si512();
+        acc[r][1] = _mm512_setzero_si512();
+    }
+    for(unsigned int p=0; p<groups; p++)
+    {
+        const __m512i b0 = _mm512_load_si512(b);
+        const __m512i b1 = _mm512_load_si512(b+64);
+        for(unsigned int r=0; r<QGEMM_MR; r++)
+        {
+            const __m512i ar = _mm512_set1_epi32(a[r]);
+            acc[r][0] = _mm512_add_epi32(acc[r][0], _mm512_madd_epi16(_mm512_maddubs_epi16(ar, b0), ones));
+            acc[r][1] = _mm512_add_epi32(acc[r][1], _mm512_madd_epi16(_mm512_maddubs_epi16(ar, b1), ones));
+        }
+        a += QGEMM_MR;
+        b += 4*32;
+    }
+    store_tile_avx512(acc, C, ldc);
+}
+
+/**
+ * @brief Blocked driver shared by every integer kernel. Same loop nest as
+ * sgemm: NC wide blocks of B, KC deep slices, MC tall blocks of A, then one
+ * QGEMM_MR x NR register tile at a time.
+ *
+ * @tparam TA Element type of A
+ * @tparam TB Element type of B
+ * @tparam G Number of consecutive k values combined by one multiply-add
+ * @tparam NR Columns of the micro-kernel's tile
+ * @tparam Kernel Micro-kernel for full tiles
+ */
+template <typename TA, typename TB, unsigned int G, unsigned int NR,
+          void (*Kernel)(unsigned int, const int32_t*, const TB*, int32_t*, unsigned int)>
+static void qgemm_driver(bool transB, unsigned int M, unsigned int N, unsigned int K,
+                         const TA* A, unsigned int lda, const TB* B, unsigned int ldb,
+                         int32_t* C, unsigned int ldc)
+{
+    static_assert(GEMM_MC % QGEMM_MR == 0, "GEMM_MC must be a multiple of the micro-kernel rows");
+    static_assert(GEMM_NC % NR == 0, "GEMM_NC must be a multiple of the micro-kernel columns");
+
+    for(unsigned int i=0; i<M; i++)
+    {
+        std::fill(C + (size_t)i*ldc, C + (size_t)i*ldc + N, 0);
+    }
+    if(K == 0)
+    {
+        return;
+    }
+
+    static thread_local QPackBuffers pack;
+    TB* packB = reinterpret_cast<TB*>(pack.b);
+
+    for(unsigned int jc=0; jc<N; jc+=GEMM_NC)
+    {
+        const unsigned int nc = std::min<unsigned int>(GEMM_NC, N-jc);
+        for(unsigned int pc=0; pc<K; pc+=GEMM_KC)
+        {
+            const unsigned int kc = std::min<unsigned int>(GEMM_KC, K-pc);
+            const unsigned int groups = (kc + G - 1)/G;
+            const TB* Bblock = transB ? B + (size_t)jc*ldb + pc : B + (size_t)pc*ldb + jc;
+            pack_B<TB, G, NR>(transB, Bblock, ldb, kc, nc, packB);
+
+            for(unsigned int ic=0; ic<M; ic+=GEMM_MC)
+            {
+                const unsigned int mc = std::min<unsigned int>(GEMM_MC, M-ic);
+                pack_A<TA, G>(A + (size_t)ic*lda + pc, lda, mc, kc, pack.a);
+
+                for(unsigned int jr=0; jr<nc; jr+=NR)
+                {
+                    const unsigned int nr = std::min<unsigned int>(NR, nc-jr);
+                    const TB* b = packB + (size_t)jr*groups*G;
+                    for(unsigned int ir=0; ir<mc; ir+=QGEMM_MR)
+                    {
+                        const unsigned int mr = std::min<unsigned int>(QGEMM_MR, mc-ir);
+                        const int32_t* a = pack.a + (size_t)ir*groups;
+                        int32_t* c = C + (size_t)(ic+ir)*ldc + jc + jr;
+                        if(mr == QGEMM_MR && nr == NR)
+                        {
+                            Kernel(groups, a, b, c, ldc);
+                        }
+                        else
+                        { //partial tile, compute into scratch and copy the valid part
+                            alignas(MATRIX_ALIGNMENT) int32_t tile[QGEMM_MR*NR] = {0};
+                            Kernel(groups, a, b, tile, NR);
+                            for(unsigned int i=0; i<mr; i++)
+                            {
+                                for(unsigned int j=0; j<nr; j++)
+                                {
+                                    c[(size_t)i*ldc + j] += tile[i*NR + j];
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+void qgemm_s16_scalar(bool transB, unsigned int M, unsigned int N, unsigned int K,
+                      const int16_t* A, unsigned int lda, const int16_t* B, unsigned int ldb,
+                      int32_t* C, unsigned int ldc)
+{
+    qgemm_driver<int16_t, int16_t, 2, 8, kernel_scalar<int16_t, int16_t, 2, 8> >(transB, M, N, K, A, lda, B, ldb, C, ldc);
+}
+
+void qgemm_s16_sse(bool transB, unsigned int M, unsigned int N, unsigned int K,
+                   const int16_t* A, unsigned int lda, const int16_t* B, unsigned int ldb,
+                   int32_t* C, unsigned int ldc)
+{
+    qgemm_driver<int16_t, int16_t, 2, 8, kernel_s16_sse_6x8>(transB, M, N, K, A, lda, B, ldb, C, ldc);
+}
+
+void qgemm_s16_avx2(bool transB, unsigned int M, unsigned int N, unsigned int K,
+                    const int16_t* A, unsigned int lda, const int16_t* B, unsigned int ldb,
+                    int32_t* C, unsigned int ldc)
+{
+    qgemm_driver<int16_t, int16_t, 2, 16, kernel_s16_avx2_6x16>(transB, M, N, K, A, lda, B, ldb, C, ldc);
+}
+
+void qgemm_s16_avx512(bool transB, unsigned int M, unsigned int N, unsigned int K,
+                      const int16_t* A, unsigned int lda, const int16_t* B, unsigned int ldb,
+                      int32_t* C, unsigned int ldc)
+{
+    qgemm_driver<int16_t, int16_t, 2, 32, kernel_s16_avx512_6x32>(transB, M, N, K, A, lda, B, ldb, C, ldc);
+}
+
+void qgemm_u8s8_scalar(bool transB, unsigned int M, unsigned int N, unsigned int K,
+                       const uint8_t* A, unsigned int lda, const int8_t* B, unsigned int ldb,
+                       int32_t* C, unsigned int ldc)
+{
+    qgemm_driver<uint8_t, int8_t, 4, 8, kernel_scalar<uint8_t, int8_t, 4, 8> >(transB, M, N, K, A, lda, B, ldb, C, ldc);
+}
+
+void qgemm_u8s8_avx2(bool transB, unsigned int M, unsigned int N, unsigned int K,
+                     const uint8_t* A, unsigned int lda, const int8_t* B, unsigned int ldb,
+                     int32_t* C, unsigned int ldc)
+{
+    qgemm_driver<uint8_t, int8_t, 4, 16, kernel_u8s8_avx2_6x16>(transB, M, N, K, A, lda, B, ldb, C, ldc);
+}
+
+void qgemm_u8s8_avx512(bool transB, unsigned int M, unsigned int N, unsigned int K,
+                       const uint8_t* A, unsigned int lda, const int8_t* B, unsigned int ldb,
+                       int32_t* C, unsigned int ldc)
+{
+    qgemm_driver<uint8_t, int8_t, 4, 32, kernel_u8s8_avx512_6x32>(transB, M, N, K, A, lda, B, ldb, C, ldc);
+}
+
+void requantize_s32_s16_scalar(unsigned int M, unsigned int N,
+                               const int32_t* src, unsigned int lds,
+                               int16_t* dst, unsigned int ldd, float scale)
+{
+    const bool rescale = (scale != 1.0f);
+    for(unsigned int i=0; i<M; i++)
+    {
+        const int32_t* s = src + (size_t)i*lds;
+        int16_t* d = dst + (size_t)i*ldd;
+        for(unsigned int j=0; j<N; j++)
+        {
+            long r = rescale ? std::lrint(s[j]*scale) : (long)s[j];
+            d[j] = (int16_t)std::max<long>(INT16_MIN, std::min<long>(INT16_MAX, r));
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+void requantize_s32_s16_avx2(unsigned int M, unsigned int N,
+                             const int32_t* src, unsigned int lds,
+                             int16_t* dst, unsigned int ldd, float scale)
+{
+    const bool rescale = (scale != 1.0f);
+    const __m256 vscale = _mm256_set1_ps(scale);
+    //out of range floats convert to INT32_MIN, so saturate them to int16 first like the scalar version
+    const __m256 vmin = _mm256_set1_ps((float)INT16_MIN);
+    const __m256 vmax = _mm256_set1_ps((float)INT16_MAX);
+    for(unsigned int i=0; i<M; i++)
+    {
+        const int32_t* s = src + (size_t)i*lds;
+        int16_t* d = dst + (size_t)i*ldd;
+        unsigned int j = 0;
+        for(; j+16<=N; j+=16)
+        {
+            __m256i lo = _mm256_loadu_si256((const __m256i*)(s+j));
+            __m256i hi = _mm256_loadu_si256((const __m256i*)(s+j+8));
+            if(rescale)
+            { //round to nearest while converting back
+                __m256 flo = _mm256_mul_ps(_mm256_cvtepi32_ps(lo), vscale);
+                __m256 fhi = _mm256_mul_ps(_mm256_cvtepi32_ps(hi), vscale);
+                lo = _mm256_cvtps_epi32(_mm256_max_ps(vmin, _mm256_min_ps(vmax, flo)));
+                hi = _mm256_cvtps_epi32(_mm256_max_ps(vmin, _mm256_min_ps(vmax, fhi)));
+            }
+            //packs works within 128 bit lanes, permute puts the 4 quarters back in order
+            __m256i packed = _mm256_packs_epi32(lo, hi);
+            packed = _mm256_permute4x64_epi64(packed, 0xD8);
+            _mm256_storeu_si256((__m256i*)(d+j), packed);
+        }
+        //leftover columns
+        requantize_s32_s16_scalar(1, N-j, s+j, lds, d+j, ldd, scale);
+    }
+}
+
+void qgemm_s16(bool transB, unsigned int M, unsigned int N, unsigned int K,
+               const int16_t* A, unsigned int lda,
+               const int16_t* B, unsigned int ldb,
+               int32_t* C, unsigned int ldc)
+{
+    kernels().qgemm_s16(transB, M, N, K, A, lda, B, ldb, C, ldc);
+}
+
+void qgemm_u8s8(bool transB, unsigned int M, unsigned int N, unsigned int K,
+                const uint8_t* A, unsigned int lda,
+                const int8_t* B, unsigned int ldb,
+                int32_t* C, unsigned int ldc)
+{
+    kernels().qgemm_u8s8(transB, M, N, K, A, lda, B, ldb, C, ldc);
+}
+
+void requantize_s32_s16(unsigned int M, unsigned int N,
+                        const int32_t* src, unsigned int lds,
+                        int16_t* dst, unsigned int ldd, float scale)
+{
+    kernels().requantize_s32_s16(M, N, src, lds, dst, ldd, scale);
+}
+
+void SIMD_matrix_multiplication(Matrix<short int>& A, Matrix<short int>& B, Matrix<int>& C)
+{
+    #ifdef CACHE_OPTIMIZATION
+    const bool transB = true;
+    const unsigned int N = B.getRows(); //B is stored inverted
+    const unsigned int K = B.getCols();
+    #else
+    const bool transB = false;
+    const unsigned int N = B.getCols();
+    const unsigned int K = B.getRows();
+    #endif
+    if( (A.getCols() != K) ||
+        (C.getCols() != N) ||
+        (C.getRows() != A.getRows()) )
+    {
+        std::cerr<<"Error, Matrix dimensions do not match"<<std::endl;
+        return;
+    }
+    qgemm_s16(transB, A.getRows(), N, K, A.getData(), A.getStride(),
+              B.getData(), B.getStride(), C.getData(), C.getStride());
+}
+
+void SIMD_matrix_multiplication(Matrix<unsigned char>& A, Matrix<signed char>& B, Matrix<int>& C)
+{
+    #ifdef CACHE_OPTIMIZATION
+    const bool transB = true;
+    const unsigned int N = B.getRows(); //B is stored inverted
+    const unsigned int K = B.getCols();
+    #else
+    const bool transB = false;
+    const unsigned int N = B.getCols();
+    const unsigned int K = B.getRows();
+    #endif
+    if( (A.getCols() != K) ||
+        (C.getCols() != N) ||
+        (C.getRows() != A.getRows()) )
+    {
+        std::cerr<<"Error, Matrix dimensions do not match"<<std::endl;
+        return;
+    }
+    qgemm_u8s8(transB, A.getRows(), N, K, A.getData(), A.getStride(),
+               reinterpret_cast<const int8_t*>(B.getData()), B.getStride(), C.getData(), C.getStride());
+}
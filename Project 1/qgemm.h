@@ -0,0 +1,93 @@
+/**
+ * @file qgemm.h
+ * @author Ethan Stockbridge (ethanstockbridge@gmail.com)
+ * @author Devan Kidd (jjkidd1245@gmail.com)
+ * @brief Quantized integer matrix multiplication with 32 bit accumulators
+ * @date 2022-01-25
+ */
+#ifndef QGEMM_H
+#define QGEMM_H
+
+#include <cstdint>
+
+#include "matrix.h"
+
+/**
+ * @brief Integer matrix multiplication C = A*B of 16 bit inputs. Products are
+ * summed in 32 bit accumulators (_mm256_madd_epi16), so the result is exact
+ * as long as every sum fits in an int32_t.
+ *
+ * @param transB If true, B is stored transposed (N x K, element B(k,j) at B[j*ldb+k])
+ * @param M Rows of A and C
+ * @param N Columns of B and C
+ * @param K Columns of A, rows of B
+ * @param A Input matrix A (M x K)
+ * @param lda Leading dimension of A
+ * @param B Input matrix B (K x N, or N x K if transB)
+ * @param ldb Leading dimension of B
+ * @param C Output matrix C (M x N), overwritten
+ * @param ldc Leading dimension of C
+ */
+void qgemm_s16(bool transB, unsigned int M, unsigned int N, unsigned int K,
+               const int16_t* A, unsigned int lda,
+               const int16_t* B, unsigned int ldb,
+               int32_t* C, unsigned int ldc);
+
+/**
+ * @brief Integer matrix multiplication C = A*B of unsigned 8 bit A and signed
+ * 8 bit B (the usual activation x weight layout). Pairs of products are summed
+ * by _mm256_maddubs_epi16, which saturates at +-32767: keep A below 128 (7 bit
+ * activations) if both products of a pair can be near their extremes. All
+ * other sums are done in 32 bit accumulators.
+ *
+ * @param transB If true, B is stored transposed (N x K, element B(k,j) at B[j*ldb+k])
+ * @param M Rows of A and C
+ * @param N Columns of B and C
+ * @param K Columns of A, rows of B
+ * @param A Input matrix A (M x K)
+ * @param lda Leading dimension of A
+ * @param B Input matrix B (K x N, or N x K if transB)
+ * @param ldb Leading dimension of B
+ * @param C Output matrix C (M x N), overwritten
+ * @param ldc Leading dimension of C
+ */
+void qgemm_u8s8(bool transB, unsigned int M, unsigned int N, unsigned int K,
+                const uint8_t* A, unsigned int lda,
+                const int8_t* B, unsigned int ldb,
+                int32_t* C, unsigned int ldc);
+
+/**
+ * @brief Requantize 32 bit results to 16 bits: dst = saturate(round(src*scale)).
+ * A scale of 1 skips the float conversion and only saturates.
+ *
+ * @param M Rows to convert
+ * @param N Columns to convert
+ * @param src 32 bit input
+ * @param lds Leading dimension of src
+ * @param dst 16 bit output
+ * @param ldd Leading dimension of dst
+ * @param scale Scale applied before rounding
+ */
+void requantize_s32_s16(unsigned int M, unsigned int N,
+                        const int32_t* src, unsigned int lds,
+                        int16_t* dst, unsigned int ldd, float scale);
+
+/**
+ * @brief Matrix multiplication of short ints with exact 32 bit results
+ *
+ * @param A First input matrix
+ * @param B Second input matrix (stored inverted if CACHE_OPTIMIZATION is defined)
+ * @param C Output matrix (A x B = C)
+ */
+void SIMD_matrix_multiplication(Matrix<short int>& A, Matrix<short int>& B, Matrix<int>& C);
+
+/**
+ * @brief Matrix multiplication of 8 bit integers with 32 bit results
+ *
+ * @param A First input matrix (unsigned activations)
+ * @param B Second input matrix (signed weights, stored inverted if CACHE_OPTIMIZATION is defined)
+ * @param C Output matrix (A x B = C)
+ */
+void SIMD_matrix_multiplication(Matrix<unsigned char>& A, Matrix<signed char>& B, Matrix<int>& C);
+
+#endif
@@ -0,0 +1,25 @@
+/**
+ * @file simd_util.h
+ * @author Ethan Stockbridge (ethanstockbridge@gmail.com)
+ * @author Devan Kidd (jjkidd1245@gmail.com)
+ * @brief Small SIMD helpers shared by the kernels
+ * @date 2022-01-25
+ */
+#ifndef SIMD_UTIL_H
+#define SIMD_UTIL_H
+
+#include <immintrin.h> // For SIMD functions
+
+/**
+ * @brief Sum the 8 floats of a register
+ */
+__attribute__((target("avx2,fma")))
+static inline float hsum(__m256 v)
+{
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_movehdup_ps(s));
+    return _mm_cvtss_f32(s);
+}
+
+#endif
@@ -0,0 +1,450 @@
+/**
+ * @file sparse.cpp
+ * @author Ethan Stockbridge (ethanstockbridge@gmail.com)
+ * @author Devan Kidd (jjkidd1245@gmail.com)
+ * @brief Sparse matrix-vector and sparse times dense multiplication kernels for
+ * CSR and BSR matrices, in regular C++ and AVX2, single threaded or split by
+ * rows over a ThreadPool
+ * @date 2022-01-25
+ */
+
+#include <immintrin.h> // For SIMD functions
+#include <functional>
+
+#include "sparse.h"
+#include "dispatch.h"
+#include "simd_util.h"
+
+/**
+ * @brief Split rows [0, nrows) into tasks of about the same cost and run
+ * kernel(first, last) for each, on the pool if one is given. Row i costs
+ * ptr[i+1] - ptr[i] non-zeros (or blocks) plus one for the row itself.
+ *
+ * @param ptr Row (or block row) pointers, nrows + 1 values
+ * @param nrows Number of rows
+ * @param pool Worker threads, or nullptr
+ * @param kernel Function computing a range of rows
+ */
+static void run_rows(const unsigned int* ptr, unsigned int nrows, ThreadPool* pool,
+                     const std::function<void(unsigned int, unsigned int)>& kernel)
+{
+    if(pool == nullptr || pool->size() <= 1 || nrows < 2)
+    {
+        kernel(0, nrows);
+        return;
+    }
+    const unsigned int tasks = std::min(nrows, pool->size()*SPARSE_TASKS_PER_THREAD);
+    const size_t total = (size_t)ptr[nrows] + nrows;
+    //bounds[t] is the first row whose cost so far (ptr[i] + i) reaches t/tasks of the total
+    std::vector<unsigned int> bounds(tasks + 1);
+    bounds[0] = 0;
+    bounds[tasks] = nrows;
+    for(unsigned int t=1; t<tasks; t++)
+    {
+        const size_t target = total*t/tasks;
+        unsigned int lo = bounds[t-1], hi = nrows;
+        while(lo < hi)
+        {
+            const unsigned int mid = lo + (hi - lo)/2;
+            if((size_t)ptr[mid] + mid < target)
+            {
+                lo = mid + 1;
+            }
+            else
+            {
+                hi = mid;
+            }
+        }
+        bounds[t] = lo;
+    }
+    pool->run(tasks, [&](unsigned int t, unsigned int)
+    {
+        if(bounds[t] < bounds[t+1])
+        {
+            kernel(bounds[t], bounds[t+1]);
+        }
+    });
+}
+
+// CSR kernels, rows [r0, r1)
+
+static void csr_spmv_scalar(const CsrMatrix<float>& A, const float* x, float* y, unsigned int r0, unsigned int r1)
+{
+    const unsigned int* ptr = A.getRowPtr();
+    const unsigned int* idx = A.getColIdx();
+    const float* val = A.getValues();
+    for(unsigned int i=r0; i<r1; i++)
+    {
+        float sum = 0;
+        for(unsigned int n=ptr[i]; n<ptr[i+1]; n++)
+        {
+            sum += val[n]*x[idx[n]];
+        }
+        y[i] = sum;
+    }
+}
+
+/**
+ * @brief 8 non-zeros at a time, gathering the matching elements of x
+ */
+__attribute__((target("avx2,fma")))
+static void csr_spmv_avx2(const CsrMatrix<float>& A, const float* x, float* y, unsigned int r0, unsigned int r1)
+{
+    const unsigned int* ptr = A.getRowPtr();
+    const unsigned int* idx = A.getColIdx();
+    const float* val = A.getValues();
+    for(unsigned int i=r0; i<r1; i++)
+    {
+        const unsigned int end = ptr[i+1];
+        unsigned int n = ptr[i];
+        __m256 acc = _mm256_setzero_ps();
+        for(; n + 8 <= end; n += 8)
+        {
+            const __m256i cols = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(idx + n));
+            acc = _mm256_fmadd_ps(_mm256_loadu_ps(val + n), _mm256_i32gather_ps(x, cols, 4), acc);
+        }
+        float sum = hsum(acc);
+        for(; n<end; n++)
+        {
+            sum += val[n]*x[idx[n]];
+        }
+        y[i] = sum;
+    }
+}
+
+static void csr_spmm_scalar(const CsrMatrix<float>& A, const Matrix<float>& B, Matrix<float>& C,
+                            unsigned int r0, unsigned int r1)
+{
+    const unsigned int* ptr = A.getRowPtr();
+    const unsigned int* idx = A.getColIdx();
+    const float* val = A.getValues();
+    const unsigned int N = B.getCols();
+    for(unsigned int i=r0; i<r1; i++)
+    {
+        float* c = C[i];
+        for(unsigned int j=0; j<N; j++)
+        {
+            c[j] = 0;
+        }
+        for(unsigned int n=ptr[i]; n<ptr[i+1]; n++)
+        {
+            const float a = val[n];
+            const float* b = B[idx[n]];
+            for(unsigned int j=0; j<N; j++)
+            {
+                c[j] += a*b[j];
+            }
+        }
+    }
+}
+
+/**
+ * @brief Keeps 64 (then 16) columns of a row of C in registers while the rows of
+ * B picked by the non-zeros stream through, one SPMM_PANEL wide panel of B at a
+ * time. Rows are padded to a multiple of 16 with zeros, so the padded width is
+ * computed and the padding stays zero.
+ */
+__attribute__((target("avx2,fma")))
+static void csr_spmm_avx2(const CsrMatrix<float>& A, const Matrix<float>& B, Matrix<float>& C,
+                          unsigned int r0, unsigned int r1)
+{
+    const unsigned int* ptr = A.getRowPtr();
+    const unsigned int* idx = A.getColIdx();
+    const float* val = A.getValues();
+    const unsigned int width = B.getStride();
+    for(unsigned int p=0; p<width; p+=SPMM_PANEL)
+    {
+        const unsigned int pend = std::min(width, p + SPMM_PANEL);
+        for(unsigned int i=r0; i<r1; i++)
+        {
+            float* c = C[i];
+            unsigned int j = p;
+            for(; j + 64 <= pend; j += 64)
+            {
+                __m256 acc[8];
+                #pragma GCC unroll 8
+                for(unsigned int v=0; v<8; v++)
+                {
+                    acc[v] = _mm256_setzero_ps();
+                }
+                for(unsigned int n=ptr[i]; n<ptr[i+1]; n++)
+                {
+                    const __m256 a = _mm256_set1_ps(val[n]);
+                    const float* b = B[idx[n]] + j;
+                    #pragma GCC unroll 8
+                    for(unsigned int v=0; v<8; v++)
+                    {
+                        acc[v] = _mm256_fmadd_ps(a, _mm256_load_ps(b + 8*v), acc[v]);
+                    }
+                }
+                #pragma GCC unroll 8
+                for(unsigned int v=0; v<8; v++)
+                {
+                    _mm256_store_ps(c + j + 8*v, acc[v]);
+                }
+            }
+            for(; j < pend; j += 16)
+            {
+                __m256 c0 = _mm256_setzero_ps(), c1 = _mm256_setzero_ps();
+                for(unsigned int n=ptr[i]; n<ptr[i+1]; n++)
+                {
+                    const __m256 a = _mm256_set1_ps(val[n]);
+                    const float* b = B[idx[n]] + j;
+                    c0 = _mm256_fmadd_ps(a, _mm256_load_ps(b), c0);
+                    c1 = _mm256_fmadd_ps(a, _mm256_load_ps(b + 8), c1);
+                }
+                _mm256_store_ps(c + j, c0);
+                _mm256_store_ps(c + j + 8, c1);
+            }
+        }
+    }
+}
+
+// BSR kernels, block rows [b0, b1)
+
+static void bsr_spmv_scalar(const BsrMatrix<float>& A, const float* x, float* y, unsigned int b0, unsigned int b1)
+{
+    const unsigned int* ptr = A.getBlockPtr();
+    const unsigned int* bcol = A.getBlockCol();
+    const float* val = A.getValues();
+    for(unsigned int b=b0; b<b1; b++)
+    {
+        const unsigned int r0 = b*BSR_ROWS;
+        const unsigned int nr = std::min<unsigned int>(BSR_ROWS, A.getRows() - r0);
+        float sum[BSR_ROWS] = {};
+        for(unsigned int n=ptr[b]; n<ptr[b+1]; n++)
+        {
+            const unsigned int c0 = bcol[n]*BSR_COLS;
+            const unsigned int nc = std::min<unsigned int>(BSR_COLS, A.getCols() - c0);
+            const float* blk = val + (size_t)n*BSR_ROWS*BSR_COLS;
+            for(unsigned int r=0; r<BSR_ROWS; r++)
+            {
+                for(unsigned int k=0; k<nc; k++)
+                {
+                    sum[r] += blk[r*BSR_COLS + k]*x[c0 + k];
+                }
+            }
+        }
+        for(unsigned int r=0; r<nr; r++)
+        {
+            y[r0 + r] = sum[r];
+        }
+    }
+}
+
+/**
+ * @brief One load of x serves the 4 rows of a block. The block column past the
+ * end of x is loaded with a mask.
+ */
+__attribute__((target("avx2,fma")))
+static void bsr_spmv_avx2(const BsrMatrix<float>& A, const float* x, float* y, unsigned int b0, unsigned int b1)
+{
+    static_assert(BSR_ROWS == 4 && BSR_COLS == 8, "the AVX2 BSR kernels use 4x8 blocks");
+    const unsigned int* ptr = A.getBlockPtr();
+    const unsigned int* bcol = A.getBlockCol();
+    const float* val = A.getValues();
+    const unsigned int fullCols = A.getCols() / BSR_COLS;
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i tailMask = _mm256_cmpgt_epi32(_mm256_set1_epi32(A.getCols() % BSR_COLS), lanes);
+    for(unsigned int b=b0; b<b1; b++)
+    {
+        __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+        __m256 acc2 = _mm256_setzero_ps(), acc3 = _mm256_setzero_ps();
+        for(unsigned int n=ptr[b]; n<ptr[b+1]; n++)
+        {
+            const float* xc = x + bcol[n]*BSR_COLS;
+            const __m256 xv = (bcol[n] < fullCols) ? _mm256_loadu_ps(xc) : _mm256_maskload_ps(xc, tailMask);
+            const float* blk = val + (size_t)n*BSR_ROWS*BSR_COLS;
+            acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(blk), xv, acc0);
+            acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(blk + 8), xv, acc1);
+            acc2 = _mm256_fmadd_ps(_mm256_loadu_ps(blk + 16), xv, acc2);
+            acc3 = _mm256_fmadd_ps(_mm256_loadu_ps(blk + 24), xv, acc3);
+        }
+        const unsigned int r0 = b*BSR_ROWS;
+        const float sum[BSR_ROWS] = {hsum(acc0), hsum(acc1), hsum(acc2), hsum(acc3)};
+        const unsigned int nr = std::min<unsigned int>(BSR_ROWS, A.getRows() - r0);
+        for(unsigned int r=0; r<nr; r++)
+        {
+            y[r0 + r] = sum[r];
+        }
+    }
+}
+
+static void bsr_spmm_scalar(const BsrMatrix<float>& A, const Matrix<float>& B, Matrix<float>& C,
+                            unsigned int b0, unsigned int b1)
+{
+    const unsigned int* ptr = A.getBlockPtr();
+    const unsigned int* bcol = A.getBlockCol();
+    const float* val = A.getValues();
+    const unsigned int N = B.getCols();
+    for(unsigned int b=b0; b<b1; b++)
+    {
+        const unsigned int r0 = b*BSR_ROWS;
+        const unsigned int nr = std::min<unsigned int>(BSR_ROWS, A.getRows() - r0);
+        for(unsigned int r=0; r<nr; r++)
+        {
+            float* c = C[r0 + r];
+            for(unsigned int j=0; j<N; j++)
+            {
+                c[j] = 0;
+            }
+            for(unsigned int n=ptr[b]; n<ptr[b+1]; n++)
+            {
+                const unsigned int c0 = bcol[n]*BSR_COLS;
+                const unsigned int nc = std::min<unsigned int>(BSR_COLS, A.getCols() - c0);
+                const float* blk = val + (size_t)n*BSR_ROWS*BSR_COLS + r*BSR_COLS;
+                for(unsigned int k=0; k<nc; k++)
+                {
+                    const float a = blk[k];
+                    const float* brow = B[c0 + k];
+                    for(unsigned int j=0; j<N; j++)
+                    {
+                        c[j] += a*brow[j];
+                    }
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @brief Keeps a 4 x 16 tile of C in registers. Each row of B is loaded once for
+ * all 4 rows of the block. B has at least as many padded rows as the blocks
+ * reach (multiple of 16 >= multiple of 8), and those rows are zero.
+ */
+__attribute__((target("avx2,fma")))
+static void bsr_spmm_avx2(const BsrMatrix<float>& A, const Matrix<float>& B, Matrix<float>& C,
+                          unsigned int b0, unsigned int b1)
+{
+    const unsigned int* ptr = A.getBlockPtr();
+    const unsigned int* bcol = A.getBlockCol();
+    const float* val = A.getValues();
+    const unsigned int width = B.getStride();
+    for(unsigned int p=0; p<width; p+=SPMM_PANEL)
+    {
+        const unsigned int pend = std::min(width, p + SPMM_PANEL);
+        for(unsigned int b=b0; b<b1; b++)
+        {
+            const unsigned int r0 = b*BSR_ROWS;
+            const unsigned int nr = std::min<unsigned int>(BSR_ROWS, A.getRows() - r0);
+            for(unsigned int j=p; j<pend; j+=16)
+            {
+                __m256 acc[BSR_ROWS][2];
+                for(unsigned int r=0; r<BSR_ROWS; r++)
+                {
+                    acc[r][0] = _mm256_setzero_ps();
+                    acc[r][1] = _mm256_setzero_ps();
+                }
+                for(unsigned int n=ptr[b]; n<ptr[b+1]; n++)
+                {
+                    const unsigned int c0 = bcol[n]*BSR_COLS;
+                    const float* blk = val + (size_t)n*BSR_ROWS*BSR_COLS;
+                    #pragma GCC unroll 8
+                    for(unsigned int k=0; k<BSR_COLS; k++)
+                    {
+                        const float* brow = B[c0 + k] + j;
+                        const __m256 bv0 = _mm256_load_ps(brow);
+                        const __m256 bv1 = _mm256_load_ps(brow + 8);
+                        #pragma GCC unroll 4
+                        for(unsigned int r=0; r<BSR_ROWS; r++)
+                        {
+                            const __m256 a = _mm256_broadcast_ss(blk + r*BSR_COLS + k);
+                            acc[r][0] = _mm256_fmadd_ps(a, bv0, acc[r][0]);
+                            acc[r][1] = _mm256_fmadd_ps(a, bv1, acc[r][1]);
+                        }
+                    }
+                }
+                for(unsigned int r=0; r<nr; r++)
+                {
+                    _mm256_store_ps(C[r0 + r] + j, acc[r][0]);
+                    _mm256_store_ps(C[r0 + r] + j + 8, acc[r][1]);
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @brief Check the sizes of a sparse times dense multiplication
+ */
+static bool spmm_sizes_match(unsigned int M, unsigned int K, const Matrix<float>& B, const Matrix<float>& C)
+{
+    if(K != B.getRows() || C.getRows() != M || C.getCols() != B.getCols())
+    {
+        std::cerr<<"Error: Cannot perform sparse matrix multiplication because matrix dimensions do not match"<<std::endl;
+        return false;
+    }
+    return true;
+}
+
+void spmv(const CsrMatrix<float>& A, const float* x, float* y, ThreadPool* pool)
+{
+    const bool avx2 = kernels().variant >= CpuVariant::AVX2;
+    run_rows(A.getRowPtr(), A.getRows(), pool, [&](unsigned int r0, unsigned int r1)
+    {
+        if(avx2)
+        {
+            csr_spmv_avx2(A, x, y, r0, r1);
+        }
+        else
+        {
+            csr_spmv_scalar(A, x, y, r0, r1);
+        }
+    });
+}
+
+void spmv(const BsrMatrix<float>& A, const float* x, float* y, ThreadPool* pool)
+{
+    const bool avx2 = kernels().variant >= CpuVariant::AVX2;
+    run_rows(A.getBlockPtr(), A.getBlockRows(), pool, [&](unsigned int b0, unsigned int b1)
+    {
+        if(avx2)
+        {
+            bsr_spmv_avx2(A, x, y, b0, b1);
+        }
+        else
+        {
+            bsr_spmv_scalar(A, x, y, b0, b1);
+        }
+    });
+}
+
+void spmm(const CsrMatrix<float>& A, const Matrix<float>& B, Matrix<float>& C, ThreadPool* pool)
+{
+    if(!spmm_sizes_match(A.getRows(), A.getCols(), B, C))
+    {
+        return;
+    }
+    const bool avx2 = kernels().variant >= CpuVariant::AVX2;
+    run_rows(A.getRowPtr(), A.getRows(), pool, [&](unsigned int r0, unsigned int r1)
+    {
+        if(avx2)
+        {
+            csr_spmm_avx2(A, B, C, r0, r1);
+        }
+        else
+        {
+            csr_spmm_scalar(A, B, C, r0, r1);
+        }
+    });
+}
+
+void spmm(const BsrMatrix<float>& A, const Matrix<float>& B, Matrix<float>& C, ThreadPool* pool)
+{
+    if(!spmm_sizes_match(A.getRows(), A.getCols(), B, C))
+    {
+        return;
+    }
+    const bool avx2 = kernels().variant >= CpuVariant::AVX2;
+    run_rows(A.getBlockPtr(), A.getBlockRows(), pool, [&](unsigned int b0, unsigned int b1)
+    {
+        if(avx2)
+        {
+            bsr_spmm_avx2(A, B, C, b0, b1);
+        }
+        else
+        {
+            bsr_spmm_scalar(A, B, C, b0, b1);
+        }
+    });
+}
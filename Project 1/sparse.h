@@ -0,0 +1,310 @@
+/**
+ * @file sparse.h
+ * @author Ethan Stockbridge (ethanstockbridge@gmail.com)
+ * @author Devan Kidd (jjkidd1245@gmail.com)
+ * @brief Sparse matrices in compressed sparse row (CSR) and blocked CSR (BSR)
+ * form, with sparse matrix-vector (SpMV) and sparse times dense (SpMM)
+ * multiplication
+ * @date 2022-01-25
+ */
+#ifndef SPARSE_H
+#define SPARSE_H
+
+#include <algorithm>
+#include <vector>
+
+#include "matrix.h"
+#include "thread_pool.h"
+
+/**
+ * @brief Size of the dense blocks of a BSR matrix. 8 columns fill one AVX
+ * register and 4 rows share every load of x or of a row of B.
+ */
+#define BSR_ROWS 4
+#define BSR_COLS 8
+
+/**
+ * @brief Width (in floats, a multiple of 32) of the column panels of B the SpMM
+ * kernels work through one at a time. The rows of B picked by the non-zeros are
+ * random, so a whole row of B would be read from memory for every non-zero;
+ * with panels, K x SPMM_PANEL floats of B stay in cache for all of the rows.
+ */
+#ifndef SPMM_PANEL
+#define SPMM_PANEL 256
+#endif
+
+/**
+ * @brief Number of tasks per worker thread the threaded sparse kernels split
+ * the rows into. Each task gets about the same number of non-zeros, so rows of
+ * very different density still balance.
+ */
+#ifndef SPARSE_TASKS_PER_THREAD
+#define SPARSE_TASKS_PER_THREAD 4
+#endif
+
+/**
+ * @brief Sparse matrix in compressed sparse row form: the non-zeros of row i are
+ * values[rowPtr[i] .. rowPtr[i+1]), in columns colIdx[rowPtr[i] .. rowPtr[i+1])
+ *
+ * @tparam T Type of data stored in the matrix (ex: float, int)
+ */
+template <typename T>
+class CsrMatrix
+{
+private:
+    unsigned int row, col;
+    std::vector<unsigned int> rowPtr;
+    std::vector<unsigned int> colIdx;
+    std::vector<T> values;
+
+public:
+    /**
+     * @brief Compress a dense matrix, keeping every element that is not 0
+     *
+     * @param A Dense matrix
+     */
+    explicit CsrMatrix(const Matrix<T>& A);
+
+    /**
+     * @brief Expand into a dense matrix of the same size
+     *
+     * @param A Output matrix, getRows() x getCols()
+     */
+    void toDense(Matrix<T>& A) const;
+
+    unsigned int getRows() const { return this->row; }
+    unsigned int getCols() const { return this->col; }
+    /**
+     * @brief Number of stored (non-zero) elements
+     *
+     * @return size_t
+     */
+    size_t nonZeros() const { return this->values.size(); }
+    /**
+     * @brief Memory used by the row pointers, column indices and values
+     *
+     * @return size_t
+     */
+    size_t bytes() const
+    {
+        return this->rowPtr.size()*sizeof(unsigned int) + this->colIdx.size()*sizeof(unsigned int)
+             + this->values.size()*sizeof(T);
+    }
+    const unsigned int* getRowPtr() const { return this->rowPtr.data(); }
+    const unsigned int* getColIdx() const { return this->colIdx.data(); }
+    const T* getValues() const { return this->values.data(); }
+};
+
+/**
+ * @brief Sparse matrix in blocked CSR form. The matrix is cut into BSR_ROWS x
+ * BSR_COLS blocks and every block holding a non-zero is stored dense (row
+ * major, zeros included). Block row b covers rows b*BSR_ROWS.. and owns blocks
+ * blockPtr[b] .. blockPtr[b+1], block n starting at column blockCol[n]*BSR_COLS.
+ * Costs more memory than CSR when the non-zeros are scattered, but needs no
+ * gather when they are clustered.
+ *
+ * @tparam T Type of data stored in the matrix (ex: float, int)
+ */
+template <typename T>
+class BsrMatrix
+{
+private:
+    unsigned int row, col;
+    std::vector<unsigned int> blockPtr;
+    std::vector<unsigned int> blockCol;
+    std::vector<T> values;
+
+public:
+    /**
+     * @brief Compress a dense matrix, keeping every block with an element that is not 0
+     *
+     * @param A Dense matrix
+     */
+    explicit BsrMatrix(const Matrix<T>& A);
+
+    /**
+     * @brief Expand into a dense matrix of the same size
+     *
+     * @param A Output matrix, getRows() x getCols()
+     */
+    void toDense(Matrix<T>& A) const;
+
+    unsigned int getRows() const { return this->row; }
+    unsigned int getCols() const { return this->col; }
+    /**
+     * @brief Number of block rows, getRows() rounded up to BSR_ROWS
+     *
+     * @return unsigned int
+     */
+    unsigned int getBlockRows() const { return (unsigned int)this->blockPtr.size() - 1; }
+    /**
+     * @brief Number of stored blocks
+     *
+     * @return size_t
+     */
+    size_t blocks() const { return this->blockCol.size(); }
+    /**
+     * @brief Memory used by the block pointers, block columns and values
+     *
+     * @return size_t
+     */
+    size_t bytes() const
+    {
+        return this->blockPtr.size()*sizeof(unsigned int) + this->blockCol.size()*sizeof(unsigned int)
+             + this->values.size()*sizeof(T);
+    }
+    const unsigned int* getBlockPtr() const { return this->blockPtr.data(); }
+    const unsigned int* getBlockCol() const { return this->blockCol.data(); }
+    const T* getValues() const { return this->values.data(); }
+};
+
+/**
+ * @brief Sparse matrix-vector multiplication, y = A*x. Runs the AVX2 kernel if
+ * the CPU supports it. With a pool, the rows are split into tasks of about the
+ * same number of non-zeros.
+ *
+ * @param A Sparse matrix
+ * @param x Input vector, A.getCols() values
+ * @param y Output vector, A.getRows() values
+ * @param pool Worker threads to split the rows over, single threaded if nullptr
+ */
+void spmv(const CsrMatrix<float>& A, const float* x, float* y, ThreadPool* pool = nullptr);
+void spmv(const BsrMatrix<float>& A, const float* x, float* y, ThreadPool* pool = nullptr);
+
+/**
+ * @brief Sparse times dense matrix multiplication, C = A*B. Every non-zero of a
+ * row of A scales a row of B into the row of C, so only the rows of B that are
+ * needed are read. Runs the AVX2 kernel if the CPU supports it, splitting the
+ * rows over a pool like spmv().
+ *
+ * @param A Sparse matrix (M x K)
+ * @param B Dense matrix (K x N, not inverted)
+ * @param C Output matrix (M x N)
+ * @param pool Worker threads to split the rows over, single threaded if nullptr
+ */
+void spmm(const CsrMatrix<float>& A, const Matrix<float>& B, Matrix<float>& C, ThreadPool* pool = nullptr);
+void spmm(const BsrMatrix<float>& A, const Matrix<float>& B, Matrix<float>& C, ThreadPool* pool = nullptr);
+
+// Sparse matrix function implimentation
+
+template <typename T>
+CsrMatrix<T>::CsrMatrix(const Matrix<T>& A)
+{
+    this->row = A.getRows();
+    this->col = A.getCols();
+    this->rowPtr.reserve(this->row + 1);
+    this->rowPtr.push_back(0);
+    for(unsigned int i=0; i<this->row; i++)
+    {
+        const T* a = A[i];
+        for(unsigned int j=0; j<this->col; j++)
+        {
+            if(a[j] != 0)
+            {
+                this->colIdx.push_back(j);
+                this->values.push_back(a[j]);
+            }
+        }
+        this->rowPtr.push_back((unsigned int)this->values.size());
+    }
+}
+
+template <typename T>
+void CsrMatrix<T>::toDense(Matrix<T>& A) const
+{
+    if(A.getRows() != this->row || A.getCols() != this->col)
+    {
+        std::cerr<<"Error: cannot expand a "<<this->row<<"x"<<this->col<<" sparse matrix into a "
+                 <<A.getRows()<<"x"<<A.getCols()<<" matrix"<<std::endl;
+        return;
+    }
+    for(unsigned int i=0; i<this->row; i++)
+    {
+        T* a = A[i];
+        std::memset(a, 0, (size_t)this->col*sizeof(T));
+        for(unsigned int n=this->rowPtr[i]; n<this->rowPtr[i+1]; n++)
+        {
+            a[this->colIdx[n]] = this->values[n];
+        }
+    }
+}
+
+template <typename T>
+BsrMatrix<T>::BsrMatrix(const Matrix<T>& A)
+{
+    this->row = A.getRows();
+    this->col = A.getCols();
+    const unsigned int blockRows = (this->row + BSR_ROWS - 1) / BSR_ROWS;
+    const unsigned int blockCols = (this->col + BSR_COLS - 1) / BSR_COLS;
+    this->blockPtr.reserve(blockRows + 1);
+    this->blockPtr.push_back(0);
+    for(unsigned int b=0; b<blockRows; b++)
+    {
+        const unsigned int r0 = b*BSR_ROWS;
+        const unsigned int nr = std::min<unsigned int>(BSR_ROWS, this->row - r0);
+        for(unsigned int c=0; c<blockCols; c++)
+        {
+            const unsigned int c0 = c*BSR_COLS;
+            const unsigned int nc = std::min<unsigned int>(BSR_COLS, this->col - c0);
+            bool used = false;
+            for(unsigned int r=0; r<nr && !used; r++)
+            {
+                for(unsigned int j=0; j<nc; j++)
+                {
+                    if(A[r0 + r][c0 + j] != 0)
+                    {
+                        used = true;
+                        break;
+                    }
+                }
+            }
+            if(!used)
+            {
+                continue;
+            }
+            //store the whole block, the part outside of the matrix as zeros
+            this->blockCol.push_back(c);
+            const size_t start = this->values.size();
+            this->values.resize(start + BSR_ROWS*BSR_COLS, T(0));
+            for(unsigned int r=0; r<nr; r++)
+            {
+                for(unsigned int j=0; j<nc; j++)
+                {
+                    this->values[start + r*BSR_COLS + j] = A[r0 + r][c0 + j];
+                }
+            }
+        }
+        this->blockPtr.push_back((unsigned int)this->blockCol.size());
+    }
+}
+
+template <typename T>
+void BsrMatrix<T>::toDense(Matrix<T>& A) const
+{
+    if(A.getRows() != this->row || A.getCols() != this->col)
+    {
+        std::cerr<<"Error: cannot expand a "<<this->row<<"x"<<this->col<<" sparse matrix into a "
+                 <<A.getRows()<<"x"<<A.getCols()<<" matrix"<<std::endl;
+        return;
+    }
+    for(unsigned int i=0; i<this->row; i++)
+    {
+        std::memset(A[i], 0, (size_t)this->col*sizeof(T));
+    }
+    for(unsigned int b=0; b+1<this->blockPtr.size(); b++)
+    {
+        const unsigned int r0 = b*BSR_ROWS;
+        const unsigned int nr = std::min<unsigned int>(BSR_ROWS, this->row - r0);
+        for(unsigned int n=this->blockPtr[b]; n<this->blockPtr[b+1]; n++)
+        {
+            const unsigned int c0 = this->blockCol[n]*BSR_COLS;
+            const unsigned int nc = std::min<unsigned int>(BSR_COLS, this->col - c0);
+            for(unsigned int r=0; r<nr; r++)
+            {
+                std::memcpy(A[r0 + r] + c0, &this->values[(size_t)n*BSR_ROWS*BSR_COLS + r*BSR_COLS], nc*sizeof(T));
+            }
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,277 @@
+/**
+ * @file strassen.cpp
+ * @author Ethan Stockbridge (ethanstockbridge@gmail.com)
+ * @author Devan Kidd (jjkidd1245@gmail.com)
+ * @brief Strassen-Winograd fast matrix multiplication on top of the blocked GEMM engine
+ * @date 2022-01-25
+ */
+
+#include <iostream>
+#include <algorithm>
+#include <new>
+
+#include "strassen.h"
+#include "gemm.h"
+
+/**
+ * @brief Floats per MATRIX_ALIGNMENT bytes. Temporaries have their leading
+ * dimension and size rounded up to this, so every row stays aligned.
+ */
+static const size_t ALIGN_FLOATS = MATRIX_ALIGNMENT/sizeof(float);
+
+static size_t roundUp(size_t n)
+{
+    return ((n + ALIGN_FLOATS - 1)/ALIGN_FLOATS)*ALIGN_FLOATS;
+}
+
+StrassenWorkspace::StrassenWorkspace()
+{
+    this->buffer = nullptr;
+    this->capacity = 0;
+    this->used = 0;
+}
+
+StrassenWorkspace::~StrassenWorkspace()
+{
+    std::free(this->buffer);
+}
+
+void StrassenWorkspace::reserve(size_t floats)
+{
+    if(floats <= this->capacity)
+    {
+        return;
+    }
+    std::free(this->buffer);
+    this->buffer = static_cast<float*>(std::aligned_alloc(MATRIX_ALIGNMENT, roundUp(floats)*sizeof(float)));
+    if(this->buffer == nullptr)
+    {
+        this->capacity = 0;
+        throw std::bad_alloc();
+    }
+    this->capacity = roundUp(floats);
+    this->used = 0;
+}
+
+float* StrassenWorkspace::take(size_t floats)
+{
+    floats = roundUp(floats);
+    if(this->used + floats > this->capacity)
+    {
+        //the arena is sized by strassen_workspace_size(), so this is a bug
+        std::cerr<<"Error: Strassen workspace exhausted"<<std::endl;
+        throw std::bad_alloc();
+    }
+    float* block = this->buffer + this->used;
+    this->used += floats;
+    return block;
+}
+
+/**
+ * @brief Leading dimensions and sizes of the two temporaries of one level:
+ * X holds an M/2 x K/2 combination of A blocks, then the M/2 x N/2 product P1,
+ * Y holds a K/2 x N/2 combination of B blocks (stored like B).
+ */
+struct Level
+{
+    unsigned int mh, nh, kh;
+    unsigned int ldx, ldy;
+    unsigned int yRows, yCols;
+    size_t xSize, ySize;
+
+    Level(bool transB, unsigned int M, unsigned int N, unsigned int K)
+    {
+        this->mh = M/2;
+        this->nh = N/2;
+        this->kh = K/2;
+        this->ldx = roundUp(std::max(this->kh, this->nh));
+        this->yRows = transB ? this->nh : this->kh;
+        this->yCols = transB ? this->kh : this->nh;
+        this->ldy = roundUp(this->yCols);
+        this->xSize = (size_t)this->mh*this->ldx;
+        this->ySize = (size_t)this->yRows*this->ldy;
+    }
+};
+
+static bool isBase(unsigned int M, unsigned int N, unsigned int K, unsigned int cutoff)
+{
+    //below 2 the halves would be empty
+    return M <= cutoff || N <= cutoff || K <= cutoff || M < 2 || N < 2 || K < 2;
+}
+
+size_t strassen_workspace_size(unsigned int M, unsigned int N, unsigned int K, unsigned int cutoff)
+{
+    size_t total = 0;
+    //each level's temporaries stay taken while its 7 half size products run
+    while(!isBase(M, N, K, cutoff))
+    {
+        Level level(false, M, N, K);
+        total += roundUp(level.xSize) + roundUp(std::max(level.ySize, (size_t)level.nh*roundUp(level.kh)));
+        M = level.mh;
+        N = level.nh;
+        K = level.kh;
+    }
+    return total;
+}
+
+/**
+ * @brief c = a + b over a rows x cols block (c may alias a or b)
+ */
+static void add(unsigned int rows, unsigned int cols,
+                const float* a, unsigned int lda, const float* b, unsigned int ldb,
+                float* c, unsigned int ldc)
+{
+    for(unsigned int i=0; i<rows; i++)
+    {
+        const float* ar = a + (size_t)i*lda;
+        const float* br = b + (size_t)i*ldb;
+        float* cr = c + (size_t)i*ldc;
+        for(unsigned int j=0; j<cols; j++)
+        {
+            cr[j] = ar[j] + br[j];
+        }
+    }
+}
+
+/**
+ * @brief c = a - b over a rows x cols block (c may alias a or b)
+ */
+static void sub(unsigned int rows, unsigned int cols,
+                const float* a, unsigned int lda, const float* b, unsigned int ldb,
+                float* c, unsigned int ldc)
+{
+    for(unsigned int i=0; i<rows; i++)
+    {
+        const float* ar = a + (size_t)i*lda;
+        const float* br = b + (size_t)i*ldb;
+        float* cr = c + (size_t)i*ldc;
+        for(unsigned int j=0; j<cols; j++)
+        {
+            cr[j] = ar[j] - br[j];
+        }
+    }
+}
+
+/**
+ * @brief Address of element (k, n) of B, stored normally or transposed
+ */
+static const float* elementB(bool transB, const float* B, unsigned int ldb, unsigned int k, unsigned int n)
+{
+    return transB ? B + (size_t)n*ldb + k : B + (size_t)k*ldb + n;
+}
+
+static void strassen(bool transB, unsigned int M, unsigned int N, unsigned int K,
+                     const float* A, unsigned int lda,
+                     const float* B, unsigned int ldb,
+                     float* C, unsigned int ldc,
+                     unsigned int cutoff, StrassenWorkspace& workspace)
+{
+    if(isBase(M, N, K, cutoff))
+    {
+        sgemm(transB, M, N, K, 1.0f, A, lda, B, ldb, 0.0f, C, ldc);
+        return;
+    }
+
+    const Level l(transB, M, N, K);
+    const unsigned int mh = l.mh, nh = l.nh, kh = l.kh;
+    //B blocks are yRows x yCols in memory whether or not B is transposed
+    const unsigned int br = l.yRows, bc = l.yCols;
+
+    const float* A11 = A;
+    const float* A12 = A + kh;
+    const float* A21 = A + (size_t)mh*lda;
+    const float* A22 = A21 + kh;
+    const float* B11 = elementB(transB, B, ldb, 0, 0);
+    const float* B12 = elementB(transB, B, ldb, 0, nh);
+    const float* B21 = elementB(transB, B, ldb, kh, 0);
+    const float* B22 = elementB(transB, B, ldb, kh, nh);
+    float* C11 = C;
+    float* C12 = C + nh;
+    float* C21 = C + (size_t)mh*ldc;
+    float* C22 = C21 + nh;
+
+    const size_t top = workspace.mark();
+    float* X = workspace.take(l.xSize);
+    float* Y = workspace.take(l.ySize);
+    const unsigned int ldx = l.ldx, ldy = l.ldy;
+
+    //Winograd's schedule: 7 products and 15 additions with only X and Y as
+    //temporaries, the quadrants of C hold the other intermediate results
+    sub(mh, kh, A11, lda, A21, lda, X, ldx);                                    //S3 = A11 - A21
+    sub(br, bc, B22, ldb, B12, ldb, Y, ldy);                                    //T3 = B22 - B12
+    strassen(transB, mh, nh, kh, X, ldx, Y, ldy, C21, ldc, cutoff, workspace);  //P7 = S3*T3
+    add(mh, kh, A21, lda, A22, lda, X, ldx);                                    //S1 = A21 + A22
+    sub(br, bc, B12, ldb, B11, ldb, Y, ldy);                                    //T1 = B12 - B11
+    strassen(transB, mh, nh, kh, X, ldx, Y, ldy, C22, ldc, cutoff, workspace);  //P5 = S1*T1
+    sub(mh, kh, X, ldx, A11, lda, X, ldx);                                      //S2 = S1 - A11
+    sub(br, bc, B22, ldb, Y, ldy, Y, ldy);                                      //T2 = B22 - T1
+    strassen(transB, mh, nh, kh, X, ldx, Y, ldy, C12, ldc, cutoff, workspace);  //P6 = S2*T2
+    sub(mh, kh, A12, lda, X, ldx, X, ldx);                                      //S4 = A12 - S2
+    strassen(transB, mh, nh, kh, X, ldx, B22, ldb, C11, ldc, cutoff, workspace);//P3 = S4*B22
+    strassen(transB, mh, nh, kh, A11, lda, B11, ldb, X, ldx, cutoff, workspace);//P1 = A11*B11
+    add(mh, nh, X, ldx, C12, ldc, C12, ldc);                                    //U2 = P1 + P6
+    add(mh, nh, C12, ldc, C21, ldc, C21, ldc);                                  //U3 = U2 + P7
+    add(mh, nh, C12, ldc, C22, ldc, C12, ldc);                                  //U4 = U2 + P5
+    add(mh, nh, C21, ldc, C22, ldc, C22, ldc);                                  //C22 = U3 + P5
+    add(mh, nh, C12, ldc, C11, ldc, C12, ldc);                                  //C12 = U4 + P3
+    sub(br, bc, Y, ldy, B21, ldb, Y, ldy);                                      //T4 = T2 - B21
+    strassen(transB, mh, nh, kh, A22, lda, Y, ldy, C11, ldc, cutoff, workspace);//P4 = A22*T4
+    sub(mh, nh, C21, ldc, C11, ldc, C21, ldc);                                  //C21 = U3 - P4
+    strassen(transB, mh, nh, kh, A12, lda, B21, ldb, C11, ldc, cutoff, workspace);//P2 = A12*B21
+    add(mh, nh, X, ldx, C11, ldc, C11, ldc);                                    //C11 = P1 + P2
+
+    workspace.release(top);
+
+    //peel off the last row / column of odd dimensions
+    const unsigned int m2 = 2*mh, n2 = 2*nh, k2 = 2*kh;
+    if(k2 < K)
+    {
+        //rank 1 update of the even block with the last column of A / row of B
+        sgemm(transB, m2, n2, 1, 1.0f, A + k2, lda, elementB(transB, B, ldb, k2, 0), ldb, 1.0f, C, ldc);
+    }
+    if(n2 < N)
+    {
+        sgemm(transB, m2, 1, K, 1.0f, A, lda, elementB(transB, B, ldb, 0, n2), ldb, 0.0f, C + n2, ldc);
+    }
+    if(m2 < M)
+    {
+        sgemm(transB, 1, N, K, 1.0f, A + (size_t)m2*lda, lda, B, ldb, 0.0f, C + (size_t)m2*ldc, ldc);
+    }
+}
+
+void strassen_sgemm(bool transB, unsigned int M, unsigned int N, unsigned int K,
+                    const float* A, unsigned int lda,
+                    const float* B, unsigned int ldb,
+                    float* C, unsigned int ldc,
+                    unsigned int cutoff, StrassenWorkspace& workspace)
+{
+    workspace.reserve(strassen_workspace_size(M, N, K, cutoff));
+    strassen(transB, M, N, K, A, lda, B, ldb, C, ldc, cutoff, workspace);
+}
+
+void Strassen_matrix_multiplication(Matrix<float>& A, Matrix<float>& B, Matrix<float>& C, unsigned int cutoff)
+{
+    #ifdef CACHE_OPTIMIZATION
+    const bool transB = true;
+    const unsigned int N = B.getRows(); //B is stored inverted
+    const unsigned int K = B.getCols();
+    #else
+    const bool transB = false;
+    const unsigned int N = B.getCols();
+    const unsigned int K = B.getRows();
+    #endif
+    if( (A.getCols() != K) ||
+        (C.getCols() != N) ||
+        (C.getRows() != A.getRows()) )
+    {
+        std::cerr<<"Error: Matrix dimensions do not match"<<std::endl;
+        return;
+    }
+
+    StrassenWorkspace workspace;
+    strassen_sgemm(transB, A.getRows(), N, K,
+                   A.getData(), A.getStride(),
+                   B.getData(), B.getStride(),
+                   C.getData(), C.getStride(),
+                   cutoff, workspace);
+}
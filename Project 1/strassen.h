@@ -0,0 +1,130 @@
+/**
+ * @file strassen.h
+ * @author Ethan Stockbridge (ethanstockbridge@gmail.com)
+ * @author Devan Kidd (jjkidd1245@gmail.com)
+ * @brief Strassen-Winograd fast matrix multiplication on top of the blocked GEMM engine
+ * @date 2022-01-25
+ */
+#ifndef STRASSEN_H
+#define STRASSEN_H
+
+#include <cstddef>
+
+#include "matrix.h"
+
+/**
+ * @brief Default size below which the recursion stops and the blocked GEMM
+ * engine multiplies the blocks directly. Each level saves 1/8 of the
+ * multiplications but adds 15 block additions, so small blocks are faster with
+ * plain GEMM.
+ */
+#ifndef STRASSEN_CUTOFF
+#define STRASSEN_CUTOFF 1024
+#endif
+
+/**
+ * @brief Preallocated scratch memory for the recursion. Each level takes its two
+ * temporaries from the top of the arena and gives them back when it returns, so
+ * one buffer sized up front serves the whole recursion. Can be reused between
+ * multiplications, it only grows.
+ */
+class StrassenWorkspace
+{
+private:
+    /**
+     * @brief Scratch buffer, MATRIX_ALIGNMENT aligned
+     */
+    float* buffer;
+    /**
+     * @brief Number of floats in the buffer, and number currently taken
+     */
+    size_t capacity, used;
+
+public:
+    /**
+     * @brief Construct an empty workspace
+     */
+    StrassenWorkspace();
+    /**
+     * @brief Free the scratch buffer
+     */
+    ~StrassenWorkspace();
+    StrassenWorkspace(const StrassenWorkspace&) = delete;
+    StrassenWorkspace& operator=(const StrassenWorkspace&) = delete;
+
+    /**
+     * @brief Make sure the buffer holds at least the given number of floats.
+     * Must not be called while blocks are taken.
+     *
+     * @param floats Number of floats needed
+     */
+    void reserve(size_t floats);
+    /**
+     * @brief Take a block from the top of the arena
+     *
+     * @param floats Number of floats to take (rounded up to keep blocks aligned)
+     * @return float*
+     */
+    float* take(size_t floats);
+    /**
+     * @brief Get the current top of the arena, to give blocks back with release()
+     *
+     * @return size_t
+     */
+    size_t mark() const { return this->used; }
+    /**
+     * @brief Give back every block taken since mark() returned top
+     *
+     * @param top Value returned by mark()
+     */
+    void release(size_t top) { this->used = top; }
+};
+
+/**
+ * @brief Number of floats of workspace strassen_sgemm() needs for a multiplication
+ *
+ * @param M Rows of A and C
+ * @param N Columns of B and C
+ * @param K Columns of A, rows of B
+ * @param cutoff Size below which blocks are multiplied with GEMM
+ * @return size_t
+ */
+size_t strassen_workspace_size(unsigned int M, unsigned int N, unsigned int K, unsigned int cutoff);
+
+/**
+ * @brief Strassen-Winograd matrix multiplication, C = A*B (C is overwritten).
+ * Recurses with 7 half size multiplications and 15 additions while every
+ * dimension is above the cutoff, peeling off the last row / column of odd
+ * dimensions and fixing them up with GEMM. Same layout conventions as sgemm().
+ *
+ * @param transB If true, B is stored transposed (N x K)
+ * @param M Rows of A and C
+ * @param N Columns of B and C
+ * @param K Columns of A, rows of B
+ * @param A Input matrix A (M x K)
+ * @param lda Leading dimension of A
+ * @param B Input matrix B (K x N, or N x K if transB)
+ * @param ldb Leading dimension of B
+ * @param C Output matrix C (M x N)
+ * @param ldc Leading dimension of C
+ * @param cutoff Size below which blocks are multiplied with GEMM
+ * @param workspace Arena the temporaries are taken from, grown if needed
+ */
+void strassen_sgemm(bool transB, unsigned int M, unsigned int N, unsigned int K,
+                    const float* A, unsigned int lda,
+                    const float* B, unsigned int ldb,
+                    float* C, unsigned int ldc,
+                    unsigned int cutoff, StrassenWorkspace& workspace);
+
+/**
+ * @brief Matrix multiplication using Strassen-Winograd
+ *
+ * @param A First input matrix
+ * @param B Second input matrix (stored inverted if CACHE_OPTIMIZATION is defined)
+ * @param C Output matrix (A x B = C)
+ * @param cutoff Size below which blocks are multiplied with GEMM
+ */
+void Strassen_matrix_multiplication(Matrix<float>& A, Matrix<float>& B, Matrix<float>& C,
+                                    unsigned int cutoff = STRASSEN_CUTOFF);
+
+#endif
@@ -0,0 +1,224 @@
+/**
+ * @file thread_pool.cpp
+ * @author Ethan Stockbridge (ethanstockbridge@gmail.com)
+ * @author Devan Kidd (jjkidd1245@gmail.com)
+ * @brief Pthread worker pool with per-worker task queues and work stealing
+ * @date 2022-01-25
+ */
+
+#include <iostream>
+#include <sched.h>
+
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(unsigned int numThreads, bool pinThreads)
+    : generation(0), stopping(false), remaining(0)
+{
+    if(numThreads == 0)
+    {
+        numThreads = 1;
+    }
+    pthread_mutex_init(&(this->poolLock), NULL);
+    pthread_cond_init(&(this->workReady), NULL);
+    pthread_cond_init(&(this->workDone), NULL);
+
+    // list of CPUs we are allowed to run on, used for pinning
+    std::vector<int> cpus;
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if(pinThreads && sched_getaffinity(0, sizeof(allowed), &allowed) == 0)
+    {
+        for(int c=0; c<CPU_SETSIZE; c++)
+        {
+            if(CPU_ISSET(c, &allowed))
+            {
+                cpus.push_back(c);
+            }
+        }
+    }
+
+    for(unsigned int i=0; i<numThreads; i++)
+    {
+        Worker* w = new Worker();
+        pthread_mutex_init(&(w->lock), NULL);
+        w->pool = this;
+        w->id = i;
+        this->workers.push_back(w);
+    }
+    for(unsigned int i=0; i<numThreads; i++)
+    {
+        Worker* w = this->workers[i];
+        int err = pthread_create(&(w->thread), NULL, workerMain, w);
+        if (err)
+        {
+            std::cout << "Error: Unable to create thread," << err << std::endl;
+            exit(-1);
+        }
+        if(!cpus.empty())
+        {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpus[i % cpus.size()], &set);
+            pthread_setaffinity_np(w->thread, sizeof(set), &set);
+        }
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    pthread_mutex_lock(&(this->poolLock));
+    this->stopping = true;
+    pthread_cond_broadcast(&(this->workReady));
+    pthread_mutex_unlock(&(this->poolLock));
+
+    //join everyone before freeing anything, a worker may still be looking
+    //through the other workers' queues for something to steal
+    for(Worker* w : this->workers)
+    {
+        pthread_join(w->thread, NULL);
+    }
+    for(Worker* w : this->workers)
+    {
+        pthread_mutex_destroy(&(w->lock));
+        delete w;
+    }
+    pthread_cond_destroy(&(this->workDone));
+    pthread_cond_destroy(&(this->workReady));
+    pthread_mutex_destroy(&(this->poolLock));
+}
+
+unsigned int ThreadPool::availableCPUs()
+{
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if(sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+    {
+        return 1;
+    }
+    int count = CPU_COUNT(&allowed);
+    return count > 0 ? (unsigned int)count : 1;
+}
+
+void ThreadPool::run(unsigned int count, const Task& task)
+{
+    if(count == 0)
+    {
+        return;
+    }
+    this->post(count, task, true);
+}
+
+void ThreadPool::runOnEach(const Task& task)
+{
+    //one task per worker, so worker i's run is exactly task i
+    this->post(this->size(), task, false);
+}
+
+void ThreadPool::post(unsigned int count, const Task& task, bool stealable)
+{
+
+    // set the count before any task is visible, a worker still draining the
+    // previous batch may pick up one of these tasks straight away
+    this->remaining.store(count);
+
+    // hand each worker a contiguous run of task numbers
+    const unsigned int n = this->size();
+    for(unsigned int i=0; i<n; i++)
+    {
+        Worker* w = this->workers[i];
+        const unsigned int first = (unsigned int)(((unsigned long)count*i)/n);
+        const unsigned int last = (unsigned int)(((unsigned long)count*(i+1))/n);
+        pthread_mutex_lock(&(w->lock));
+        for(unsigned int t=first; t<last; t++)
+        {
+            w->tasks.push_back(Entry{&task, t, stealable});
+        }
+        pthread_mutex_unlock(&(w->lock));
+    }
+
+    pthread_mutex_lock(&(this->poolLock));
+    this->generation++;
+    pthread_cond_broadcast(&(this->workReady));
+    while(this->remaining.load() != 0)
+    {
+        pthread_cond_wait(&(this->workDone), &(this->poolLock));
+    }
+    pthread_mutex_unlock(&(this->poolLock));
+}
+
+void* ThreadPool::workerMain(void* arg)
+{
+    Worker* w = static_cast<Worker*>(arg);
+    ThreadPool* pool = w->pool;
+    unsigned long seen = 0;
+
+    pthread_mutex_lock(&(pool->poolLock));
+    while(true)
+    {
+        //sleep until a new batch is posted or the pool is shutting down
+        while(!pool->stopping && pool->generation == seen)
+        {
+            pthread_cond_wait(&(pool->workReady), &(pool->poolLock));
+        }
+        if(pool->stopping)
+        {
+            break;
+        }
+        seen = pool->generation;
+        pthread_mutex_unlock(&(pool->poolLock));
+
+        pool->runTasks(w);
+
+        pthread_mutex_lock(&(pool->poolLock));
+    }
+    pthread_mutex_unlock(&(pool->poolLock));
+    return NULL;
+}
+
+bool ThreadPool::popOwn(Worker* w, Entry& entry)
+{
+    bool found = false;
+    pthread_mutex_lock(&(w->lock));
+    if(!w->tasks.empty())
+    {   //take from the front so our own tiles are done in order
+        entry = w->tasks.front();
+        w->tasks.pop_front();
+        found = true;
+    }
+    pthread_mutex_unlock(&(w->lock));
+    return found;
+}
+
+bool ThreadPool::steal(Worker* thief, Entry& entry)
+{
+    const unsigned int n = this->size();
+    for(unsigned int offset=1; offset<n; offset++)
+    {
+        Worker* victim = this->workers[(thief->id + offset) % n];
+        pthread_mutex_lock(&(victim->lock));
+        if(!victim->tasks.empty() && victim->tasks.back().stealable)
+        {   //take from the back, furthest away from what the owner is working on
+            entry = victim->tasks.back();
+            victim->tasks.pop_back();
+            pthread_mutex_unlock(&(victim->lock));
+            return true;
+        }
+        pthread_mutex_unlock(&(victim->lock));
+    }
+    return false;
+}
+
+void ThreadPool::runTasks(Worker* w)
+{
+    Entry e;
+    while(this->popOwn(w, e) || this->steal(w, e))
+    {
+        (*e.fn)(e.task, w->id);
+        if(this->remaining.fetch_sub(1) == 1)
+        {   //last task of the batch, wake up the caller
+            pthread_mutex_lock(&(this->poolLock));
+            pthread_cond_signal(&(this->workDone));
+            pthread_mutex_unlock(&(this->poolLock));
+        }
+    }
+}
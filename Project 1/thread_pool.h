@@ -0,0 +1,120 @@
+/**
+ * @file thread_pool.h
+ * @author Ethan Stockbridge (ethanstockbridge@gmail.com)
+ * @author Devan Kidd (jjkidd1245@gmail.com)
+ * @brief Pthread worker pool with per-worker task queues and work stealing
+ * @date 2022-01-25
+ */
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <pthread.h>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <vector>
+
+/**
+ * @brief Pool of worker threads that runs batches of independent tasks.
+ * Every batch is split into contiguous runs of task numbers, one run per worker,
+ * so neighbouring tasks (ex: neighbouring tiles of C) stay on the same thread.
+ * A worker that runs out of tasks steals from the back of another worker's queue.
+ */
+class ThreadPool
+{
+public:
+    /**
+     * @brief Function run for every task: (task number, worker number)
+     */
+    typedef std::function<void(unsigned int, unsigned int)> Task;
+
+    /**
+     * @brief Construct a new pool and start its worker threads
+     *
+     * @param numThreads Number of worker threads (at least 1)
+     * @param pinThreads If true, pin worker i to the i'th CPU this process may run on
+     */
+    ThreadPool(unsigned int numThreads, bool pinThreads);
+    /**
+     * @brief Stop and join all worker threads
+     */
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /**
+     * @brief Get the number of worker threads
+     *
+     * @return unsigned int
+     */
+    unsigned int size() const { return (unsigned int)this->workers.size(); }
+
+    /**
+     * @brief Run task(i, worker) for every i in [0, count) on the pool and wait
+     * for all of them to complete. Only one thread may call run() at a time.
+     *
+     * @param count Number of tasks
+     * @param task Function to run for each task
+     */
+    void run(unsigned int count, const Task& task);
+
+    /**
+     * @brief Run task(i, i) once on every worker i and wait for all of them to
+     * complete. These tasks are never stolen, so task i always runs on worker i
+     * (ex: first touch placement, where the worker that writes a band of a matrix
+     * has to be the one that later uses it). Only one thread may call it at a time.
+     *
+     * @param task Function to run on each worker
+     */
+    void runOnEach(const Task& task);
+
+    /**
+     * @brief Number of logical CPUs available to this process
+     *
+     * @return unsigned int
+     */
+    static unsigned int availableCPUs();
+
+private:
+    /**
+     * @brief One queued task. The function travels with the task number so a
+     * worker that wakes up late can never run a task with another batch's function.
+     */
+    struct Entry
+    {
+        const Task* fn;
+        unsigned int task;
+        bool stealable;
+    };
+
+    /**
+     * @brief A worker thread and the queue of tasks it owns
+     */
+    struct Worker
+    {
+        pthread_t thread;
+        pthread_mutex_t lock;
+        std::deque<Entry> tasks;
+        ThreadPool* pool;
+        unsigned int id;
+    };
+
+    std::vector<Worker*> workers;
+
+    // batch state, protected by poolLock
+    pthread_mutex_t poolLock;
+    pthread_cond_t workReady;
+    pthread_cond_t workDone;
+    unsigned long generation;
+    bool stopping;
+    std::atomic<unsigned int> remaining;
+
+    static void* workerMain(void* arg);
+    void post(unsigned int count, const Task& task, bool stealable);
+    bool popOwn(Worker* w, Entry& entry);
+    bool steal(Worker* thief, Entry& entry);
+    void runTasks(Worker* w);
+};
+
+#endif
@@ -0,0 +1,314 @@
+/**
+ * @file transpose.cpp
+ * @author Ethan Stockbridge (ethanstockbridge@gmail.com)
+ * @author Devan Kidd (jjkidd1245@gmail.com)
+ * @brief Cache blocked matrix transpose built from 8x8 SIMD register transposes,
+ * split over threads in bands of blocks for large matrices
+ * @date 2022-01-25
+ */
+
+#include <immintrin.h>
+
+#include "transpose.h"
+#include "dispatch.h"
+#include "fill.h"
+
+/**
+ * @brief Transpose one 8x8 block from src into dst
+ */
+template <typename T>
+using Kernel8x8 = void (*)(const T* src, unsigned int lds, T* dst, unsigned int ldd);
+
+/**
+ * @brief Transpose two 8x8 blocks mirrored across the diagonal and swap them:
+ * a <- b^T and b <- a^T. With a == b it transposes a diagonal block in place.
+ */
+template <typename T>
+using Swap8x8 = void (*)(T* a, T* b, unsigned int ld);
+
+/**
+ * @brief Transpose the 8 rows of floats in r0..r7 (one 8x8 block) in registers
+ */
+__attribute__((target("avx")))
+static inline void transpose8_ps(__m256& r0, __m256& r1, __m256& r2, __m256& r3,
+                                 __m256& r4, __m256& r5, __m256& r6, __m256& r7)
+{
+    //interleave pairs of rows: 2x2 blocks
+    __m256 t0 = _mm256_unpacklo_ps(r0, r1);
+    __m256 t1 = _mm256_unpackhi_ps(r0, r1);
+    __m256 t2 = _mm256_unpacklo_ps(r2, r3);
+    __m256 t3 = _mm256_unpackhi_ps(r2, r3);
+    __m256 t4 = _mm256_unpacklo_ps(r4, r5);
+    __m256 t5 = _mm256_unpackhi_ps(r4, r5);
+    __m256 t6 = _mm256_unpacklo_ps(r6, r7);
+    __m256 t7 = _mm256_unpackhi_ps(r6, r7);
+    //combine 2x2 blocks: 4x4 blocks in each 128 bit lane
+    __m256 s0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 s1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+    __m256 s2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 s3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+    __m256 s4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 s5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+    __m256 s6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 s7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+    //swap the off diagonal 4x4 blocks across lanes
+    r0 = _mm256_permute2f128_ps(s0, s4, 0x20);
+    r1 = _mm256_permute2f128_ps(s1, s5, 0x20);
+    r2 = _mm256_permute2f128_ps(s2, s6, 0x20);
+    r3 = _mm256_permute2f128_ps(s3, s7, 0x20);
+    r4 = _mm256_permute2f128_ps(s0, s4, 0x31);
+    r5 = _mm256_permute2f128_ps(s1, s5, 0x31);
+    r6 = _mm256_permute2f128_ps(s2, s6, 0x31);
+    r7 = _mm256_permute2f128_ps(s3, s7, 0x31);
+}
+
+__attribute__((target("avx")))
+static void kernel_avx_8x8(const float* src, unsigned int lds, float* dst, unsigned int ldd)
+{
+    __m256 r0 = _mm256_loadu_ps(src + 0*(size_t)lds);
+    __m256 r1 = _mm256_loadu_ps(src + 1*(size_t)lds);
+    __m256 r2 = _mm256_loadu_ps(src + 2*(size_t)lds);
+    __m256 r3 = _mm256_loadu_ps(src + 3*(size_t)lds);
+    __m256 r4 = _mm256_loadu_ps(src + 4*(size_t)lds);
+    __m256 r5 = _mm256_loadu_ps(src + 5*(size_t)lds);
+    __m256 r6 = _mm256_loadu_ps(src + 6*(size_t)lds);
+    __m256 r7 = _mm256_loadu_ps(src + 7*(size_t)lds);
+    transpose8_ps(r0, r1, r2, r3, r4, r5, r6, r7);
+    _mm256_storeu_ps(dst + 0*(size_t)ldd, r0);
+    _mm256_storeu_ps(dst + 1*(size_t)ldd, r1);
+    _mm256_storeu_ps(dst + 2*(size_t)ldd, r2);
+    _mm256_storeu_ps(dst + 3*(size_t)ldd, r3);
+    _mm256_storeu_ps(dst + 4*(size_t)ldd, r4);
+    _mm256_storeu_ps(dst + 5*(size_t)ldd, r5);
+    _mm256_storeu_ps(dst + 6*(size_t)ldd, r6);
+    _mm256_storeu_ps(dst + 7*(size_t)ldd, r7);
+}
+
+__attribute__((target("avx")))
+static void swap_avx_8x8(float* a, float* b, unsigned int ld)
+{
+    //load both blocks before storing either, so a == b also works
+    __m256 a0 = _mm256_loadu_ps(a + 0*(size_t)ld);
+    __m256 a1 = _mm256_loadu_ps(a + 1*(size_t)ld);
+    __m256 a2 = _mm256_loadu_ps(a + 2*(size_t)ld);
+    __m256 a3 = _mm256_loadu_ps(a + 3*(size_t)ld);
+    __m256 a4 = _mm256_loadu_ps(a + 4*(size_t)ld);
+    __m256 a5 = _mm256_loadu_ps(a + 5*(size_t)ld);
+    __m256 a6 = _mm256_loadu_ps(a + 6*(size_t)ld);
+    __m256 a7 = _mm256_loadu_ps(a + 7*(size_t)ld);
+    __m256 b0 = _mm256_loadu_ps(b + 0*(size_t)ld);
+    __m256 b1 = _mm256_loadu_ps(b + 1*(size_t)ld);
+    __m256 b2 = _mm256_loadu_ps(b + 2*(size_t)ld);
+    __m256 b3 = _mm256_loadu_ps(b + 3*(size_t)ld);
+    __m256 b4 = _mm256_loadu_ps(b + 4*(size_t)ld);
+    __m256 b5 = _mm256_loadu_ps(b + 5*(size_t)ld);
+    __m256 b6 = _mm256_loadu_ps(b + 6*(size_t)ld);
+    __m256 b7 = _mm256_loadu_ps(b + 7*(size_t)ld);
+    transpose8_ps(a0, a1, a2, a3, a4, a5, a6, a7);
+    transpose8_ps(b0, b1, b2, b3, b4, b5, b6, b7);
+    _mm256_storeu_ps(a + 0*(size_t)ld, b0);
+    _mm256_storeu_ps(a + 1*(size_t)ld, b1);
+    _mm256_storeu_ps(a + 2*(size_t)ld, b2);
+    _mm256_storeu_ps(a + 3*(size_t)ld, b3);
+    _mm256_storeu_ps(a + 4*(size_t)ld, b4);
+    _mm256_storeu_ps(a + 5*(size_t)ld, b5);
+    _mm256_storeu_ps(a + 6*(size_t)ld, b6);
+    _mm256_storeu_ps(a + 7*(size_t)ld, b7);
+    _mm256_storeu_ps(b + 0*(size_t)ld, a0);
+    _mm256_storeu_ps(b + 1*(size_t)ld, a1);
+    _mm256_storeu_ps(b + 2*(size_t)ld, a2);
+    _mm256_storeu_ps(b + 3*(size_t)ld, a3);
+    _mm256_storeu_ps(b + 4*(size_t)ld, a4);
+    _mm256_storeu_ps(b + 5*(size_t)ld, a5);
+    _mm256_storeu_ps(b + 6*(size_t)ld, a6);
+    _mm256_storeu_ps(b + 7*(size_t)ld, a7);
+}
+
+/**
+ * @brief Transpose the 8 rows of short ints in r[0..7] (one 8x8 block) in registers.
+ * SSE2 is part of x86-64, so this needs no dispatch.
+ */
+static inline void transpose8_epi16(__m128i* r)
+{
+    //interleave pairs of rows: 2x2 blocks
+    __m128i b0 = _mm_unpacklo_epi16(r[0], r[1]);
+    __m128i b1 = _mm_unpackhi_epi16(r[0], r[1]);
+    __m128i b2 = _mm_unpacklo_epi16(r[2], r[3]);
+    __m128i b3 = _mm_unpackhi_epi16(r[2], r[3]);
+    __m128i b4 = _mm_unpacklo_epi16(r[4], r[5]);
+    __m128i b5 = _mm_unpackhi_epi16(r[4], r[5]);
+    __m128i b6 = _mm_unpacklo_epi16(r[6], r[7]);
+    __m128i b7 = _mm_unpackhi_epi16(r[6], r[7]);
+    //4x4 blocks
+    __m128i c0 = _mm_unpacklo_epi32(b0, b2);
+    __m128i c1 = _mm_unpackhi_epi32(b0, b2);
+    __m128i c2 = _mm_unpacklo_epi32(b1, b3);
+    __m128i c3 = _mm_unpackhi_epi32(b1, b3);
+    __m128i c4 = _mm_unpacklo_epi32(b4, b6);
+    __m128i c5 = _mm_unpackhi_epi32(b4, b6);
+    __m128i c6 = _mm_unpacklo_epi32(b5, b7);
+    __m128i c7 = _mm_unpackhi_epi32(b5, b7);
+    //full columns
+    r[0] = _mm_unpacklo_epi64(c0, c4);
+    r[1] = _mm_unpackhi_epi64(c0, c4);
+    r[2] = _mm_unpacklo_epi64(c1, c5);
+    r[3] = _mm_unpackhi_epi64(c1, c5);
+    r[4] = _mm_unpacklo_epi64(c2, c6);
+    r[5] = _mm_unpackhi_epi64(c2, c6);
+    r[6] = _mm_unpacklo_epi64(c3, c7);
+    r[7] = _mm_unpackhi_epi64(c3, c7);
+}
+
+static void kernel_sse2_8x8(const short int* src, unsigned int lds, short int* dst, unsigned int ldd)
+{
+    __m128i r[8];
+    for(int i=0; i<8; i++)
+    {
+        r[i] = _mm_loadu_si128((const __m128i*)(src + i*(size_t)lds));
+    }
+    transpose8_epi16(r);
+    for(int i=0; i<8; i++)
+    {
+        _mm_storeu_si128((__m128i*)(dst + i*(size_t)ldd), r[i]);
+    }
+}
+
+static void swap_sse2_8x8(short int* a, short int* b, unsigned int ld)
+{
+    __m128i ra[8], rb[8];
+    for(int i=0; i<8; i++)
+    {
+        ra[i] = _mm_loadu_si128((const __m128i*)(a + i*(size_t)ld));
+        rb[i] = _mm_loadu_si128((const __m128i*)(b + i*(size_t)ld));
+    }
+    transpose8_epi16(ra);
+    transpose8_epi16(rb);
+    for(int i=0; i<8; i++)
+    {
+        _mm_storeu_si128((__m128i*)(a + i*(size_t)ld), rb[i]);
+        _mm_storeu_si128((__m128i*)(b + i*(size_t)ld), ra[i]);
+    }
+}
+
+/**
+ * @brief Out-of-place blocked transpose: whole 8x8 blocks go through the SIMD
+ * kernel, TRANSPOSE_BLOCK at a time, and the ragged right and bottom edges go
+ * through the generic version. Each band of TRANSPOSE_BLOCK source rows is one
+ * task, writing its own band of destination columns, so large matrices (at
+ * least FILL_PARALLEL_MIN bytes) are split over the shared fill pool.
+ */
+template <typename T>
+static void transpose_driver(Kernel8x8<T> kernel, const T* src, unsigned int lds,
+                             T* dst, unsigned int ldd, unsigned int rows, unsigned int cols)
+{
+    const unsigned int rows8 = rows & ~7u;
+    const unsigned int cols8 = cols & ~7u;
+    const unsigned int bands = (rows8 + TRANSPOSE_BLOCK - 1) / TRANSPOSE_BLOCK;
+    parallel_fill(bands, (size_t)rows*cols*sizeof(T), [&](unsigned int band)
+    {
+        const unsigned int ib = band*TRANSPOSE_BLOCK;
+        const unsigned int iend = std::min<unsigned int>(rows8, ib+TRANSPOSE_BLOCK);
+        for(unsigned int jb=0; jb<cols8; jb+=TRANSPOSE_BLOCK)
+        {
+            const unsigned int jend = std::min<unsigned int>(cols8, jb+TRANSPOSE_BLOCK);
+            for(unsigned int i=ib; i<iend; i+=8)
+            {
+                for(unsigned int j=jb; j<jend; j+=8)
+                {
+                    kernel(src + (size_t)i*lds + j, lds, dst + (size_t)j*ldd + i, ldd);
+                }
+            }
+        }
+    });
+    //right edge: every row, columns past the last whole block
+    if(cols8 < cols)
+    {
+        transpose<T>(src + cols8, lds, dst + (size_t)cols8*ldd, ldd, rows, cols - cols8);
+    }
+    //bottom edge: rows past the last whole block, columns of the whole blocks
+    if(rows8 < rows)
+    {
+        transpose<T>(src + (size_t)rows8*lds, lds, dst + rows8, ldd, rows - rows8, cols8);
+    }
+}
+
+/**
+ * @brief In-place blocked transpose of an n x n block: pairs of 8x8 blocks
+ * mirrored across the diagonal are swapped by the SIMD kernel, and the ragged
+ * edge is swapped element by element. Block row ib swaps the blocks right of the
+ * diagonal with the ones below it, which no other block row touches, so block
+ * rows are split over the shared fill pool for large matrices. Block rows get
+ * shorter down the diagonal, so each task takes one from each end.
+ */
+template <typename T>
+static void transpose_inplace_driver(Swap8x8<T> swap, T* data, unsigned int ld, unsigned int n)
+{
+    const unsigned int n8 = n & ~7u;
+    const unsigned int blockRows = (n8 + TRANSPOSE_BLOCK - 1) / TRANSPOSE_BLOCK;
+    auto blockRow = [&](unsigned int ib)
+    {
+        const unsigned int iend = std::min<unsigned int>(n8, ib+TRANSPOSE_BLOCK);
+        for(unsigned int jb=ib; jb<n8; jb+=TRANSPOSE_BLOCK)
+        {
+            const unsigned int jend = std::min<unsigned int>(n8, jb+TRANSPOSE_BLOCK);
+            for(unsigned int i=ib; i<iend; i+=8)
+            {
+                //on a diagonal block pair, only visit the upper triangle of 8x8 blocks
+                for(unsigned int j=(jb == ib ? i : jb); j<jend; j+=8)
+                {
+                    swap(data + (size_t)i*ld + j, data + (size_t)j*ld + i, ld);
+                }
+            }
+        }
+    };
+    parallel_fill((blockRows + 1) / 2, (size_t)n*n*sizeof(T), [&](unsigned int task)
+    {
+        blockRow(task*TRANSPOSE_BLOCK);
+        if(blockRows - 1 - task != task)
+        {
+            blockRow((blockRows - 1 - task)*TRANSPOSE_BLOCK);
+        }
+    });
+    //every pair with its column in the ragged edge
+    for(unsigned int i=0; i<n; i++)
+    {
+        for(unsigned int j=std::max(n8, i+1); j<n; j++)
+        {
+            std::swap(data[(size_t)i*ld + j], data[(size_t)j*ld + i]);
+        }
+    }
+}
+
+void transpose(const float* src, unsigned int lds, float* dst, unsigned int ldd, unsigned int rows, unsigned int cols)
+{
+    if(cpu_features().avx)
+    {
+        transpose_driver<float>(kernel_avx_8x8, src, lds, dst, ldd, rows, cols);
+    }
+    else
+    {
+        transpose<float>(src, lds, dst, ldd, rows, cols);
+    }
+}
+
+void transpose(const short int* src, unsigned int lds, short int* dst, unsigned int ldd, unsigned int rows, unsigned int cols)
+{
+    transpose_driver<short int>(kernel_sse2_8x8, src, lds, dst, ldd, rows, cols);
+}
+
+void transpose_inplace(float* data, unsigned int ld, unsigned int n)
+{
+    if(cpu_features().avx)
+    {
+        transpose_inplace_driver<float>(swap_avx_8x8, data, ld, n);
+    }
+    else
+    {
+        transpose_inplace<float>(data, ld, n);
+    }
+}
+
+void transpose_inplace(short int* data, unsigned int ld, unsigned int n)
+{
+    transpose_inplace_driver<short int>(swap_sse2_8x8, data, ld, n);
+}
@@ -0,0 +1,106 @@
+/**
+ * @file transpose.h
+ * @author Ethan Stockbridge (ethanstockbridge@gmail.com)
+ * @author Devan Kidd (jjkidd1245@gmail.com)
+ * @brief Cache blocked matrix transpose, out-of-place and in-place
+ * @date 2022-01-25
+ */
+#ifndef TRANSPOSE_H
+#define TRANSPOSE_H
+
+#include <cstddef>
+#include <algorithm>
+#include <utility>
+
+/**
+ * @brief Side of the square blocks the transpose walks through. A block of the
+ * source and a block of the destination (2 x 16KB for floats) fit in L1 together,
+ * so the strided side of the copy only touches lines that are already cached.
+ */
+#ifndef TRANSPOSE_BLOCK
+#define TRANSPOSE_BLOCK 64
+#endif
+
+/**
+ * @brief Out-of-place transpose: dst[j][i] = src[i][j] for a rows x cols block.
+ * Generic version for any element type, see the float and short int overloads
+ * for the SIMD versions.
+ *
+ * @param src Source matrix (rows x cols)
+ * @param lds Leading dimension of src
+ * @param dst Destination matrix (cols x rows), must not overlap src
+ * @param ldd Leading dimension of dst
+ * @param rows Rows of src
+ * @param cols Columns of src
+ */
+template <typename T>
+void transpose(const T* src, unsigned int lds, T* dst, unsigned int ldd, unsigned int rows, unsigned int cols)
+{
+    for(unsigned int ib=0; ib<rows; ib+=TRANSPOSE_BLOCK)
+    {
+        const unsigned int iend = std::min<unsigned int>(rows, ib+TRANSPOSE_BLOCK);
+        for(unsigned int jb=0; jb<cols; jb+=TRANSPOSE_BLOCK)
+        {
+            const unsigned int jend = std::min<unsigned int>(cols, jb+TRANSPOSE_BLOCK);
+            for(unsigned int i=ib; i<iend; i++)
+            {
+                const T* s = src + (size_t)i*lds;
+                for(unsigned int j=jb; j<jend; j++)
+                {
+                    dst[(size_t)j*ldd + i] = s[j];
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @brief In-place transpose of a square n x n block. Generic version for any
+ * element type, see the float and short int overloads for the SIMD versions.
+ *
+ * @param data Matrix to transpose
+ * @param ld Leading dimension of data
+ * @param n Rows and columns of the block
+ */
+template <typename T>
+void transpose_inplace(T* data, unsigned int ld, unsigned int n)
+{
+    for(unsigned int ib=0; ib<n; ib+=TRANSPOSE_BLOCK)
+    {
+        const unsigned int iend = std::min<unsigned int>(n, ib+TRANSPOSE_BLOCK);
+        for(unsigned int jb=ib; jb<n; jb+=TRANSPOSE_BLOCK)
+        {
+            const unsigned int jend = std::min<unsigned int>(n, jb+TRANSPOSE_BLOCK);
+            //swap block (ib, jb) with block (jb, ib), only above the diagonal
+            for(unsigned int i=ib; i<iend; i++)
+            {
+                for(unsigned int j=std::max(jb, i+1); j<jend; j++)
+                {
+                    std::swap(data[(size_t)i*ld + j], data[(size_t)j*ld + i]);
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @brief Out-of-place transpose of floats, built from 8x8 AVX register transposes
+ */
+void transpose(const float* src, unsigned int lds, float* dst, unsigned int ldd, unsigned int rows, unsigned int cols);
+/**
+ * @brief Out-of-place transpose of short ints, built from 8x8 SSE2 register transposes
+ */
+void transpose(const short int* src, unsigned int lds, short int* dst, unsigned int ldd, unsigned int rows, unsigned int cols);
+/**
+ * @brief In-place transpose of a square block of floats, built from 8x8 AVX
+ * register transposes: each pair of 8x8 blocks mirrored across the diagonal is
+ * loaded, transposed in registers and stored back swapped.
+ */
+void transpose_inplace(float* data, unsigned int ld, unsigned int n);
+/**
+ * @brief In-place transpose of a square block of short ints, built from 8x8 SSE2
+ * register transposes
+ */
+void transpose_inplace(short int* data, unsigned int ld, unsigned int n);
+
+#endif
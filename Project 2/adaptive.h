@@ -0,0 +1,266 @@
+/**
+ * @file adaptive.h
+ * @author Ethan Stockbridge (ethanstockbridge@gmail.com)
+ * @author Devan Kidd (jjkidd1245@gmail.com)
+ * @brief Controller that picks the compression level of each chunk from the
+ * measured ratio and throughput, aiming at a target speed or a target ratio
+ * @date 2022-02-06
+ */
+
+#ifndef ADAPTIVE_H_
+#define ADAPTIVE_H_
+
+#include <pthread.h>
+#include <algorithm>
+#include <ostream>
+#include <vector>
+
+/**
+ * @brief Number of chunks compressed at the current level before the level is
+ * changed. Default 32
+ *
+ */
+#ifndef ADAPT_WINDOW
+#define ADAPT_WINDOW 32
+#endif
+
+/**
+ * @brief A chunk that compresses to more than this fraction of its size counts as
+ * incompressible, and the chunks after it are stored raw. Default 0.97
+ *
+ */
+#ifndef ADAPT_RAW_RATIO
+#define ADAPT_RAW_RATIO 0.97
+#endif
+
+/**
+ * @brief While storing raw, every ADAPT_PROBE_INTERVAL'th chunk is still compressed
+ * to find out whether the data compresses again. Default 16
+ *
+ */
+#ifndef ADAPT_PROBE_INTERVAL
+#define ADAPT_PROBE_INTERVAL 16
+#endif
+
+/**
+ * @brief Lowest level the controller goes down to. Default 1
+ *
+ */
+#ifndef ADAPT_MIN_LEVEL
+#define ADAPT_MIN_LEVEL 1
+#endif
+
+/**
+ * @brief Margin over a target before the level moves away from it, so the level
+ * does not go back and forth around the target. Default 1.15
+ *
+ */
+#ifndef ADAPT_HYSTERESIS
+#define ADAPT_HYSTERESIS 1.15
+#endif
+
+/**
+ * @brief Picks the level of each chunk. The workers ask for a level with choose()
+ * and report how the chunk went with record(). After every ADAPT_WINDOW chunks at
+ * the current level, the level goes one step:
+ * - down if the throughput is below the target speed, or the ratio is well above
+ *   the target ratio (CPU spent for nothing),
+ * - up if the ratio is below the target ratio, or there is no target ratio and the
+ *   throughput is well above the target speed.
+ * Incompressible chunks (ex: random data) switch to storing raw, which costs no
+ * compression time, until a probe chunk compresses again.
+ *
+ */
+class LevelController
+{
+private:
+    int minLevel;
+    int maxLevel;
+    int level;
+
+    /**
+     * @brief Targets in MB/s and in uncompressed/compressed size, 0 if not set
+     *
+     */
+    double targetSpeed;
+    double targetRatio;
+
+    /**
+     * @brief Workers compressing at once, to turn the speed of one chunk into the
+     * speed of the whole program
+     *
+     */
+    unsigned int workers;
+
+    /**
+     * @brief Chunks, bytes in and out, and seconds spent compressing at the
+     * current level since it was last changed
+     *
+     */
+    unsigned int windowChunks;
+    double windowIn;
+    double windowOut;
+    double windowSeconds;
+
+    /**
+     * @brief Whether chunks are stored raw, and the chunks since the last probe
+     *
+     */
+    bool storing;
+    unsigned int sinceProbe;
+
+    /**
+     * @brief Chunks compressed at each level (from minLevel), and stored raw
+     *
+     */
+    std::vector<unsigned long> chunksAtLevel;
+    unsigned long storedChunks;
+
+    pthread_mutex_t lock;
+
+    /**
+     * @brief Move the level one step after a full window. The lock has to be held.
+     *
+     */
+    void adapt()
+    {
+        const double speed = this->windowIn/this->windowSeconds*this->workers/1e6;
+        const double ratio = this->windowIn/this->windowOut;
+        const bool tooSlow = this->targetSpeed > 0 && speed < this->targetSpeed;
+        const bool fastEnough = this->targetSpeed <= 0 || speed > this->targetSpeed*ADAPT_HYSTERESIS;
+        int step = 0;
+        if(tooSlow)
+        {
+            step = -1;
+        }
+        else if(this->targetRatio > 0)
+        {
+            if(ratio < this->targetRatio && fastEnough)
+            {
+                step = 1;
+            }
+            else if(ratio > this->targetRatio*ADAPT_HYSTERESIS)
+            {
+                step = -1;
+            }
+        }
+        else if(fastEnough)
+        {
+            step = 1;
+        }
+        this->level = std::min(this->maxLevel, std::max(this->minLevel, this->level + step));
+        this->windowChunks = 0;
+        this->windowIn = this->windowOut = this->windowSeconds = 0;
+    }
+
+public:
+    /**
+     * @brief Construct a new controller
+     *
+     * @param mminLevel Lowest level to use
+     * @param mmaxLevel Highest level to use
+     * @param startLevel Level of the first chunks
+     * @param mtargetSpeed Target throughput of the program in MB/s, 0 for none
+     * @param mtargetRatio Target compression ratio, 0 for none
+     * @param mworkers Number of worker threads
+     */
+    LevelController(int mminLevel, int mmaxLevel, int startLevel, double mtargetSpeed, double mtargetRatio, unsigned int mworkers) :
+        minLevel(mminLevel), maxLevel(std::max(mminLevel, mmaxLevel)), level(0), targetSpeed(mtargetSpeed),
+        targetRatio(mtargetRatio), workers(mworkers > 0 ? mworkers : 1), windowChunks(0), windowIn(0), windowOut(0),
+        windowSeconds(0), storing(false), sinceProbe(0), chunksAtLevel(this->maxLevel - this->minLevel + 1, 0), storedChunks(0)
+    {
+        this->level = std::min(this->maxLevel, std::max(this->minLevel, startLevel));
+        pthread_mutex_init(&(this->lock), NULL);
+    }
+
+    ~LevelController()
+    {
+        pthread_mutex_destroy(&(this->lock));
+    }
+
+    LevelController(const LevelController&) = delete;
+    LevelController& operator=(const LevelController&) = delete;
+
+    /**
+     * @brief Pick how to compress the next chunk
+     *
+     * @param chosen Output level, if the chunk is to be compressed
+     * @return true Compress the chunk at the chosen level
+     * @return false Store the chunk raw
+     */
+    bool choose(int& chosen)
+    {
+        pthread_mutex_lock(&(this->lock));
+        bool compress = true;
+        if(this->storing)
+        {
+            this->sinceProbe++;
+            compress = (this->sinceProbe >= ADAPT_PROBE_INTERVAL);
+            if(compress)
+            {
+                this->sinceProbe = 0;
+            }
+        }
+        chosen = this->level;
+        if(!compress)
+        {
+            this->storedChunks++;
+        }
+        pthread_mutex_unlock(&(this->lock));
+        return compress;
+    }
+
+    /**
+     * @brief Report a compressed chunk
+     *
+     * @param used Level it was compressed at
+     * @param in Uncompressed size in bytes
+     * @param out Compressed size in bytes
+     * @param seconds Time spent compressing it
+     */
+    void record(int used, size_t in, size_t out, double seconds)
+    {
+        pthread_mutex_lock(&(this->lock));
+        this->chunksAtLevel[used - this->minLevel]++;
+        this->storing = (out >= in*ADAPT_RAW_RATIO);
+        if(this->storing)
+        {
+            this->sinceProbe = 0;
+        }
+        //chunks still in flight from before the last change say nothing about this level
+        if(used == this->level && !this->storing)
+        {
+            this->windowChunks++;
+            this->windowIn += in;
+            this->windowOut += out;
+            this->windowSeconds += seconds;
+            if(this->windowChunks >= ADAPT_WINDOW)
+            {
+                this->adapt();
+            }
+        }
+        pthread_mutex_unlock(&(this->lock));
+    }
+
+    /**
+     * @brief Print how many chunks were compressed at each level, and stored raw
+     *
+     * @param out Stream to print to
+     */
+    void printSummary(std::ostream& out)
+    {
+        pthread_mutex_lock(&(this->lock));
+        out << "Chunks per level:";
+        for(size_t i=0; i<this->chunksAtLevel.size(); i++)
+        {
+            if(this->chunksAtLevel[i] > 0)
+            {
+                out << " " << (int)i + this->minLevel << ": " << this->chunksAtLevel[i];
+            }
+        }
+        out << ", stored raw: " << this->storedChunks << std::endl;
+        pthread_mutex_unlock(&(this->lock));
+    }
+};
+
+#endif
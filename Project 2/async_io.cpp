@@ -0,0 +1,400 @@
+/**
+ * @file async_io.cpp
+ * @author Ethan Stockbridge (ethanstockbridge@gmail.com)
+ * @author Devan Kidd (jjkidd1245@gmail.com)
+ * @brief Asynchronous file reads and writes with the io_uring and Linux AIO
+ * system calls (no liburing or libaio needed)
+ * @date 2022-02-06
+ */
+
+#include <linux/aio_abi.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <new>
+
+#include "async_io.h"
+
+AsyncIO::AsyncIO(unsigned int mdepth, int requested) : backend(IO_BACKEND_SYNC), depth(mdepth > 0 ? mdepth : 1),
+    inFlight(0), ringFd(-1), sqRing(MAP_FAILED), cqRing(MAP_FAILED), sqRingSize(0), cqRingSize(0),
+    sqes((io_uring_sqe*)MAP_FAILED), sqesSize(0), sqTail(nullptr), sqMask(nullptr), sqArray(nullptr),
+    cqHead(nullptr), cqTail(nullptr), cqMask(nullptr), cqes(nullptr), aioContext(0)
+{
+    if((requested == IO_BACKEND_AUTO || requested == IO_BACKEND_URING) && this->setupUring())
+    {
+        this->backend = IO_BACKEND_URING;
+    }
+    else if((requested == IO_BACKEND_AUTO || requested == IO_BACKEND_AIO) && this->setupAio())
+    {
+        this->backend = IO_BACKEND_AIO;
+    }
+}
+
+AsyncIO::~AsyncIO()
+{
+    //requests still in flight write into buffers about to be freed
+    while(this->inFlight > 0)
+    {
+        this->wait();
+    }
+    if(this->sqes != MAP_FAILED)
+    {
+        munmap(this->sqes, this->sqesSize);
+    }
+    if(this->cqRing != MAP_FAILED && this->cqRing != this->sqRing)
+    {
+        munmap(this->cqRing, this->cqRingSize);
+    }
+    if(this->sqRing != MAP_FAILED)
+    {
+        munmap(this->sqRing, this->sqRingSize);
+    }
+    if(this->ringFd >= 0)
+    {
+        close(this->ringFd);
+    }
+    if(this->backend == IO_BACKEND_AIO)
+    {
+        syscall(__NR_io_destroy, this->aioContext);
+    }
+}
+
+/**
+ * @brief Create an io_uring and map its rings. Needs IORING_OP_READ and
+ * IORING_OP_WRITE (Linux 5.6), which came with IORING_FEAT_RW_CUR_POS.
+ */
+bool AsyncIO::setupUring()
+{
+    io_uring_params p;
+    std::memset(&p, 0, sizeof(p));
+    this->ringFd = (int)syscall(__NR_io_uring_setup, this->depth, &p);
+    if(this->ringFd < 0)
+    {
+        return false;
+    }
+    if(!(p.features & IORING_FEAT_RW_CUR_POS))
+    {
+        close(this->ringFd);
+        this->ringFd = -1;
+        return false;
+    }
+    this->sqRingSize = p.sq_off.array + p.sq_entries*sizeof(unsigned int);
+    this->cqRingSize = p.cq_off.cqes + p.cq_entries*sizeof(io_uring_cqe);
+    //both rings in one mapping when the kernel allows it
+    if(p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        this->sqRingSize = this->cqRingSize = std::max(this->sqRingSize, this->cqRingSize);
+    }
+    this->sqRing = mmap(nullptr, this->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        this->ringFd, IORING_OFF_SQ_RING);
+    if(this->sqRing != MAP_FAILED)
+    {
+        this->cqRing = (p.features & IORING_FEAT_SINGLE_MMAP) ? this->sqRing :
+            mmap(nullptr, this->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->ringFd, IORING_OFF_CQ_RING);
+    }
+    if(this->cqRing != MAP_FAILED)
+    {
+        this->sqesSize = p.sq_entries*sizeof(io_uring_sqe);
+        this->sqes = (io_uring_sqe*)mmap(nullptr, this->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                         this->ringFd, IORING_OFF_SQES);
+    }
+    if(this->sqes == MAP_FAILED)
+    {
+        //the destructor unmaps what was mapped, as long as the backend is not AIO
+        return false;
+    }
+    char* sq = (char*)this->sqRing;
+    char* cq = (char*)this->cqRing;
+    this->sqTail = (unsigned int*)(sq + p.sq_off.tail);
+    this->sqMask = (unsigned int*)(sq + p.sq_off.ring_mask);
+    this->sqArray = (unsigned int*)(sq + p.sq_off.array);
+    this->cqHead = (unsigned int*)(cq + p.cq_off.head);
+    this->cqTail = (unsigned int*)(cq + p.cq_off.tail);
+    this->cqMask = (unsigned int*)(cq + p.cq_off.ring_mask);
+    this->cqes = (io_uring_cqe*)(cq + p.cq_off.cqes);
+    return true;
+}
+
+/**
+ * @brief Create a Linux AIO context. Reads and writes only run asynchronously on
+ * files opened with O_DIRECT, others complete during io_submit().
+ */
+bool AsyncIO::setupAio()
+{
+    aio_context_t context = 0;
+    if(syscall(__NR_io_setup, this->depth, &context) < 0)
+    {
+        return false;
+    }
+    this->aioContext = context;
+    return true;
+}
+
+bool AsyncIO::read(int fd, char* buffer, size_t size, uint64_t offset, uint64_t tag)
+{
+    return this->submit(false, fd, buffer, size, offset, tag);
+}
+
+bool AsyncIO::write(int fd, const char* buffer, size_t size, uint64_t offset, uint64_t tag)
+{
+    return this->submit(true, fd, (char*)buffer, size, offset, tag);
+}
+
+bool AsyncIO::submit(bool isWrite, int fd, char* buffer, size_t size, uint64_t offset, uint64_t tag)
+{
+    if(this->backend == IO_BACKEND_URING)
+    {
+        //fill the next entry, publish it to the kernel with the tail, then enter
+        const unsigned int tail = *(this->sqTail);
+        const unsigned int index = tail & *(this->sqMask);
+        io_uring_sqe* sqe = &(this->sqes[index]);
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = isWrite ? IORING_OP_WRITE : IORING_OP_READ;
+        sqe->fd = fd;
+        sqe->addr = (uint64_t)(uintptr_t)buffer;
+        sqe->len = (uint32_t)size;
+        sqe->off = offset;
+        sqe->user_data = tag;
+        this->sqArray[index] = index;
+        __atomic_store_n(this->sqTail, tail + 1, __ATOMIC_RELEASE);
+        long submitted;
+        do
+        {
+            submitted = syscall(__NR_io_uring_enter, this->ringFd, 1, 0, 0, nullptr, 0);
+        } while(submitted < 0 && errno == EINTR);
+        if(submitted != 1)
+        {
+            return false;
+        }
+    }
+    else if(this->backend == IO_BACKEND_AIO)
+    {
+        //the kernel copies the control block during io_submit()
+        iocb cb;
+        std::memset(&cb, 0, sizeof(cb));
+        cb.aio_lio_opcode = isWrite ? IOCB_CMD_PWRITE : IOCB_CMD_PREAD;
+        cb.aio_fildes = (uint32_t)fd;
+        cb.aio_buf = (uint64_t)(uintptr_t)buffer;
+        cb.aio_nbytes = size;
+        cb.aio_offset = (int64_t)offset;
+        cb.aio_data = tag;
+        iocb* list[1] = {&cb};
+        long submitted;
+        do
+        {
+            submitted = syscall(__NR_io_submit, this->aioContext, 1, list);
+        } while(submitted < 0 && errno == EINTR);
+        if(submitted != 1)
+        {
+            return false;
+        }
+    }
+    else
+    {
+        //the whole request now, short of the end of the file
+        size_t total = 0;
+        long result = 0;
+        while(total < size)
+        {
+            const ssize_t n = isWrite ? pwrite(fd, buffer + total, size - total, offset + total)
+                                      : pread(fd, buffer + total, size - total, offset + total);
+            if(n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if(n <= 0)
+            {
+                result = (n < 0) ? -errno : 0;
+                break;
+            }
+            total += n;
+        }
+        this->done.push_back({tag, (result < 0) ? result : (long)total});
+    }
+    this->inFlight++;
+    return true;
+}
+
+AsyncIO::completion AsyncIO::wait()
+{
+    completion c = {IO_NO_TAG, -EINVAL};
+    if(this->inFlight == 0)
+    {
+        return c;
+    }
+    if(this->backend == IO_BACKEND_URING)
+    {
+        unsigned int head = *(this->cqHead);
+        while(head == __atomic_load_n(this->cqTail, __ATOMIC_ACQUIRE))
+        {
+            if(syscall(__NR_io_uring_enter, this->ringFd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR)
+            {
+                c.result = -errno;
+                this->inFlight--;
+                return c;
+            }
+        }
+        const io_uring_cqe& cqe = this->cqes[head & *(this->cqMask)];
+        c.tag = cqe.user_data;
+        c.result = cqe.res;
+        __atomic_store_n(this->cqHead, head + 1, __ATOMIC_RELEASE);
+    }
+    else if(this->backend == IO_BACKEND_AIO)
+    {
+        io_event event;
+        long n;
+        while((n = syscall(__NR_io_getevents, this->aioContext, 1, 1, &event, nullptr)) != 1)
+        {
+            if(n < 0 && errno != EINTR)
+            {
+                c.result = -errno;
+                this->inFlight--;
+                return c;
+            }
+        }
+        c.tag = event.data;
+        c.result = (long)event.res;
+    }
+    else
+    {
+        c = this->done.front();
+        this->done.pop_front();
+    }
+    this->inFlight--;
+    return c;
+}
+
+const char* AsyncIO::getBackendName() const
+{
+    switch(this->backend)
+    {
+        case IO_BACKEND_URING: return "io_uring";
+        case IO_BACKEND_AIO: return "Linux AIO";
+        default: return "pread/pwrite";
+    }
+}
+
+
+AsyncWriter::AsyncWriter(int mfd, bool mdirect, size_t mblockSize, unsigned int depth, int backend) :
+    io(depth, backend), fd(mfd), direct(mdirect), blockSize(mblockSize), current(0), used(0), offset(0), failed(false)
+{
+    //O_DIRECT needs aligned buffers, and it is free to have them otherwise
+    for(unsigned int i=0; i<this->io.getDepth(); i++)
+    {
+        char* block = (char*)std::aligned_alloc(IO_ALIGNMENT, (this->blockSize + IO_ALIGNMENT - 1)/IO_ALIGNMENT*IO_ALIGNMENT);
+        if(block == nullptr)
+        {
+            for(char* allocated : this->blocks)
+            {
+                std::free(allocated);
+            }
+            throw std::bad_alloc();
+        }
+        this->blocks.push_back(block);
+        this->sizes.push_back(0);
+    }
+}
+
+AsyncWriter::~AsyncWriter()
+{
+    while(this->io.getInFlight() > 0)
+    {
+        this->reap();
+    }
+    for(char* block : this->blocks)
+    {
+        std::free(block);
+    }
+}
+
+/**
+ * @brief Wait for one write and free its block
+ */
+bool AsyncWriter::reap()
+{
+    const AsyncIO::completion c = this->io.wait();
+    if(c.tag == IO_NO_TAG)
+    {
+        //the write may still be in flight, so its block is never used again
+        this->failed = true;
+        return false;
+    }
+    if(c.result != (long)this->sizes[c.tag])
+    {
+        this->failed = true;
+    }
+    this->sizes[c.tag] = 0;
+    return !this->failed;
+}
+
+/**
+ * @brief Write the current block, then wait until the next one is free
+ */
+bool AsyncWriter::submitBlock()
+{
+    if(this->failed)
+    {
+        return false;
+    }
+    size_t size = this->used;
+    if(this->direct)
+    {
+        size = (size + IO_ALIGNMENT - 1)/IO_ALIGNMENT*IO_ALIGNMENT;
+        std::memset(this->blocks[this->current] + this->used, 0, size - this->used);
+    }
+    if(!this->io.write(this->fd, this->blocks[this->current], size, this->offset, this->current))
+    {
+        this->failed = true;
+        return false;
+    }
+    this->sizes[this->current] = size;
+    this->offset += this->used;
+    this->used = 0;
+    this->current = (this->current + 1) % this->blocks.size();
+    while(this->sizes[this->current] != 0 && !this->failed)
+    {
+        this->reap();
+    }
+    return !this->failed;
+}
+
+bool AsyncWriter::write(const char* data, size_t size)
+{
+    while(size > 0 && !this->failed)
+    {
+        const size_t n = std::min(size, this->blockSize - this->used);
+        std::memcpy(this->blocks[this->current] + this->used, data, n);
+        this->used += n;
+        data += n;
+        size -= n;
+        if(this->used == this->blockSize)
+        {
+            this->submitBlock();
+        }
+    }
+    return !this->failed;
+}
+
+bool AsyncWriter::finish()
+{
+    const uint64_t fileSize = this->offset + this->used;
+    if(this->used > 0)
+    {
+        this->submitBlock();
+    }
+    while(this->io.getInFlight() > 0)
+    {
+        this->reap();
+    }
+    //cut off the padding of the last O_DIRECT block
+    if(this->direct && ftruncate(this->fd, fileSize) != 0)
+    {
+        this->failed = true;
+    }
+    return !this->failed;
+}
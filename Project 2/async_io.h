@@ -0,0 +1,254 @@
+/**
+ * @file async_io.h
+ * @author Ethan Stockbridge (ethanstockbridge@gmail.com)
+ * @author Devan Kidd (jjkidd1245@gmail.com)
+ * @brief Asynchronous file reads and writes with io_uring, or Linux AIO where
+ * io_uring is not available, so several requests are in flight at once
+ * @date 2022-02-06
+ */
+
+#ifndef ASYNC_IO_H_
+#define ASYNC_IO_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+/**
+ * @brief Backends of AsyncIO. AUTO takes the first one the kernel supports, in
+ * this order. SYNC does each request with pread()/pwrite() when it is submitted.
+ *
+ */
+#define IO_BACKEND_AUTO 0
+#define IO_BACKEND_URING 1
+#define IO_BACKEND_AIO 2
+#define IO_BACKEND_SYNC 3
+
+/**
+ * @brief Tag of the completion returned when waiting itself failed, so no request
+ * is known to have completed
+ *
+ */
+#define IO_NO_TAG UINT64_MAX
+
+/**
+ * @brief Alignment of buffers, offsets and sizes for O_DIRECT. Default 4KB, the
+ * logical block size of most devices
+ *
+ */
+#ifndef IO_ALIGNMENT
+#define IO_ALIGNMENT 4096
+#endif
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+/**
+ * @brief Queue of asynchronous reads and writes at given offsets. Requests are
+ * submitted right away and complete in any order, each one is told apart by its
+ * tag. Only to be used by one thread.
+ *
+ */
+class AsyncIO
+{
+public:
+    /**
+     * @brief A finished request
+     *
+     */
+    struct completion
+    {
+        uint64_t tag;
+        long result; //bytes read or written, or -errno
+    };
+
+    /**
+     * @brief Set up the queue
+     *
+     * @param mdepth Largest number of requests in flight at once
+     * @param requested IO_BACKEND_ value
+     */
+    AsyncIO(unsigned int mdepth, int requested = IO_BACKEND_AUTO);
+    ~AsyncIO();
+
+    AsyncIO(const AsyncIO&) = delete;
+    AsyncIO& operator=(const AsyncIO&) = delete;
+
+    /**
+     * @brief Submit a read. There must be fewer than getDepth() requests in flight.
+     *
+     * @param fd File to read from
+     * @param buffer Buffer of at least size bytes, untouched until the read completes
+     * @param size Bytes to read
+     * @param offset Offset in the file
+     * @param tag Value to tell the request apart by
+     * @return true The read was submitted
+     * @return false The read could not be submitted
+     */
+    bool read(int fd, char* buffer, size_t size, uint64_t offset, uint64_t tag);
+
+    /**
+     * @brief Submit a write. There must be fewer than getDepth() requests in flight.
+     *
+     * @param fd File to write to
+     * @param buffer Data, kept until the write completes
+     * @param size Bytes to write
+     * @param offset Offset in the file
+     * @param tag Value to tell the request apart by
+     * @return true The write was submitted
+     * @return false The write could not be submitted
+     */
+    bool write(int fd, const char* buffer, size_t size, uint64_t offset, uint64_t tag);
+
+    /**
+     * @brief Wait for a request to complete. There must be one in flight. If the
+     * wait fails for a reason other than a signal, the request is given up on and
+     * the completion has IO_NO_TAG and -errno.
+     *
+     * @return completion
+     */
+    completion wait();
+
+    /**
+     * @brief Get the number of requests in flight
+     *
+     * @return unsigned int
+     */
+    unsigned int getInFlight() const {return inFlight;}
+
+    /**
+     * @brief Get the largest number of requests in flight at once
+     *
+     * @return unsigned int
+     */
+    unsigned int getDepth() const {return depth;}
+
+    /**
+     * @brief Get the name of the backend in use
+     *
+     * @return const char*
+     */
+    const char* getBackendName() const;
+
+private:
+    int backend;
+    unsigned int depth;
+    unsigned int inFlight;
+
+    /**
+     * @brief io_uring: the ring's file, its submission and completion rings
+     * shared with the kernel, and the submission queue entries
+     *
+     */
+    int ringFd;
+    void* sqRing;
+    void* cqRing;
+    size_t sqRingSize;
+    size_t cqRingSize;
+    io_uring_sqe* sqes;
+    size_t sqesSize;
+    unsigned int* sqTail;
+    unsigned int* sqMask;
+    unsigned int* sqArray;
+    unsigned int* cqHead;
+    unsigned int* cqTail;
+    unsigned int* cqMask;
+    io_uring_cqe* cqes;
+
+    /**
+     * @brief Linux AIO: the context from io_setup()
+     *
+     */
+    unsigned long aioContext;
+
+    /**
+     * @brief SYNC: requests done at submission, waiting to be returned by wait()
+     *
+     */
+    std::deque<completion> done;
+
+    bool setupUring();
+    bool setupAio();
+    bool submit(bool isWrite, int fd, char* buffer, size_t size, uint64_t offset, uint64_t tag);
+};
+
+/**
+ * @brief Writes a file front to back through AsyncIO. Data is gathered into
+ * blocks of blockSize bytes, and each full block is written while the next ones
+ * fill up, up to depth blocks in flight. With O_DIRECT, the last block is padded
+ * to IO_ALIGNMENT and the file is cut back to its size by finish().
+ *
+ */
+class AsyncWriter
+{
+public:
+    /**
+     * @brief Set up the writer. Throws std::bad_alloc if the blocks cannot be
+     * allocated.
+     *
+     * @param mfd File to write, empty
+     * @param mdirect Whether the file was opened with O_DIRECT
+     * @param blockSize Bytes per write, a multiple of IO_ALIGNMENT for O_DIRECT
+     * @param depth Largest number of writes in flight at once (at least 1)
+     * @param backend IO_BACKEND_ value
+     */
+    AsyncWriter(int mfd, bool mdirect, size_t blockSize, unsigned int depth, int backend = IO_BACKEND_AUTO);
+    ~AsyncWriter();
+
+    AsyncWriter(const AsyncWriter&) = delete;
+    AsyncWriter& operator=(const AsyncWriter&) = delete;
+
+    /**
+     * @brief Add data at the end of the file
+     *
+     * @param data Data, copied before returning
+     * @param size Bytes of data
+     * @return true
+     * @return false A write failed
+     */
+    bool write(const char* data, size_t size);
+
+    /**
+     * @brief Write the last block and wait for every write to complete
+     *
+     * @return true
+     * @return false A write failed
+     */
+    bool finish();
+
+    /**
+     * @brief Get the name of the backend in use
+     *
+     * @return const char*
+     */
+    const char* getBackendName() const {return io.getBackendName();}
+
+private:
+    AsyncIO io;
+    int fd;
+    bool direct;
+    size_t blockSize;
+
+    /**
+     * @brief Ring of blocks: the one being filled, and the ones being written with
+     * the size of their write (0 when free)
+     *
+     */
+    std::vector<char*> blocks;
+    std::vector<size_t> sizes;
+    unsigned int current;
+    size_t used;
+
+    /**
+     * @brief Offset of the current block in the file
+     *
+     */
+    uint64_t offset;
+    bool failed;
+
+    bool submitBlock();
+    bool reap();
+};
+
+#endif
@@ -0,0 +1,153 @@
+/**
+ * @file buffer_pool.h
+ * @author Ethan Stockbridge (ethanstockbridge@gmail.com)
+ * @author Devan Kidd (jjkidd1245@gmail.com)
+ * @brief Pool of recycled fixed size buffers, so chunks do not allocate memory
+ * once the pipeline is running
+ * @date 2022-02-06
+ */
+
+#ifndef BUFFER_POOL_H_
+#define BUFFER_POOL_H_
+
+#include <pthread.h>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+/**
+ * @brief Buffers of one size, carved out of large slabs. acquire() takes a free
+ * buffer and recycle() gives it back. The pool starts with enough buffers for
+ * every chunk that can be in flight at once, so new slabs (the only allocations)
+ * are only needed if that estimate is short.
+ *
+ */
+class BufferPool
+{
+private:
+    size_t bufferSize;
+
+    /**
+     * @brief Every buffer starts at a multiple of the alignment (ex: for O_DIRECT)
+     *
+     */
+    size_t alignment;
+
+    /**
+     * @brief Buffers per slab
+     *
+     */
+    unsigned int slabBuffers;
+
+    std::vector<char*> slabs;
+    std::vector<char*> freeBuffers;
+
+    pthread_mutex_t lock;
+
+    /**
+     * @brief Allocate one more slab and add its buffers to the free list. The
+     * lock has to be held. Throws std::bad_alloc if the slab cannot be allocated,
+     * leaving the pool as it was.
+     *
+     */
+    void grow()
+    {
+        char* slab = (char*)std::aligned_alloc(this->alignment, this->bufferSize*this->slabBuffers);
+        if(slab == nullptr)
+        {
+            throw std::bad_alloc();
+        }
+        this->slabs.push_back(slab);
+        //room for every buffer, so recycle() never allocates
+        this->freeBuffers.reserve(this->slabs.size()*this->slabBuffers);
+        for(unsigned int i=0; i<this->slabBuffers; i++)
+        {
+            this->freeBuffers.push_back(slab + i*this->bufferSize);
+        }
+    }
+
+public:
+    /**
+     * @brief Construct a new pool
+     *
+     * @param mbufferSize Size of each buffer in bytes
+     * @param count Number of buffers to start with (at least 1)
+     * @param malignment Alignment of the buffers, a power of 2. The size is rounded
+     * up to a multiple of it
+     */
+    BufferPool(size_t mbufferSize, unsigned int count, size_t malignment = 64) :
+        bufferSize((mbufferSize + malignment - 1)/malignment*malignment), alignment(malignment),
+        slabBuffers(count > 0 ? count : 1)
+    {
+        pthread_mutex_init(&(this->lock), NULL);
+        this->grow();
+    }
+
+    ~BufferPool()
+    {
+        for(char* slab : this->slabs)
+        {
+            std::free(slab);
+        }
+        pthread_mutex_destroy(&(this->lock));
+    }
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    /**
+     * @brief Take a free buffer, allocating a new slab if there are none. Throws
+     * std::bad_alloc if the new slab cannot be allocated.
+     *
+     * @return char* Buffer of getBufferSize() bytes
+     */
+    char* acquire()
+    {
+        pthread_mutex_lock(&(this->lock));
+        if(this->freeBuffers.empty())
+        {
+            try
+            {
+                this->grow();
+            }
+            catch(const std::bad_alloc&)
+            {
+                pthread_mutex_unlock(&(this->lock));
+                throw;
+            }
+        }
+        char* buffer = this->freeBuffers.back();
+        this->freeBuffers.pop_back();
+        pthread_mutex_unlock(&(this->lock));
+        return buffer;
+    }
+
+    /**
+     * @brief Give back a buffer from acquire()
+     *
+     * @param buffer Buffer to give back
+     */
+    void recycle(char* buffer)
+    {
+        pthread_mutex_lock(&(this->lock));
+        this->freeBuffers.push_back(buffer);
+        pthread_mutex_unlock(&(this->lock));
+    }
+
+    /**
+     * @brief Get the size of each buffer, at least the size asked for
+     *
+     * @return size_t
+     */
+    size_t getBufferSize() const {return bufferSize;}
+
+    /**
+     * @brief Get the number of slabs allocated so far
+     *
+     * @return size_t
+     */
+    size_t getNumSlabs() const {return slabs.size();}
+};
+
+#endif
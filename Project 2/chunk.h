@@ -9,9 +9,14 @@
 #ifndef CHUNK_H_
 #define CHUNK_H_
 
+#include <algorithm>
+#include <cstdint>
+#include "buffer_pool.h" //Recycled data buffers
+
 /**
  * @brief Chunk class used for storing chunks of data, compressing them, and then storing 
- * the compressed data, to be then written into the output file later.
+ * the compressed data, to be then written into the output file later. When
+ * decompressing, a chunk holds one compressed frame and its decompressed data.
  * 
  */
 class chunk
@@ -37,15 +42,68 @@ private:
      */
     int id;
 
+    /**
+     * @brief If not null, decompress straight into this buffer (ex: the chunk's
+     * place in a memory mapped output file) instead of a new one
+     * 
+     */
+    char* target;
+
+    /**
+     * @brief Pools the data and compressed data buffers came from, or nullptr if
+     * they were allocated with new
+     * 
+     */
+    BufferPool* dataPool;
+    BufferPool* compressedPool;
+
+    /**
+     * @brief Whether the chunk frees its data, false if the data is a view into
+     * memory owned elsewhere (ex: the memory mapped input file)
+     * 
+     */
+    bool ownsData;
+
 public:
+    /**
+     * @brief Construct an empty chunk, to be assigned a chunk taken from a queue
+     * 
+     */
+    chunk() : data(nullptr),compressedData(nullptr),dataSize(0),compressedDataSize(0),id(0),target(nullptr),
+              dataPool(nullptr),compressedPool(nullptr),ownsData(true)
+    {
+        ;
+    }
+
     /**
      * @brief Construct a new chunk object
      * 
      * @param mid Chunk's number relative to the number of chunks read in from the file
      * @param mdata Chunk's uncompressed size in bytes
      * @param mdataSize Chunk's data 
+     * @param mdataPool Pool the data buffer came from, nullptr if allocated with new
+     * @param mownsData false if the data is only a view, never to be freed or written to
+     */
+    chunk(int mid,char* mdata,int mdataSize,BufferPool* mdataPool = nullptr,bool mownsData = true) :
+        data(mdata),compressedData(nullptr),dataSize(mdataSize),compressedDataSize(0),id(mid),target(nullptr),
+        dataPool(mdataPool),compressedPool(nullptr),ownsData(mownsData)
+    {
+        ;
+    }
+
+    /**
+     * @brief Construct a chunk holding one compressed frame, to be decompressed
+     * 
+     * @param mid Frame's number relative to the number of frames read in from the file
+     * @param mcompressedData Frame's compressed data
+     * @param mcompressedDataSize Frame's size in bytes
+     * @param mdataSize Frame's decompressed size in bytes
+     * @param mtarget Buffer of mdataSize bytes to decompress into, or nullptr to allocate one
      */
-    chunk(int mid,char* mdata,int mdataSize) : id(mid),data(mdata),dataSize(mdataSize)
+    chunk(int mid,char* mcompressedData,int mcompressedDataSize,int mdataSize,char* mtarget) :
+        data(nullptr),compressedData(mcompressedData),dataSize(mdataSize),
+        compressedDataSize(mcompressedDataSize),id(mid),target(mtarget),dataPool(nullptr),compressedPool(nullptr),
+        ownsData(mtarget == nullptr)
     {
         ;
     }
@@ -54,16 +112,137 @@ public:
      * @brief Compress the data using ZSTD compression algorithms. To be performed by the
      * currently active thread. Store the compressed data into this object
      * 
+     * @param cctx The thread's compression context, reused for every chunk it compresses
+     * @param pool Pool of buffers of at least ZSTD_compressBound(dataSize) bytes
+     * @param cdict Dictionary shared by all threads (built for the level), or nullptr to compress without one
+     * @param level Compression level, only used without a dictionary
      */
-    void compress()
+    void compress(ZSTD_CCtx* cctx, BufferPool* pool, const ZSTD_CDict* cdict, int level)
     {
         // Compress with a thread using zstd
-        size_t const cBuffSize = ZSTD_compressBound(this->dataSize);
-        char* const cBuff = new char[cBuffSize];
-        size_t const cSize = ZSTD_compress(cBuff, cBuffSize, this->data, this->dataSize, COMPRESSION_LEVEL);
+        char* const cBuff = pool->acquire();
+        size_t const cSize = (cdict != nullptr)
+            ? ZSTD_compress_usingCDict(cctx, cBuff, pool->getBufferSize(), this->data, this->dataSize, cdict)
+            : ZSTD_compressCCtx(cctx, cBuff, pool->getBufferSize(), this->data, this->dataSize, level);
         this->compressedData = cBuff;
         this->compressedDataSize = cSize;
+        this->compressedPool = pool;
+    }
+
+    /**
+     * @brief Store the data without compressing it, as a zstd frame of raw blocks,
+     * for data that does not compress. Any zstd decoder reads it.
+     * 
+     * @param pool Pool of buffers of at least ZSTD_compressBound(dataSize) bytes
+     */
+    void store(BufferPool* pool)
+    {
+        unsigned char* const cBuff = (unsigned char*)pool->acquire();
+        size_t size = 0;
+        auto put = [&](uint64_t value, int bytes)
+        {
+            for(int b=0; b<bytes; b++)
+            {
+                cBuff[size++] = (unsigned char)(value >> (8*b));
+            }
+        };
+        //frame header: magic number, then a single segment (the window is the content size)
+        //with the content size in 1, 2 or 4 bytes, no checksum and no dictionary
+        put(0xFD2FB528, 4);
+        const uint64_t contentSize = (uint64_t)this->dataSize;
+        if(contentSize < 256)
+        {
+            put(0x20, 1);
+            put(contentSize, 1);
+        }
+        else if(contentSize < 65536 + 256)
+        {
+            put(0x60, 1);
+            put(contentSize - 256, 2);
+        }
+        else
+        {
+            put(0xA0, 1);
+            put(contentSize, 4);
+        }
+        //raw blocks of at most 128KB, the last one flagged in its header
+        size_t done = 0;
+        do
+        {
+            const size_t blockSize = std::min<size_t>(ZSTD_BLOCKSIZE_MAX, contentSize - done);
+            const bool last = (done + blockSize == contentSize);
+            put((blockSize << 3) | (last ? 1 : 0), 3);
+            std::copy(this->data + done, this->data + done + blockSize, cBuff + size);
+            size += blockSize;
+            done += blockSize;
+        } while(done < contentSize);
+        this->compressedData = (char*)cBuff;
+        this->compressedDataSize = size;
+        this->compressedPool = pool;
+    }
+
+    /**
+     * @brief Decompress the frame using ZSTD. To be performed by the currently
+     * active thread. Store the decompressed data into this object (or the target)
+     * 
+     * @param dctx The thread's decompression context, reused for every frame it decompresses
+     * @param ddict Dictionary the frames were compressed with, or nullptr
+     * @return true The frame decompressed to the expected size
+     * @return false The frame is corrupt (or needs another dictionary), the data is left null
+     */
+    bool decompress(ZSTD_DCtx* dctx, const ZSTD_DDict* ddict)
+    {
+        char* const dBuff = (this->target != nullptr) ? this->target : new char[this->dataSize];
+        size_t const dSize = ZSTD_decompress_usingDDict(dctx, dBuff, this->dataSize, this->compressedData,
+                                                        this->compressedDataSize, ddict);
+        if(ZSTD_isError(dSize) || dSize != (size_t)this->dataSize)
+        {
+            if(this->target == nullptr)
+            {
+                delete[] dBuff;
+            }
+            return false;
+        }
+        this->data = dBuff;
+        return true;
     }
+
+    /**
+     * @brief Free the chunk's buffers, or give them back to their pools (not the
+     * target it was decompressed into, or the memory its data is a view of)
+     * 
+     */
+    void release()
+    {
+        if(this->dataPool != nullptr)
+        {
+            this->dataPool->recycle(this->data);
+        }
+        else if(this->ownsData)
+        {
+            delete[] this->data;
+        }
+        if(this->compressedPool != nullptr)
+        {
+            this->compressedPool->recycle(this->compressedData);
+        }
+        else
+        {
+            delete[] this->compressedData;
+        }
+        this->data = nullptr;
+        this->compressedData = nullptr;
+    }
+
+    /**
+     * @brief Check whether the chunk was decompressed into its target rather than
+     * its own buffer
+     * 
+     * @return true 
+     * @return false 
+     */
+    bool inPlace() const {return target != nullptr;}
+
     /**
      * @brief Get the chunk's id
      * 
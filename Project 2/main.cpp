@@ -11,29 +11,149 @@
 #include <fstream>
 #include <pthread.h>
 #include "zstd.h"       // Assume already installed 
+#include "zdict.h"      // Dictionary training, part of the ZSTD library
 #include <chrono> // For timing
 
 #include <vector>
-#include <set>
+#include <string>
+#include <algorithm>
+#include <cstdint>
+#include <climits>
+#include <cstring>
+#include <iterator>
+
+#include <fcntl.h>    // For the memory mapped output file
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <sstream>
+#include <cstdlib>
+#include <cerrno>
 
 /**
- * @brief Compression level for ZSTD usage. Default 50
+ * @brief Compression level for ZSTD usage, unless given with -l. Default 22, the
+ * highest level zstd has (higher levels are clamped to it)
  * 
  */
 #ifndef COMPRESSION_LEVEL
-#define COMPRESSION_LEVEL 50
+#define COMPRESSION_LEVEL 22
 #endif
 
 #include "chunk.h"      //Data storage class
+#include "queue.h"      //Blocking queues between the threads
+#include "seek_table.h" //Frame index at the end of the output file
+#include "async_io.h"   //Reads and writes kept in flight while the workers compress
+#include "adaptive.h"   //Compression level picked from the measured ratio and speed
 
 /**
- * @brief Size (in bytes) of each chunk to be compressed. Default 16KB
+ * @brief Size (in bytes) of each chunk to be compressed, unless given with -c. Default 16KB
  * 
  */
 #ifndef CHUNK_SIZE
 #define CHUNK_SIZE 16*1024 // 16KB
 #endif
 
+/**
+ * @brief Largest amount of memory (in bytes) the queue of raw chunks waiting for a
+ * worker may hold when compressing. With large chunks (-c), fewer of them are queued.
+ * Default 256MB
+ * 
+ */
+#ifndef QUEUE_MEMORY
+#define QUEUE_MEMORY 256*1024*1024UL // 256MB
+#endif
+
+/**
+ * @brief Size (in bytes) of each read when looking for the frames of a file
+ * without a seek table. Default 1MB
+ * 
+ */
+#ifndef FRAME_READ_SIZE
+#define FRAME_READ_SIZE 1024*1024 // 1MB
+#endif
+
+/**
+ * @brief Size (in bytes) of the pieces a frame without a decompressed size (ex: from
+ * zstd writing to a pipe) is decompressed into by the frame reader. Default 1MB
+ * 
+ */
+#ifndef STREAM_PIECE_SIZE
+#define STREAM_PIECE_SIZE 1024*1024 // 1MB
+#endif
+
+/**
+ * @brief Number of reads, and of writes, kept in flight at once when compressing.
+ * Default 8
+ * 
+ */
+#ifndef IO_DEPTH
+#define IO_DEPTH 8
+#endif
+
+/**
+ * @brief Size (in bytes) of each write of the compressed output. Compressed chunks
+ * are gathered into blocks of this size. Default 1MB
+ * 
+ */
+#ifndef WRITE_BLOCK_SIZE
+#define WRITE_BLOCK_SIZE 1024*1024 // 1MB
+#endif
+
+/**
+ * @brief Set to 1 to bypass the page cache with O_DIRECT when compressing. Reads
+ * only use it if the chunk size is a multiple of IO_ALIGNMENT, and writes if
+ * WRITE_BLOCK_SIZE is. Default 0
+ * 
+ */
+#ifndef IO_DIRECT
+#define IO_DIRECT 0
+#endif
+
+/**
+ * @brief Set to 1 to memory map the input file when compressing. Chunks are then
+ * views into the mapping instead of copies read into buffers. Default 0
+ * 
+ */
+#ifndef IO_MMAP
+#define IO_MMAP 0
+#endif
+
+/**
+ * @brief Set to 1 to ask for transparent huge pages for the memory mapped input
+ * (only used by file systems that support them, ex: tmpfs mounted with huge=). Default 0
+ * 
+ */
+#ifndef IO_MMAP_HUGEPAGES
+#define IO_MMAP_HUGEPAGES 0
+#endif
+
+/**
+ * @brief Asynchronous I/O backend, IO_BACKEND_AUTO (io_uring, then Linux AIO,
+ * then pread/pwrite), IO_BACKEND_URING, IO_BACKEND_AIO or IO_BACKEND_SYNC
+ * 
+ */
+#ifndef IO_BACKEND
+#define IO_BACKEND IO_BACKEND_AUTO
+#endif
+
+/**
+ * @brief Largest size (in bytes) of a trained dictionary. Default 110KB, the
+ * same as the zstd command line tool
+ * 
+ */
+#ifndef DICT_SIZE
+#define DICT_SIZE 110*1024 // 110KB
+#endif
+
+/**
+ * @brief Amount of input (in bytes) sampled to train a dictionary. Default 100
+ * times the dictionary size
+ * 
+ */
+#ifndef DICT_SAMPLE_SIZE
+#define DICT_SAMPLE_SIZE 100*DICT_SIZE
+#endif
+
 /**
  * @brief keep only MAX_RAW_CHUNKS amount of chunks available at any given time.
  * This reduces the amount of RAM used by reading in more chunks as needed 
@@ -42,25 +162,107 @@
  */
 unsigned int MAX_RAW_CHUNKS = 0;
 
-// use a thread lock so multiple workers can work from the same bin 
-pthread_mutex_t raw_lock; 
-pthread_mutex_t compressed_lock; 
+/**
+ * @brief data storage of chunks waiting for a worker thread and chunks the workers
+ * are done with. The reader blocks when pending is full, workers block when pending
+ * is empty, and the writer blocks until the next chunk in order is done.
+ * When compressing the chunks are raw data, when decompressing they are frames.
+ * 
+ */
+BoundedQueue<chunk>* pending = nullptr;
+ReorderBuffer<chunk>* finished = nullptr;
+
+/**
+ * @brief Recycled buffers for the raw chunks and their compressed data. Every
+ * chunk in flight holds one of each, so after the first chunks nothing is allocated.
+ * 
+ */
+BufferPool* rawBuffers = nullptr;
+BufferPool* compressedBuffers = nullptr;
 
-//flags to indicate status of main thread 
-bool reading_complete = false;
-bool writing_complete = false;
+/**
+ * @brief Dictionary given with -D or trained with -T, and its digested form built
+ * once and shared read-only by all workers. Without a dictionary every chunk starts
+ * with an empty history, which compresses small chunks poorly.
+ * 
+ */
+std::vector<char> dictionary;
+ZSTD_DDict* ddict = nullptr;
 
 /**
- * @brief data storage of raw data and compressed data from worker threads
+ * @brief Digested dictionary for each compression level that can be used, starting
+ * at level cdictFirstLevel. A CDict is built for one level, so when the level adapts,
+ * each level needs its own. They are all built before the workers start, and only
+ * read after that, so the workers look them up without a lock.
  * 
  */
-std::set<chunk> compressed; //one chunk per thread
-std::vector<chunk> raw; //one chunk per thread
+std::vector<ZSTD_CDict*> cdicts;
+int cdictFirstLevel = 0;
+
+/**
+ * @brief Size of the chunks and compression level, CHUNK_SIZE and COMPRESSION_LEVEL
+ * unless given with -c and -l. With an adaptive level, the level is the highest one
+ * the controller may use.
+ * 
+ */
+unsigned int chunkBytes = CHUNK_SIZE;
+int compressionLevel = COMPRESSION_LEVEL;
+
+/**
+ * @brief Picks the level of each chunk when a target speed (-s) or ratio (-r) is
+ * given, nullptr to compress every chunk at compressionLevel
+ * 
+ */
+LevelController* controller = nullptr;
+
+/**
+ * @brief Whether the workers decompress frames instead of compressing chunks
+ * 
+ */
+bool decompressing = false;
+
+/**
+ * @brief Input file and its total size, for the reader thread
+ * 
+ */
+struct readerArgs
+{
+    int fd;
+    long totalFileSize;
+    const char* map; //memory mapped input file, nullptr to read it
+};
+
+/**
+ * @brief Compressed file for the frame reader thread. With a seek table and a
+ * memory mapped output, every frame is decompressed straight into its place in
+ * the output.
+ * 
+ */
+struct frameReaderArgs
+{
+    std::ifstream* fin;
+    long totalFileSize;
+    const SeekTable* table; //nullptr to find the frames by reading them
+    char* output;           //memory mapped output, nullptr to write it in order
+    bool failed;            //set if the file is not a sequence of zstd frames
+};
 
 
 // Forward declaration
-void *threadCompress(void *id);
+void *threadWork(void *id);
+void *threadRead(void *args);
+void *threadReadFrames(void *args);
+bool streamFrame(frameReaderArgs* reader, ZSTD_DCtx* dctx, std::vector<char>& buffer, size_t& begin,
+                 unsigned long& readSize, uint& chunksQueued, uint frame);
 void manageChunks(const char* inFilename, const char* outFilename);
+int decompressFile(const char* inFilename, const char* outFilename);
+int extractRange(const char* inFilename, const char* outFilename, uint64_t offset, uint64_t length);
+bool loadDictionary(const char* dictFilename);
+bool trainDictionary(const char* inFilename, const char* dictFilename);
+void buildDictionaries(int firstLevel, int lastLevel);
+const ZSTD_CDict* dictionaryFor(int level);
+bool parseSize(const char* text, unsigned long& bytes);
+void reportFrameError(unsigned long id, const char* frame, size_t frameSize);
 
 
 /**
@@ -75,30 +277,173 @@ int main(int argc, const char** argv)
 {
     const char* exeName = argv[0];
 
-    if (argc!=4) {
+    //optional pairs at the end, in any order: -D <file> to use a dictionary, -T <file> to
+    //train one from the input, -l <level>, -c <chunk size>, and the targets of the
+    //adaptive level, -s <MB/s> and -r <ratio>
+    const char* dictFilename = nullptr;
+    bool trainDict = false;
+    bool compressOnly = false; //an option that only applies to compression was given
+    bool badOption = false;
+    double targetSpeed = 0;
+    double targetRatio = 0;
+    while (argc>=3 && std::strlen(argv[argc-2])==2 && argv[argc-2][0]=='-' && std::strchr("DTlcsr", argv[argc-2][1])) {
+        const char option = argv[argc-2][1];
+        const char* value = argv[argc-1];
+        char* end = nullptr;
+        unsigned long bytes = 0;
+        switch (option) {
+            case 'D':
+            case 'T':
+                trainDict = (option=='T');
+                dictFilename = value;
+                break;
+            case 'l':
+                compressionLevel = std::strtol(value, &end, 10);
+                badOption |= (*end != '\0');
+                break;
+            case 'c':
+                badOption |= !parseSize(value, bytes) || bytes == 0 || bytes > (1UL << 30);
+                chunkBytes = bytes;
+                break;
+            case 's':
+                targetSpeed = std::strtod(value, &end);
+                badOption |= (*end != '\0' || !(targetSpeed > 0));
+                break;
+            case 'r':
+                targetRatio = std::strtod(value, &end);
+                badOption |= (*end != '\0' || !(targetRatio > 0));
+                break;
+        }
+        compressOnly |= (option != 'D');
+        argc -= 2;
+    }
+
+    //extract a range of a compressed file with its seek table
+    const bool extracting = (argc==6 && std::string(argv[1])=="-x");
+    uint64_t extractBounds[2] = {0, 0}; //offset and length
+    for (int k=0; extracting && k<2; k++) {
+        //strtoull would take "-5" as a huge value, so only digits are accepted
+        const char* value = argv[2+k];
+        char* end = nullptr;
+        errno = 0;
+        extractBounds[k] = std::strtoull(value, &end, 10);
+        badOption |= (value[0] < '0' || value[0] > '9' || *end != '\0' || errno == ERANGE);
+    }
+
+    //decompress a whole file, its frames spread over the workers
+    decompressing = (argc==5 && std::string(argv[1])=="-d");
+
+    if ((argc!=4 && !decompressing && !extracting) || (compressOnly && (decompressing || extracting)) || badOption) {
         std::cout<<"Error: Incorrect arguments"<<std::endl;
-        std::cout<<"Usage: "<<exeName<<" <NUM WORKERS> <INPUT FILE> <OUTPUT FILE>"<<std::endl;;
+        std::cout<<"Usage: "<<exeName<<" <NUM WORKERS> <INPUT FILE> <OUTPUT FILE> [-D <DICTIONARY> | -T <NEW DICTIONARY>]"<<std::endl;
+        std::cout<<"       "<<std::string(std::strlen(exeName), ' ')<<" [-l <LEVEL>] [-c <CHUNK SIZE>[K|M]] [-s <TARGET MB/S>] [-r <TARGET RATIO>]"<<std::endl;
+        std::cout<<"       "<<exeName<<" -d <NUM WORKERS> <COMPRESSED FILE> <OUTPUT FILE> [-D <DICTIONARY>]"<<std::endl;
+        std::cout<<"       "<<exeName<<" -x <OFFSET> <LENGTH> <COMPRESSED FILE> <OUTPUT FILE> [-D <DICTIONARY>]"<<std::endl;
         return 1;
     }
 
-    const char* numWorkers = argv[1];
-    unsigned int NUM_WORKERS = std::stoi(argv[1]);
-    const char* inFilename = argv[2];
-    const char* outFilename = argv[3];
+    if (!decompressing && !extracting && (compressionLevel < ZSTD_minCLevel() || compressionLevel > ZSTD_maxCLevel())) {
+        const int clamped = std::min(ZSTD_maxCLevel(), std::max(ZSTD_minCLevel(), compressionLevel));
+        std::cout << "Compression level " << compressionLevel << " is out of zstd's range, using " << clamped << std::endl;
+        compressionLevel = clamped;
+    }
+
+    //levels the chunks can be compressed at: only compressionLevel, or with an adaptive
+    //level, ADAPT_MIN_LEVEL up to compressionLevel
+    const bool adaptive = (targetSpeed > 0 || targetRatio > 0);
+    const int minLevel = adaptive ? ADAPT_MIN_LEVEL : compressionLevel;
+    const int maxLevel = adaptive ? std::max(ADAPT_MIN_LEVEL, compressionLevel) : compressionLevel;
+
+    if (dictFilename != nullptr) {
+        if (!(trainDict ? trainDictionary(argv[argc-2], dictFilename) : loadDictionary(dictFilename))) {
+            return 1;
+        }
+        if (decompressing || extracting) {
+            ddict = ZSTD_createDDict(dictionary.data(), dictionary.size());
+        }
+        else {
+            buildDictionaries(minLevel, maxLevel);
+        }
+        std::cout << "Using dictionary ID " << ZSTD_getDictID_fromDict(dictionary.data(), dictionary.size())
+                  << " (" << dictionary.size() << " Bytes)" << std::endl;
+    }
+
+    if (extracting) {
+        const int result = extractRange(argv[4], argv[5], extractBounds[0], extractBounds[1]);
+        ZSTD_freeDDict(ddict);
+        return result;
+    }
 
-    //allocate 10*number of worker threads of raw chunks available to all workers
+    const char* numWorkers = argv[argc-3];
+    unsigned int NUM_WORKERS = std::stoi(argv[argc-3]);
+    const char* inFilename = argv[argc-2];
+    const char* outFilename = argv[argc-1];
+
+    //allocate 10*number of worker threads of chunks available to all workers, fewer
+    //if those chunks would take more than QUEUE_MEMORY
     MAX_RAW_CHUNKS = NUM_WORKERS*10;
+    if(!decompressing)
+    {
+        MAX_RAW_CHUNKS = std::max<unsigned long>(1, std::min<unsigned long>(MAX_RAW_CHUNKS, (QUEUE_MEMORY)/chunkBytes));
+    }
+    pending = new BoundedQueue<chunk>(MAX_RAW_CHUNKS);
+    //finished chunks wait for the slowest one of at most every chunk in flight
+    finished = new ReorderBuffer<chunk>(MAX_RAW_CHUNKS + NUM_WORKERS);
+    if(!decompressing)
+    {
+        //chunks queued, in the reorder window, held by workers, being read, and held by the
+        //writer, but never more than the input has (the pools grow if this is short)
+        unsigned long inFlight = 2*MAX_RAW_CHUNKS + 2*NUM_WORKERS + IO_DEPTH + 1;
+        struct stat info;
+        if(stat(inFilename, &info) == 0)
+        {
+            inFlight = std::max<unsigned long>(1, std::min<unsigned long>(inFlight, (info.st_size + chunkBytes - 1)/chunkBytes));
+        }
+        try
+        {
+            rawBuffers = new BufferPool(chunkBytes, inFlight, IO_ALIGNMENT);
+            compressedBuffers = new BufferPool(ZSTD_compressBound(chunkBytes), inFlight);
+        }
+        catch(const std::bad_alloc&)
+        {
+            std::cout << "Error: Not enough memory for " << inFlight << " chunks of " << chunkBytes
+                      << " Bytes, use a smaller chunk size (-c <CHUNK SIZE>)" << std::endl;
+            return 1;
+        }
+        if(adaptive)
+        {
+            controller = new LevelController(minLevel, maxLevel, ZSTD_CLEVEL_DEFAULT, targetSpeed, targetRatio, NUM_WORKERS);
+        }
+    }
     
     //dispatch workers to process chunks:
     pthread_t threads[NUM_WORKERS];
     int err;
     long i;
 
-    std::cout << "Using " << NUM_WORKERS << " threads for compression" << std::endl;
+    std::cout << "Using " << NUM_WORKERS << " threads for " << (decompressing ? "decompression" : "compression") << std::endl;
+    if(controller != nullptr)
+    {
+        std::cout << "Adapting the level of " << chunkBytes << " Byte chunks (" << minLevel << " to "
+                  << maxLevel << ")";
+        if(targetSpeed > 0)
+        {
+            std::cout << ", aiming at " << targetSpeed << " MB/s";
+        }
+        if(targetRatio > 0)
+        {
+            std::cout << ", aiming at a ratio of " << targetRatio;
+        }
+        std::cout << std::endl;
+    }
+    else if(!decompressing)
+    {
+        std::cout << "Compressing " << chunkBytes << " Byte chunks at level " << compressionLevel << std::endl;
+    }
 
     for( i = 0; i < NUM_WORKERS; i++ ) {
         // Create new thread:
-        err = pthread_create(&threads[i], NULL, threadCompress, (void*)i);
+        err = pthread_create(&threads[i], NULL, threadWork, (void*)i);
         if (err)
         {
             std::cout << "Error: Unable to create thread," << err << std::endl;
@@ -107,84 +452,408 @@ int main(int argc, const char** argv)
     }
 
     //start reading in the file as chunks and write them when workers are done:
+    int result = 0;
     auto start = std::chrono::high_resolution_clock::now();
-    manageChunks(inFilename, outFilename); 
+    if(decompressing)
+    {
+        result = decompressFile(inFilename, outFilename);
+    }
+    else
+    {
+        manageChunks(inFilename, outFilename);
+    }
     auto stop = std::chrono::high_resolution_clock::now();
 
+    for( i = 0; i < NUM_WORKERS; i++ ) {
+        pthread_join(threads[i], NULL);
+    }
+    if(controller != nullptr)
+    {
+        controller->printSummary(std::cout);
+    }
+    delete controller;
+    delete finished;
+    delete pending;
+    delete compressedBuffers;
+    delete rawBuffers;
+    ZSTD_freeDDict(ddict);
+    for(ZSTD_CDict* levelDict : cdicts)
+    {
+        ZSTD_freeCDict(levelDict);
+    }
+
     auto duration = std::chrono::duration_cast<std::chrono::microseconds>(stop - start);
 
-    std::cout<<"Compression took "<<duration.count()*1e-6<<"s\n"<<std::endl;
-    return 0;
+    std::cout<<(decompressing ? "Decompression" : "Compression")<<" took "<<duration.count()*1e-6<<"s\n"<<std::endl;
+    return result;
 }
 
 
 /**
- * @brief Worker thread's function. Monitor the raw data vector and take from it when
- * data appears. Then compress and add to the compressed set to keep data in-order.
+ * @brief Worker thread's function. Take pending chunks as they appear, sleeping while
+ * there are none, then compress them (or decompress them) and hand them to the
+ * writer in order. Returns once the reader has closed the pending queue and it is empty.
+ * Each worker creates its zstd context once and reuses it for all of its chunks.
+ * With an adaptive level, each chunk is compressed at the level the controller picks
+ * (or stored raw), and the time it took is reported back to the controller.
  * 
  * @param id Thread's numerical ID
  */
-void *threadCompress(void *id)
+void *threadWork(void *id)
 {
-    long myID = (long)id;
-    // std::cout << "Thread #" << myID << " starting"<< std::endl;
+    ZSTD_CCtx* cctx = decompressing ? nullptr : ZSTD_createCCtx();
+    ZSTD_DCtx* dctx = decompressing ? ZSTD_createDCtx() : nullptr;
+    chunk mychunk;
+    while(pending->pop(mychunk))
+    {
+        if(decompressing)
+        {
+            //a corrupt frame is still handed on with no data, the writer reports it.
+            //Pieces of a frame the reader decompressed already are handed on as they are
+            if(mychunk.getData() == nullptr)
+            {
+                mychunk.decompress(dctx, ddict);
+            }
+        }
+        else if(controller == nullptr)
+        {
+            mychunk.compress(cctx, compressedBuffers, dictionaryFor(compressionLevel), compressionLevel);
+        }
+        else
+        {
+            int level = compressionLevel;
+            if(controller->choose(level))
+            {
+                auto start = std::chrono::steady_clock::now();
+                mychunk.compress(cctx, compressedBuffers, dictionaryFor(level), level);
+                std::chrono::duration<double> took = std::chrono::steady_clock::now() - start;
+                controller->record(level, mychunk.getDataSize(), mychunk.getCompressedDataSize(), took.count());
+            }
+            else
+            {
+                mychunk.store(compressedBuffers);
+            }
+        }
+        finished->insert(mychunk.getID(), mychunk);
+    }
+    ZSTD_freeDCtx(dctx);
+    ZSTD_freeCCtx(cctx);
+    return id;
+}
 
-    while(!writing_complete)
+
+/**
+ * @brief Reader thread's function. Read the input file in chunkBytes chunks
+ * into the pending queue, waiting whenever MAX_RAW_CHUNKS are already queued. At the
+ * end of the file, close the queue and tell the writer how many chunks there are.
+ * Up to IO_DEPTH reads of the next chunks are kept in flight, and chunks are
+ * queued in order as their reads complete. If the input is memory mapped, the
+ * chunks are views into the mapping and nothing is read or copied.
+ * 
+ * @param args readerArgs with the input file
+ */
+void *threadRead(void *args)
+{
+    readerArgs* reader = (readerArgs*)args;
+    const uint numChunks = (reader->totalFileSize + chunkBytes - 1)/chunkBytes;
+    unsigned long readSize = 0; //total amount of bytes read in
+    uint chunksRead = 0; //amount of chunkBytes chunks read in
+    uint chunksSubmitted = 0; //amount of chunks asked for
+
+    //the workers only read the data of a view, the mapping is read-only
+    while(reader->map != nullptr && chunksRead < numChunks)
     {
-        //check for availble chunks
-        if(raw.size()>0)
-        { //we found one (possibly). lock thread and try to get it if not already taken
-            pthread_mutex_lock(&(raw_lock));
-            if(raw.size()>0)
+        uint chunkSize = std::min<unsigned long>(chunkBytes, reader->totalFileSize - readSize); //may differ from chunkBytes for last chunk
+        std::cout << "\33[2K" << "Progress: " << (int)((100*readSize)/reader->totalFileSize) << "%\r";
+        std::cout.flush();
+        pending->push(chunk(chunksRead, (char*)reader->map + readSize, chunkSize, nullptr, false));
+        readSize += chunkSize;
+        chunksRead++;
+    }
+
+    //chunk n is read into slot n % IO_DEPTH, done once its read completed
+    AsyncIO io(IO_DEPTH, IO_BACKEND);
+    std::vector<char*> slotData(io.getDepth());
+    std::vector<bool> slotDone(io.getDepth());
+    while(chunksRead < numChunks)
+    {
+        while(chunksSubmitted < numChunks && chunksSubmitted - chunksRead < io.getDepth())
+        {
+            const uint slot = chunksSubmitted % io.getDepth();
+            slotData[slot] = rawBuffers->acquire();
+            slotDone[slot] = false;
+            if(!io.read(reader->fd, slotData[slot], chunkBytes, (uint64_t)chunksSubmitted*chunkBytes, chunksSubmitted))
             {
-                // std::cout<<"thread "<<id<<" grabbed chunk"<<std::endl;
-                // start compression on that chunk
-                chunk mychunk = raw[0];
-                raw.erase(raw.begin());
-                pthread_mutex_unlock(&(raw_lock));
+                std::cout << "Error: Unable to read the input file" << std::endl;
+                exit(1);
+            }
+            chunksSubmitted++;
+        }
+        const uint slot = chunksRead % io.getDepth();
+        uint chunkSize = std::min<unsigned long>(chunkBytes, reader->totalFileSize - readSize); //may differ from chunkBytes for last chunk
+        while(!slotDone[slot])
+        {
+            const AsyncIO::completion c = io.wait();
+            if(c.tag == IO_NO_TAG)
+            {
+                std::cout << "Error: Unable to read the input file (" << std::strerror(-c.result) << ")" << std::endl;
+                exit(1);
+            }
+            if(c.result != (long)std::min<unsigned long>(chunkBytes, reader->totalFileSize - c.tag*chunkBytes))
+            {
+                std::cout << "Error: Unable to read the input file at offset " << c.tag*chunkBytes << std::endl;
+                exit(1);
+            }
+            slotDone[c.tag % io.getDepth()] = true;
+        }
+        std::cout << "\33[2K" << "Progress: " << (int)((100*readSize)/reader->totalFileSize) << "%\r";
+        std::cout.flush();
+        readSize += chunkSize;
+        pending->push(chunk(chunksRead, slotData[slot], chunkSize, rawBuffers));
+        chunksRead++;
+    }
+    std::cout << "Finishing up writing compressed output file now..." << "\r";
+    std::cout.flush();
+    pending->close();
+    finished->finish(chunksRead);
+    return NULL;
+}
 
-                mychunk.compress();
 
-                //save to global set to be written
-                pthread_mutex_lock(&(compressed_lock));
-                compressed.insert(mychunk); //insert uncompressed just for testing
-                pthread_mutex_unlock(&(compressed_lock));
+/**
+ * @brief Frame reader thread's function. Read the compressed file one frame at a
+ * time into the pending queue, like threadRead(). With a seek table the frames are
+ * read by its sizes and given their place in the memory mapped output. Without one,
+ * the file is read in FRAME_READ_SIZE blocks and split where each frame ends.
+ * Skippable frames (ex: the seek table) are left out. Frames that do not give their
+ * decompressed size are decompressed here with streamFrame(), since the workers
+ * need to know it, and queued as already decompressed pieces.
+ * 
+ * @param args frameReaderArgs with the input file
+ */
+void *threadReadFrames(void *args)
+{
+    frameReaderArgs* reader = (frameReaderArgs*)args;
+    unsigned long readSize = 0; //total amount of bytes read in
+    uint framesRead = 0; //amount of frames read in
+    uint chunksQueued = 0; //amount of chunks queued, frames and streamed pieces
+    ZSTD_DCtx* dctx = nullptr; //created for the first frame without a decompressed size
+    if(reader->table != nullptr)
+    {
+        for(size_t i=0; i<reader->table->getNumFrames(); i++)
+        {
+            const SeekTable::frame& f = reader->table->getFrame(i);
+            char* frameData = new char[f.compressedSize];
+            reader->fin->read(frameData, f.compressedSize);
+            if(!*(reader->fin))
+            {
+                std::cout << "Error: Frame " << i << " is cut short" << std::endl;
+                delete[] frameData;
+                reader->failed = true;
+                break;
             }
-            else
+            std::cout << "\33[2K" << "Progress: " << (int)((100*readSize)/reader->totalFileSize) << "%\r";
+            std::cout.flush();
+            readSize += f.compressedSize;
+            pending->push(chunk(chunksQueued++, frameData, f.compressedSize, f.decompressedSize,
+                                reader->output + f.decompressedOffset));
+            framesRead++;
+        }
+    }
+    else
+    {
+        std::vector<char> buffer; //read but not yet queued data starts at buffer[begin]
+        size_t begin = 0;
+        bool endOfFile = false;
+        while(true)
+        {
+            const char* frameStart = buffer.data() + begin;
+            const size_t available = buffer.size() - begin;
+            //a frame from a stream (ex: zstd writing to a pipe) may not give its
+            //decompressed size, and may hold the whole file: decompress it in pieces
+            if(available >= sizeof(uint32_t) && ZSTD_getFrameContentSize(frameStart, available) == ZSTD_CONTENTSIZE_UNKNOWN)
             {
-                pthread_mutex_unlock(&(raw_lock));
+                if(dctx == nullptr)
+                {
+                    dctx = ZSTD_createDCtx();
+                    ZSTD_DCtx_refDDict(dctx, ddict);
+                }
+                if(!streamFrame(reader, dctx, buffer, begin, readSize, chunksQueued, framesRead))
+                {
+                    reader->failed = true;
+                    break;
+                }
+                framesRead++;
+                continue;
             }
+            //an error here is a frame cut short by the end of the buffer, or not a frame
+            const size_t frameSize = (available > 0) ? ZSTD_findFrameCompressedSize(frameStart, available) : 0;
+            if(available == 0 || ZSTD_isError(frameSize))
+            {
+                if(endOfFile)
+                {
+                    if(available > 0)
+                    {
+                        std::cout << "Error: Data after frame " << framesRead << " is not a zstd frame" << std::endl;
+                        reader->failed = true;
+                    }
+                    break;
+                }
+                //keep the partial frame and read the next block after it
+                buffer.erase(buffer.begin(), buffer.begin() + begin);
+                begin = 0;
+                const size_t kept = buffer.size();
+                buffer.resize(kept + FRAME_READ_SIZE);
+                reader->fin->read(buffer.data() + kept, FRAME_READ_SIZE);
+                buffer.resize(kept + reader->fin->gcount());
+                endOfFile = (buffer.size() == kept);
+                continue;
+            }
+            begin += frameSize;
+            std::cout << "\33[2K" << "Progress: " << (int)((100*readSize)/reader->totalFileSize) << "%\r";
+            std::cout.flush();
+            readSize += frameSize;
+            uint32_t magic = 0;
+            std::memcpy(&magic, frameStart, std::min<size_t>(frameSize, sizeof(magic)));
+            if((magic & ZSTD_MAGIC_SKIPPABLE_MASK) == ZSTD_MAGIC_SKIPPABLE_START)
+            {
+                continue;
+            }
+            //frames without a decompressed size were streamed above
+            const unsigned long long contentSize = ZSTD_getFrameContentSize(frameStart, frameSize);
+            if(contentSize == ZSTD_CONTENTSIZE_ERROR || contentSize > INT_MAX)
+            {
+                std::cout << "Error: Frame " << framesRead << " is too large to decompress in one piece" << std::endl;
+                reader->failed = true;
+                break;
+            }
+            char* frameData = new char[frameSize];
+            std::copy(frameStart, frameStart + frameSize, frameData);
+            pending->push(chunk(chunksQueued++, frameData, frameSize, (int)contentSize, nullptr));
+            framesRead++;
         }
     }
-    return id;
+    ZSTD_freeDCtx(dctx);
+    std::cout << "Finishing up writing decompressed output file now..." << "\r";
+    std::cout.flush();
+    pending->close();
+    finished->finish(chunksQueued);
+    return NULL;
 }
 
 
 /**
- * @brief Function to manage the chunks. This reads in chunks of data from the input file
- * and has up to MAX_RAW_CHUNKS available at any given time. When compressed chunks are 
- * sensed, this then writes them to the output file. 
+ * @brief Decompress a frame that does not give its decompressed size, on the frame
+ * reader thread, and queue its data in STREAM_PIECE_SIZE pieces that the workers pass
+ * on as they are. The frame is read from the file as it is decompressed, so neither
+ * all of it nor all of its data has to fit in memory.
+ * 
+ * @param reader Frame reader's arguments, with the file after the buffer
+ * @param dctx Context to decompress with, its dictionary already set
+ * @param buffer Data read from the file, the frame starts at buffer[begin]
+ * @param begin Output start of the data after the frame
+ * @param readSize Total amount of bytes read in, increased by the frame's size
+ * @param chunksQueued Amount of chunks queued, increased by the pieces queued
+ * @param frame Frame number, for errors
+ * @return true The frame was decompressed
+ * @return false The frame is corrupt or cut short (already reported)
+ */
+bool streamFrame(frameReaderArgs* reader, ZSTD_DCtx* dctx, std::vector<char>& buffer, size_t& begin,
+                 unsigned long& readSize, uint& chunksQueued, uint frame)
+{
+    //the header (at most 18 bytes), for reportFrameError(), before the buffer is read over
+    const std::vector<char> header(buffer.begin() + begin,
+                                   buffer.begin() + begin + std::min<size_t>(buffer.size() - begin, 18));
+    ZSTD_DCtx_reset(dctx, ZSTD_reset_session_only);
+    ZSTD_inBuffer in = {buffer.data(), buffer.size(), begin};
+    bool frameDone = false;
+    bool first = true;
+    while(!frameDone)
+    {
+        char* piece = new char[STREAM_PIECE_SIZE];
+        ZSTD_outBuffer out = {piece, STREAM_PIECE_SIZE, 0};
+        while(!frameDone && out.pos < out.size)
+        {
+            if(in.pos == in.size)
+            {
+                //the whole buffer is used, read the next block of the file
+                readSize += in.size - begin;
+                buffer.resize(FRAME_READ_SIZE);
+                reader->fin->read(buffer.data(), FRAME_READ_SIZE);
+                buffer.resize(reader->fin->gcount());
+                begin = 0;
+                in = {buffer.data(), buffer.size(), 0};
+                if(buffer.empty())
+                {
+                    std::cout << "\33[2K" << "Error: Frame " << frame << " is cut short" << std::endl;
+                    delete[] piece;
+                    return false;
+                }
+            }
+            const size_t result = ZSTD_decompressStream(dctx, &out, &in);
+            if(ZSTD_isError(result))
+            {
+                reportFrameError(frame, header.data(), header.size());
+                delete[] piece;
+                return false;
+            }
+            frameDone = (result == 0);
+        }
+        //a frame that ends right after a full piece adds no empty piece
+        if(out.pos > 0 || first)
+        {
+            pending->push(chunk(chunksQueued++, piece, (int)out.pos));
+        }
+        else
+        {
+            delete[] piece;
+        }
+        first = false;
+        std::cout << "\33[2K" << "Progress: " << (int)((100*(readSize + in.pos - begin))/reader->totalFileSize) << "%\r";
+        std::cout.flush();
+    }
+    readSize += in.pos - begin;
+    begin = in.pos;
+    return true;
+}
+
+
+/**
+ * @brief Function to manage the chunks. This starts a reader thread that reads in
+ * chunks of data from the input file and has up to MAX_RAW_CHUNKS available at
+ * any given time, then writes the compressed chunks to the output file in order
+ * as the workers finish them.
  * Basically, keeps the worker threads fed at all times and puts away their results in order.
  * 
  * @param fname Input file name
  */
 void manageChunks(const char* inFilename, const char* outFilename)
 {
-    unsigned long readSize = 0; //total amount of bytes read in
     unsigned long writeSize=0; //total amount of bytes written
-    uint chunkWriteOrder=0; //amount of chunks written
-    uint chunksRead=0; //amount of CHUNK_SIZE chunks read in
-    uint chunkSize; //current size of chunk (may differ from CHUNK_SIZE for last chunk)
 
-    std::ifstream fin(inFilename);
-    std::ofstream fout(outFilename);
+    //O_DIRECT if asked for and the file system takes it (not for a memory mapped input)
+    const bool directRead = IO_DIRECT && !IO_MMAP && chunkBytes % IO_ALIGNMENT == 0;
+    int fin = directRead ? open(inFilename, O_RDONLY | O_DIRECT) : -1;
+    if(fin < 0)
+    {
+        fin = open(inFilename, O_RDONLY);
+    }
+    const bool alignedWrites = (WRITE_BLOCK_SIZE) % IO_ALIGNMENT == 0;
+    int fout = (IO_DIRECT && alignedWrites) ? open(outFilename, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644) : -1;
+    const bool directWrite = (fout >= 0);
+    if(fout < 0)
+    {
+        fout = open(outFilename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+    struct stat info;
+    if(fin < 0 || fout < 0 || fstat(fin, &info) != 0)
+    {
+        std::cout << "Error: Cannot open '" << ((fin < 0) ? inFilename : outFilename) << "'" << std::endl;
+        exit(1);
+    }
 
     //get total file size
-    const auto begin = fin.tellg();
-    fin.seekg (0, std::ios::end);
-    const auto end = fin.tellg();
-    const auto totalFileSize = (end-begin);
-    fin.seekg (0, std::ios::beg); //move back to beginning of file
+    const long totalFileSize = info.st_size;
 
     if(totalFileSize==0)
     {
@@ -194,56 +863,426 @@ void manageChunks(const char* inFilename, const char* outFilename)
 
     std::cout << "Input file '" << inFilename << "' size: " << totalFileSize << " Bytes" << std::endl;
 
+    //map the input, read front to back once. Reading it in is used if it cannot be mapped
+    char* map = nullptr;
+    if(IO_MMAP)
+    {
+        void* input = mmap(nullptr, totalFileSize, PROT_READ, MAP_PRIVATE, fin, 0);
+        if(input != MAP_FAILED)
+        {
+            map = (char*)input;
+            madvise(map, totalFileSize, MADV_SEQUENTIAL);
+            if(IO_MMAP_HUGEPAGES)
+            {
+                madvise(map, totalFileSize, MADV_HUGEPAGE);
+            }
+        }
+        else
+        {
+            std::cout << "Unable to map '" << inFilename << "', reading it instead" << std::endl;
+        }
+    }
 
-    while(!reading_complete || !writing_complete)// && writing_complete))
+    AsyncWriter writer(fout, directWrite, WRITE_BLOCK_SIZE, IO_DEPTH, IO_BACKEND);
+    const bool directInput = (fcntl(fin, F_GETFL) & O_DIRECT) != 0;
+    std::cout << "Using " << writer.getBackendName() << " with " << IO_DEPTH << ((map != nullptr) ? " writes" : " reads and writes")
+              << " in flight" << ((directInput || directWrite) ? " (O_DIRECT)" : "") << std::endl;
+
+    readerArgs args = {fin, totalFileSize, map};
+    pthread_t reader;
+    int err = pthread_create(&reader, NULL, threadRead, &args);
+    if (err)
     {
-        if(!reading_complete && raw.size()<MAX_RAW_CHUNKS)
+        std::cout << "Error: Unable to create thread," << err << std::endl;
+        exit(-1);
+    }
+
+    //write each chunk as soon as it and every chunk before it are compressed.
+    //every chunk is its own zstd frame, indexed by the seek table
+    SeekTable table;
+    chunk next;
+    bool written = true;
+    const unsigned long pageSize = sysconf(_SC_PAGESIZE);
+    unsigned long unmapped = 0; //mapped input before this is dropped from memory
+    while(finished->pop(next))
+    {
+        written = writer.write(next.getCompressedData(), next.getCompressedDataSize()) && written;
+        writeSize+=next.getCompressedDataSize();
+        table.addFrame(next.getCompressedDataSize(), next.getDataSize());
+        const char* viewEnd = next.getData() + next.getDataSize();
+        next.release();
+        //the mapped pages of written chunks are not needed again, keep them out of
+        //resident memory (they stay in the page cache), every WRITE_BLOCK_SIZE bytes
+        if(map != nullptr)
         {
-            // grab new chunk if there are still chunks to be read
-            // and we arent at max chunk size yet
-            char* someData = new char[CHUNK_SIZE];
-            fin.read(someData, CHUNK_SIZE);
-            chunkSize = fin.gcount();
-            if(chunkSize==0)
+            const unsigned long done = (viewEnd - map)/pageSize*pageSize;
+            if(done - unmapped >= (WRITE_BLOCK_SIZE))
             {
-                //no more chunks to be read in from the file, stop reading
-                reading_complete=true;
-                std::cout << "Finishing up writing compressed output file now..." << "\r";
-                std::cout.flush();
+                madvise(map + unmapped, done - unmapped, MADV_DONTNEED);
+                unmapped = done;
             }
-            else
-            {   //successfully read in a chunk
-                std::cout << "\33[2K" << "Progress: " << (int)((100*readSize)/totalFileSize) << "%\r";
-                std::cout.flush();
-                readSize+=chunkSize;
-                //lock to prevent incorrect read
-                pthread_mutex_lock(&(raw_lock));
-                raw.push_back(chunk(chunksRead,someData,chunkSize));
-                pthread_mutex_unlock(&(raw_lock));
-                chunksRead++;
-            }
-        }
-        if(!writing_complete)
-        { 
-            //writing not complete, check if next in-order chunk has been compressed yet
-            if((compressed.begin())->getID() == chunkWriteOrder)
-            {   //next, in-order chunk was added, so write to file now.
-                fout.write(compressed.begin()->getCompressedData(),compressed.begin()->getCompressedDataSize());
-                writeSize+=compressed.begin()->getCompressedDataSize();
-                delete[] compressed.begin()->getData();
-                delete[] compressed.begin()->getCompressedData();
-                pthread_mutex_lock(&(compressed_lock));
-                compressed.erase(compressed.begin()); //erase from list
-                pthread_mutex_unlock(&(compressed_lock));
-                chunkWriteOrder+=1;
-            }
-            if(reading_complete && chunkWriteOrder==chunksRead)
-            {   //we reached the last chunk to be written. everything is done now, we may exit
-                //clear line "finishing up writing ..." and output file name and size
-                std::cout << "\33[2K" << "Output file '" << outFilename << "' size: " << writeSize << " Bytes" << std::endl;
-                std::cout.flush();
-                writing_complete=true; 
+        }
+    }
+    pthread_join(reader, NULL);
+    if(map != nullptr)
+    {
+        munmap(map, totalFileSize);
+    }
+    std::ostringstream tableData;
+    writeSize+=table.write(tableData);
+    written = writer.write(tableData.str().data(), tableData.str().size()) && written;
+    written = writer.finish() && written;
+    close(fin);
+    close(fout);
+    if(!written)
+    {
+        std::cout << "\33[2K" << "Error: Unable to write '" << outFilename << "'" << std::endl;
+        exit(1);
+    }
+
+    //clear line "finishing up writing ..." and output file name and size
+    std::cout << "\33[2K" << "Output file '" << outFilename << "' size: " << writeSize << " Bytes" << std::endl;
+    std::cout.flush();
+}
+
+
+/**
+ * @brief Decompress a whole compressed file on the worker threads, one frame per
+ * chunk. If the file has a seek table, the output file is sized up front and memory
+ * mapped, and each worker decompresses its frame straight into its place (the
+ * writer only waits for them in order). Otherwise, or if the output cannot be
+ * mapped (ex: a pipe), the frames are found by reading the file and the writer
+ * writes them in order.
+ * 
+ * @param inFilename Compressed file, any sequence of zstd frames
+ * @param outFilename Decompressed file
+ * @return int 0 on success, 1 on error
+ */
+int decompressFile(const char* inFilename, const char* outFilename)
+{
+    std::ifstream fin(inFilename, std::ios::binary);
+    if(!fin)
+    {
+        std::cout << "Error: Cannot open '" << inFilename << "'" << std::endl;
+        pending->close();
+        finished->finish(0);
+        return 1;
+    }
+    SeekTable table;
+    const bool indexed = table.read(fin);
+    const long totalFileSize = (long)fin.tellg();
+    fin.clear();
+    fin.seekg(0, std::ios::beg);
+
+    std::cout << "Input file '" << inFilename << "' size: " << totalFileSize << " Bytes" << std::endl;
+
+    //every frame's place in the output is known from the seek table: map the output
+    const uint64_t outputSize = table.getDecompressedSize();
+    char* output = nullptr;
+    int fd = -1;
+    if(indexed && outputSize > 0)
+    {
+        fd = open(outFilename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if(fd >= 0 && ftruncate(fd, outputSize) == 0)
+        {
+            void* map = mmap(nullptr, outputSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if(map != MAP_FAILED)
+            {
+                output = (char*)map;
             }
         }
+        if(output == nullptr && fd >= 0)
+        {
+            close(fd);
+            fd = -1;
+        }
+    }
+    std::ofstream fout;
+    if(output == nullptr)
+    {
+        fout.open(outFilename, std::ios::binary);
+    }
+
+    frameReaderArgs args = {&fin, std::max(totalFileSize, 1L), (output != nullptr) ? &table : nullptr, output, false};
+    pthread_t reader;
+    int err = pthread_create(&reader, NULL, threadReadFrames, &args);
+    if (err)
+    {
+        std::cout << "Error: Unable to create thread," << err << std::endl;
+        exit(-1);
+    }
+
+    //frames decompressed in place are done once the writer gets them
+    unsigned long writeSize = 0; //total amount of bytes decompressed
+    bool corrupt = false;
+    chunk next;
+    while(finished->pop(next))
+    {
+        if(next.getData() == nullptr)
+        {
+            if(!corrupt)
+            {
+                reportFrameError(next.getID(), next.getCompressedData(), next.getCompressedDataSize());
+            }
+            corrupt = true;
+        }
+        else
+        {
+            if(!next.inPlace())
+            {
+                fout.write(next.getData(), next.getDataSize());
+            }
+            writeSize += next.getDataSize();
+        }
+        next.release();
+    }
+    pthread_join(reader, NULL);
+    if(output != nullptr)
+    {
+        munmap(output, outputSize);
+        close(fd);
+    }
+    if(corrupt || args.failed)
+    {
+        //do not leave a partly written (or zero filled) file behind, but only remove
+        //regular files (not ex: /dev/stdout)
+        fout.close();
+        struct stat info;
+        if(stat(outFilename, &info) == 0 && S_ISREG(info.st_mode))
+        {
+            unlink(outFilename);
+        }
+        return 1;
+    }
+
+    //clear line "finishing up writing ..." and output file name and size
+    std::cout << "\33[2K" << "Output file '" << outFilename << "' size: " << writeSize << " Bytes" << std::endl;
+    std::cout.flush();
+    return 0;
+}
+
+
+/**
+ * @brief Decompress part of a compressed file: only the frames holding the range,
+ * found with the seek table, are read and decompressed.
+ * 
+ * @param inFilename Compressed file, with a seek table
+ * @param outFilename File to write the range to
+ * @param offset Start of the range in the uncompressed data
+ * @param length Length of the range (cut short at the end of the data)
+ * @return int 0 on success, 1 on error
+ */
+int extractRange(const char* inFilename, const char* outFilename, uint64_t offset, uint64_t length)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    std::ifstream fin(inFilename, std::ios::binary);
+    SeekTable table;
+    if(!table.read(fin))
+    {
+        std::cout << "Error: '" << inFilename << "' has no seek table" << std::endl;
+        return 1;
+    }
+    const uint64_t totalSize = table.getDecompressedSize();
+    if(offset >= totalSize)
+    {
+        std::cout << "Error: Offset " << offset << " is past the end of the data (" << totalSize << " Bytes)" << std::endl;
+        return 1;
+    }
+    const uint64_t stop = std::min(totalSize, offset + std::min(length, totalSize - offset));
+
+    std::ofstream fout(outFilename, std::ios::binary);
+    std::vector<char> cBuff, dBuff;
+    ZSTD_DCtx* dctx = ZSTD_createDCtx();
+    size_t frames = 0;
+    for(size_t i=table.frameAt(offset); i<table.getNumFrames(); i++)
+    {
+        const SeekTable::frame& f = table.getFrame(i);
+        if(f.decompressedOffset >= stop)
+        {
+            break;
+        }
+        cBuff.resize(f.compressedSize);
+        dBuff.resize(f.decompressedSize);
+        fin.seekg(f.compressedOffset);
+        fin.read(cBuff.data(), f.compressedSize);
+        size_t const dSize = ZSTD_decompress_usingDDict(dctx, dBuff.data(), dBuff.size(), cBuff.data(), cBuff.size(), ddict);
+        if(!fin || ZSTD_isError(dSize) || dSize != f.decompressedSize)
+        {
+            reportFrameError(i, cBuff.data(), fin ? cBuff.size() : 0);
+            ZSTD_freeDCtx(dctx);
+            return 1;
+        }
+        //the part of this frame inside the range
+        const uint64_t from = std::max(offset, f.decompressedOffset) - f.decompressedOffset;
+        const uint64_t to = std::min(stop, f.decompressedOffset + f.decompressedSize) - f.decompressedOffset;
+        fout.write(dBuff.data() + from, to - from);
+        frames++;
+    }
+    ZSTD_freeDCtx(dctx);
+    auto end = std::chrono::high_resolution_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+    std::cout << "Extracted " << stop - offset << " Bytes at offset " << offset << " from " << frames << " of "
+              << table.getNumFrames() << " frames in " << duration.count()*1e-6 << "s" << std::endl;
+    return 0;
+}
+
+
+/**
+ * @brief Read a dictionary file (made by -T or by zstd --train) into the dictionary
+ * 
+ * @param dictFilename Dictionary file
+ * @return true The dictionary was read
+ * @return false The file cannot be read or is empty
+ */
+bool loadDictionary(const char* dictFilename)
+{
+    std::ifstream fin(dictFilename, std::ios::binary);
+    dictionary.assign(std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>());
+    if(dictionary.empty())
+    {
+        std::cout << "Error: Cannot read dictionary '" << dictFilename << "'" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+
+/**
+ * @brief Train a dictionary on samples of the input and save it. Each sample is one
+ * chunkBytes chunk, since chunks are what the dictionary will be used on, and the
+ * DICT_SAMPLE_SIZE bytes of samples are spread evenly over the file.
+ * 
+ * @param inFilename File to be compressed
+ * @param dictFilename File to save the dictionary to, needed to decompress the output
+ * @return true The dictionary was trained and saved
+ * @return false The input is too small or too uniform to train a dictionary
+ */
+bool trainDictionary(const char* inFilename, const char* dictFilename)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    std::ifstream fin(inFilename, std::ios::binary);
+    fin.seekg(0, std::ios::end);
+    const uint64_t totalFileSize = fin ? (uint64_t)fin.tellg() : 0;
+    const uint64_t numSamples = std::max<uint64_t>(1, std::min<uint64_t>(totalFileSize, DICT_SAMPLE_SIZE)/chunkBytes);
+    const uint64_t stride = totalFileSize/numSamples;
+
+    std::vector<char> samples;
+    std::vector<size_t> sampleSizes;
+    for(uint64_t i=0; i<numSamples; i++)
+    {
+        const size_t kept = samples.size();
+        samples.resize(kept + chunkBytes);
+        fin.seekg(i*stride);
+        fin.read(samples.data() + kept, chunkBytes);
+        samples.resize(kept + fin.gcount());
+        sampleSizes.push_back(fin.gcount());
+        fin.clear();
+    }
+
+    dictionary.resize(DICT_SIZE);
+    size_t const dictSize = ZDICT_trainFromBuffer(dictionary.data(), dictionary.size(), samples.data(),
+                                                  sampleSizes.data(), (unsigned int)sampleSizes.size());
+    if(ZDICT_isError(dictSize))
+    {
+        std::cout << "Error: Cannot train a dictionary on '" << inFilename << "': " << ZDICT_getErrorName(dictSize) << std::endl;
+        return false;
+    }
+    dictionary.resize(dictSize);
+    std::ofstream fout(dictFilename, std::ios::binary);
+    fout.write(dictionary.data(), dictionary.size());
+    if(!fout)
+    {
+        std::cout << "Error: Cannot write dictionary '" << dictFilename << "'" << std::endl;
+        return false;
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+    std::cout << "Trained dictionary '" << dictFilename << "' on " << sampleSizes.size() << " samples in "
+              << duration.count()*1e-6 << "s" << std::endl;
+    return true;
+}
+
+
+/**
+ * @brief Print why a frame could not be decompressed. Frames compressed with a
+ * dictionary have its ID in their header, so a missing or wrong dictionary is told
+ * apart from a corrupt frame.
+ * 
+ * @param id Frame number
+ * @param frame Compressed frame
+ * @param frameSize Size of the frame, 0 if it could not be read
+ */
+void reportFrameError(unsigned long id, const char* frame, size_t frameSize)
+{
+    const unsigned int needed = (frameSize > 0) ? ZSTD_getDictID_fromFrame(frame, frameSize) : 0;
+    const unsigned int given = (ddict != nullptr) ? ZSTD_getDictID_fromDDict(ddict) : 0;
+    std::cout << "\33[2K" << "Error: Frame " << id;
+    if(needed != 0 && needed != given)
+    {
+        std::cout << " needs dictionary ID " << needed << ", use -D <DICTIONARY>" << std::endl;
+    }
+    else
+    {
+        std::cout << " is corrupt" << std::endl;
+    }
+}
+
+
+/**
+ * @brief Digest the dictionary for every compression level in a range. To be called
+ * before the workers start.
+ * 
+ * @param firstLevel Lowest level
+ * @param lastLevel Highest level
+ */
+void buildDictionaries(int firstLevel, int lastLevel)
+{
+    cdictFirstLevel = firstLevel;
+    for(int level=firstLevel; level<=lastLevel; level++)
+    {
+        cdicts.push_back(ZSTD_createCDict(dictionary.data(), dictionary.size(), level));
+    }
+}
+
+
+/**
+ * @brief Get the dictionary digested for a compression level
+ * 
+ * @param level Compression level, in the range given to buildDictionaries()
+ * @return const ZSTD_CDict* The digested dictionary, or nullptr if there is no dictionary
+ */
+const ZSTD_CDict* dictionaryFor(int level)
+{
+    return cdicts.empty() ? nullptr : cdicts[level - cdictFirstLevel];
+}
+
+
+/**
+ * @brief Read a size in bytes, with an optional K or M suffix (ex: 64K)
+ * 
+ * @param text Size to read
+ * @param bytes Output size in bytes
+ * @return true 
+ * @return false The text is not a size
+ */
+bool parseSize(const char* text, unsigned long& bytes)
+{
+    char* end = nullptr;
+    bytes = std::strtoul(text, &end, 10);
+    if(end == text)
+    {
+        return false;
+    }
+    if(*end == 'K' || *end == 'k')
+    {
+        bytes *= 1024;
+        end++;
+    }
+    else if(*end == 'M' || *end == 'm')
+    {
+        bytes *= 1024*1024;
+        end++;
     }
+    return *end == '\0';
 }
@@ -0,0 +1,251 @@
+/**
+ * @file queue.h
+ * @author Ethan Stockbridge (ethanstockbridge@gmail.com)
+ * @author Devan Kidd (jjkidd1245@gmail.com)
+ * @brief Blocking queues that connect the reader, the workers and the writer
+ * @date 2022-02-06
+ */
+
+#ifndef QUEUE_H_
+#define QUEUE_H_
+
+#include <pthread.h>
+#include <optional>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Bounded multi-producer, multi-consumer FIFO queue on a ring buffer.
+ * A full queue blocks producers (backpressure) and an empty queue blocks
+ * consumers. Waiting threads sleep on a condition variable (a futex on Linux)
+ * instead of spinning, so an idle pipeline uses no CPU.
+ *
+ * @tparam T Type of the items
+ */
+template <typename T>
+class BoundedQueue
+{
+private:
+    /**
+     * @brief Ring buffer of items, head is the oldest and count the number queued
+     *
+     */
+    std::vector<std::optional<T>> items;
+    unsigned int head;
+    unsigned int count;
+
+    /**
+     * @brief Set once no more items will be pushed
+     *
+     */
+    bool closed;
+
+    pthread_mutex_t lock;
+    pthread_cond_t notEmpty;
+    pthread_cond_t notFull;
+
+public:
+    /**
+     * @brief Construct a new queue
+     *
+     * @param capacity Number of items the queue holds before push() blocks (at least 1)
+     */
+    BoundedQueue(unsigned int capacity) : items(capacity > 0 ? capacity : 1), head(0), count(0), closed(false)
+    {
+        pthread_mutex_init(&(this->lock), NULL);
+        pthread_cond_init(&(this->notEmpty), NULL);
+        pthread_cond_init(&(this->notFull), NULL);
+    }
+
+    ~BoundedQueue()
+    {
+        pthread_cond_destroy(&(this->notFull));
+        pthread_cond_destroy(&(this->notEmpty));
+        pthread_mutex_destroy(&(this->lock));
+    }
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    /**
+     * @brief Add an item at the back, waiting while the queue is full
+     *
+     * @param item Item to add
+     */
+    void push(T item)
+    {
+        pthread_mutex_lock(&(this->lock));
+        while(this->count == this->items.size())
+        {
+            pthread_cond_wait(&(this->notFull), &(this->lock));
+        }
+        this->items[(this->head + this->count) % this->items.size()].emplace(std::move(item));
+        this->count++;
+        pthread_cond_signal(&(this->notEmpty));
+        pthread_mutex_unlock(&(this->lock));
+    }
+
+    /**
+     * @brief Take the item at the front, waiting while the queue is empty
+     *
+     * @param item Output item
+     * @return true An item was taken
+     * @return false The queue is empty and closed
+     */
+    bool pop(T& item)
+    {
+        pthread_mutex_lock(&(this->lock));
+        while(this->count == 0 && !this->closed)
+        {
+            pthread_cond_wait(&(this->notEmpty), &(this->lock));
+        }
+        if(this->count == 0)
+        {
+            pthread_mutex_unlock(&(this->lock));
+            return false;
+        }
+        std::optional<T>& slot = this->items[this->head];
+        item = std::move(*slot);
+        slot.reset();
+        this->head = (this->head + 1) % this->items.size();
+        this->count--;
+        pthread_cond_signal(&(this->notFull));
+        pthread_mutex_unlock(&(this->lock));
+        return true;
+    }
+
+    /**
+     * @brief Mark the end of the items. Consumers drain what is left, then pop()
+     * returns false.
+     *
+     */
+    void close()
+    {
+        pthread_mutex_lock(&(this->lock));
+        this->closed = true;
+        pthread_cond_broadcast(&(this->notEmpty));
+        pthread_mutex_unlock(&(this->lock));
+    }
+};
+
+/**
+ * @brief Puts items numbered 0, 1, 2, ... back in order. Items are inserted in
+ * any order and taken out in number order. Only a window of numbers after the
+ * next one to take out is held: inserting a number past the window blocks until
+ * the items before it are taken out, which bounds the memory used when one item
+ * is slow.
+ *
+ * @tparam T Type of the items
+ */
+template <typename T>
+class ReorderBuffer
+{
+private:
+    /**
+     * @brief Item number n is kept in slot n % window
+     *
+     */
+    std::vector<std::optional<T>> slots;
+
+    /**
+     * @brief Number of the next item to take out, and the number of items in
+     * total (unknown until finish() is called)
+     *
+     */
+    unsigned long next;
+    unsigned long total;
+    bool totalKnown;
+
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    pthread_cond_t space;
+
+public:
+    /**
+     * @brief Construct a new reorder buffer
+     *
+     * @param window Number of items held at once (at least 1)
+     */
+    ReorderBuffer(unsigned int window) : slots(window > 0 ? window : 1), next(0), total(0), totalKnown(false)
+    {
+        pthread_mutex_init(&(this->lock), NULL);
+        pthread_cond_init(&(this->ready), NULL);
+        pthread_cond_init(&(this->space), NULL);
+    }
+
+    ~ReorderBuffer()
+    {
+        pthread_cond_destroy(&(this->space));
+        pthread_cond_destroy(&(this->ready));
+        pthread_mutex_destroy(&(this->lock));
+    }
+
+    ReorderBuffer(const ReorderBuffer&) = delete;
+    ReorderBuffer& operator=(const ReorderBuffer&) = delete;
+
+    /**
+     * @brief Insert an item, waiting while its number is past the window
+     *
+     * @param id Number of the item
+     * @param item Item to insert
+     */
+    void insert(unsigned long id, T item)
+    {
+        pthread_mutex_lock(&(this->lock));
+        while(id >= this->next + this->slots.size())
+        {
+            pthread_cond_wait(&(this->space), &(this->lock));
+        }
+        this->slots[id % this->slots.size()].emplace(std::move(item));
+        if(id == this->next)
+        {
+            pthread_cond_signal(&(this->ready));
+        }
+        pthread_mutex_unlock(&(this->lock));
+    }
+
+    /**
+     * @brief Take out the next item in order, waiting until it is inserted
+     *
+     * @param item Output item
+     * @return true An item was taken out
+     * @return false All finish() items have been taken out
+     */
+    bool pop(T& item)
+    {
+        pthread_mutex_lock(&(this->lock));
+        std::optional<T>* slot = &(this->slots[this->next % this->slots.size()]);
+        while(!slot->has_value() && !(this->totalKnown && this->next == this->total))
+        {
+            pthread_cond_wait(&(this->ready), &(this->lock));
+        }
+        if(!slot->has_value())
+        {
+            pthread_mutex_unlock(&(this->lock));
+            return false;
+        }
+        item = std::move(**slot);
+        slot->reset();
+        this->next++;
+        //the window moved, inserters waiting on it may fit now
+        pthread_cond_broadcast(&(this->space));
+        pthread_mutex_unlock(&(this->lock));
+        return true;
+    }
+
+    /**
+     * @brief Set the number of items in total, once they are all known
+     *
+     * @param count Number of items
+     */
+    void finish(unsigned long count)
+    {
+        pthread_mutex_lock(&(this->lock));
+        this->total = count;
+        this->totalKnown = true;
+        pthread_cond_broadcast(&(this->ready));
+        pthread_mutex_unlock(&(this->lock));
+    }
+};
+
+#endif
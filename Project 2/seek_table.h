@@ -0,0 +1,231 @@
+/**
+ * @file seek_table.h
+ * @author Ethan Stockbridge (ethanstockbridge@gmail.com)
+ * @author Devan Kidd (jjkidd1245@gmail.com)
+ * @brief Seek table of the zstd seekable format: the compressed and uncompressed
+ * size of every frame, stored in a skippable frame at the end of the file
+ * @date 2022-02-06
+ */
+
+#ifndef SEEK_TABLE_H_
+#define SEEK_TABLE_H_
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+/**
+ * @brief Magic number of the skippable frame that holds the seek table. zstd
+ * skips the frame when it decompresses the whole file.
+ *
+ */
+#define SEEK_TABLE_SKIPPABLE_MAGIC 0x184D2A5E
+
+/**
+ * @brief Magic number at the very end of a seekable file
+ *
+ */
+#define SEEKABLE_MAGIC_NUMBER 0x8F92EAB1
+
+/**
+ * @brief Bytes of the skippable frame header (magic number and frame size) and
+ * of the seek table footer (number of frames, descriptor and magic number)
+ *
+ */
+#define SEEK_TABLE_HEADER_SIZE 8
+#define SEEK_TABLE_FOOTER_SIZE 9
+
+/**
+ * @brief Seek_Table_Descriptor bit set when every entry has a checksum
+ *
+ */
+#define SEEK_TABLE_CHECKSUM_FLAG 0x80
+
+/**
+ * @brief Index of the frames of a compressed file, to find the frame holding any
+ * uncompressed offset without decompressing the frames before it
+ *
+ */
+class SeekTable
+{
+public:
+    /**
+     * @brief One frame: where it starts in the compressed and uncompressed data,
+     * and its size in both
+     *
+     */
+    struct frame
+    {
+        uint64_t compressedOffset;
+        uint64_t decompressedOffset;
+        uint32_t compressedSize;
+        uint32_t decompressedSize;
+    };
+
+private:
+    std::vector<frame> frames;
+
+    /**
+     * @brief Read and write 32 bit little endian values
+     *
+     */
+    static void put32(std::ostream& out, uint32_t value)
+    {
+        const char bytes[4] = {(char)value, (char)(value >> 8), (char)(value >> 16), (char)(value >> 24)};
+        out.write(bytes, 4);
+    }
+    static uint32_t get32(const unsigned char* bytes)
+    {
+        return (uint32_t)bytes[0] | (uint32_t)bytes[1] << 8 | (uint32_t)bytes[2] << 16 | (uint32_t)bytes[3] << 24;
+    }
+
+public:
+    /**
+     * @brief Add the next frame of the file
+     *
+     * @param compressedSize Size of the frame in the file
+     * @param decompressedSize Size of the frame's data
+     */
+    void addFrame(uint32_t compressedSize, uint32_t decompressedSize)
+    {
+        frame f = {0, 0, compressedSize, decompressedSize};
+        if(!this->frames.empty())
+        {
+            const frame& last = this->frames.back();
+            f.compressedOffset = last.compressedOffset + last.compressedSize;
+            f.decompressedOffset = last.decompressedOffset + last.decompressedSize;
+        }
+        this->frames.push_back(f);
+    }
+
+    /**
+     * @brief Write the seek table as a skippable frame, after the last frame
+     *
+     * @param out Output file
+     * @return unsigned long Bytes written
+     */
+    unsigned long write(std::ostream& out) const
+    {
+        const uint32_t tableSize = (uint32_t)(8*this->frames.size() + SEEK_TABLE_FOOTER_SIZE);
+        put32(out, SEEK_TABLE_SKIPPABLE_MAGIC);
+        put32(out, tableSize);
+        for(const frame& f : this->frames)
+        {
+            put32(out, f.compressedSize);
+            put32(out, f.decompressedSize);
+        }
+        put32(out, (uint32_t)this->frames.size());
+        out.put(0); //descriptor: no checksums
+        put32(out, SEEKABLE_MAGIC_NUMBER);
+        return SEEK_TABLE_HEADER_SIZE + tableSize;
+    }
+
+    /**
+     * @brief Read the seek table from the end of a seekable file
+     *
+     * @param in Input file
+     * @return true The table was read and matches the file size
+     * @return false The file does not end with a seek table
+     */
+    bool read(std::istream& in)
+    {
+        this->frames.clear();
+        in.seekg(0, std::ios::end);
+        const uint64_t fileSize = (uint64_t)in.tellg();
+        if(!in || fileSize < SEEK_TABLE_HEADER_SIZE + SEEK_TABLE_FOOTER_SIZE)
+        {
+            return false;
+        }
+        unsigned char footer[SEEK_TABLE_FOOTER_SIZE];
+        in.seekg(fileSize - SEEK_TABLE_FOOTER_SIZE);
+        in.read((char*)footer, SEEK_TABLE_FOOTER_SIZE);
+        if(!in || get32(footer + 5) != SEEKABLE_MAGIC_NUMBER)
+        {
+            return false;
+        }
+        const uint64_t count = get32(footer);
+        const unsigned int entrySize = (footer[4] & SEEK_TABLE_CHECKSUM_FLAG) ? 12 : 8;
+        const uint64_t tableSize = count*entrySize + SEEK_TABLE_FOOTER_SIZE;
+        if(tableSize + SEEK_TABLE_HEADER_SIZE > fileSize)
+        {
+            return false;
+        }
+        //skippable frame header, then the entries
+        std::vector<unsigned char> table(SEEK_TABLE_HEADER_SIZE + tableSize);
+        in.seekg(fileSize - table.size());
+        in.read((char*)table.data(), table.size());
+        if(!in || get32(table.data()) != SEEK_TABLE_SKIPPABLE_MAGIC || get32(table.data() + 4) != tableSize)
+        {
+            return false;
+        }
+        for(uint64_t i=0; i<count; i++)
+        {
+            const unsigned char* entry = table.data() + SEEK_TABLE_HEADER_SIZE + i*entrySize;
+            this->addFrame(get32(entry), get32(entry + 4));
+        }
+        //the frames must fill the file up to the seek table
+        return this->getCompressedSize() + table.size() == fileSize;
+    }
+
+    /**
+     * @brief Get the number of frames
+     *
+     * @return size_t
+     */
+    size_t getNumFrames() const {return frames.size();}
+
+    /**
+     * @brief Get a frame
+     *
+     * @param i Frame number
+     * @return const frame&
+     */
+    const frame& getFrame(size_t i) const {return frames[i];}
+
+    /**
+     * @brief Get the size of all frames in the file, without the seek table
+     *
+     * @return uint64_t
+     */
+    uint64_t getCompressedSize() const
+    {
+        return frames.empty() ? 0 : frames.back().compressedOffset + frames.back().compressedSize;
+    }
+
+    /**
+     * @brief Get the size of the uncompressed data
+     *
+     * @return uint64_t
+     */
+    uint64_t getDecompressedSize() const
+    {
+        return frames.empty() ? 0 : frames.back().decompressedOffset + frames.back().decompressedSize;
+    }
+
+    /**
+     * @brief Find the frame holding an uncompressed offset (binary search)
+     *
+     * @param offset Offset in the uncompressed data, less than getDecompressedSize()
+     * @return size_t Frame number
+     */
+    size_t frameAt(uint64_t offset) const
+    {
+        size_t lo = 0, hi = this->frames.size();
+        while(hi - lo > 1)
+        {
+            const size_t mid = (lo + hi)/2;
+            if(this->frames[mid].decompressedOffset <= offset)
+            {
+                lo = mid;
+            }
+            else
+            {
+                hi = mid;
+            }
+        }
+        return lo;
+    }
+};
+
+#endif